@@ -0,0 +1,25 @@
+# Find the LZ4 headers and libraries
+#
+#  LZ4_INCLUDE_DIRS - The LZ4 include directory (directory where lz4.h was found)
+#  LZ4_LIBRARIES    - The libraries needed to use LZ4
+#  LZ4_FOUND        - True if LZ4 found in system
+ 
+ 
+FIND_PATH(LZ4_INCLUDE_DIR NAMES lz4.h)
+ 
+FIND_LIBRARY(LZ4_LIBRARY NAMES 
+    lz4
+    liblz4
+)
+
+INCLUDE(FindPackageHandleStandardArgs)
+FIND_PACKAGE_HANDLE_STANDARD_ARGS(LZ4 DEFAULT_MSG LZ4_LIBRARY LZ4_INCLUDE_DIR)
+ 
+IF(LZ4_FOUND)
+  SET(LZ4_LIBRARIES ${LZ4_LIBRARY})
+  SET(LZ4_INCLUDE_DIRS ${LZ4_INCLUDE_DIR})
+ENDIF(LZ4_FOUND)
+
+MARK_AS_ADVANCED(CLEAR LZ4_INCLUDE_DIR)
+MARK_AS_ADVANCED(CLEAR LZ4_LIBRARY)
+ 
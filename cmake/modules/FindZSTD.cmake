@@ -0,0 +1,25 @@
+# Find the ZSTD headers and libraries
+#
+#  ZSTD_INCLUDE_DIRS - The ZSTD include directory (directory where zstd.h was found)
+#  ZSTD_LIBRARIES    - The libraries needed to use ZSTD
+#  ZSTD_FOUND        - True if ZSTD found in system
+ 
+ 
+FIND_PATH(ZSTD_INCLUDE_DIR NAMES zstd.h)
+ 
+FIND_LIBRARY(ZSTD_LIBRARY NAMES 
+    zstd
+    libzstd
+)
+
+INCLUDE(FindPackageHandleStandardArgs)
+FIND_PACKAGE_HANDLE_STANDARD_ARGS(ZSTD DEFAULT_MSG ZSTD_LIBRARY ZSTD_INCLUDE_DIR)
+ 
+IF(ZSTD_FOUND)
+  SET(ZSTD_LIBRARIES ${ZSTD_LIBRARY})
+  SET(ZSTD_INCLUDE_DIRS ${ZSTD_INCLUDE_DIR})
+ENDIF(ZSTD_FOUND)
+
+MARK_AS_ADVANCED(CLEAR ZSTD_INCLUDE_DIR)
+MARK_AS_ADVANCED(CLEAR ZSTD_LIBRARY)
+ 
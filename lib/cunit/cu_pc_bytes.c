@@ -333,6 +333,432 @@ test_sigbits_encoding()
 
 }
 
+/*
+* 64-bit words, for int64 dimensions like GPS time or point ids.
+* Round trip, then make sure stats and filters see the same values
+* as they would on the raw array.
+*/
+static void
+test_sigbits_encoding_64()
+{
+	int i;
+	uint64_t *ebytes64;
+	int64_t *bytes64;
+	double min, max, avg;
+	PCBYTES pcb, epcb, pcb2, fpcb;
+	PCBITMAP *map;
+
+	bytes64 = (int64_t[]){
+		1000000000000001LL,
+		1000000000000002LL,
+		1000000000000003LL,
+		1000000000000004LL,
+		1000000000000005LL,
+		1000000000000006LL
+		};
+	pcb = initbytes((uint8_t*)bytes64, 6*8, PC_INT64);
+	CU_ASSERT_EQUAL(pc_bytes_sigbits_count(&pcb), 61);
+
+	epcb = pc_bytes_sigbits_encode(pcb);
+	ebytes64 = (uint64_t*)(epcb.bytes);
+	CU_ASSERT_EQUAL(epcb.compression, PC_DIM_SIGBITS);
+	CU_ASSERT_EQUAL(ebytes64[0], 3); /* unique bit count */
+	CU_ASSERT_EQUAL(ebytes64[1], 1000000000000000LL); /* common bits */
+	/* 001 010 011 100 101 110, left-justified */
+	CU_ASSERT_EQUAL(ebytes64[2], 0xA72EULL << 46);
+	CU_ASSERT_EQUAL(epcb.size, 24);
+
+	pcb2 = pc_bytes_sigbits_decode(epcb);
+	CU_ASSERT_EQUAL(pcb2.compression, PC_DIM_NONE);
+	CU_ASSERT_EQUAL(memcmp(pcb.bytes, pcb2.bytes, pcb.size), 0);
+	pc_bytes_free(pcb2);
+
+	pc_bytes_minmax(&epcb, &min, &max, &avg);
+	CU_ASSERT_DOUBLE_EQUAL(min, 1000000000000001.0, 0.1);
+	CU_ASSERT_DOUBLE_EQUAL(max, 1000000000000006.0, 0.1);
+
+	map = pc_bytes_bitmap(&epcb, PC_GT, 1000000000000004.0, 0);
+	CU_ASSERT_EQUAL(map->nset, 2);
+	fpcb = pc_bytes_filter(&epcb, map, NULL);
+	CU_ASSERT_EQUAL(fpcb.compression, PC_DIM_SIGBITS);
+	CU_ASSERT_EQUAL(fpcb.npoints, 2);
+	pcb2 = pc_bytes_decode(fpcb);
+	bytes64 = (int64_t*)(pcb2.bytes);
+	CU_ASSERT_EQUAL(bytes64[0], 1000000000000005LL);
+	CU_ASSERT_EQUAL(bytes64[1], 1000000000000006LL);
+	pc_bytes_free(pcb2);
+	pc_bytes_free(fpcb);
+	pc_bitmap_free(map);
+	pc_bytes_free(epcb);
+
+	/* Nothing in common, values straddle word boundaries */
+	bytes64 = pcalloc(5*8);
+	for ( i = 0; i < 5; i++ )
+		bytes64[i] = (i % 2) ? -i : INT64_MAX - i;
+	pcb = initbytes((uint8_t*)bytes64, 5*8, PC_INT64);
+	epcb = pc_bytes_sigbits_encode(pcb);
+	CU_ASSERT_EQUAL(((uint64_t*)(epcb.bytes))[0], 64);
+	pcb2 = pc_bytes_sigbits_decode(epcb);
+	CU_ASSERT_EQUAL(memcmp(pcb.bytes, pcb2.bytes, pcb.size), 0);
+	pc_bytes_free(pcb2);
+	pc_bytes_free(epcb);
+	pcfree(bytes64);
+}
+
+/*
+* Delta encoding stores the first value and the bit packed
+* zigzagged differences. Steady steps cost no bits at all,
+* wobbling ones pick second differences.
+*/
+static void
+test_delta_encoding()
+{
+	int i, order;
+	uint8_t *bytes;
+	int32_t *bytes32;
+	uint16_t *bytes16;
+	double min, max, avg;
+	PCBYTES pcb, epcb, pcb2, fpcb;
+	PCBITMAP *map;
+	PCDIMENSION dim;
+	int32_t flipsize;
+
+	/* Constant step, nothing left to pack */
+	bytes32 = (int32_t[]){ 100, 90, 80, 70, 60, 50 };
+	pcb = initbytes((uint8_t*)bytes32, 6*4, PC_INT32);
+	CU_ASSERT_EQUAL(pc_bytes_delta_count(&pcb, &order), 0);
+	CU_ASSERT_EQUAL(order, 1);
+	epcb = pc_bytes_delta_encode(pcb);
+	CU_ASSERT_EQUAL(epcb.compression, PC_DIM_DELTA);
+	CU_ASSERT_EQUAL(((int32_t*)epcb.bytes)[0], 1);   /* order */
+	CU_ASSERT_EQUAL(((int32_t*)epcb.bytes)[1], 100); /* first value */
+	CU_ASSERT_EQUAL(((int32_t*)epcb.bytes)[2], 0);   /* sigbits unique bit count */
+	CU_ASSERT_EQUAL(((int32_t*)epcb.bytes)[3], 19);  /* sigbits common value, zigzag(-10) */
+	pcb2 = pc_bytes_delta_decode(epcb);
+	CU_ASSERT_EQUAL(pcb2.compression, PC_DIM_NONE);
+	CU_ASSERT_EQUAL(memcmp(pcb.bytes, pcb2.bytes, pcb.size), 0);
+	pc_bytes_free(pcb2);
+
+	pc_bytes_minmax(&epcb, &min, &max, &avg);
+	CU_ASSERT_DOUBLE_EQUAL(min, 50, 0.0001);
+	CU_ASSERT_DOUBLE_EQUAL(max, 100, 0.0001);
+	CU_ASSERT_DOUBLE_EQUAL(avg, 75, 0.0001);
+
+	map = pc_bytes_bitmap(&epcb, PC_LT, 75, 0);
+	CU_ASSERT_EQUAL(map->nset, 3);
+	fpcb = pc_bytes_filter(&epcb, map, NULL);
+	CU_ASSERT_EQUAL(fpcb.compression, PC_DIM_DELTA);
+	CU_ASSERT_EQUAL(fpcb.npoints, 3);
+	pcb2 = pc_bytes_decode(fpcb);
+	CU_ASSERT_EQUAL(((int32_t*)pcb2.bytes)[0], 70);
+	CU_ASSERT_EQUAL(((int32_t*)pcb2.bytes)[2], 50);
+	pc_bytes_free(pcb2);
+	pc_bytes_free(fpcb);
+	pc_bitmap_free(map);
+	pc_bytes_free(epcb);
+
+	/* Accelerating values, second differences are constant */
+	bytes16 = (uint16_t[]){ 1, 2, 4, 7, 11, 16, 22, 29 };
+	pcb = initbytes((uint8_t*)bytes16, 8*2, PC_UINT16);
+	CU_ASSERT_EQUAL(pc_bytes_delta_count(&pcb, &order), 0);
+	CU_ASSERT_EQUAL(order, 2);
+	epcb = pc_bytes_delta_encode(pcb);
+	CU_ASSERT_EQUAL(((uint16_t*)epcb.bytes)[0], 2); /* order */
+	CU_ASSERT_EQUAL(((uint16_t*)epcb.bytes)[1], 1); /* first value */
+	CU_ASSERT_EQUAL(((uint16_t*)epcb.bytes)[2], 1); /* first delta */
+	pcb2 = pc_bytes_delta_decode(epcb);
+	CU_ASSERT_EQUAL(memcmp(pcb.bytes, pcb2.bytes, pcb.size), 0);
+	pc_bytes_free(pcb2);
+
+	/* Byte swapped input, every stored word is 16 bits wide here */
+	bytes = pcalloc(pc_bytes_serialized_size(&epcb));
+	bytes[0] = PC_DIM_DELTA;
+	flipsize = int32_flip_endian(epcb.size);
+	memcpy(bytes+1, &flipsize, 4);
+	for ( i = 0; i < epcb.size; i += 2 )
+	{
+		bytes[5+i] = epcb.bytes[i+1];
+		bytes[5+i+1] = epcb.bytes[i];
+	}
+	dim.interpretation = PC_UINT16;
+	pc_bytes_deserialize(bytes, &dim, &pcb2, PC_FALSE, PC_TRUE);
+	CU_ASSERT_EQUAL(pcb2.size, epcb.size);
+	CU_ASSERT_EQUAL(memcmp(pcb2.bytes, epcb.bytes, epcb.size), 0);
+	pc_bytes_free(pcb2);
+	pc_bytes_free(epcb);
+	pcfree(bytes);
+
+	/* Wrapping differences, short arrays, and every word size */
+	bytes = pcalloc(257 * 8);
+	for ( i = 0; i < 257 * 8; i++ )
+		bytes[i] = (i * 37) ^ (i >> 3);
+	for ( i = 0; i <= 257; i += (i < 4 ? 1 : 51) )
+	{
+		static const uint32_t interps[] = { PC_INT8, PC_UINT16, PC_INT32, PC_UINT64, PC_INT64 };
+		int t;
+		for ( t = 0; t < 5; t++ )
+		{
+			size_t size = pc_interpretation_size(interps[t]);
+			pcb = initbytes(bytes, i * size, interps[t]);
+			epcb = pc_bytes_encode(pcb, PC_DIM_DELTA);
+			pcb2 = pc_bytes_decode(epcb);
+			CU_ASSERT_EQUAL(pcb2.npoints, i);
+			CU_ASSERT_EQUAL(pcb2.size, pcb.size);
+			if ( i )
+				CU_ASSERT_EQUAL(memcmp(pcb.bytes, pcb2.bytes, pcb.size), 0);
+			pc_bytes_free(pcb2);
+			pc_bytes_free(epcb);
+		}
+	}
+	pcfree(bytes);
+}
+
+/*
+* XOR encoding keeps floating point values bit for bit,
+* repeats cost one bit and slow changes a few
+*/
+static void
+test_xor_encoding()
+{
+	int i;
+	uint8_t *bytes;
+	double *dbl;
+	float *flt;
+	double min, max, avg;
+	PCBYTES pcb, epcb, pcb2, fpcb;
+	PCBITMAP *map;
+	PCDIMENSION dim;
+	size_t sz;
+	int32_t flipsize;
+
+	/* One repeat, then a new window of eleven bits */
+	dbl = (double[]){ 1.0, 1.0, 2.0 };
+	pcb = initbytes((uint8_t*)dbl, 3*8, PC_DOUBLE);
+	CU_ASSERT_EQUAL(pc_bytes_xor_count(&pcb), 26);
+	epcb = pc_bytes_xor_encode(pcb);
+	CU_ASSERT_EQUAL(epcb.compression, PC_DIM_XOR);
+	CU_ASSERT_EQUAL(epcb.size, 12);
+	CU_ASSERT_DOUBLE_EQUAL(((double*)epcb.bytes)[0], 1.0, 0.0);
+	CU_ASSERT_EQUAL(epcb.bytes[8], 0x60);
+	CU_ASSERT_EQUAL(epcb.bytes[9], 0x95);
+	CU_ASSERT_EQUAL(epcb.bytes[10], 0xFF);
+	CU_ASSERT_EQUAL(epcb.bytes[11], 0xC0);
+	pcb2 = pc_bytes_xor_decode(epcb);
+	CU_ASSERT_EQUAL(memcmp(pcb.bytes, pcb2.bytes, pcb.size), 0);
+	pc_bytes_free(pcb2);
+	pc_bytes_free(epcb);
+
+	/* GPS time like series, with the odd special value */
+	dbl = pcalloc(1000 * sizeof(double));
+	for ( i = 0; i < 1000; i++ )
+		dbl[i] = 412345.0 + (i / 4) * 0.25;
+	dbl[500] = -0.0;
+	dbl[501] = 1.0 / 0.0;
+	dbl[502] = 0.0 / 0.0;
+	pcb = initbytes((uint8_t*)dbl, 1000*8, PC_DOUBLE);
+	epcb = pc_bytes_encode(pcb, PC_DIM_XOR);
+	CU_ASSERT(epcb.size < pcb.size / 10);
+	pcb2 = pc_bytes_decode(epcb);
+	CU_ASSERT_EQUAL(pcb2.compression, PC_DIM_NONE);
+	CU_ASSERT_EQUAL(memcmp(pcb.bytes, pcb2.bytes, pcb.size), 0);
+	pc_bytes_free(pcb2);
+
+	/* Byte swapped input only needs the first word turned around */
+	bytes = pcalloc(pc_bytes_serialized_size(&epcb));
+	pc_bytes_serialize(&epcb, bytes, &sz);
+	flipsize = int32_flip_endian(epcb.size);
+	memcpy(bytes+1, &flipsize, 4);
+	for ( i = 0; i < 8; i++ )
+		bytes[5+i] = epcb.bytes[7-i];
+	dim.interpretation = PC_DOUBLE;
+	pc_bytes_deserialize(bytes, &dim, &pcb2, PC_FALSE, PC_TRUE);
+	CU_ASSERT_EQUAL(memcmp(pcb2.bytes, epcb.bytes, epcb.size), 0);
+	pc_bytes_free(pcb2);
+	pcfree(bytes);
+	pc_bytes_free(epcb);
+	pcfree(dbl);
+
+	/* Floats, filtering and stats */
+	flt = (float[]){ 1.5f, 1.5f, 1.75f, 2.0f, -3.25f, 2.0f, 2.0f };
+	pcb = initbytes((uint8_t*)flt, 7*4, PC_FLOAT);
+	epcb = pc_bytes_encode(pcb, PC_DIM_XOR);
+	pcb2 = pc_bytes_decode(epcb);
+	CU_ASSERT_EQUAL(memcmp(pcb.bytes, pcb2.bytes, pcb.size), 0);
+	pc_bytes_free(pcb2);
+
+	pc_bytes_minmax(&epcb, &min, &max, &avg);
+	CU_ASSERT_DOUBLE_EQUAL(min, -3.25, 0.0001);
+	CU_ASSERT_DOUBLE_EQUAL(max, 2.0, 0.0001);
+	CU_ASSERT_DOUBLE_EQUAL(avg, 7.5/7, 0.0001);
+
+	map = pc_bytes_bitmap(&epcb, PC_GT, 1.6, 0);
+	CU_ASSERT_EQUAL(map->nset, 4);
+	fpcb = pc_bytes_filter(&epcb, map, NULL);
+	CU_ASSERT_EQUAL(fpcb.compression, PC_DIM_XOR);
+	CU_ASSERT_EQUAL(fpcb.npoints, 4);
+	pcb2 = pc_bytes_decode(fpcb);
+	CU_ASSERT_DOUBLE_EQUAL(((float*)pcb2.bytes)[0], 1.75, 0.0);
+	CU_ASSERT_DOUBLE_EQUAL(((float*)pcb2.bytes)[3], 2.0, 0.0);
+	pc_bytes_free(pcb2);
+	pc_bytes_free(fpcb);
+	pc_bitmap_free(map);
+	pc_bytes_free(epcb);
+
+	/* Short arrays */
+	for ( i = 0; i < 2; i++ )
+	{
+		pcb = initbytes((uint8_t*)flt, i*4, PC_FLOAT);
+		epcb = pc_bytes_encode(pcb, PC_DIM_XOR);
+		CU_ASSERT_EQUAL(epcb.size, i*4);
+		pcb2 = pc_bytes_decode(epcb);
+		CU_ASSERT_EQUAL(pcb2.npoints, i);
+		CU_ASSERT_EQUAL(pcb2.size, i*4);
+		if ( i )
+			CU_ASSERT_EQUAL(memcmp(pcb.bytes, pcb2.bytes, pcb.size), 0);
+		pc_bytes_free(pcb2);
+		pc_bytes_free(epcb);
+	}
+}
+
+/*
+* Every unpacking kernel has to agree with the packed layout
+* for every word width, bit count and array length, including
+* the ragged tails the vector kernels leave to the scalar one.
+*/
+static void
+test_sigbits_kernels()
+{
+	static const char *kernels[] = { "scalar", "auto" };
+	static const uint32_t interps[] = { PC_UINT8, PC_UINT16, PC_UINT32, PC_UINT64 };
+	static const uint32_t lengths[] = { 1, 7, 33, 1001 };
+	uint8_t *bytes = pcalloc(1001 * 8);
+	int k, t, l, nbits, i;
+
+	for ( k = 0; k < 2; k++ )
+	{
+		CU_ASSERT_EQUAL(pc_sigbits_kernel_set(kernels[k]), PC_SUCCESS);
+		for ( t = 0; t < 4; t++ )
+		{
+			size_t size = pc_interpretation_size(interps[t]);
+			for ( nbits = 0; nbits <= 8 * size; nbits++ )
+			{
+				for ( l = 0; l < 4; l++ )
+				{
+					PCBYTES pcb, epcb, pcb2;
+					uint32_t npoints = lengths[l];
+					uint64_t common = 0xA5A5A5A5A5A5A5A5ULL;
+					uint64_t mask = nbits ? (0xFFFFFFFFFFFFFFFFULL >> (64 - nbits)) : 0;
+
+					for ( i = 0; i < npoints; i++ )
+					{
+						uint64_t v = (common & ~mask) | ((i * 0x9E3779B97F4A7C15ULL) & mask);
+						memcpy(bytes + i * size, &v, size);
+					}
+					pcb = initbytes(bytes, npoints * size, interps[t]);
+					epcb = pc_bytes_sigbits_encode(pcb);
+					pcb2 = pc_bytes_sigbits_decode(epcb);
+					CU_ASSERT_EQUAL(pcb2.size, pcb.size);
+					CU_ASSERT_EQUAL(memcmp(pcb.bytes, pcb2.bytes, pcb.size), 0);
+					pc_bytes_free(epcb);
+					pc_bytes_free(pcb2);
+				}
+			}
+		}
+	}
+	pc_sigbits_kernel_set("auto");
+	pcfree(bytes);
+}
+
+/*
+* Varint run lengths let a constant dimension
+* be a single run, however many points it has
+*/
+static void
+test_vrle_encoding()
+{
+	int i;
+	uint8_t *bytes;
+	uint16_t *bytes16;
+	double min, max, avg;
+	PCBYTES pcb, epcb, pcb2, fpcb;
+	PCBITMAP *map;
+	PCDIMENSION dim;
+	PCDOUBLESTAT stats;
+	size_t sz;
+	int32_t flipsize;
+
+	bytes = pcalloc(1000);
+	memset(bytes, 7, 1000);
+	pcb = initbytes(bytes, 1000, PC_UINT8);
+	epcb = pc_bytes_encode(pcb, PC_DIM_VRLE);
+	CU_ASSERT_EQUAL(epcb.compression, PC_DIM_VRLE);
+	CU_ASSERT_EQUAL(epcb.size, 3);
+	CU_ASSERT_EQUAL(epcb.bytes[0], 0xE8); /* 1000 = 0x3E8 */
+	CU_ASSERT_EQUAL(epcb.bytes[1], 0x07);
+	CU_ASSERT_EQUAL(epcb.bytes[2], 7);
+	pcb2 = pc_bytes_decode(epcb);
+	CU_ASSERT_EQUAL(pcb2.size, 1000);
+	CU_ASSERT_EQUAL(memcmp(pcb.bytes, pcb2.bytes, pcb.size), 0);
+	pc_bytes_free(pcb2);
+	pc_bytes_free(epcb);
+
+	/* The byte counted encoding needs four runs for the same thing */
+	epcb = pc_bytes_run_length_encode(pcb);
+	CU_ASSERT_EQUAL(epcb.size, 8);
+	pc_bytes_free(epcb);
+	pcfree(bytes);
+
+	/* Mixed short and long runs */
+	bytes16 = pcalloc(600 * 2);
+	for ( i = 0; i < 600; i++ )
+		bytes16[i] = i < 200 ? 3 : (i < 203 ? 9 : 5);
+	pcb = initbytes((uint8_t*)bytes16, 600*2, PC_UINT16);
+	epcb = pc_bytes_encode(pcb, PC_DIM_VRLE);
+	CU_ASSERT_EQUAL(epcb.size, 2+2 + 1+2 + 2+2);
+	pcb2 = pc_bytes_decode(epcb);
+	CU_ASSERT_EQUAL(memcmp(pcb.bytes, pcb2.bytes, pcb.size), 0);
+	pc_bytes_free(pcb2);
+
+	pc_bytes_minmax(&epcb, &min, &max, &avg);
+	CU_ASSERT_DOUBLE_EQUAL(min, 3, 0.0001);
+	CU_ASSERT_DOUBLE_EQUAL(max, 9, 0.0001);
+	CU_ASSERT_DOUBLE_EQUAL(avg, (200*3 + 3*9 + 397*5)/600.0, 0.0001);
+
+	/* Filtering keeps the format and weighs stats by run length */
+	map = pc_bytes_bitmap(&epcb, PC_LT, 8, 0);
+	CU_ASSERT_EQUAL(map->nset, 597);
+	stats.min = 1e30;
+	stats.max = -1e30;
+	stats.sum = 0;
+	fpcb = pc_bytes_filter(&epcb, map, &stats);
+	CU_ASSERT_EQUAL(fpcb.compression, PC_DIM_VRLE);
+	CU_ASSERT_EQUAL(fpcb.npoints, 597);
+	CU_ASSERT_EQUAL(fpcb.size, 2+2 + 2+2);
+	CU_ASSERT_DOUBLE_EQUAL(stats.sum, 200*3 + 397*5, 0.0001);
+	pcb2 = pc_bytes_decode(fpcb);
+	CU_ASSERT_EQUAL(((uint16_t*)pcb2.bytes)[199], 3);
+	CU_ASSERT_EQUAL(((uint16_t*)pcb2.bytes)[200], 5);
+	pc_bytes_free(pcb2);
+	pc_bytes_free(fpcb);
+	pc_bitmap_free(map);
+
+	/* Byte swapped input flips the values and leaves the counts alone */
+	bytes = pcalloc(pc_bytes_serialized_size(&epcb));
+	pc_bytes_serialize(&epcb, bytes, &sz);
+	flipsize = int32_flip_endian(epcb.size);
+	memcpy(bytes+1, &flipsize, 4);
+	bytes[5+2] = 0; bytes[5+3] = 3;
+	bytes[5+5] = 0; bytes[5+6] = 9;
+	bytes[5+9] = 0; bytes[5+10] = 5;
+	dim.interpretation = PC_UINT16;
+	pc_bytes_deserialize(bytes, &dim, &pcb2, PC_FALSE, PC_TRUE);
+	CU_ASSERT_EQUAL(memcmp(pcb2.bytes, epcb.bytes, epcb.size), 0);
+	pc_bytes_free(pcb2);
+	pcfree(bytes);
+	pc_bytes_free(epcb);
+	pcfree(bytes16);
+}
+
 /*
 * Encode and decode a byte stream. Data matches?
 */
@@ -350,13 +776,233 @@ test_zlib_encoding()
     */
     bytes = "abcaabcaabcbabcc";
     pcb = initbytes(bytes, strlen(bytes), PC_INT8);
-    epcb = pc_bytes_zlib_encode(pcb);
+    epcb = pc_bytes_zlib_encode(pcb, 0);
     pcb2 = pc_bytes_zlib_decode(epcb);
 	CU_ASSERT_EQUAL(memcmp(pcb.bytes, pcb2.bytes, pcb.size), 0);
     pc_bytes_free(epcb);
     pc_bytes_free(pcb2);
 }
 
+/*
+* Analyzer sizes must match what the codecs produce
+*/
+static void
+test_codec_sizes()
+{
+	int i, j, k, n;
+	uint32_t interps[] = { PC_UINT8, PC_UINT16, PC_INT32, PC_DOUBLE };
+	uint32_t npoints[] = { 1, 2, 3, 777 };
+	uint32_t codecs[] = { PC_DIM_VRLE, PC_DIM_SIGBITS, PC_DIM_DELTA, PC_DIM_XOR };
+	uint8_t *bytes;
+	PCBYTES pcb, epcb;
+	PCBYTESSIZES sizes;
+
+	srand(7);
+	for ( i = 0; i < 4; i++ )
+	{
+		size_t size = pc_interpretation_size(interps[i]);
+		for ( j = 0; j < 4; j++ )
+		{
+			/* Steadily climbing values with a few repeats and jumps */
+			n = npoints[j];
+			bytes = pcalloc(n * size);
+			for ( k = 0; k < n; k++ )
+			{
+				uint64_t v = 1000 + k * 3 + (k % 5 == 0 ? 0 : rand() % 4);
+				if ( k % 100 == 99 ) v += rand();
+				memcpy(bytes + k*size, &v, size);
+			}
+			pcb = initbytes(bytes, n * size, interps[i]);
+			pc_bytes_sizes(&pcb, &sizes);
+			CU_ASSERT_EQUAL(sizes.none, n * size);
+			for ( k = 0; k < 4; k++ )
+			{
+				size_t expected;
+				if ( codecs[k] == PC_DIM_XOR && size < 4 )
+				{
+					CU_ASSERT_EQUAL(sizes.xor, 0);
+					continue;
+				}
+				epcb = pc_bytes_encode(pcb, codecs[k]);
+				switch ( codecs[k] )
+				{
+				case PC_DIM_VRLE: expected = sizes.vrle; break;
+				case PC_DIM_SIGBITS: expected = sizes.sigbits; break;
+				case PC_DIM_DELTA: expected = sizes.delta; break;
+				default: expected = sizes.xor;
+				}
+				CU_ASSERT_EQUAL(epcb.size, expected);
+				pc_bytes_free(epcb);
+			}
+			pcfree(bytes);
+		}
+	}
+}
+
+/*
+* Encoding into a caller's buffer gives the same bytes as the
+* allocating encoder, within the promised bound, and decodes back
+*/
+static void
+test_codec_into()
+{
+	int i, j, k, p, n;
+	uint32_t interps[] = { PC_UINT8, PC_INT16, PC_UINT32, PC_INT64, PC_DOUBLE };
+	uint32_t npoints[] = { 1, 2, 777 };
+	uint32_t codecs[] = { PC_DIM_NONE, PC_DIM_RLE, PC_DIM_VRLE, PC_DIM_SIGBITS, PC_DIM_DELTA, PC_DIM_XOR, PC_DIM_ZLIB };
+	uint8_t *bytes, *buf, *ser, *out;
+	PCBYTES pcb, epcb;
+	PCBYTESSCRATCH scratch = {NULL, 0};
+
+	srand(11);
+	for ( i = 0; i < 5; i++ )
+	{
+		size_t size = pc_interpretation_size(interps[i]);
+		for ( j = 0; j < 3; j++ )
+		for ( p = 0; p < 2; p++ )
+		{
+			/* Smooth values, then noise over every bit */
+			n = npoints[j];
+			bytes = pcalloc(n * size);
+			for ( k = 0; k < n; k++ )
+			{
+				uint64_t v = p ? ((uint64_t)rand() << 40) ^ ((uint64_t)rand() << 20) ^ rand() : 5000 + k * 7 + rand() % 3;
+				memcpy(bytes + k*size, &v, size);
+			}
+			pcb = initbytes(bytes, n * size, interps[i]);
+			out = pcalloc(n * size);
+			for ( k = 0; k < 7; k++ )
+			{
+				size_t bound, size_out, ser_size;
+				if ( codecs[k] == PC_DIM_XOR && size < 4 )
+					continue;
+				bound = pc_bytes_encoded_size_bound(&pcb, codecs[k]);
+				buf = pcalloc(bound);
+				size_out = pc_bytes_encode_into(&pcb, codecs[k], 0, buf, &scratch);
+				CU_ASSERT(size_out <= bound);
+
+				/* Same bytes as the allocating encoder */
+				epcb = pc_bytes_encode(pcb, codecs[k]);
+				CU_ASSERT_EQUAL(size_out, epcb.size);
+				CU_ASSERT_EQUAL(memcmp(buf, epcb.bytes, size_out), 0);
+
+				/* And the same serialization */
+				ser = pcalloc(pc_bytes_serialized_size_bound(&pcb, codecs[k]));
+				ser_size = pc_bytes_serialize_encoded(&pcb, codecs[k], 0, ser, NULL);
+				CU_ASSERT_EQUAL(ser_size, pc_bytes_serialized_size(&epcb));
+				CU_ASSERT_EQUAL(ser[0], codecs[k]);
+				CU_ASSERT_EQUAL(memcmp(ser + 5, buf, size_out), 0);
+
+				memset(out, 0xAB, n * size);
+				pc_bytes_decode_into(&epcb, out);
+				CU_ASSERT_EQUAL(memcmp(out, bytes, n * size), 0);
+
+				pc_bytes_free(epcb);
+				pcfree(ser);
+				pcfree(buf);
+			}
+			pcfree(out);
+			pcfree(bytes);
+		}
+	}
+	pc_bytes_scratch_free(&scratch);
+}
+
+/*
+* Codec choice from exact sizes
+*/
+static void
+test_choose_compression()
+{
+	int i;
+	uint8_t *bytes;
+	uint32_t *bytes32;
+	PCBYTES pcb;
+
+	/* One long run */
+	bytes = pcalloc(1000);
+	memset(bytes, 7, 1000);
+	pcb = initbytes(bytes, 1000, PC_UINT8);
+	CU_ASSERT_EQUAL(pc_bytes_choose_compression(&pcb, PC_DIM_ZLIB), PC_DIM_VRLE);
+	pcfree(bytes);
+
+	/* A clock, delta beats sigbits */
+	bytes32 = pcalloc(1000 * 4);
+	for ( i = 0; i < 1000; i++ )
+		bytes32[i] = 1500000000 + i * 10;
+	pcb = initbytes((uint8_t*)bytes32, 1000*4, PC_UINT32);
+	CU_ASSERT_EQUAL(pc_bytes_choose_compression(&pcb, PC_DIM_ZLIB), PC_DIM_DELTA);
+
+	/* A narrow band of noise, sigbits */
+	srand(3);
+	for ( i = 0; i < 1000; i++ )
+		bytes32[i] = 1500000000 + rand() % 256;
+	CU_ASSERT_EQUAL(pc_bytes_choose_compression(&pcb, PC_DIM_ZLIB), PC_DIM_SIGBITS);
+
+	/* Full width noise, left to the general purpose codec */
+	for ( i = 0; i < 1000; i++ )
+		bytes32[i] = (uint32_t)rand() * 2654435761u;
+	CU_ASSERT_EQUAL(pc_bytes_choose_compression(&pcb, PC_DIM_ZSTD), PC_DIM_ZSTD);
+	pcfree(bytes32);
+
+	/* A clock in doubles, not left to delta, as dimstats would not be */
+	bytes = pcalloc(1000 * 8);
+	for ( i = 0; i < 1000; i++ )
+		((double*)bytes)[i] = 1500000000.0 + i * 10;
+	pcb = initbytes(bytes, 1000*8, PC_DOUBLE);
+	CU_ASSERT(! pc_bytes_compression_eligible(PC_DOUBLE, PC_DIM_DELTA));
+	CU_ASSERT(pc_bytes_choose_compression(&pcb, PC_DIM_ZLIB) != PC_DIM_DELTA);
+	CU_ASSERT(pc_bytes_choose_compression(&pcb, PC_DIM_ZLIB) != PC_DIM_SIGBITS);
+	pcfree(bytes);
+}
+
+/*
+* Every general purpose codec, at its fastest and strongest
+* level, has to give the bytes back untouched
+*/
+static void
+test_codec_levels()
+{
+	int i, c, l;
+	uint8_t *bytes;
+	PCBYTES pcb, epcb, pcb2;
+	double min, max, avg;
+	int codecs[3] = { PC_DIM_ZLIB, 0, 0 };
+	int ncodecs = 1;
+#ifdef HAVE_LIBZSTD
+	codecs[ncodecs++] = PC_DIM_ZSTD;
+#endif
+#ifdef HAVE_LIBLZ4
+	codecs[ncodecs++] = PC_DIM_LZ4;
+#endif
+
+	bytes = pcalloc(4000);
+	for ( i = 0; i < 1000; i++ )
+		((int32_t*)bytes)[i] = (i % 50) * 1000 - 20000;
+	pcb = initbytes(bytes, 4000, PC_INT32);
+
+	for ( c = 0; c < ncodecs; c++ )
+	{
+		int levels[3] = { 0, 1, 9 };
+		for ( l = 0; l < 3; l++ )
+		{
+			epcb = pc_bytes_encode_level(pcb, codecs[c], levels[l]);
+			CU_ASSERT_EQUAL(epcb.compression, codecs[c]);
+			CU_ASSERT(epcb.size < pcb.size);
+			pcb2 = pc_bytes_decode(epcb);
+			CU_ASSERT_EQUAL(pcb2.compression, PC_DIM_NONE);
+			CU_ASSERT_EQUAL(pcb2.size, pcb.size);
+			CU_ASSERT_EQUAL(memcmp(pcb.bytes, pcb2.bytes, pcb.size), 0);
+			pc_bytes_minmax(&epcb, &min, &max, &avg);
+			CU_ASSERT_DOUBLE_EQUAL(min, -20000, 0.0001);
+			CU_ASSERT_DOUBLE_EQUAL(max, 29000, 0.0001);
+			pc_bytes_free(pcb2);
+			pc_bytes_free(epcb);
+		}
+	}
+	pcfree(bytes);
+}
+
 
 static void
 test_rle_filter()
@@ -479,14 +1125,215 @@ test_uncompressed_filter()
 }
 
 
+/*
+* Stats read off packed arrays match the decoded ones
+*/
+static void
+test_bytes_stat()
+{
+	int i, j, k, n = 300;
+	uint32_t interps[] = { PC_INT8, PC_UINT8, PC_INT16, PC_INT32, PC_UINT32, PC_INT64, PC_DOUBLE };
+	uint32_t codecs[] = { PC_DIM_RLE, PC_DIM_VRLE, PC_DIM_SIGBITS, PC_DIM_DELTA, PC_DIM_ZLIB };
+	uint8_t *bytes = pcalloc(n * 8);
+	PCBYTES pcb, epcb;
+	PCBYTESSTAT expected, stat, total;
+
+	srand(9);
+	for ( i = 0; i < 7; i++ )
+	{
+		size_t size = pc_interpretation_size(interps[i]);
+		/* Negative, then all positive, then straddling zero */
+		for ( j = 0; j < 3; j++ )
+		{
+			for ( k = 0; k < n; k++ )
+			{
+				int64_t v = (k / 4) % 60 + ( j == 0 ? -100 : ( j == 1 ? 20 : -30 ) );
+				if ( interps[i] == PC_DOUBLE )
+				{
+					double d = v;
+					memcpy(bytes + k*size, &d, size);
+				}
+				else
+				{
+					memcpy(bytes + k*size, &v, size);
+				}
+			}
+			pcb = initbytes(bytes, n * size, interps[i]);
+			pc_bytes_stat_init(&expected);
+			pc_bytes_stat(&pcb, &expected);
+			CU_ASSERT_EQUAL(expected.count, n);
+			pc_bytes_stat_init(&total);
+
+			for ( k = 0; k < 5; k++ )
+			{
+				epcb = pc_bytes_encode(pcb, codecs[k]);
+				pc_bytes_stat_init(&stat);
+				CU_ASSERT_EQUAL(pc_bytes_stat(&epcb, &stat), PC_SUCCESS);
+				CU_ASSERT_EQUAL(stat.count, expected.count);
+				CU_ASSERT_DOUBLE_EQUAL(stat.min, expected.min, 0.000001);
+				CU_ASSERT_DOUBLE_EQUAL(stat.max, expected.max, 0.000001);
+				CU_ASSERT_DOUBLE_EQUAL(stat.sum, expected.sum, 0.000001);
+				pc_bytes_stat_merge(&total, &stat);
+				pc_bytes_free(epcb);
+			}
+			CU_ASSERT_EQUAL(total.count, 5 * expected.count);
+			CU_ASSERT_DOUBLE_EQUAL(total.min, expected.min, 0.000001);
+			CU_ASSERT_DOUBLE_EQUAL(total.sum, 5 * expected.sum, 0.000001);
+		}
+	}
+	pcfree(bytes);
+}
+
+/*
+* Integer filters run on the stored words, and must agree with
+* comparing every value as a double
+*/
+static void
+test_key_bitmap()
+{
+	int i, j, k, f, n = 500;
+	uint32_t interps[] = { PC_INT8, PC_UINT8, PC_INT16, PC_UINT16, PC_INT32, PC_UINT32, PC_INT64 };
+	uint32_t codecs[] = { PC_DIM_NONE, PC_DIM_RLE, PC_DIM_VRLE, PC_DIM_SIGBITS, PC_DIM_DELTA, PC_DIM_ZLIB };
+	PC_FILTERTYPE filters[] = { PC_GT, PC_LT, PC_EQUAL, PC_BETWEEN };
+	double consts[][2] = { { 10, 60 }, { 9.5, 60.5 }, { -3.2, 3.2 }, { -1e30, 1e30 }, { 250, 1000 }, { 35, 35 }, { NAN, 10 } };
+	uint8_t *bytes = pcalloc(n * 8);
+	PCBYTES pcb, epcb;
+	PCBITMAP *map, *expected;
+
+	srand(8);
+	for ( i = 0; i < 7; i++ )
+	{
+		size_t size = pc_interpretation_size(interps[i]);
+		/* Runs of small values, some negative for the signed types */
+		for ( k = 0; k < n; k++ )
+		{
+			int64_t v = (k / 7) % 50 + ( k % 3 ? 0 : rand() % 20 ) - 8;
+			memcpy(bytes + k*size, &v, size);
+		}
+		pcb = initbytes(bytes, n * size, interps[i]);
+
+		for ( j = 0; j < 6; j++ )
+		{
+			epcb = pc_bytes_encode(pcb, codecs[j]);
+			for ( f = 0; f < 4; f++ )
+			{
+				for ( k = 0; k < 7; k++ )
+				{
+					int m, same = 1;
+					expected = pc_bitmap_new(n);
+					for ( m = 0; m < n; m++ )
+						pc_bitmap_filter(expected, filters[f], m, pc_double_from_ptr(bytes + m*size, interps[i]), consts[k][0], consts[k][1]);
+					map = pc_bytes_bitmap(&epcb, filters[f], consts[k][0], consts[k][1]);
+					CU_ASSERT_EQUAL(map->nset, expected->nset);
+					for ( m = 0; m < n; m++ )
+						same &= ( pc_bitmap_get(map, m) == pc_bitmap_get(expected, m) );
+					CU_ASSERT(same);
+					pc_bitmap_free(map);
+					pc_bitmap_free(expected);
+				}
+			}
+			pc_bytes_free(epcb);
+		}
+	}
+	pcfree(bytes);
+}
+
+
+/* Array readers agree with the per value ones, packed or strided */
+static void
+test_double_array()
+{
+	int i, j, n = 300;
+	size_t strides[] = { 0, 11 };
+	uint8_t *bytes = pcalloc(n * 11);
+	double vals[300];
+	PCBITMAP *map, *expected;
+
+	for ( i = PC_INT8; i < NUM_INTERPRETATIONS; i++ )
+	{
+		size_t size = pc_interpretation_size(i);
+		for ( j = 0; j < 2; j++ )
+		{
+			size_t stride = strides[j] ? strides[j] : size;
+			int k;
+			for ( k = 0; k < n; k++ )
+				pc_double_to_ptr(bytes + k*stride, i, (k % 100) - 20);
+			pc_double_array_from_ptr(vals, bytes, i, stride, n);
+			for ( k = 0; k < n; k++ )
+				CU_ASSERT_DOUBLE_EQUAL(vals[k], pc_double_from_ptr(bytes + k*stride, i), 0.0);
+		}
+	}
+
+	/* Filtering a run at a time matches filtering value by value */
+	expected = pc_bitmap_new(n);
+	map = pc_bitmap_new(n);
+	for ( i = 0; i < n; i++ )
+		pc_bitmap_filter(expected, PC_BETWEEN, i, vals[i], 10, 50);
+	pc_bitmap_filter_array(map, PC_BETWEEN, 0, vals, 100, 10, 50);
+	pc_bitmap_filter_array(map, PC_BETWEEN, 100, vals + 100, n - 100, 10, 50);
+	CU_ASSERT_EQUAL(map->nset, expected->nset);
+	CU_ASSERT_EQUAL(memcmp(map->map, expected->map, n), 0);
+	pc_bitmap_filter_array(map, PC_LT, 0, vals, n, -100, 0);
+	CU_ASSERT_EQUAL(map->nset, 0);
+
+	pc_bitmap_free(map);
+	pc_bitmap_free(expected);
+	pcfree(bytes);
+}
+
+/*
+* Joined arrays decode to the inputs end to end, whether the
+* runs are copied as they are or the arrays re-encoded
+*/
+static void
+test_bytes_concat()
+{
+	PCBYTES pcbs[2], pcb, dpcb;
+
+	pcbs[0] = pc_bytes_run_length_encode(initbytes((uint8_t*)"aaaabbbb", 8, PC_UINT8));
+	pcbs[1] = pc_bytes_run_length_encode(initbytes((uint8_t*)"bbcc", 4, PC_UINT8));
+	pcb = pc_bytes_concat(pcbs, 2, PC_DIM_NONE, 0);
+	CU_ASSERT_EQUAL(pcb.compression, PC_DIM_RLE);
+	CU_ASSERT_EQUAL(pcb.npoints, 12);
+	dpcb = pc_bytes_decode(pcb);
+	CU_ASSERT_EQUAL(memcmp(dpcb.bytes, "aaaabbbbbbcc", 12), 0);
+	pc_bytes_free(pcb);
+	pc_bytes_free(dpcb);
+
+	/* Mixed codecs go through the values */
+	pc_bytes_free(pcbs[1]);
+	pcbs[1] = pc_bytes_sigbits_encode(initbytes((uint8_t*)"abcd", 4, PC_UINT8));
+	pcb = pc_bytes_concat(pcbs, 2, PC_DIM_NONE, 0);
+	CU_ASSERT_EQUAL(pcb.npoints, 12);
+	dpcb = pc_bytes_decode(pcb);
+	CU_ASSERT_EQUAL(memcmp(dpcb.bytes, "aaaabbbbabcd", 12), 0);
+	pc_bytes_free(pcb);
+	pc_bytes_free(dpcb);
+	pc_bytes_free(pcbs[0]);
+	pc_bytes_free(pcbs[1]);
+}
+
 /* REGISTER ***********************************************************/
 
 CU_TestInfo bytes_tests[] = {
 	PC_TEST(test_run_length_encoding),
+	PC_TEST(test_vrle_encoding),
 	PC_TEST(test_sigbits_encoding),
+	PC_TEST(test_sigbits_encoding_64),
+	PC_TEST(test_sigbits_kernels),
+	PC_TEST(test_delta_encoding),
+	PC_TEST(test_xor_encoding),
 	PC_TEST(test_zlib_encoding),
+	PC_TEST(test_codec_levels),
+	PC_TEST(test_codec_sizes),
+	PC_TEST(test_codec_into),
+	PC_TEST(test_choose_compression),
 	PC_TEST(test_rle_filter),
 	PC_TEST(test_uncompressed_filter),
+	PC_TEST(test_key_bitmap),
+	PC_TEST(test_bytes_stat),
+	PC_TEST(test_double_array),
+	PC_TEST(test_bytes_concat),
 	CU_TEST_INFO_NULL
 };
 
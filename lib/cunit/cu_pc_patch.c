@@ -9,6 +9,7 @@
 
 #include "CUnit/Basic.h"
 #include "cu_tester.h"
+#include <math.h>
 
 
 /* GLOBALS ************************************************************/
@@ -317,7 +318,7 @@ test_patch_dimensional_compression()
     // printf("z2 %ld\n", z2);
 
     str = pc_dimstats_to_string(pds);
-    CU_ASSERT_STRING_EQUAL(str, "{\"ndims\":4,\"total_points\":1200,\"total_patches\":3,\"dims\":[{\"total_runs\":1200,\"total_commonbits\":45,\"recommended_compression\":2},{\"total_runs\":1200,\"total_commonbits\":45,\"recommended_compression\":2},{\"total_runs\":1200,\"total_commonbits\":54,\"recommended_compression\":2},{\"total_runs\":3,\"total_commonbits\":48,\"recommended_compression\":1}]}");
+    CU_ASSERT_STRING_EQUAL(str, "{\"ndims\":4,\"total_points\":1200,\"total_patches\":3,\"dims\":[{\"total_runs\":1200,\"total_commonbits\":45,\"total_deltabits\":0,\"total_xorbits\":0,\"recommended_compression\":4},{\"total_runs\":1200,\"total_commonbits\":45,\"total_deltabits\":0,\"total_xorbits\":0,\"recommended_compression\":4},{\"total_runs\":1200,\"total_commonbits\":54,\"total_deltabits\":0,\"total_xorbits\":0,\"recommended_compression\":4},{\"total_runs\":3,\"total_commonbits\":48,\"total_deltabits\":0,\"total_xorbits\":0,\"recommended_compression\":8}]}");
     // printf("%s\n", str);
     pcfree(str);
 
@@ -351,9 +352,10 @@ test_patch_union()
 {
     int i;
     int npts = 20;
-    PCPOINTLIST *pl1;
+    PCPOINTLIST *pl1, *pl2;
     PCPATCH *pu;
     PCPATCH **palist;
+    double d;
     PCDIMSTATS *pds = NULL;
     size_t z1, z2;
     char *str;
@@ -377,6 +379,24 @@ test_patch_union()
 
     pu = pc_patch_from_patchlist(palist, 2);
     CU_ASSERT_EQUAL(pu->npoints, 2*npts);
+    pc_patch_free(pu);
+
+    /* Compressed dimensional inputs are joined without going through points */
+    pc_patch_free(palist[1]);
+    palist[1] = (PCPATCH*)pc_patch_dimensional_compress((PCPATCH_DIMENSIONAL*)palist[0], NULL);
+    palist[1]->stats = pc_stats_clone(palist[0]->stats);
+    pu = pc_patch_from_patchlist(palist, 2);
+    CU_ASSERT_EQUAL(pu->type, PC_DIMENSIONAL);
+    CU_ASSERT_EQUAL(pu->npoints, 2*npts);
+    pc_point_get_double_by_name(&(pu->stats->max), "x", &d);
+    CU_ASSERT_DOUBLE_EQUAL(d, 38, 0.000001);
+    pc_point_get_double_by_name(&(pu->stats->avg), "intensity", &d);
+    CU_ASSERT_DOUBLE_EQUAL(d, 10, 0.000001);
+    CU_ASSERT_DOUBLE_EQUAL(pu->bounds.ymax, 36.1, 0.000001);
+    pl2 = pc_pointlist_from_patch(pu);
+    pc_point_get_double_by_name(pc_pointlist_get_point(pl2, npts + 3), "Z", &d);
+    CU_ASSERT_DOUBLE_EQUAL(d, 1.02, 0.000001);
+    pc_pointlist_free(pl2);
 
     pc_pointlist_free(pl1);
     pc_patch_free(pu);
@@ -386,6 +406,116 @@ test_patch_union()
 }
 
 
+static void
+test_patch_builder()
+{
+    int i;
+    int npts = 100;
+    double d;
+    PCPOINTLIST *pl1, *pl2;
+    PCPATCH *pa1, *pa2, *pa3;
+    PCPATCHBUILDER *b2, *b = pc_patch_builder_make(simpleschema);
+
+    pl1 = pc_pointlist_make(npts);
+    for ( i = 0; i < npts; i++ )
+    {
+        PCPOINT *pt = pc_point_make(simpleschema);
+        pc_point_set_double_by_name(pt, "x", i*2.0);
+        pc_point_set_double_by_name(pt, "y", i*1.9);
+        pc_point_set_double_by_name(pt, "Z", i*0.34);
+        pc_point_set_double_by_name(pt, "intensity", 10);
+        pc_pointlist_add_point(pl1, pt);
+    }
+    pa1 = (PCPATCH*)pc_patch_dimensional_from_pointlist(pl1);
+    pa2 = (PCPATCH*)pc_patch_dimensional_compress((PCPATCH_DIMENSIONAL*)pa1, NULL);
+    pa2->stats = NULL;
+
+    CU_ASSERT(pc_patch_builder_to_patch(b) == NULL);
+    pc_patch_builder_add_patch(b, pa2);
+    pc_patch_builder_add_point(b, pc_pointlist_get_point(pl1, 7));
+    pc_patch_builder_add_patch(b, pa1);
+    CU_ASSERT_EQUAL(b->npoints, 2*npts + 1);
+
+    /* The simple schema is dimensional, so the arrays come out compressed */
+    pa3 = pc_patch_builder_to_patch(b);
+    CU_ASSERT_EQUAL(pa3->type, PC_DIMENSIONAL);
+    CU_ASSERT_EQUAL(pa3->npoints, 2*npts + 1);
+    pc_point_get_double_by_name(&(pa3->stats->max), "x", &d);
+    CU_ASSERT_DOUBLE_EQUAL(d, 198, 0.000001);
+    CU_ASSERT_DOUBLE_EQUAL(pa3->bounds.ymax, 188.1, 0.000001);
+    pl2 = pc_pointlist_from_patch(pa3);
+    pc_point_get_double_by_name(pc_pointlist_get_point(pl2, npts), "Z", &d);
+    CU_ASSERT_DOUBLE_EQUAL(d, 2.38, 0.000001);
+    pc_point_get_double_by_name(pc_pointlist_get_point(pl2, 2*npts), "y", &d);
+    CU_ASSERT_DOUBLE_EQUAL(d, 188.1, 0.000001);
+
+    pc_pointlist_free(pl2);
+    pc_patch_free(pa3);
+
+    /* Partial builders append in order, a merged builder patches the same */
+    b2 = pc_patch_builder_make(simpleschema);
+    pc_patch_builder_add_patch(b2, pa1);
+    CU_ASSERT_EQUAL(pc_patch_builder_merge(b2, b), PC_SUCCESS);
+    CU_ASSERT_EQUAL(b2->npoints, 3*npts + 1);
+    pa3 = pc_patch_builder_to_patch(b2);
+    pl2 = pc_pointlist_from_patch(pa3);
+    pc_point_get_double_by_name(pc_pointlist_get_point(pl2, 2*npts), "Z", &d);
+    CU_ASSERT_DOUBLE_EQUAL(d, 2.38, 0.000001);
+    pc_point_get_double_by_name(pc_pointlist_get_point(pl2, 3*npts), "y", &d);
+    CU_ASSERT_DOUBLE_EQUAL(d, 188.1, 0.000001);
+    CU_ASSERT_DOUBLE_EQUAL(pa3->bounds.xmax, 198, 0.000001);
+
+    pc_pointlist_free(pl2);
+    pc_patch_free(pa3);
+    pc_patch_builder_free(b2);
+
+    /* Dimensional inputs alone are held compressed and joined at the end */
+    b2 = pc_patch_builder_make(simpleschema);
+    pc_patch_builder_add_patch(b2, pa1);
+    pc_patch_builder_add_patch(b2, pa2);
+    CU_ASSERT_EQUAL(b2->npatches, 2);
+    CU_ASSERT_EQUAL(b2->maxpoints, 0);
+    pa3 = pc_patch_builder_to_patch(b2);
+    CU_ASSERT_EQUAL(pa3->type, PC_DIMENSIONAL);
+    CU_ASSERT_EQUAL(pa3->npoints, 2*npts);
+    pc_point_get_double_by_name(&(pa3->stats->max), "x", &d);
+    CU_ASSERT_DOUBLE_EQUAL(d, 198, 0.000001);
+    pl2 = pc_pointlist_from_patch(pa3);
+    pc_point_get_double_by_name(pc_pointlist_get_point(pl2, npts + 7), "Z", &d);
+    CU_ASSERT_DOUBLE_EQUAL(d, 2.38, 0.000001);
+    pc_pointlist_free(pl2);
+    pc_patch_free(pa3);
+
+    /* Then decoded in order once anything else comes in */
+    pc_patch_builder_add_point(b2, pc_pointlist_get_point(pl1, 3));
+    CU_ASSERT_EQUAL(b2->npatches, 0);
+    CU_ASSERT_EQUAL(b2->npoints, 2*npts + 1);
+    pa3 = pc_patch_builder_to_patch(b2);
+    pl2 = pc_pointlist_from_patch(pa3);
+    pc_point_get_double_by_name(pc_pointlist_get_point(pl2, npts + 7), "Z", &d);
+    CU_ASSERT_DOUBLE_EQUAL(d, 2.38, 0.000001);
+    pc_point_get_double_by_name(pc_pointlist_get_point(pl2, 2*npts), "x", &d);
+    CU_ASSERT_DOUBLE_EQUAL(d, 6, 0.000001);
+    pc_pointlist_free(pl2);
+    pc_patch_free(pa3);
+    pc_patch_builder_free(b2);
+
+    /* Columns stop doubling at the limit, and only grow as needed past it */
+    pa3 = (PCPATCH*)pc_patch_uncompressed_from_pointlist(pl1);
+    b2 = pc_patch_builder_make(simpleschema);
+    b2->limitpoints = npts + 10;
+    pc_patch_builder_add_patch(b2, pa3);
+    CU_ASSERT_EQUAL(b2->maxpoints, npts + 10);
+    pc_patch_builder_add_patch(b2, pa3);
+    CU_ASSERT_EQUAL(b2->maxpoints, 2*npts);
+    pc_patch_builder_free(b2);
+    pc_patch_free(pa3);
+    pc_patch_builder_free(b);
+    pc_patch_free(pa2);
+    pc_patch_free(pa1);
+    pc_pointlist_free(pl1);
+}
+
 static void
 test_patch_wkb()
 {
@@ -451,6 +581,7 @@ test_patch_filter()
 {
     int i;
     int npts = 20;
+    double d;
     PCPOINTLIST *pl1, *pl2;
     PCPATCH_UNCOMPRESSED *pu1, *pu2;
     PCPATCH *pa1, *pa2, *pa3, *pa4;
@@ -486,6 +617,15 @@ test_patch_filter()
     str1 = pc_patch_to_string(pa2);
     // printf("pa2\n%s\n", str1);
     CU_ASSERT_STRING_EQUAL(str1, "{\"pcid\":0,\"pts\":[[18,18,1.8,82],[19,19,1.9,81]]}");
+    /* Stats and bounds are recomputed on the filtered values, in scaled units */
+    pc_point_get_double_by_name(&(pa2->stats->min), "x", &d);
+    CU_ASSERT_DOUBLE_EQUAL(d, 18, 0.000001);
+    pc_point_get_double_by_name(&(pa2->stats->max), "Z", &d);
+    CU_ASSERT_DOUBLE_EQUAL(d, 1.9, 0.000001);
+    pc_point_get_double_by_name(&(pa2->stats->avg), "y", &d);
+    CU_ASSERT_DOUBLE_EQUAL(d, 18.5, 0.000001);
+    CU_ASSERT_DOUBLE_EQUAL(pa2->bounds.xmin, 18, 0.000001);
+    CU_ASSERT_DOUBLE_EQUAL(pa2->bounds.ymax, 19, 0.000001);
 
     pa3 = (PCPATCH*)pc_patch_uncompressed_from_pointlist(pl2);
     // printf("\npa3\n%s\n", pc_patch_to_string(pa3));
@@ -511,6 +651,246 @@ test_patch_filter()
 }
 
 
+/*
+* Points on the diagonal x = y = i, with Z = i/10 and intensity
+* 100 - i, as a dimensional patch, an uncompressed one and, when
+* pa3 is given, a compressed copy of the first with its own stats.
+*/
+static PCPOINTLIST *
+test_filter_fixture(int npts, PCPATCH **pa1, PCPATCH **pa2, PCPATCH **pa3)
+{
+    int i;
+    PCPOINTLIST *pl = pc_pointlist_make(npts);
+
+    for ( i = 0; i < npts; i++ )
+    {
+        PCPOINT *pt = pc_point_make(simpleschema);
+        pc_point_set_double_by_name(pt, "x", i);
+        pc_point_set_double_by_name(pt, "y", i);
+        pc_point_set_double_by_name(pt, "Z", i*0.1);
+        pc_point_set_double_by_name(pt, "intensity", 100-i);
+        pc_pointlist_add_point(pl, pt);
+    }
+    *pa1 = (PCPATCH*)pc_patch_dimensional_from_pointlist(pl);
+    *pa2 = (PCPATCH*)pc_patch_uncompressed_from_pointlist(pl);
+    if ( pa3 )
+    {
+        *pa3 = (PCPATCH*)pc_patch_dimensional_compress((PCPATCH_DIMENSIONAL*)*pa1, NULL);
+        (*pa3)->stats = pc_stats_clone((*pa1)->stats);
+    }
+    return pl;
+}
+
+static void
+test_patch_filter_values()
+{
+    int npts = 20;
+    PCPOINTLIST *pl;
+    PCPATCH *pa1, *pa2;
+    uint32_t fdims[2] = {0, 3};
+    double fmins[2] = {4, 80};
+    double fmaxs[2] = {INFINITY, 95};
+    uint32_t odims[2] = {2, 0};
+    uint32_t n;
+    double *vals;
+
+    pl = test_filter_fixture(npts, &pa1, &pa2, NULL);
+
+    /* x in (4, inf) and intensity in (80, 95) keeps x = 6..19, read back as Z, x */
+    vals = pc_patch_filter_values(pa1, fdims, fmins, fmaxs, 2, odims, 2, &n);
+    CU_ASSERT_EQUAL(n, 14);
+    CU_ASSERT_DOUBLE_EQUAL(vals[0], 0.6, 0.000001);
+    CU_ASSERT_DOUBLE_EQUAL(vals[1], 6, 0.000001);
+    CU_ASSERT_DOUBLE_EQUAL(vals[2*13+1], 19, 0.000001);
+    pcfree(vals);
+
+    vals = pc_patch_filter_values(pa2, fdims, fmins, fmaxs, 2, odims, 2, &n);
+    CU_ASSERT_EQUAL(n, 14);
+    CU_ASSERT_DOUBLE_EQUAL(vals[2*13], 1.9, 0.000001);
+    pcfree(vals);
+
+    /* The stats alone rule out x > 100 */
+    fmins[0] = 100;
+    vals = pc_patch_filter_values(pa1, fdims, fmins, fmaxs, 2, odims, 2, &n);
+    CU_ASSERT_EQUAL(n, 0);
+    CU_ASSERT(vals == NULL);
+
+    pc_patch_free(pa1);
+    pc_patch_free(pa2);
+    pc_pointlist_free(pl);
+}
+
+static void
+test_patch_filter_predicate()
+{
+    int npts = 20;
+    double d;
+    PCPOINTLIST *pl;
+    PCPATCH *pa1, *pa2, *pa3, *pa4;
+    PCPREDICATE *pred;
+    char deep[134];
+
+    pl = test_filter_fixture(npts, &pa1, &pa2, &pa3);
+
+    /* Keeps x = 10 and x = 15..17 */
+    pred = pc_predicate_parse(simpleschema, "x >= 4 and (Intensity IN (90, 85, 99) OR \"Z\" BETWEEN 1.45 AND 1.75)");
+    CU_ASSERT(pred != NULL);
+    CU_ASSERT_EQUAL(pred->type, PC_PRED_AND);
+    CU_ASSERT_EQUAL(pred->nargs, 2);
+
+    pa4 = pc_patch_filter_predicate(pa3, pred);
+    CU_ASSERT_EQUAL(pa4->npoints, 4);
+    pc_point_get_double_by_name(&(pa4->stats->min), "x", &d);
+    CU_ASSERT_DOUBLE_EQUAL(d, 10, 0.000001);
+    CU_ASSERT_DOUBLE_EQUAL(pa4->bounds.xmax, 17, 0.000001);
+    pc_patch_free(pa4);
+
+    pa4 = pc_patch_filter_predicate(pa2, pred);
+    CU_ASSERT_EQUAL(pa4->npoints, 4);
+    pc_point_get_double_by_name(&(pa4->stats->max), "intensity", &d);
+    CU_ASSERT_DOUBLE_EQUAL(d, 90, 0.000001);
+    pc_patch_free(pa4);
+    pc_predicate_free(pred);
+
+    /* The stats settle these two without reading the points */
+    pred = pc_predicate_parse(simpleschema, "intensity > 0");
+    CU_ASSERT_EQUAL(pc_predicate_match_stats(pred, pa1->stats), PC_MATCH_ALL);
+    pa4 = pc_patch_filter_predicate(pa1, pred);
+    CU_ASSERT_EQUAL(pa4->npoints, npts);
+    pc_patch_free(pa4);
+    pc_predicate_free(pred);
+
+    pred = pc_predicate_parse(simpleschema, "x > 100 OR y < -1");
+    CU_ASSERT_EQUAL(pc_predicate_match_stats(pred, pa1->stats), PC_MATCH_NONE);
+    pa4 = pc_patch_filter_predicate(pa1, pred);
+    CU_ASSERT_EQUAL(pa4->npoints, 0);
+    pc_patch_free(pa4);
+    pc_predicate_free(pred);
+
+    /* 64 levels of parentheses is as deep as the parser goes */
+    memset(deep, '(', 64);
+    strcpy(deep + 64, "x < 3");
+    memset(deep + 69, ')', 64);
+    deep[133] = '\0';
+    pred = pc_predicate_parse(simpleschema, deep);
+    CU_ASSERT(pred != NULL);
+    pa4 = pc_patch_filter_predicate(pa2, pred);
+    CU_ASSERT_EQUAL(pa4->npoints, 3);
+    pc_patch_free(pa4);
+    pc_predicate_free(pred);
+
+    pc_patch_free(pa1);
+    pc_patch_free(pa2);
+    pc_patch_free(pa3);
+    pc_pointlist_free(pl);
+}
+
+/* Native-endian WKB of a polygon, rings given as closed x,y lists */
+static uint8_t *
+test_wkb_polygon(const double *coords, const uint32_t *ringsizes, uint32_t nrings, size_t *wkbsize)
+{
+    uint32_t i, n = 0, type = 3;
+    uint8_t *wkb, *ptr;
+
+    for ( i = 0; i < nrings; i++ )
+        n += ringsizes[i];
+    *wkbsize = 1 + 4 + 4 + 4 * nrings + 16 * n;
+    ptr = wkb = pcalloc(*wkbsize);
+    *ptr = machine_endian(); ptr += 1;
+    memcpy(ptr, &type, 4); ptr += 4;
+    memcpy(ptr, &nrings, 4); ptr += 4;
+    for ( i = 0; i < nrings; i++ )
+    {
+        memcpy(ptr, &(ringsizes[i]), 4); ptr += 4;
+        memcpy(ptr, coords, 16 * ringsizes[i]); ptr += 16 * ringsizes[i];
+        coords += 2 * ringsizes[i];
+    }
+    return wkb;
+}
+
+static void
+test_patch_filter_geometry()
+{
+    int npts = 20;
+    size_t wkbsize;
+    uint8_t *wkb;
+    PCPOINTLIST *pl;
+    PCPATCH *pa1, *pa2, *pa3, *pa4;
+    PCGEOMETRY *geom;
+    /* A square around x = 5..10 with a hole around x = 7 */
+    double polygon[] = { 4.5, -1, 10.5, -1, 10.5, 21, 4.5, 21, 4.5, -1,
+                         6.8, 6.8, 7.2, 6.8, 7.2, 7.2, 6.8, 7.2, 6.8, 6.8 };
+    uint32_t rings[] = { 5, 5 };
+    double large[] = { -1, -1, 30, -1, 30, 30, -1, 30, -1, -1 };
+    uint8_t point[21] = { 0, 1, 0, 0, 0 };
+    uint8_t ewkb[25];
+    double xy[] = { 15.2, 15.2 };
+    uint32_t one = 1;
+    uint32_t ewkbtype = 0x20000001;
+    int32_t srid = 4326;
+
+    pl = test_filter_fixture(npts, &pa1, &pa2, &pa3);
+
+    wkb = test_wkb_polygon(polygon, rings, 2, &wkbsize);
+    geom = pc_geometry_from_wkb(wkb, wkbsize);
+    pcfree(wkb);
+    CU_ASSERT_EQUAL(geom->nedges, 8);
+    CU_ASSERT_EQUAL(pc_geometry_match_bounds(geom, &(pa1->bounds), 0), PC_MATCH_SOME);
+
+    pa4 = pc_patch_filter_geometry(pa3, geom, 0);
+    CU_ASSERT_EQUAL(pa4->npoints, 5);
+    CU_ASSERT_DOUBLE_EQUAL(pa4->bounds.xmin, 5, 0.000001);
+    CU_ASSERT_DOUBLE_EQUAL(pa4->bounds.xmax, 10, 0.000001);
+    pc_patch_free(pa4);
+
+    /* A quarter unit around the hole takes it back */
+    pa4 = pc_patch_filter_geometry(pa2, geom, 0.25);
+    CU_ASSERT_EQUAL(pa4->npoints, 6);
+    pc_patch_free(pa4);
+    pc_geometry_free(geom);
+
+    /* The bounds settle this one */
+    wkb = test_wkb_polygon(large, rings, 1, &wkbsize);
+    geom = pc_geometry_from_wkb(wkb, wkbsize);
+    pcfree(wkb);
+    CU_ASSERT_EQUAL(pc_geometry_match_bounds(geom, &(pa1->bounds), 0), PC_MATCH_ALL);
+    pa4 = pc_patch_filter_geometry(pa1, geom, 0);
+    CU_ASSERT_EQUAL(pa4->npoints, npts);
+    pc_patch_free(pa4);
+    pc_geometry_free(geom);
+
+    /* A buffer around a point */
+    point[0] = machine_endian();
+    memcpy(point + 1, &one, 4);
+    memcpy(point + 5, xy, 16);
+    geom = pc_geometry_from_wkb(point, sizeof(point));
+    CU_ASSERT(pc_geometry_covers(geom, 15, 15, 1));
+    CU_ASSERT(! pc_geometry_covers(geom, 16, 16, 1));
+    CU_ASSERT(! pc_geometry_covers(geom, NAN, 15, 1));
+    CU_ASSERT(! pc_geometry_covers(geom, 15, 15, NAN));
+    CU_ASSERT_EQUAL(pc_geometry_match_bounds(geom, &(pa3->bounds), INFINITY), PC_MATCH_NONE);
+    pa4 = pc_patch_filter_geometry(pa3, geom, 1.2);
+    CU_ASSERT_EQUAL(pa4->npoints, 2);
+    pc_patch_free(pa4);
+    CU_ASSERT_EQUAL(geom->srid, 0);
+    pc_geometry_free(geom);
+
+    /* The same point as EWKB keeps its SRID */
+    ewkb[0] = machine_endian();
+    memcpy(ewkb + 1, &ewkbtype, 4);
+    memcpy(ewkb + 5, &srid, 4);
+    memcpy(ewkb + 9, xy, 16);
+    geom = pc_geometry_from_wkb(ewkb, sizeof(ewkb));
+    CU_ASSERT_EQUAL(geom->srid, 4326);
+    CU_ASSERT(pc_geometry_covers(geom, 15, 15, 1));
+    pc_geometry_free(geom);
+
+    pc_patch_free(pa1);
+    pc_patch_free(pa2);
+    pc_patch_free(pa3);
+    pc_pointlist_free(pl);
+}
+
 /**
 * Test the function which clone a patch keeping only a part of dimensions, numerous print to see what happens
 */
@@ -628,6 +1008,27 @@ test_patch_subset()
 
 }
 
+static void
+test_hilbert_key()
+{
+    /* The curve runs through the quadrants in a U */
+    CU_ASSERT(pc_hilbert_key(-1, -1) < pc_hilbert_key(-1, 1));
+    CU_ASSERT(pc_hilbert_key(-1, 1) < pc_hilbert_key(1, 1));
+    CU_ASSERT(pc_hilbert_key(1, 1) < pc_hilbert_key(1, -1));
+    CU_ASSERT(pc_hilbert_key(0.5, 0.5) != pc_hilbert_key(0.5, 0.25));
+
+    /* Quadrant in the top two bits, the origin opening the third */
+    CU_ASSERT_EQUAL(pc_hilbert_key(-180, -90) >> 62, 0);
+    CU_ASSERT_EQUAL(pc_hilbert_key(-180, 90) >> 62, 1);
+    CU_ASSERT_EQUAL(pc_hilbert_key(180, 90) >> 62, 2);
+    CU_ASSERT_EQUAL(pc_hilbert_key(180, -90) >> 62, 3);
+    CU_ASSERT_EQUAL(pc_hilbert_key(0, 0), UINT64_C(0x8000000000000000));
+
+    /* Points a couple of float steps apart share the top of their key */
+    CU_ASSERT_EQUAL(pc_hilbert_key(0.5, 0.5) >> 32, pc_hilbert_key(0.5000001, 0.5) >> 32);
+    CU_ASSERT(pc_hilbert_key(0.5, 0.5) != pc_hilbert_key(0.5000001, 0.5));
+}
+
 /* REGISTER ***********************************************************/
 
 CU_TestInfo patch_tests[] = {
@@ -638,9 +1039,14 @@ CU_TestInfo patch_tests[] = {
 	PC_TEST(test_patch_dimensional),
 	PC_TEST(test_patch_dimensional_compression),
 	PC_TEST(test_patch_union),
+	PC_TEST(test_patch_builder),
 	PC_TEST(test_patch_wkb),
 	PC_TEST(test_patch_filter),
+	PC_TEST(test_patch_filter_values),
+	PC_TEST(test_patch_filter_predicate),
+	PC_TEST(test_patch_filter_geometry),
 	PC_TEST(test_patch_subset),
+	PC_TEST(test_hilbert_key),
 	CU_TEST_INFO_NULL
 };
 
@@ -124,6 +124,106 @@ test_schema_compression(void)
     CU_ASSERT_EQUAL(compression, PC_DIMENSIONAL);
 }
 
+static void
+test_schema_dimcompression(void)
+{
+	PCSCHEMA *myschema = NULL;
+	const char *xmlstr =
+		"<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
+		"<pc:PointCloudSchema xmlns:pc=\"http://pointcloud.org/schemas/PC/1.1\">"
+		"<pc:dimension><pc:position>1</pc:position><pc:size>4</pc:size>"
+		"<pc:name>X</pc:name><pc:interpretation>int32_t</pc:interpretation></pc:dimension>"
+		"<pc:dimension><pc:position>2</pc:position><pc:size>4</pc:size>"
+		"<pc:name>Y</pc:name><pc:interpretation>int32_t</pc:interpretation></pc:dimension>"
+		"<pc:metadata>"
+		"<Metadata name=\"compression\">dimensional</Metadata>"
+		"<Metadata name=\"dimcompression\">zstd</Metadata>"
+		"<Metadata name=\"dimcompression_level\">19</Metadata>"
+		"</pc:metadata></pc:PointCloudSchema>";
+
+	/* Not asked for, zlib at its usual level */
+	CU_ASSERT_EQUAL(schema->dimcompression, PC_DIM_ZLIB);
+	CU_ASSERT_EQUAL(schema->dimcompression_level, 0);
+
+	CU_ASSERT_EQUAL(pc_schema_from_xml(xmlstr, &myschema), PC_SUCCESS);
+	CU_ASSERT_EQUAL(myschema->compression, PC_DIMENSIONAL);
+#ifdef HAVE_LIBZSTD
+	CU_ASSERT_EQUAL(myschema->dimcompression, PC_DIM_ZSTD);
+#else
+	CU_ASSERT_EQUAL(myschema->dimcompression, PC_DIM_ZLIB);
+#endif
+	CU_ASSERT_EQUAL(myschema->dimcompression_level, 19);
+	pc_schema_free(myschema);
+}
+
+static void
+test_schema_indexdims(void)
+{
+	PCSCHEMA *myschema = NULL;
+	const char *xmlstr =
+		"<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
+		"<pc:PointCloudSchema xmlns:pc=\"http://pointcloud.org/schemas/PC/1.1\">"
+		"<pc:dimension><pc:position>1</pc:position><pc:size>4</pc:size>"
+		"<pc:name>X</pc:name><pc:interpretation>int32_t</pc:interpretation></pc:dimension>"
+		"<pc:dimension><pc:position>2</pc:position><pc:size>4</pc:size>"
+		"<pc:name>Y</pc:name><pc:interpretation>int32_t</pc:interpretation></pc:dimension>"
+		"<pc:dimension><pc:position>3</pc:position><pc:size>4</pc:size>"
+		"<pc:name>Z</pc:name><pc:interpretation>int32_t</pc:interpretation></pc:dimension>"
+		"<pc:dimension><pc:position>4</pc:position><pc:size>2</pc:size>"
+		"<pc:name>Intensity</pc:name><pc:interpretation>uint16_t</pc:interpretation></pc:dimension>"
+		"<pc:dimension><pc:position>5</pc:position><pc:size>8</pc:size>"
+		"<pc:name>GpsTime</pc:name><pc:interpretation>double</pc:interpretation></pc:dimension>"
+		"<pc:metadata>"
+		"<Metadata name=\"indexdims\">GpsTime</Metadata>"
+		"</pc:metadata></pc:PointCloudSchema>";
+
+	/* X, Y and Z by default */
+	CU_ASSERT(pc_schema_get_dimension_by_name(schema, "Z")->indexed);
+	CU_ASSERT(! pc_schema_get_dimension_by_name(schema, "Intensity")->indexed);
+
+	CU_ASSERT_EQUAL(pc_schema_from_xml(xmlstr, &myschema), PC_SUCCESS);
+	CU_ASSERT(myschema->dims[0]->indexed);
+	CU_ASSERT(myschema->dims[1]->indexed);
+	CU_ASSERT(myschema->dims[2]->indexed);
+	CU_ASSERT(! myschema->dims[3]->indexed);
+	CU_ASSERT(myschema->dims[4]->indexed);
+	pc_schema_free(myschema);
+}
+
+static void
+test_schema_binary(void)
+{
+	int i;
+	size_t size;
+	uint8_t *bin = pc_schema_to_binary(schema, &size);
+	PCSCHEMA *myschema = pc_schema_from_binary(bin, size);
+
+	CU_ASSERT(myschema != NULL);
+	CU_ASSERT_EQUAL(myschema->ndims, schema->ndims);
+	CU_ASSERT_EQUAL(myschema->size, schema->size);
+	CU_ASSERT_EQUAL(myschema->x_position, schema->x_position);
+	CU_ASSERT_EQUAL(myschema->y_position, schema->y_position);
+	CU_ASSERT_EQUAL(myschema->compression, schema->compression);
+	CU_ASSERT_EQUAL(myschema->dimcompression, schema->dimcompression);
+	for ( i = 0; i < schema->ndims; i++ )
+	{
+		PCDIMENSION *d = myschema->dims[i];
+		CU_ASSERT_STRING_EQUAL(d->name, schema->dims[i]->name);
+		CU_ASSERT_EQUAL(d->byteoffset, schema->dims[i]->byteoffset);
+		CU_ASSERT_EQUAL(d->interpretation, schema->dims[i]->interpretation);
+		CU_ASSERT_DOUBLE_EQUAL(d->scale, schema->dims[i]->scale, 0.0);
+		CU_ASSERT_EQUAL(d->indexed, schema->dims[i]->indexed);
+		CU_ASSERT(pc_schema_get_dimension_by_name(myschema, d->name) == d);
+	}
+	pc_schema_free(myschema);
+
+	/* Truncated or from another version, no schema */
+	CU_ASSERT(pc_schema_from_binary(bin, size - 1) == NULL);
+	bin[4]++;
+	CU_ASSERT(pc_schema_from_binary(bin, size) == NULL);
+	pcfree(bin);
+}
+
 /* REGISTER ***********************************************************/
 
 CU_TestInfo schema_tests[] = {
@@ -132,6 +232,9 @@ CU_TestInfo schema_tests[] = {
 	PC_TEST(test_dimension_get),
 	PC_TEST(test_dimension_byteoffsets),
 	PC_TEST(test_schema_compression),
+	PC_TEST(test_schema_dimcompression),
+	PC_TEST(test_schema_indexdims),
+	PC_TEST(test_schema_binary),
 	CU_TEST_INFO_NULL
 };
 
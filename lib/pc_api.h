@@ -64,6 +64,22 @@ typedef enum
     PC_BETWEEN
 } PC_FILTERTYPE;
 
+typedef enum
+{
+    PC_PRED_AND,
+    PC_PRED_OR,
+    PC_PRED_RANGE,
+    PC_PRED_IN
+} PC_PREDICATETYPE;
+
+/* What the stats of a patch say of a predicate */
+typedef enum
+{
+    PC_MATCH_NONE,
+    PC_MATCH_SOME,
+    PC_MATCH_ALL
+} PC_MATCHTYPE;
+
 
 
 /**
@@ -81,6 +97,7 @@ typedef struct
 	double scale;
 	double offset;
 	uint8_t active;
+	uint8_t indexed; /* Carried in the N-D index key of patches */
 } PCDIMENSION;
 
 typedef struct
@@ -93,6 +110,8 @@ typedef struct
 	int32_t x_position;  /* What entry is the x coordinate at? */
 	int32_t y_position;  /* What entry is the y coordinate at? */
 	uint32_t compression; /* Compression type applied to the data */
+	uint32_t dimcompression;      /* General purpose codec for dimensional patches */
+	int32_t dimcompression_level; /* Level for that codec, 0 for its default */
 	hashtable *namehash;  /* Look-up from dimension name to pointer */
 } PCSCHEMA;
 
@@ -101,6 +120,8 @@ typedef struct
 {
 	uint32_t total_runs;
 	uint32_t total_commonbits;
+	uint32_t total_deltabits;
+	uint32_t total_xorbits;
 	uint32_t recommended_compression;
 } PCDIMSTAT;
 
@@ -144,6 +165,13 @@ typedef struct
 	uint8_t *bytes;
 } PCBYTES;
 
+/* Working space a codec can grow and reuse between byte arrays */
+typedef struct
+{
+	uint8_t *bytes;
+	size_t size;
+} PCBYTESSCRATCH;
+
 typedef struct
 {
 	double xmin;
@@ -203,6 +231,60 @@ typedef struct
 	uint8_t *ght;
 } PCPATCH_GHT;
 
+/*
+* Patch being built up one column of uncompressed values per dimension.
+* Dimensional patches are held as they are until anything else comes in,
+* and only then decoded into the columns.
+*/
+typedef struct
+{
+	const PCSCHEMA *schema;
+	uint32_t npoints;     /* held or in the columns */
+	uint32_t maxpoints;
+	uint32_t limitpoints; /* columns grow no further than this unless they must, 0 for no limit */
+	uint8_t **dims;
+	PCPATCH **patches;
+	int npatches;
+	int maxpatches;
+} PCPATCHBUILDER;
+
+/**
+* Condition on the points of a patch, parsed from text such as
+* "z > 10 AND (classification IN (2, 9) OR intensity BETWEEN 5 AND 50)".
+* Comparisons are ranges over one dimension, open sides infinite.
+*/
+typedef struct PCPREDICATE_s
+{
+	PC_PREDICATETYPE type;
+	uint32_t dimnum;
+	double min;
+	double max;
+	uint8_t mininc;
+	uint8_t maxinc;
+	uint32_t nvals;
+	double *vals;
+	uint32_t nargs;
+	struct PCPREDICATE_s **args;
+} PCPREDICATE;
+
+/**
+* Linework and polygon rings of a (E)WKB geometry as segments,
+* indexed in horizontal bands for quick point tests. Points
+* are segments of zero length.
+*/
+typedef struct
+{
+	uint32_t nedges;
+	double *edges;       /* x1, y1, x2, y2 of each segment */
+	uint8_t *ring;       /* whether each segment bounds an area */
+	PCBOUNDS bounds;
+	int32_t srid;        /* given by the EWKB, 0 if none */
+	uint32_t nbands;
+	double bandheight;
+	uint32_t *bandstart; /* nbands+1 offsets into bandedges */
+	uint32_t *bandedges;
+} PCGEOMETRY;
+
 
 
 /* Global function signatures for memory/logging handlers. */
@@ -263,6 +345,10 @@ int pc_dimstats_update(PCDIMSTATS *pds, const PCPATCH_DIMENSIONAL *pdl);
 void pc_schema_free(PCSCHEMA *pcs);
 /** Build a schema structure from the XML serialisation */
 int pc_schema_from_xml(const char *xmlstr, PCSCHEMA **schema);
+/** Write the schema in a compact binary form, NULL if it is incomplete */
+uint8_t* pc_schema_to_binary(const PCSCHEMA *s, size_t *size);
+/** Read a schema from its binary form, NULL if the blob is from another version */
+PCSCHEMA* pc_schema_from_binary(const uint8_t *buf, size_t size);
 /** Print out JSON readable format of schema */
 char* pc_schema_to_json(const PCSCHEMA *pcs);
 /** Print a JSOn readable format of a PCDIMENSION */
@@ -303,6 +389,63 @@ void pc_pointlist_add_point(PCPOINTLIST *pl, PCPOINT *pt);
 PCPOINT* pc_pointlist_get_point(const PCPOINTLIST *pl, int i);
 
 
+/**********************************************************************
+* PCPATCHBUILDER
+*/
+
+/** Allocate an empty builder for patches of this schema */
+PCPATCHBUILDER* pc_patch_builder_make(const PCSCHEMA *schema);
+
+/** Free a builder and its columns */
+void pc_patch_builder_free(PCPATCHBUILDER *b);
+
+/** Append the values of a point to the columns */
+int pc_patch_builder_add_point(PCPATCHBUILDER *b, const PCPOINT *pt);
+
+/** Append the points of a patch, holding dimensional ones compressed while only they came in */
+int pc_patch_builder_add_patch(PCPATCHBUILDER *b, const PCPATCH *pa);
+
+/** Append the points of another builder of the same schema, as when combining partial aggregates */
+int pc_patch_builder_merge(PCPATCHBUILDER *b, const PCPATCHBUILDER *other);
+
+/** Copy the values of one dimension of the points so far into out, in point order */
+void pc_patch_builder_copy_dimension(const PCPATCHBUILDER *b, int dim, uint8_t *out);
+
+/** Patch of the points so far with stats and bounds, NULL if none; it may read the builder's columns, so free it first */
+PCPATCH* pc_patch_builder_to_patch(const PCPATCHBUILDER *b);
+
+
+/**********************************************************************
+* PCPREDICATE
+*/
+
+/** Parse a predicate on the dimensions of a schema, NULL on syntax error or unknown dimension */
+PCPREDICATE* pc_predicate_parse(const PCSCHEMA *schema, const char *str);
+
+/** Free a predicate and its arguments */
+void pc_predicate_free(PCPREDICATE *pred);
+
+/** Whether no point, some or all of the points within the stats can match the predicate */
+PC_MATCHTYPE pc_predicate_match_stats(const PCPREDICATE *pred, const PCSTATS *stats);
+
+
+/**********************************************************************
+* PCGEOMETRY
+*/
+
+/** Read the segments of a WKB or EWKB geometry and index them, NULL if it cannot be read */
+PCGEOMETRY* pc_geometry_from_wkb(const uint8_t *wkb, size_t wkbsize);
+
+/** Free a geometry and its index */
+void pc_geometry_free(PCGEOMETRY *geom);
+
+/** Whether a point is within distance of the geometry, or inside one of its polygons */
+int pc_geometry_covers(const PCGEOMETRY *geom, double x, double y, double distance);
+
+/** Whether no point, some or all of the points within the bounds are covered by the geometry */
+PC_MATCHTYPE pc_geometry_match_bounds(const PCGEOMETRY *geom, const PCBOUNDS *bounds, double distance);
+
+
 /**********************************************************************
 * PCPOINT
 */
@@ -390,6 +533,18 @@ char* pc_patch_to_string(const PCPATCH *patch);
 /** Return byte buffer size of serialization */
 size_t pc_patch_dimensional_serialized_size(const PCPATCH_DIMENSIONAL *patch);
 
+/** Split an uncompressed patch into one uncompressed byte array per dimension */
+PCPATCH_DIMENSIONAL* pc_patch_dimensional_from_uncompressed(const PCPATCH_UNCOMPRESSED *pa);
+
+/** Pick the compression of each dimension, updating the #PCDIMSTATS while it is still sampling */
+void pc_patch_dimensional_compressions(const PCPATCH_DIMENSIONAL *pdl, PCDIMSTATS *pds, uint32_t *compressions);
+
+/** Largest size the dimensions of an uncompressed patch can serialize to under the given compressions */
+size_t pc_patch_dimensional_serialized_size_bound(const PCPATCH_DIMENSIONAL *pdl, const uint32_t *compressions);
+
+/** Encode the dimensions of an uncompressed patch straight into their serialized form, returning its size */
+size_t pc_patch_dimensional_serialize_encoded(const PCPATCH_DIMENSIONAL *pdl, const uint32_t *compressions, uint8_t *buf);
+
 /** How big will the serialization be? */
 size_t pc_bytes_serialized_size(const PCBYTES *pcb);
 
@@ -399,6 +554,15 @@ char * pc_bytes_to_string(PCBYTES * a_bytes_dim);
 /** Write the representation down to a buffer */
 int pc_bytes_serialize(const PCBYTES *pcb, uint8_t *buf, size_t *size);
 
+/** How big can the serialization of value bytes encoded with this compression get? */
+size_t pc_bytes_serialized_size_bound(const PCBYTES *pcb, int compression);
+
+/** Encode value bytes straight into their serialized form, returning its size */
+size_t pc_bytes_serialize_encoded(const PCBYTES *pcb, int compression, int level, uint8_t *buf, PCBYTESSCRATCH *scratch);
+
+/** Release the working space held by a scratch */
+void pc_bytes_scratch_free(PCBYTESSCRATCH *scratch);
+
 /** Read a buffer up into a bytes structure */
 int pc_bytes_deserialize(const uint8_t *buf, const PCDIMENSION *dim, PCBYTES *pcb, int readonly, int flip_endian);
 
@@ -429,6 +593,9 @@ int pc_bounds_intersects(const PCBOUNDS *b1, const PCBOUNDS *b2);
 /** Print bounds to json */
 char * pc_bounds_to_string(PCBOUNDS *b);
 
+/** Position of a point along a Hilbert curve, for sorting on locality */
+uint64_t pc_hilbert_key(double x, double y);
+
 /** Subset batch based on less-than condition on dimension */
 PCPATCH* pc_patch_filter_lt_by_name(const PCPATCH *pa, const char *name, double val);
 
@@ -441,6 +608,22 @@ PCPATCH* pc_patch_filter_equal_by_name(const PCPATCH *pa, const char *name, doub
 /** Subset batch based on range condition on dimension */
 PCPATCH* pc_patch_filter_between_by_name(const PCPATCH *pa, const char *name, double val1, double val2);
 
+/**
+* Values of the odims dimensions for the points strictly between fmins[i] and fmaxs[i]
+* on every fdims[i], as nkept rows of nodims doubles. Patches the stats rule out are
+* not decoded. Returns NULL when no point is kept.
+*/
+double* pc_patch_filter_values(const PCPATCH *pa, const uint32_t *fdims, const double *fmins, const double *fmaxs, uint32_t nfilters, const uint32_t *odims, uint32_t nodims, uint32_t *nkept);
+
+/**
+* Subset of the points matching a predicate, found in one pass over the dimensions
+* it names. Each dimension is then copied once; stats and bounds are recomputed.
+*/
+PCPATCH* pc_patch_filter_predicate(const PCPATCH *pa, const PCPREDICATE *pred);
+
+/** Subset of the points inside or within distance of a geometry, decoding only X and Y to find them */
+PCPATCH* pc_patch_filter_geometry(const PCPATCH *pa, const PCGEOMETRY *geom, double distance);
+
 /** Subset of a patch by reducing the number of dimension, the name of dimension to keep are in array, the total number of dimension to keep is also to provide*/
 PCPATCH* pc_patch_reduce_dimension(PCPATCH *pa, char **array, uint32_t num);
 
@@ -81,9 +81,31 @@ enum DIMCOMPRESSIONS
     PC_DIM_NONE = 0,
     PC_DIM_RLE = 1,
     PC_DIM_SIGBITS = 2,
-    PC_DIM_ZLIB = 3
+    PC_DIM_ZLIB = 3,
+    PC_DIM_DELTA = 4,
+    PC_DIM_ZSTD = 5,
+    PC_DIM_LZ4 = 6,
+    PC_DIM_XOR = 7,
+    PC_DIM_VRLE = 8
 };
 
+/**
+* Levels used by the general purpose codecs when the
+* schema does not ask for one (dimcompression_level = 0)
+*/
+#define PC_ZLIB_DEFAULT_LEVEL 9
+#define PC_ZSTD_DEFAULT_LEVEL 3
+#define PC_LZ4_DEFAULT_LEVEL 1
+
+/**
+* Header of the binary schema form. The version is bumped
+* whenever PCSCHEMA or PCDIMENSION change shape, readers
+* also compare the dimension record width, and both tell
+* a stale or foreign blob from a good one.
+*/
+#define PC_SCHEMA_BINARY_MAGIC 0x50435342
+#define PC_SCHEMA_BINARY_VERSION 2
+
 /* PCDOUBLESTAT are members of PCDOUBLESTATS */
 typedef struct
 {
@@ -99,6 +121,25 @@ typedef struct
 	PCDOUBLESTAT *dims;
 } PCDOUBLESTATS;
 
+/* PCBYTESSTAT accumulates the count, extremes and sum of array values */
+typedef struct
+{
+	uint64_t count;
+	double min;
+	double max;
+	double sum;
+} PCBYTESSTAT;
+
+/* PCBYTESSIZES holds the exact encoded size of an array under each bit level codec */
+typedef struct
+{
+	size_t none;
+	size_t vrle;
+	size_t sigbits;
+	size_t delta;
+	size_t xor;
+} PCBYTESSIZES;
+
 
 typedef struct
 {
@@ -141,6 +182,18 @@ double pc_double_from_ptr(const uint8_t *ptr, uint32_t interpretation);
 /** Write value to buffer in the interpretation type */
 int pc_double_to_ptr(uint8_t *ptr, uint32_t interpretation, double val);
 
+/** Values are read and worked on this many at a time by the array functions */
+#define PC_DOUBLE_ARRAY_CHUNK 256
+
+/** Read n values of an interpretation, stride bytes apart, as doubles */
+void pc_double_array_from_ptr(double *vals, const uint8_t *ptr, uint32_t interpretation, size_t stride, uint32_t n);
+
+/** Update n values using the scale/offset info from a dimension */
+void pc_double_array_scale_offset(double *vals, uint32_t n, const PCDIMENSION *dim);
+
+/** Add n values to the min, max and sum of a stat */
+void pc_double_array_stat(const double *vals, uint32_t n, PCDOUBLESTAT *stat);
+
 /** Return number of bytes in a given interpretation */
 size_t pc_interpretation_size(uint32_t interp);
 /**Return a string version of the interpretation value*/
@@ -181,14 +234,16 @@ PCPATCH* pc_patch_filter(const PCPATCH *pa, uint32_t dimnum, PC_FILTERTYPE filte
 char* pc_patch_dimensional_to_string(const PCPATCH_DIMENSIONAL *pa);
 
 
-PCPATCH_DIMENSIONAL* pc_patch_dimensional_from_uncompressed(const PCPATCH_UNCOMPRESSED *pa);
 PCPATCH_DIMENSIONAL* pc_patch_dimensional_compress(const PCPATCH_DIMENSIONAL *pdl, PCDIMSTATS *pds);
 PCPATCH_DIMENSIONAL* pc_patch_dimensional_decompress(const PCPATCH_DIMENSIONAL *pdl);
 void pc_patch_dimensional_free(PCPATCH_DIMENSIONAL *pdl);
 int pc_patch_dimensional_compute_extent(PCPATCH_DIMENSIONAL *pdl);
+int pc_patch_dimensional_compute_stats(PCPATCH_DIMENSIONAL *pdl);
 uint8_t* pc_patch_dimensional_to_wkb(const PCPATCH_DIMENSIONAL *patch, size_t *wkbsize);
 PCPATCH* pc_patch_dimensional_from_wkb(const PCSCHEMA *schema, const uint8_t *wkb, size_t wkbsize);
 PCPATCH_DIMENSIONAL* pc_patch_dimensional_from_pointlist(const PCPOINTLIST *pdl);
+/** Union of dimensional patches, joining their arrays without going through points */
+PCPATCH_DIMENSIONAL* pc_patch_dimensional_from_patchlist(PCPATCH **palist, int numpatches);
 PCPOINTLIST* pc_pointlist_from_dimensional(const PCPATCH_DIMENSIONAL *pdl);
 PCPATCH_DIMENSIONAL* pc_patch_dimensional_clone(const PCPATCH_DIMENSIONAL *patch);
 /**cloning the bytes content of a PCBYTES array but only for a subset of dimension */
@@ -230,21 +285,47 @@ PCBYTES pc_bytes_make(const PCDIMENSION *dim, uint32_t npoints);
 void pc_bytes_free(PCBYTES bytes);
 /** Apply the compresstion to the byte array in place, freeing the original byte buffer */
 PCBYTES pc_bytes_encode(PCBYTES pcb, int compression);
+/** As pc_bytes_encode, passing a level on to the zlib, zstd and lz4 codecs (0 for their default) */
+PCBYTES pc_bytes_encode_level(PCBYTES pcb, int compression, int level);
 /** Convert the bytes in #PCBYTES to PC_DIM_NONE compression */
 PCBYTES pc_bytes_decode(PCBYTES epcb);
+/** Largest size pc_bytes_encode_into can write for this array and compression */
+size_t pc_bytes_encoded_size_bound(const PCBYTES *pcb, int compression);
+/** Encode value bytes into a caller buffer of pc_bytes_encoded_size_bound bytes, returning the encoded size */
+size_t pc_bytes_encode_into(const PCBYTES *pcb, int compression, int level, uint8_t *buf, PCBYTESSCRATCH *scratch);
+/** Decode the bytes into a caller buffer holding npoints values */
+void pc_bytes_decode_into(const PCBYTES *epcb, uint8_t *buf);
 
 /** Convert value bytes to RLE bytes */
 PCBYTES pc_bytes_run_length_encode(const PCBYTES pcb);
-/** Convert RLE bytes to value bytes */
+/** Convert value bytes to RLE bytes with varint run lengths */
+PCBYTES pc_bytes_vrle_encode(const PCBYTES pcb);
+/** Convert RLE or VRLE bytes to value bytes */
 PCBYTES pc_bytes_run_length_decode(const PCBYTES pcb);
 /** Convert value bytes to bit packed bytes */
 PCBYTES pc_bytes_sigbits_encode(const PCBYTES pcb);
 /** Convert bit packed bytes to value bytes */
 PCBYTES pc_bytes_sigbits_decode(const PCBYTES pcb);
 /** Compress bytes using zlib */
-PCBYTES pc_bytes_zlib_encode(const PCBYTES pcb);
+PCBYTES pc_bytes_zlib_encode(const PCBYTES pcb, int level);
 /** De-compress bytes using zlib */
 PCBYTES pc_bytes_zlib_decode(const PCBYTES pcb);
+/** Compress bytes using zstd */
+PCBYTES pc_bytes_zstd_encode(const PCBYTES pcb, int level);
+/** De-compress bytes using zstd */
+PCBYTES pc_bytes_zstd_decode(const PCBYTES pcb);
+/** Compress bytes using lz4, levels above one use the lz4hc compressor */
+PCBYTES pc_bytes_lz4_encode(const PCBYTES pcb, int level);
+/** De-compress bytes using lz4 */
+PCBYTES pc_bytes_lz4_decode(const PCBYTES pcb);
+/** Convert value bytes to first value plus bit packed differences */
+PCBYTES pc_bytes_delta_encode(const PCBYTES pcb);
+/** Convert delta bytes to value bytes */
+PCBYTES pc_bytes_delta_decode(const PCBYTES pcb);
+/** Convert floating point value bytes to a stream of XORs with the previous value */
+PCBYTES pc_bytes_xor_encode(const PCBYTES pcb);
+/** Convert XOR bytes to value bytes */
+PCBYTES pc_bytes_xor_decode(const PCBYTES pcb);
 
 /** How many runs are there in a value array? */
 uint32_t pc_bytes_run_count(const PCBYTES *pcb);
@@ -258,14 +339,61 @@ uint16_t pc_bytes_sigbits_count_16(const PCBYTES *pcb, uint32_t *nsigbits);
 uint32_t pc_bytes_sigbits_count_32(const PCBYTES *pcb, uint32_t *nsigbits);
 /** Using an 64-bit word, what is the common word and number of bits in common? */
 uint64_t pc_bytes_sigbits_count_64(const PCBYTES *pcb, uint32_t *nsigbits);
+/** How many bits per difference does delta encoding need, and at which order? */
+uint32_t pc_bytes_delta_count(const PCBYTES *pcb, int *order);
+/** How many bits does the XOR stream of a 32 or 64 bit array take? */
+uint32_t pc_bytes_xor_count(const PCBYTES *pcb);
+/** Whether a bit level codec is worth trying on values of this interpretation */
+int pc_bytes_compression_eligible(uint32_t interpretation, uint32_t compression);
+/** Exact encoded sizes under each bit level codec, in one pass and without encoding */
+void pc_bytes_sizes(const PCBYTES *pcb, PCBYTESSIZES *sizes);
+/** Smallest bit level codec that beats the general purpose ratio, or fallback */
+uint32_t pc_bytes_choose_compression(const PCBYTES *pcb, uint32_t fallback);
 
 PCBYTES pc_bytes_filter(const PCBYTES *pcb, const PCBITMAP *map, PCDOUBLESTAT *stats);
 
 PCBITMAP* pc_bytes_bitmap(const PCBYTES *pcb, PC_FILTERTYPE filter, double val1, double val2);
 int pc_bytes_minmax(const PCBYTES *pcb, double *min, double *max, double *avg);
+/** Reset a PCBYTESSTAT to hold no values */
+void pc_bytes_stat_init(PCBYTESSTAT *stat);
+/** Add the values of an array into a PCBYTESSTAT, reading runs and sigbits without decoding */
+int pc_bytes_stat(const PCBYTES *pcb, PCBYTESSTAT *stat);
+/** Add one PCBYTESSTAT into another */
+void pc_bytes_stat_merge(PCBYTESSTAT *stat, const PCBYTESSTAT *other);
 
 /** this function clone a PCBYTES for patch_dimensionnal*/
 PCBYTES pc_bytes_clone(PCBYTES bytes);
+/** Join arrays end to end, copying run-length streams as they are and re-encoding the others */
+PCBYTES pc_bytes_concat(const PCBYTES *pcbs, int n, uint32_t fallback, int level);
+
+/****************************************************************************
+* SIGBITS KERNELS
+*/
+
+/** Pack the low nbits of each value, most significant bit first, into 8-bit words */
+void pc_sigbits_pack_8(const uint8_t *in, uint32_t npoints, uint32_t nbits, uint8_t *words);
+/** Pack the low nbits of each value, most significant bit first, into 16-bit words */
+void pc_sigbits_pack_16(const uint16_t *in, uint32_t npoints, uint32_t nbits, uint16_t *words);
+/** Pack the low nbits of each value, most significant bit first, into 32-bit words */
+void pc_sigbits_pack_32(const uint32_t *in, uint32_t npoints, uint32_t nbits, uint32_t *words);
+/** Pack the low nbits of each value, most significant bit first, into 64-bit words */
+void pc_sigbits_pack_64(const uint64_t *in, uint32_t npoints, uint32_t nbits, uint64_t *words);
+/** Unpack nbits-wide values from 8-bit words and add the common value back in */
+void pc_sigbits_unpack_8(const uint8_t *words, size_t nwords, uint32_t nbits, uint8_t commonvalue, uint8_t *out, uint32_t npoints);
+/** Unpack nbits-wide values from 16-bit words and add the common value back in */
+void pc_sigbits_unpack_16(const uint16_t *words, size_t nwords, uint32_t nbits, uint16_t commonvalue, uint16_t *out, uint32_t npoints);
+/** Unpack nbits-wide values from 32-bit words and add the common value back in */
+void pc_sigbits_unpack_32(const uint32_t *words, size_t nwords, uint32_t nbits, uint32_t commonvalue, uint32_t *out, uint32_t npoints);
+/** Unpack nbits-wide values from 64-bit words and add the common value back in */
+void pc_sigbits_unpack_64(const uint64_t *words, size_t nwords, uint32_t nbits, uint64_t commonvalue, uint64_t *out, uint32_t npoints);
+/** Set map[i] for each packed nbits-wide value within [lo, hi], returning how many were set */
+uint32_t pc_sigbits_match(const uint8_t *words, size_t size, size_t nwords, uint32_t nbits, uint64_t lo, uint64_t hi, uint8_t *map, uint32_t npoints);
+/** Minimum, maximum and sum of the packed nbits-wide values */
+void pc_sigbits_stat(const uint8_t *words, size_t size, size_t nwords, uint32_t nbits, uint32_t npoints, uint64_t *min, uint64_t *max, double *sum);
+/** Name of the unpacking kernel in use for this CPU ("scalar" or "avx2") */
+const char* pc_sigbits_kernel_name(void);
+/** Force an unpacking kernel by name, or pick the best one again with "auto" */
+int pc_sigbits_kernel_set(const char *name);
 
 /****************************************************************************
 * BOUNDS
@@ -275,6 +403,8 @@ PCBYTES pc_bytes_clone(PCBYTES bytes);
 void pc_bounds_init(PCBOUNDS *b);
 /** Copy a bounds */
 PCSTATS* pc_stats_clone(const PCSTATS *stats);
+/** Merge the stats of a list of patches, weighting averages by point counts */
+PCSTATS* pc_stats_merge(PCPATCH **palist, int numpatches);
 /** Expand extents of b1 to encompass b2 */
 void pc_bounds_merge(PCBOUNDS *b1, const PCBOUNDS *b2);
 
@@ -293,6 +423,18 @@ extern inline void pc_bitmap_set(PCBITMAP *map, int i, int val);
 extern inline uint8_t pc_bitmap_get(const PCBITMAP *map, int i);
 /** Set indicated bit on bitmap if filter and value are consistent */
 void pc_bitmap_filter(PCBITMAP *map, PC_FILTERTYPE filter, int i, double d, double val1, double val2);
+/** Apply a filter to n values, setting the bitmap entries from start onwards */
+void pc_bitmap_filter_array(PCBITMAP *map, PC_FILTERTYPE filter, uint32_t start, const double *vals, uint32_t n, double val1, double val2);
+
+
+/****************************************************************************
+* PREDICATES
+*/
+
+/** Flag in used[] the dimensions the predicate reads */
+void pc_predicate_dimensions(const PCPREDICATE *pred, uint8_t *used);
+/** Set map[i] for the points matching the predicate, given the scaled values of the dimensions it reads; returns how many match */
+uint32_t pc_predicate_eval(const PCPREDICATE *pred, double **dimvals, uint32_t npoints, uint8_t *map);
 
 
 
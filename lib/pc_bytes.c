@@ -8,9 +8,13 @@
 *  Depending on the character of the data, one of these schemes
 *  will be used:
 *
-*  - run-length encoding
+*  - run-length encoding, with byte or varint run lengths
 *  - significant-bit removal
+*  - delta encoding
+*  - xor encoding, for floating point values
 *  - deflate
+*  - zstandard (when built with libzstd)
+*  - lz4 (when built with liblz4)
 *
 *  PgSQL Pointcloud is free and open source software provided
 *  by the Government of Canada
@@ -21,9 +25,17 @@
 #include <stdarg.h>
 #include <assert.h>
 #include <float.h>
+#include <math.h>
 #include "pc_api_internal.h"
 #include "zlib.h"
 #include "stringbuffer.h"
+#ifdef HAVE_LIBZSTD
+#include "zstd.h"
+#endif
+#ifdef HAVE_LIBLZ4
+#include "lz4.h"
+#include "lz4hc.h"
+#endif
 
 void
 pc_bytes_free(PCBYTES pcb)
@@ -63,8 +75,118 @@ pc_bytes_clone(PCBYTES pcb)
 	return pcbnew;
 }
 
+/**
+* Join n arrays end to end. When they all share an uncompressed or
+* run-length compression their streams are simply copied one after
+* the other. Otherwise they are decoded side by side and the joined
+* values encoded again with the codec that suits them, so sigbits
+* arrays are re-packed on their new common bits.
+*/
+PCBYTES
+pc_bytes_concat(const PCBYTES *pcbs, int n, uint32_t fallback, int level)
+{
+	int i;
+	uint8_t *ptr;
+	int same = PC_TRUE;
+	uint32_t compression;
+	PCBYTES pcb;
+
+	assert(n > 0);
+	pcb.interpretation = pcbs[0].interpretation;
+	pcb.readonly = PC_FALSE;
+	pcb.npoints = 0;
+	pcb.size = 0;
+
+	for ( i = 0; i < n; i++ )
+	{
+		if ( pcbs[i].interpretation != pcb.interpretation )
+			pcerror("%s: cannot join arrays of different types", __func__);
+		if ( pcbs[i].compression != pcbs[0].compression )
+			same = PC_FALSE;
+		pcb.npoints += pcbs[i].npoints;
+		pcb.size += pcbs[i].size;
+	}
+
+	compression = pcbs[0].compression;
+	if ( same && ( compression == PC_DIM_NONE || compression == PC_DIM_RLE || compression == PC_DIM_VRLE ) )
+	{
+		pcb.compression = compression;
+		pcb.bytes = pcalloc(pcb.size ? pcb.size : 1);
+		for ( i = 0, ptr = pcb.bytes; i < n; i++ )
+		{
+			if ( pcbs[i].size )
+				memcpy(ptr, pcbs[i].bytes, pcbs[i].size);
+			ptr += pcbs[i].size;
+		}
+		return pcb;
+	}
+
+	pcb.compression = PC_DIM_NONE;
+	pcb.size = pc_interpretation_size(pcb.interpretation) * pcb.npoints;
+	pcb.bytes = pcalloc(pcb.size ? pcb.size : 1);
+	for ( i = 0, ptr = pcb.bytes; i < n; i++ )
+	{
+		pc_bytes_decode_into(&(pcbs[i]), ptr);
+		ptr += pc_interpretation_size(pcb.interpretation) * pcbs[i].npoints;
+	}
+
+	compression = pc_bytes_choose_compression(&pcb, fallback);
+	if ( compression != PC_DIM_NONE )
+	{
+		PCBYTES epcb = pc_bytes_encode_level(pcb, compression, level);
+		pc_bytes_free(pcb);
+		return epcb;
+	}
+	return pcb;
+}
+
+/**
+* Uncompressed, writable array to decode pcb into.
+*/
+static PCBYTES
+pc_bytes_decoded_make(const PCBYTES *pcb)
+{
+	PCBYTES pcbout = *pcb;
+	pcbout.size = pc_interpretation_size(pcb->interpretation) * pcb->npoints;
+	pcbout.bytes = pcalloc(pcbout.size);
+	pcbout.compression = PC_DIM_NONE;
+	pcbout.readonly = PC_FALSE;
+	return pcbout;
+}
+
+/**
+* Make sure the scratch space holds at least size bytes,
+* growing it only when it is too small.
+*/
+static uint8_t *
+pc_bytes_scratch_reserve(PCBYTESSCRATCH *scratch, size_t size)
+{
+	if ( scratch->size < size )
+	{
+		pcfree(scratch->bytes);
+		scratch->bytes = pcalloc(size);
+		scratch->size = size;
+	}
+	return scratch->bytes;
+}
+
+void
+pc_bytes_scratch_free(PCBYTESSCRATCH *scratch)
+{
+	if ( scratch->bytes )
+		pcfree(scratch->bytes);
+	scratch->bytes = NULL;
+	scratch->size = 0;
+}
+
 PCBYTES
 pc_bytes_encode(PCBYTES pcb, int compression)
+{
+	return pc_bytes_encode_level(pcb, compression, 0);
+}
+
+PCBYTES
+pc_bytes_encode_level(PCBYTES pcb, int compression, int level)
 {
 	PCBYTES epcb;
 	switch ( compression )
@@ -74,6 +196,11 @@ pc_bytes_encode(PCBYTES pcb, int compression)
 		epcb = pc_bytes_run_length_encode(pcb);
 		break;
 	}
+	case PC_DIM_VRLE:
+	{
+		epcb = pc_bytes_vrle_encode(pcb);
+		break;
+	}
 	case PC_DIM_SIGBITS:
 	{
 		epcb = pc_bytes_sigbits_encode(pcb);
@@ -81,7 +208,27 @@ pc_bytes_encode(PCBYTES pcb, int compression)
 	}
 	case PC_DIM_ZLIB:
 	{
-		epcb = pc_bytes_zlib_encode(pcb);
+		epcb = pc_bytes_zlib_encode(pcb, level);
+		break;
+	}
+	case PC_DIM_ZSTD:
+	{
+		epcb = pc_bytes_zstd_encode(pcb, level);
+		break;
+	}
+	case PC_DIM_LZ4:
+	{
+		epcb = pc_bytes_lz4_encode(pcb, level);
+		break;
+	}
+	case PC_DIM_DELTA:
+	{
+		epcb = pc_bytes_delta_encode(pcb);
+		break;
+	}
+	case PC_DIM_XOR:
+	{
+		epcb = pc_bytes_xor_encode(pcb);
 		break;
 	}
 	case PC_DIM_NONE:
@@ -104,6 +251,7 @@ pc_bytes_decode(PCBYTES epcb)
 	switch ( epcb.compression )
 	{
 	case PC_DIM_RLE:
+	case PC_DIM_VRLE:
 	{
 		pcb = pc_bytes_run_length_decode(epcb);
 		break;
@@ -118,6 +266,26 @@ pc_bytes_decode(PCBYTES epcb)
 		pcb = pc_bytes_zlib_decode(epcb);
 		break;
 	}
+	case PC_DIM_ZSTD:
+	{
+		pcb = pc_bytes_zstd_decode(epcb);
+		break;
+	}
+	case PC_DIM_LZ4:
+	{
+		pcb = pc_bytes_lz4_decode(epcb);
+		break;
+	}
+	case PC_DIM_DELTA:
+	{
+		pcb = pc_bytes_delta_decode(epcb);
+		break;
+	}
+	case PC_DIM_XOR:
+	{
+		pcb = pc_bytes_xor_decode(epcb);
+		break;
+	}
 	case PC_DIM_NONE:
 	{
 		pcb = pc_bytes_clone(epcb);
@@ -159,107 +327,161 @@ pc_bytes_run_count(const PCBYTES *pcb)
 }
 
 /**
-* Take the uncompressed bytes and run-length encode (RLE) them.
-* Structure of RLE array as:
-* <uint8> number of elements
-* <val> value
-* ...
+* Run lengths are a single byte for RLE, capped at 255,
+* and a little endian base-128 varint for VRLE, so a
+* constant dimension is one run whatever its length.
 */
-PCBYTES
-pc_bytes_run_length_encode(const PCBYTES pcb)
+static inline uint8_t *
+pc_bytes_run_length_put(uint8_t *ptr, uint32_t count, uint32_t compression)
+{
+	if ( compression == PC_DIM_RLE )
+	{
+		*ptr = (uint8_t)count;
+		return ptr + 1;
+	}
+	while ( count >= 0x80 )
+	{
+		*(ptr++) = (uint8_t)(count | 0x80);
+		count >>= 7;
+	}
+	*(ptr++) = (uint8_t)count;
+	return ptr;
+}
+
+/** Read the run length at ptr and step past it */
+static inline uint32_t
+pc_bytes_run_length_get(const uint8_t **ptr, const uint8_t *end, uint32_t compression)
+{
+	const uint8_t *p = *ptr;
+	uint32_t count = 0;
+	int shift = 0;
+
+	if ( compression == PC_DIM_RLE )
+	{
+		*ptr = p + 1;
+		return *p;
+	}
+	do
+	{
+		if ( p >= end || shift > 28 )
+			pcerror("%s: invalid varint run length", __func__);
+		count |= (uint32_t)(*p & 0x7F) << shift;
+		shift += 7;
+	}
+	while ( *(p++) & 0x80 );
+	*ptr = p;
+	return count;
+}
+
+/**
+* Write the run-length encoding of pcb into buf and return its size.
+* With a NULL buf nothing is written and only the size is counted.
+*/
+static size_t
+pc_bytes_run_length_encode_into(const PCBYTES *pcb, uint32_t compression, uint8_t *buf)
 {
 	int i;
-	uint8_t *buf, *bufptr;
+	uint8_t countbuf[5];
+	uint8_t *bufptr = buf;
 	const uint8_t *bytesptr;
 	const uint8_t *runstart;
-	uint8_t *bytes_rle;
-	size_t size = pc_interpretation_size(pcb.interpretation);
-	uint8_t runlength = 1;
-	PCBYTES pcbout = pcb;
-
-	/* Allocate more size than we need (worst case: n elements, n runs) */
-	buf = pcalloc(pcb.npoints*size + sizeof(uint8_t)*pcb.npoints);
-	bufptr = buf;
+	size_t size = pc_interpretation_size(pcb->interpretation);
+	size_t size_out = 0;
+	uint32_t maxrun = compression == PC_DIM_RLE ? 255 : UINT32_MAX;
+	uint32_t runlength = 1;
 
 	/* First run starts at the start! */
-	runstart = pcb.bytes;
+	runstart = pcb->bytes;
 
-	for ( i = 1; i <= pcb.npoints; i++ )
+	for ( i = 1; i <= pcb->npoints; i++ )
 	{
-		bytesptr = pcb.bytes + i*size;
+		bytesptr = pcb->bytes + i*size;
 		/* Run continues... */
-		if ( i < pcb.npoints && runlength < 255 && memcmp(runstart, bytesptr, size) == 0  )
+		if ( i < pcb->npoints && runlength < maxrun && memcmp(runstart, bytesptr, size) == 0  )
 		{
 			runlength++;
+			continue;
 		}
-		else
+		/* Write # elements in the run, then the element value */
+		if ( buf )
 		{
-			/* Write # elements in the run */
-			*bufptr = runlength;
-			bufptr += 1;
-			/* Write element value */
+			bufptr = pc_bytes_run_length_put(bufptr, runlength, compression);
 			memcpy(bufptr, runstart, size);
 			bufptr += size;
-			/* Advance read head */
-			runstart = bytesptr;
-			runlength = 1;
 		}
+		else
+		{
+			size_out += (pc_bytes_run_length_put(countbuf, runlength, compression) - countbuf) + size;
+		}
+		/* Advance read head */
+		runstart = bytesptr;
+		runlength = 1;
 	}
-	/* Length of buffer */
-	pcbout.size = (bufptr - buf);
-	/* Write out shortest buffer possible */
-	bytes_rle = pcalloc(pcbout.size);
-	memcpy(bytes_rle, buf, pcbout.size);
-	pcfree(buf);
-	/* We're going to replace the current buffer */
-	pcbout.bytes = bytes_rle;
-	pcbout.compression = PC_DIM_RLE;
+	return buf ? (size_t)(bufptr - buf) : size_out;
+}
+
+static PCBYTES
+pc_bytes_run_length_encode_as(const PCBYTES pcb, uint32_t compression)
+{
+	PCBYTES pcbout = pcb;
+
+	/* Size the output exactly, then fill it */
+	pcbout.size = pc_bytes_run_length_encode_into(&pcb, compression, NULL);
+	pcbout.bytes = pcalloc(pcbout.size);
+	pc_bytes_run_length_encode_into(&pcb, compression, pcbout.bytes);
+	pcbout.compression = compression;
 	pcbout.readonly = PC_FALSE;
 	return pcbout;
 }
 
 /**
-* Take the compressed bytes and run-length dencode (RLE) them.
-* Structure of RLE array is:
+* Take the uncompressed bytes and run-length encode (RLE) them.
+* Structure of RLE array as:
 * <uint8> number of elements
 * <val> value
 * ...
 */
 PCBYTES
-pc_bytes_run_length_decode(const PCBYTES pcb)
+pc_bytes_run_length_encode(const PCBYTES pcb)
 {
-	int i, n;
-	uint8_t *bytes;
-	uint8_t *bytes_ptr;
-	const uint8_t *bytes_rle_ptr = pcb.bytes;
-	const uint8_t *bytes_rle_end = pcb.bytes + pcb.size;
-
-	size_t size = pc_interpretation_size(pcb.interpretation);
-	size_t size_out;
-	uint8_t runlength;
-	uint32_t npoints = 0;
-	PCBYTES pcbout = pcb;
+	return pc_bytes_run_length_encode_as(pcb, PC_DIM_RLE);
+}
 
-	assert(pcb.compression == PC_DIM_RLE);
+/**
+* Run-length encode with varint counts (VRLE).
+* Structure of VRLE array as:
+* <varint> number of elements
+* <val> value
+* ...
+*/
+PCBYTES
+pc_bytes_vrle_encode(const PCBYTES pcb)
+{
+	return pc_bytes_run_length_encode_as(pcb, PC_DIM_VRLE);
+}
 
-	/* Count up how big our output is. */
-	while( bytes_rle_ptr < bytes_rle_end )
-	{
-		npoints += *bytes_rle_ptr;
-		bytes_rle_ptr += 1 + size;
-	}
+/**
+* Expand the RLE or VRLE bytes into the npoints values of bytes,
+* checking the runs neither overflow nor underfill it.
+*/
+static void
+pc_bytes_run_length_decode_into(const PCBYTES *pcb, uint8_t *bytes)
+{
+	uint32_t i, n;
+	uint32_t npoints = 0;
+	uint8_t *bytes_ptr = bytes;
+	const uint8_t *bytes_rle_ptr = pcb->bytes;
+	const uint8_t *bytes_rle_end = pcb->bytes + pcb->size;
+	size_t size = pc_interpretation_size(pcb->interpretation);
 
-	assert(npoints == pcb.npoints);
+	assert(pcb->compression == PC_DIM_RLE || pcb->compression == PC_DIM_VRLE);
 
-	/* Alocate output and fill it up */
-	size_out = size * npoints;
-	bytes = pcalloc(size_out);
-	bytes_ptr = bytes;
-	bytes_rle_ptr = pcb.bytes;
 	while ( bytes_rle_ptr < bytes_rle_end )
 	{
-		n = *bytes_rle_ptr;
-		bytes_rle_ptr += 1;
+		n = pc_bytes_run_length_get(&bytes_rle_ptr, bytes_rle_end, pcb->compression);
+		if ( n > pcb->npoints - npoints || bytes_rle_ptr + size > bytes_rle_end )
+			break;
+		npoints += n;
 		for ( i = 0; i < n; i++ )
 		{
 			memcpy(bytes_ptr, bytes_rle_ptr, size);
@@ -267,28 +489,38 @@ pc_bytes_run_length_decode(const PCBYTES pcb)
 		}
 		bytes_rle_ptr += size;
 	}
-	pcbout.compression = PC_DIM_NONE;
-	pcbout.size = size_out;
-	pcbout.bytes = bytes;
-	pcbout.readonly = PC_FALSE;
-	return pcbout;
+
+	if ( npoints != pcb->npoints || bytes_rle_ptr != bytes_rle_end )
+		pcerror("%s: run lengths do not add up to %u points", __func__, pcb->npoints);
 }
 
+/**
+* Take the RLE or VRLE bytes and turn them back into
+* uncompressed values.
+*/
+PCBYTES
+pc_bytes_run_length_decode(const PCBYTES pcb)
+{
+	PCBYTES pcbout = pc_bytes_decoded_make(&pcb);
+	pc_bytes_run_length_decode_into(&pcb, pcbout.bytes);
+	return pcbout;
+}
 
 /**
 * RLE bytes consist of a <byte:count><word:value><byte:count><word:value> pattern
-* so we can hope from word to word and flip each one in place.
+* so we can hope from word to word and flip each one in place. VRLE counts are
+* byte sequences, they just vary in length.
 */
 static PCBYTES
 pc_bytes_run_length_flip_endian(PCBYTES pcb)
 {
 	int i, n;
-	uint8_t *bytes_ptr = pcb.bytes;
-	uint8_t *end_ptr = pcb.bytes + pcb.size;
+	uint8_t *bytes_ptr;
+	uint8_t *end_ptr;
 	uint8_t tmp;
 	size_t size = pc_interpretation_size(pcb.interpretation);
 
-	assert(pcb.compression == PC_DIM_RLE);
+	assert(pcb.compression == PC_DIM_RLE || pcb.compression == PC_DIM_VRLE);
 	assert(pcb.npoints > 0);
 
 	/* If the type isn't multibyte, it doesn't need flipping */
@@ -304,11 +536,14 @@ pc_bytes_run_length_flip_endian(PCBYTES pcb)
 		pcb.readonly = PC_FALSE;
 	}
 
-	bytes_ptr++; /* Advance past count */
+	bytes_ptr = pcb.bytes;
+	end_ptr = pcb.bytes + pcb.size;
 
 	/* Visit each entry and flip the word, skip the count */
 	while( bytes_ptr < end_ptr )
 	{
+		/* Advance past count */
+		pc_bytes_run_length_get((const uint8_t**)&bytes_ptr, end_ptr, pcb.compression);
 
 		/* Swap the bytes in a way that makes sense for this word size */
 		for ( n = 0; n < size/2; n++ )
@@ -320,8 +555,6 @@ pc_bytes_run_length_flip_endian(PCBYTES pcb)
 
 		/* Move past this word */
 		bytes_ptr += size;
-		/* Advance past next count */
-		bytes_ptr++;
 	}
 
 	return pcb;
@@ -404,7 +637,8 @@ pc_bytes_sigbits_count_32(const PCBYTES *pcb, uint32_t *nsigbits)
 		elem_or >>= 1;
 		commonbits -= 1;
 	}
-	elem_and <<= nbits - commonbits;
+	/* No common bits at all would be a shift by the full width */
+	elem_and = commonbits ? elem_and << (nbits - commonbits) : 0;
 	if ( nsigbits ) *nsigbits = commonbits;
 	return elem_and;
 }
@@ -431,7 +665,8 @@ pc_bytes_sigbits_count_64(const PCBYTES *pcb, uint32_t *nsigbits)
 		elem_or >>= 1;
 		commonbits -= 1;
 	}
-	elem_and <<= nbits - commonbits;
+	/* No common bits at all would be a shift by the full width */
+	elem_and = commonbits ? elem_and << (nbits - commonbits) : 0;
 	if ( nsigbits ) *nsigbits = commonbits;
 	return elem_and;
 }
@@ -476,95 +711,55 @@ pc_bytes_sigbits_count(const PCBYTES *pcb)
 }
 
 
+/**
+* Size of a sigbits array of npoints values with nbits unique
+* bits each: two header words, then the packed bits padded out
+* to whole words.
+*/
+static size_t
+pc_bytes_sigbits_size(size_t size, uint32_t nbits, uint32_t npoints)
+{
+	size_t size_out_raw = (uint64_t)nbits * npoints / 8;
+	switch ( size )
+	{
+	case 1:
+		return size_out_raw + 3;
+	case 2:
+		size_out_raw += 5;
+		return size_out_raw + (size_out_raw % 2);
+	case 4:
+		size_out_raw += 9;
+		return size_out_raw + (4 - (size_out_raw % 4));
+	default:
+		size_out_raw += 17;
+		return size_out_raw + (8 - (size_out_raw % 8));
+	}
+}
+
 /**
 * Encoded array:
 * <uint8> number of bits per unique section
 * <uint8> common bits for the array
 * [n_bits]... unique bits packed in
-* Size of encoded array comes out in ebytes_size.
+* Written to bytes_out, size of encoded array is returned.
 */
-PCBYTES
-pc_bytes_sigbits_encode_8(const PCBYTES pcb, uint8_t commonvalue, uint8_t commonbits)
+static size_t
+pc_bytes_sigbits_encode_8(const PCBYTES *pcb, uint8_t commonvalue, uint8_t commonbits, uint8_t *bytes_out)
 {
-	int i;
-	int shift;
-	uint8_t *bytes = (uint8_t*)(pcb.bytes);
 	/* How wide are our words? */
 	static int bitwidth = 8;
 	/* How wide are our unique values? */
 	int nbits = bitwidth - commonbits;
-	/* Size of output buffer (#bits/8+1remainder+2metadata) */
-	size_t size_out = (nbits * pcb.npoints / 8) + 3;
-	uint8_t *bytes_out = pcalloc(size_out);
-	/* Use this to zero out the parts that are common */
-	uint8_t mask = (0xFF >> commonbits);
-	/* Write head */
-	uint8_t *byte_ptr = bytes_out;
-	/* What bit are we writing to now? */
-	int bit = bitwidth;
-	/* Write to... */
-	PCBYTES pcbout = pcb;
 
 	/* Number of unique bits goes up front */
-	*byte_ptr = nbits;
-	byte_ptr++;
+	bytes_out[0] = nbits;
 	/* The common value we'll add the unique values to */
-	*byte_ptr = commonvalue;
-	byte_ptr++;
+	bytes_out[1] = commonvalue;
+	/* Unique parts packed in behind, nothing to do if all values are the same */
+	pc_sigbits_pack_8(pcb->bytes, pcb->npoints, nbits, bytes_out + 2);
 
-	/* All the values are the same... */
-	if ( bitwidth == commonbits )
-	{
-		pcbout.size = size_out;
-		pcbout.bytes = bytes_out;
-		pcbout.compression = PC_DIM_SIGBITS;
-		return pcbout;
-	}
-
-	for ( i = 0; i < pcb.npoints; i++ )
-	{
-		uint8_t val = bytes[i];
-		/* Clear off common parts */
-		val &= mask;
-		/* How far to move unique parts to get to write head? */
-		shift = bit - nbits;
-		/* If positive, we can fit this part into the current word */
-		if ( shift >= 0 )
-		{
-			val <<= shift;
-			*byte_ptr |= val;
-			bit -= nbits;
-			if ( bit <= 0 )
-			{
-				bit = bitwidth;
-				byte_ptr++;
-			}
-		}
-		/* If negative, then we need to split this part across words */
-		else
-		{
-			/* First the bit into the current word */
-			uint8_t v = val;
-			int s = abs(shift);
-			v >>= s;
-			*byte_ptr |= v;
-			/* The reset to write the next word */
-			bit = bitwidth;
-			byte_ptr++;
-			v = val;
-			shift = bit - s;
-			/* But only those parts we didn't already write */
-			v <<= shift;
-			*byte_ptr |= v;
-			bit -= s;
-		}
-	}
-
-	pcbout.size = size_out;
-	pcbout.bytes = bytes_out;
-	pcbout.compression = PC_DIM_SIGBITS;
-	pcbout.readonly = PC_FALSE;
-	return pcbout;
+	/* Size of output buffer (#bits/8+1remainder+2metadata) */
+	return pc_bytes_sigbits_size(1, nbits, pcb->npoints);
 }
 
 /**
@@ -572,93 +767,29 @@ pc_bytes_sigbits_encode_8(const PCBYTES pcb, uint8_t commonvalue, uint8_t common
 * <uint16> number of bits per unique section
 * <uint16> common bits for the array
 * [n_bits]... unique bits packed in
-* Size of encoded array comes out in ebytes_size.
+* Written to bytes_out, size of encoded array is returned.
 */
-PCBYTES
-pc_bytes_sigbits_encode_16(const PCBYTES pcb, uint16_t commonvalue, uint8_t commonbits)
+static size_t
+pc_bytes_sigbits_encode_16(const PCBYTES *pcb, uint16_t commonvalue, uint8_t commonbits, uint8_t *bytes_out)
 {
-	int i;
-	int shift;
-	uint16_t *bytes = (uint16_t*)(pcb.bytes);
-
 	/* How wide are our words? */
 	static int bitwidth = 16;
 	/* How wide are our unique values? */
 	int nbits = bitwidth - commonbits;
-	/* Size of output buffer (#bits/8+1remainder+4metadata)  */
-	size_t size_out_raw = (nbits * pcb.npoints / 8) + 5;
-	/* Make sure buffer is size to hold all our words */
-	size_t size_out = size_out_raw + (size_out_raw % 2);
-	uint8_t *bytes_out = pcalloc(size_out);
-	/* Use this to zero out the parts that are common */
-	uint16_t mask = (0xFFFF >> commonbits);
-	/* Write head */
-	uint16_t *byte_ptr = (uint16_t*)(bytes_out);
-	/* What bit are we writing to now? */
-	int bit = bitwidth;
-	/* Write to... */
-	PCBYTES pcbout = pcb;
+	uint16_t *words_out = (uint16_t*)bytes_out;
+	uint16_t header[2];
 
 	/* Number of unique bits goes up front */
-	*byte_ptr = nbits;
-	byte_ptr++;
+	header[0] = nbits;
 	/* The common value we'll add the unique values to */
-	*byte_ptr = commonvalue;
-	byte_ptr++;
-
-	/* All the values are the same... */
-	if ( bitwidth == commonbits )
-	{
-		pcbout.size = size_out;
-		pcbout.bytes = bytes_out;
-		pcbout.compression = PC_DIM_SIGBITS;
-		return pcbout;
-	}
-
-	for ( i = 0; i < pcb.npoints; i++ )
-	{
-		uint16_t val = bytes[i];
-		/* Clear off common parts */
-		val &= mask;
-		/* How far to move unique parts to get to write head? */
-		shift = bit - nbits;
-		/* If positive, we can fit this part into the current word */
-		if ( shift >= 0 )
-		{
-			val <<= shift;
-			*byte_ptr |= val;
-			bit -= nbits;
-			if ( bit <= 0 )
-			{
-				bit = bitwidth;
-				byte_ptr++;
-			}
-		}
-		/* If negative, then we need to split this part across words */
-		else
-		{
-			/* First the bit into the current word */
-			uint16_t v = val;
-			int s = abs(shift);
-			v >>= s;
-			*byte_ptr |= v;
-			/* The reset to write the next word */
-			bit = bitwidth;
-			byte_ptr++;
-			v = val;
-			shift = bit - s;
-			/* But only those parts we didn't already write */
-			v <<= shift;
-			*byte_ptr |= v;
-			bit -= s;
-		}
-	}
-
-	pcbout.size = size_out;
-	pcbout.bytes = bytes_out;
-	pcbout.compression = PC_DIM_SIGBITS;
-	pcbout.readonly = PC_FALSE;
-	return pcbout;
+	header[1] = commonvalue;
+	/* bytes_out need not be aligned for the words */
+	memcpy(bytes_out, header, sizeof(header));
+	/* Unique parts packed in behind, nothing to do if all values are the same */
+	pc_sigbits_pack_16((uint16_t*)(pcb->bytes), pcb->npoints, nbits, words_out + 2);
+
+	/* Size of output buffer (#bits/8+1remainder+4metadata), in whole words */
+	return pc_bytes_sigbits_size(2, nbits, pcb->npoints);
 }
 
 /**
@@ -666,131 +797,143 @@ pc_bytes_sigbits_encode_16(const PCBYTES pcb, uint16_t commonvalue, uint8_t comm
 * <uint32> number of bits per unique section
 * <uint32> common bits for the array
 * [n_bits]... unique bits packed in
-* Size of encoded array comes out in ebytes_size.
+* Written to bytes_out, size of encoded array is returned.
 */
-PCBYTES
-pc_bytes_sigbits_encode_32(const PCBYTES pcb, uint32_t commonvalue, uint8_t commonbits)
+static size_t
+pc_bytes_sigbits_encode_32(const PCBYTES *pcb, uint32_t commonvalue, uint8_t commonbits, uint8_t *bytes_out)
 {
-	int i;
-	int shift;
-	uint32_t *bytes = (uint32_t*)(pcb.bytes);
-
 	/* How wide are our words? */
 	static int bitwidth = 32;
 	/* How wide are our unique values? */
 	int nbits = bitwidth - commonbits;
-	/* Size of output buffer (#bits/8+1remainder+8metadata) */
-	size_t size_out_raw = (nbits * pcb.npoints / 8) + 9;
-	size_t size_out = size_out_raw + (4 - (size_out_raw % 4));
-	uint8_t *bytes_out = pcalloc(size_out);
-	/* Use this to zero out the parts that are common */
-	uint32_t mask = (0xFFFFFFFF >> commonbits);
-	/* Write head */
-	uint32_t *byte_ptr = (uint32_t*)bytes_out;
-	/* What bit are we writing to now? */
-	int bit = bitwidth;
-	/* Write to... */
-	PCBYTES pcbout = pcb;
+	uint32_t *words_out = (uint32_t*)bytes_out;
+	uint32_t header[2];
 
 	/* Number of unique bits goes up front */
-	*byte_ptr = nbits;
-	byte_ptr++;
+	header[0] = nbits;
 	/* The common value we'll add the unique values to */
-	*byte_ptr = commonvalue;
-	byte_ptr++;
-
-	/* All the values are the same... */
-	if ( bitwidth == commonbits )
-	{
-		pcbout.size = size_out;
-		pcbout.bytes = bytes_out;
-		pcbout.compression = PC_DIM_SIGBITS;
-		return pcbout;
-	}
+	header[1] = commonvalue;
+	/* bytes_out need not be aligned for the words */
+	memcpy(bytes_out, header, sizeof(header));
+	/* Unique parts packed in behind, nothing to do if all values are the same */
+	pc_sigbits_pack_32((uint32_t*)(pcb->bytes), pcb->npoints, nbits, words_out + 2);
+
+	/* Size of output buffer (#bits/8+1remainder+8metadata), in whole words */
+	return pc_bytes_sigbits_size(4, nbits, pcb->npoints);
+}
 
-	for ( i = 0; i < pcb.npoints; i++ )
-	{
-		uint32_t val = bytes[i];
-		/* Clear off common parts */
-		val &= mask;
-		/* How far to move unique parts to get to write head? */
-		shift = bit - nbits;
-		/* If positive, we can fit this part into the current word */
-		if ( shift >= 0 )
-		{
-			val <<= shift;
-			*byte_ptr |= val;
-			bit -= nbits;
-			if ( bit <= 0 )
-			{
-				bit = bitwidth;
-				byte_ptr++;
-			}
-		}
-		/* If negative, then we need to split this part across words */
-		else
-		{
-			/* First the bit into the current word */
-			uint32_t v = val;
-			int s = abs(shift);
-			v >>= s;
-			*byte_ptr |= v;
-			/* The reset to write the next word */
-			bit = bitwidth;
-			byte_ptr++;
-			v = val;
-			shift = bit - s;
-			/* But only those parts we didn't already write */
-			v <<= shift;
-			*byte_ptr |= v;
-			bit -= s;
-		}
-	}
+/**
+* Encoded array:
+* <uint64> number of bits per unique section
+* <uint64> common bits for the array
+* [n_bits]... unique bits packed in
+* Written to bytes_out, size of encoded array is returned.
+*/
+static size_t
+pc_bytes_sigbits_encode_64(const PCBYTES *pcb, uint64_t commonvalue, uint8_t commonbits, uint8_t *bytes_out)
+{
+	/* How wide are our words? */
+	static int bitwidth = 64;
+	/* How wide are our unique values? */
+	int nbits = bitwidth - commonbits;
+	uint64_t *words_out = (uint64_t*)bytes_out;
+	uint64_t header[2];
 
-	pcbout.size = size_out;
-	pcbout.bytes = bytes_out;
-	pcbout.compression = PC_DIM_SIGBITS;
-	pcbout.readonly = PC_FALSE;
-	return pcbout;
+	/* Number of unique bits goes up front */
+	header[0] = nbits;
+	/* The common value we'll add the unique values to */
+	header[1] = commonvalue;
+	/* bytes_out need not be aligned for the words */
+	memcpy(bytes_out, header, sizeof(header));
+	/* Unique parts packed in behind, nothing to do if all values are the same */
+	pc_sigbits_pack_64((uint64_t*)(pcb->bytes), pcb->npoints, nbits, words_out + 2);
+
+	/* Size of output buffer (#bits/8+1remainder+16metadata), in whole words */
+	return pc_bytes_sigbits_size(8, nbits, pcb->npoints);
 }
 
 /**
-* Convert a raw byte array into with common bits stripped and the
-* remaining bits packed in.
-* <uint8|uint16|uint32> number of bits per unique section
-* <uint8|uint16|uint32> common bits for the array
-* [n_bits]... unique bits packed in
-* Size of encoded array comes out in ebytes_size.
+* Common value and number of common bits of the array,
+* whatever its word size.
 */
-PCBYTES
-pc_bytes_sigbits_encode(const PCBYTES pcb)
+static uint64_t
+pc_bytes_sigbits_common(const PCBYTES *pcb, uint32_t *commonbits)
 {
-	size_t size = pc_interpretation_size(pcb.interpretation);
-	uint32_t nbits;
+	size_t size = pc_interpretation_size(pcb->interpretation);
 	switch ( size )
 	{
 	case 1:
-	{
-		uint8_t commonvalue = pc_bytes_sigbits_count_8(&pcb, &nbits);
-		return pc_bytes_sigbits_encode_8(pcb, commonvalue, nbits);
-	}
+		return pc_bytes_sigbits_count_8(pcb, commonbits);
 	case 2:
-	{
-		uint16_t commonvalue = pc_bytes_sigbits_count_16(&pcb, &nbits);
-		return pc_bytes_sigbits_encode_16(pcb, commonvalue, nbits);
-	}
+		return pc_bytes_sigbits_count_16(pcb, commonbits);
 	case 4:
-	{
-		uint32_t commonvalue = pc_bytes_sigbits_count_32(&pcb, &nbits);
-		return pc_bytes_sigbits_encode_32(pcb, commonvalue, nbits);
-	}
+		return pc_bytes_sigbits_count_32(pcb, commonbits);
+	case 8:
+		return pc_bytes_sigbits_count_64(pcb, commonbits);
 	default:
-	{
-		pcerror("%s: bits_encode cannot handle interpretation %d", __func__, pcb.interpretation);
+		pcerror("%s: bits_encode cannot handle interpretation %d", __func__, pcb->interpretation);
 	}
+	return 0;
+}
+
+/**
+* Write the sigbits encoding into bytes_out, which must hold
+* pc_bytes_sigbits_size() bytes for the number of unique bits,
+* and return its size. Padding after the packed bits is zeroed.
+*/
+static size_t
+pc_bytes_sigbits_encode_into(const PCBYTES *pcb, uint64_t commonvalue, uint32_t commonbits, uint8_t *bytes_out)
+{
+	size_t size = pc_interpretation_size(pcb->interpretation);
+	uint32_t wordbits = 8 * size;
+	uint64_t nbits = wordbits - commonbits;
+	size_t packed = 2 * size + size * ((nbits * pcb->npoints + wordbits - 1) / wordbits);
+	size_t size_out;
+
+	switch ( size )
+	{
+	case 1:
+		size_out = pc_bytes_sigbits_encode_8(pcb, commonvalue, commonbits, bytes_out);
+		break;
+	case 2:
+		size_out = pc_bytes_sigbits_encode_16(pcb, commonvalue, commonbits, bytes_out);
+		break;
+	case 4:
+		size_out = pc_bytes_sigbits_encode_32(pcb, commonvalue, commonbits, bytes_out);
+		break;
+	case 8:
+		size_out = pc_bytes_sigbits_encode_64(pcb, commonvalue, commonbits, bytes_out);
+		break;
+	default:
+		pcerror("%s: bits_encode cannot handle interpretation %d", __func__, pcb->interpretation);
+		return 0;
 	}
-	pcerror("Uh Oh");
-	return pcb;
+	if ( size_out > packed )
+		memset(bytes_out + packed, 0, size_out - packed);
+	return size_out;
+}
+
+/**
+* Convert a raw byte array into with common bits stripped and the
+* remaining bits packed in.
+* <uint8|uint16|uint32|uint64> number of bits per unique section
+* <uint8|uint16|uint32|uint64> common bits for the array
+* [n_bits]... unique bits packed in
+*/
+PCBYTES
+pc_bytes_sigbits_encode(const PCBYTES pcb)
+{
+	size_t size = pc_interpretation_size(pcb.interpretation);
+	uint32_t commonbits;
+	uint64_t commonvalue = pc_bytes_sigbits_common(&pcb, &commonbits);
+	PCBYTES pcbout = pcb;
+
+	pcbout.size = pc_bytes_sigbits_size(size, 8*size - commonbits, pcb.npoints);
+	pcbout.bytes = pcalloc(pcbout.size);
+	pc_bytes_sigbits_encode_into(&pcb, commonvalue, commonbits, pcbout.bytes);
+	pcbout.compression = PC_DIM_SIGBITS;
+	pcbout.readonly = PC_FALSE;
+	return pcbout;
 }
 
 static PCBYTES
@@ -824,311 +967,1225 @@ pc_bytes_sigbits_flip_endian(const PCBYTES pcb)
 }
 
 
-PCBYTES
-pc_bytes_sigbits_decode_8(const PCBYTES pcb)
+static void
+pc_bytes_sigbits_decode_8(const PCBYTES *pcb, uint8_t *outbytes)
 {
-	int i;
-	const uint8_t *bytes_ptr = (const uint8_t*)(pcb.bytes);
+	const uint8_t *bytes_ptr = (const uint8_t*)(pcb->bytes);
 	uint8_t nbits;
 	uint8_t commonvalue;
-	uint8_t mask;
-	int bit = 8;
-	size_t outbytes_size = sizeof(uint8_t) * pcb.npoints;
-	uint8_t *outbytes = pcalloc(outbytes_size);
-	uint8_t *obytes = (uint8_t*)outbytes;
-	PCBYTES pcbout = pcb;
+	/* Packed words following the two metadata words */
+	size_t nwords = pcb->size > 2 ? pcb->size - 2 : 0;
 
 	/* How many unique bits? */
-	nbits = *bytes_ptr;
-	bytes_ptr++;
+	nbits = bytes_ptr[0];
 	/* What is the shared bit value? */
-	commonvalue = *bytes_ptr;
-	bytes_ptr++;
-	/* Mask for just the unique parts */
-	mask = (0xFF >> (bit-nbits));
+	commonvalue = bytes_ptr[1];
+	if ( nbits > 8 )
+		pcerror("%s: invalid unique bit count %d", __func__, nbits);
 
-	for ( i = 0; i < pcb.npoints; i++ )
-	{
-		int shift = bit - nbits;
-		uint8_t val = *bytes_ptr;
-		/* The unique part is all in this word */
-		if ( shift >= 0 )
-		{
-			/* Push unique part to bottom of word */
-			val >>= shift;
-			/* Mask out any excess */
-			val &= mask;
-			/* Add in the common part */
-			val |= commonvalue;
-			/* Save */
-			obytes[i] = val;
-			/* Move read head */
-			bit -= nbits;
-		}
-		/* The unique part is split over this word and the next */
-		else
-		{
-			int s = abs(shift);
-			val <<= s;
-			val &= mask;
-			val |= commonvalue;
-			obytes[i] = val;
-			bytes_ptr++;
-			bit = 8;
-			val = *bytes_ptr;
-			shift = bit - s;
-			val >>= shift;
-			val &= mask;
-			obytes[i] |= val;
-			bit -= s;
-		}
-	}
-	pcbout.size = outbytes_size;
-	pcbout.compression = PC_DIM_SIGBITS;
-	pcbout.bytes = outbytes;
-	pcbout.readonly = PC_FALSE;
-	return pcbout;
+	pc_sigbits_unpack_8(bytes_ptr + 2, nwords, nbits, commonvalue, outbytes, pcb->npoints);
 }
 
-PCBYTES
-pc_bytes_sigbits_decode_16(const PCBYTES pcb)
+static void
+pc_bytes_sigbits_decode_16(const PCBYTES *pcb, uint8_t *outbytes)
 {
-	int i;
-	const uint16_t *bytes_ptr = (const uint16_t *)(pcb.bytes);
+	const uint16_t *bytes_ptr = (const uint16_t *)(pcb->bytes);
 	uint16_t nbits;
 	uint16_t commonvalue;
-	uint16_t mask;
-	int bit = 16;
-	size_t outbytes_size = sizeof(uint16_t) * pcb.npoints;
-	uint8_t *outbytes = pcalloc(outbytes_size);
-	uint16_t *obytes = (uint16_t*)outbytes;
-	PCBYTES pcbout = pcb;
+	size_t nwords = pcb->size > 4 ? (pcb->size - 4) / 2 : 0;
 
 	/* How many unique bits? */
-	nbits = *bytes_ptr;
-	bytes_ptr++;
+	nbits = bytes_ptr[0];
 	/* What is the shared bit value? */
-	commonvalue = *bytes_ptr;
-	bytes_ptr++;
-	/* Calculate mask */
-	mask = (0xFFFF >> (bit-nbits));
+	commonvalue = bytes_ptr[1];
+	if ( nbits > 16 )
+		pcerror("%s: invalid unique bit count %d", __func__, nbits);
 
-	for ( i = 0; i < pcb.npoints; i++ )
-	{
-		int shift = bit - nbits;
-		uint16_t val = *bytes_ptr;
-		if ( shift >= 0 )
-		{
-			val >>= shift;
-			val &= mask;
-			val |= commonvalue;
-			obytes[i] = val;
-			bit -= nbits;
-		}
-		else
-		{
-			int s = abs(shift);
-			val <<= s;
-			val &= mask;
-			val |= commonvalue;
-			obytes[i] = val;
-			bytes_ptr++;
-			bit = 16;
-			val = *bytes_ptr;
-			shift = bit - s;
-			val >>= shift;
-			val &= mask;
-			obytes[i] |= val;
-			bit -= s;
-		}
-	}
-	pcbout.size = outbytes_size;
-	pcbout.compression = PC_DIM_SIGBITS;
-	pcbout.bytes = outbytes;
-	pcbout.readonly = PC_FALSE;
-	return pcbout;
+	pc_sigbits_unpack_16(bytes_ptr + 2, nwords, nbits, commonvalue, (uint16_t*)outbytes, pcb->npoints);
 }
 
-PCBYTES
-pc_bytes_sigbits_decode_32(const PCBYTES pcb)
+static void
+pc_bytes_sigbits_decode_32(const PCBYTES *pcb, uint8_t *outbytes)
 {
-	int i;
-	const uint32_t *bytes_ptr = (const uint32_t *)(pcb.bytes);
+	const uint32_t *bytes_ptr = (const uint32_t *)(pcb->bytes);
 	uint32_t nbits;
 	uint32_t commonvalue;
-	uint32_t mask;
-	int bit = 32;
-	size_t outbytes_size = sizeof(uint32_t) * pcb.npoints;
-	uint8_t *outbytes = pcalloc(outbytes_size);
-	uint32_t *obytes = (uint32_t*)outbytes;
-	PCBYTES pcbout = pcb;
+	size_t nwords = pcb->size > 8 ? (pcb->size - 8) / 4 : 0;
 
 	/* How many unique bits? */
-	nbits = *bytes_ptr;
-	bytes_ptr++;
+	nbits = bytes_ptr[0];
 	/* What is the shared bit value? */
-	commonvalue = *bytes_ptr;
-	bytes_ptr++;
-	/* Calculate mask */
-	mask = (0xFFFFFFFF >> (bit-nbits));
+	commonvalue = bytes_ptr[1];
+	if ( nbits > 32 )
+		pcerror("%s: invalid unique bit count %d", __func__, nbits);
 
-	for ( i = 0; i < pcb.npoints; i++ )
-	{
-		int shift = bit - nbits;
-		uint32_t val = *bytes_ptr;
-		if ( shift >= 0 )
-		{
-			val >>= shift;
-			val &= mask;
-			val |= commonvalue;
-			obytes[i] = val;
-			bit -= nbits;
-		}
-		else
-		{
-			int s = abs(shift);
-			val <<= s;
-			val &= mask;
-			val |= commonvalue;
-			obytes[i] = val;
-			bytes_ptr++;
-			bit = 32;
-			val = *bytes_ptr;
-			shift = bit - s;
-			val >>= shift;
-			val &= mask;
-			bit -= s;
-			obytes[i] |= val;
-		}
-	}
+	pc_sigbits_unpack_32(bytes_ptr + 2, nwords, nbits, commonvalue, (uint32_t*)outbytes, pcb->npoints);
+}
 
-	pcbout.size = outbytes_size;
-	pcbout.compression = PC_DIM_SIGBITS;
-	pcbout.bytes = outbytes;
-	pcbout.readonly = PC_FALSE;
-	return pcbout;
+static void
+pc_bytes_sigbits_decode_64(const PCBYTES *pcb, uint8_t *outbytes)
+{
+	const uint64_t *bytes_ptr = (const uint64_t *)(pcb->bytes);
+	uint64_t nbits;
+	uint64_t commonvalue;
+	size_t nwords = pcb->size > 16 ? (pcb->size - 16) / 8 : 0;
+
+	/* How many unique bits? */
+	nbits = bytes_ptr[0];
+	/* What is the shared bit value? */
+	commonvalue = bytes_ptr[1];
+	if ( nbits > 64 )
+		pcerror("%s: invalid unique bit count %llu", __func__, (unsigned long long)nbits);
+
+	pc_sigbits_unpack_64(bytes_ptr + 2, nwords, nbits, commonvalue, (uint64_t*)outbytes, pcb->npoints);
 }
 
+/** Unpack the values of a sigbits array into outbytes */
+static void
+pc_bytes_sigbits_decode_into(const PCBYTES *pcb, uint8_t *outbytes)
+{
+	size_t size = pc_interpretation_size(pcb->interpretation);
+	switch ( size )
+	{
+	case 1:
+		pc_bytes_sigbits_decode_8(pcb, outbytes);
+		break;
+	case 2:
+		pc_bytes_sigbits_decode_16(pcb, outbytes);
+		break;
+	case 4:
+		pc_bytes_sigbits_decode_32(pcb, outbytes);
+		break;
+	case 8:
+		pc_bytes_sigbits_decode_64(pcb, outbytes);
+		break;
+	default:
+		pcerror("%s: cannot handle interpretation %d", __func__, pcb->interpretation);
+	}
+}
 
 PCBYTES
 pc_bytes_sigbits_decode(const PCBYTES pcb)
 {
-	size_t size = pc_interpretation_size(pcb.interpretation);
+	PCBYTES pcbout = pc_bytes_decoded_make(&pcb);
+	pc_bytes_sigbits_decode_into(&pcb, pcbout.bytes);
+	return pcbout;
+}
+
+/**
+* Read a word of the given size as an unsigned 64-bit value.
+*/
+static inline uint64_t
+pc_bytes_word_get(const uint8_t *ptr, size_t size)
+{
 	switch ( size )
 	{
 	case 1:
+		return *ptr;
+	case 2:
 	{
-		return pc_bytes_sigbits_decode_8(pcb);
+		uint16_t v;
+		memcpy(&v, ptr, 2);
+		return v;
 	}
+	case 4:
+	{
+		uint32_t v;
+		memcpy(&v, ptr, 4);
+		return v;
+	}
+	default:
+	{
+		uint64_t v;
+		memcpy(&v, ptr, 8);
+		return v;
+	}
+	}
+}
+
+/**
+* Write the low bytes of a 64-bit value as a word of the given size.
+*/
+static inline void
+pc_bytes_word_set(uint8_t *ptr, size_t size, uint64_t val)
+{
+	switch ( size )
+	{
+	case 1:
+		*ptr = (uint8_t)val;
+		return;
 	case 2:
 	{
-		return pc_bytes_sigbits_decode_16(pcb);
+		uint16_t v = (uint16_t)val;
+		memcpy(ptr, &v, 2);
+		return;
 	}
 	case 4:
 	{
-		return pc_bytes_sigbits_decode_32(pcb);
+		uint32_t v = (uint32_t)val;
+		memcpy(ptr, &v, 4);
+		return;
 	}
 	default:
+		memcpy(ptr, &val, 8);
+		return;
+	}
+}
+
+/**
+* Reverse the bytes of a word in place.
+*/
+static inline void
+pc_bytes_word_flip(uint8_t *ptr, size_t size)
+{
+	size_t n;
+	uint8_t tmp;
+	for ( n = 0; n < size / 2; n++ )
 	{
-		pcerror("%s: cannot handle interpretation %d", __func__, pcb.interpretation);
+		tmp = ptr[n];
+		ptr[n] = ptr[size-n-1];
+		ptr[size-n-1] = tmp;
 	}
+}
+
+/**
+* Unsigned interpretation with the same word size, used for
+* the residual arrays handed to the sigbits encoder.
+*/
+static uint32_t
+pc_bytes_unsigned_interpretation(size_t size)
+{
+	switch ( size )
+	{
+	case 1:
+		return PC_UINT8;
+	case 2:
+		return PC_UINT16;
+	case 4:
+		return PC_UINT32;
+	case 8:
+		return PC_UINT64;
+	default:
+		pcerror("%s: cannot handle word size %d", __func__, (int)size);
 	}
-	pcerror("%s: got an unhandled errror", __func__);
-	return pcb;
+	return PC_UNKNOWN;
 }
 
-static voidpf
-pc_zlib_alloc(voidpf opaque, uInt nitems, uInt sz)
+/**
+* Map a difference, taken modulo the word size, onto an unsigned
+* code so that small negative steps get small codes too.
+*/
+static inline uint64_t
+pc_bytes_zigzag_encode(uint64_t delta, size_t size)
 {
-	return pcalloc(sz*nitems);
+	int shift = 64 - 8 * size;
+	int64_t s = (int64_t)(delta << shift) >> shift;
+	return (((uint64_t)s << 1) ^ (uint64_t)(s >> 63)) & (0xFFFFFFFFFFFFFFFFULL >> shift);
 }
 
-static void
-pc_zlib_free(voidpf opaque, voidpf ptr)
+static inline uint64_t
+pc_bytes_zigzag_decode(uint64_t code)
 {
-	pcfree(ptr);
+	return (code >> 1) ^ (0 - (code & 1));
+}
+
+/**
+* How many unique bits would the zigzagged residuals need after
+* differencing once (order 1) or twice (order 2)?
+*/
+static uint32_t
+pc_bytes_delta_bits(const PCBYTES *pcb, int order)
+{
+	uint32_t i;
+	size_t size = pc_interpretation_size(pcb->interpretation);
+	uint64_t elem_and = 0xFFFFFFFFFFFFFFFFULL;
+	uint64_t elem_or = 0;
+	uint64_t diff;
+	uint64_t prev, delta, prevdelta = 0;
+	uint32_t nbits = 0;
+
+	if ( pcb->npoints <= order )
+		return 0;
+
+	prev = pc_bytes_word_get(pcb->bytes, size);
+	for ( i = 1; i < pcb->npoints; i++ )
+	{
+		uint64_t val = pc_bytes_word_get(pcb->bytes + i*size, size);
+		delta = val - prev;
+		if ( i >= order )
+		{
+			uint64_t code = pc_bytes_zigzag_encode(order == 1 ? delta : delta - prevdelta, size);
+			elem_and &= code;
+			elem_or |= code;
+		}
+		prevdelta = delta;
+		prev = val;
+	}
+
+	/* Unique bits run up to the highest bit that is not shared */
+	diff = elem_and ^ elem_or;
+	while ( diff )
+	{
+		diff >>= 1;
+		nbits++;
+	}
+	return nbits;
 }
 
+/**
+* How many unique bits per residual does the better of the two
+* differencing orders need? The order is returned in *order.
+*/
+uint32_t
+pc_bytes_delta_count(const PCBYTES *pcb, int *order)
+{
+	uint32_t bits1 = pc_bytes_delta_bits(pcb, 1);
+	uint32_t bits2 = pc_bytes_delta_bits(pcb, 2);
 
-/* TO DO look for Z_STREAM_END on the write */
+	/* Second differences cost an extra header word, only use them when they pay */
+	if ( bits2 < bits1 )
+	{
+		if ( order ) *order = 2;
+		return bits2;
+	}
+	if ( order ) *order = 1;
+	return bits1;
+}
 
 /**
-* Returns compressed byte array with
-* <size_t> size of compressed portion
-* <size_t> size of original data
-* <.....> compresssed bytes
+* Write the delta encoding of pcb into bytes_out, using scratch
+* to hold the residuals, and return its size.
+*/
+static size_t
+pc_bytes_delta_encode_into(const PCBYTES *pcb, uint8_t *bytes_out, PCBYTESSCRATCH *scratch)
+{
+	uint32_t i;
+	int order;
+	size_t size = pc_interpretation_size(pcb->interpretation);
+	uint32_t nresiduals;
+	size_t header_size;
+	size_t residuals_size = 0;
+	uint64_t prev, delta, prevdelta = 0;
+	PCBYTES rpcb;
+
+	pc_bytes_delta_count(pcb, &order);
+	header_size = (1 + order) * size;
+	nresiduals = pcb->npoints > order ? pcb->npoints - order : 0;
+
+	pc_bytes_word_set(bytes_out, size, order);
+	if ( pcb->npoints > 0 )
+		memcpy(bytes_out + size, pcb->bytes, size);
+	if ( order == 2 )
+	{
+		delta = pc_bytes_word_get(pcb->bytes + size, size) - pc_bytes_word_get(pcb->bytes, size);
+		pc_bytes_word_set(bytes_out + 2*size, size, delta);
+	}
+
+	if ( nresiduals )
+	{
+		uint32_t commonbits;
+		uint64_t commonvalue;
+
+		/* Differences, zigzagged, go into the scratch array for sigbits */
+		rpcb.size = nresiduals * size;
+		rpcb.npoints = nresiduals;
+		rpcb.interpretation = pc_bytes_unsigned_interpretation(size);
+		rpcb.compression = PC_DIM_NONE;
+		rpcb.readonly = PC_TRUE;
+		rpcb.bytes = pc_bytes_scratch_reserve(scratch, rpcb.size);
+
+		prev = pc_bytes_word_get(pcb->bytes, size);
+		for ( i = 1; i < pcb->npoints; i++ )
+		{
+			uint64_t val = pc_bytes_word_get(pcb->bytes + i*size, size);
+			delta = val - prev;
+			if ( i >= order )
+			{
+				uint64_t code = pc_bytes_zigzag_encode(order == 1 ? delta : delta - prevdelta, size);
+				pc_bytes_word_set(rpcb.bytes + (i - order)*size, size, code);
+			}
+			prevdelta = delta;
+			prev = val;
+		}
+		commonvalue = pc_bytes_sigbits_common(&rpcb, &commonbits);
+		residuals_size = pc_bytes_sigbits_encode_into(&rpcb, commonvalue, commonbits, bytes_out + header_size);
+	}
+	return header_size + residuals_size;
+}
+
+/**
+* Encoded array:
+* <word> differencing order, 1 (delta) or 2 (delta of delta)
+* <word> first value
+* <word> first delta, only for order 2
+* [sigbits] zigzagged residuals for the remaining points
+* All words are the size of the interpretation.
 */
 PCBYTES
-pc_bytes_zlib_encode(const PCBYTES pcb)
+pc_bytes_delta_encode(const PCBYTES pcb)
 {
-	z_stream strm;
-	int ret;
-	size_t have;
-	size_t bufsize = 4*pcb.size;
-	uint8_t *buf = pcalloc(bufsize);
+	int order;
+	size_t size = pc_interpretation_size(pcb.interpretation);
+	uint32_t nbits = pc_bytes_delta_count(&pcb, &order);
+	uint32_t nresiduals = pcb.npoints > order ? pcb.npoints - order : 0;
+	PCBYTESSCRATCH scratch = {NULL, 0};
 	PCBYTES pcbout = pcb;
 
-	/* Use our own allocators */
-	strm.zalloc = pc_zlib_alloc;
-	strm.zfree = pc_zlib_free;
-	strm.opaque = Z_NULL;
-	ret = deflateInit(&strm, 9);
-	/* Set up input buffer */
-	strm.avail_in = pcb.size;
-	strm.next_in = pcb.bytes;
-	/* Set up output buffer */
-	strm.avail_out = bufsize;
-	strm.next_out = buf;
-	/* Compress */
-	ret = deflate(&strm, Z_FINISH);
-	assert(ret != Z_STREAM_ERROR);
-	have = strm.total_out;
-	pcbout.size = have;
+	/* The residuals need exactly as many unique bits as counted */
+	pcbout.size = (1 + order) * size;
+	if ( nresiduals )
+		pcbout.size += pc_bytes_sigbits_size(size, nbits, nresiduals);
 	pcbout.bytes = pcalloc(pcbout.size);
-	pcbout.compression = PC_DIM_ZLIB;
+	pc_bytes_delta_encode_into(&pcb, pcbout.bytes, &scratch);
+	pc_bytes_scratch_free(&scratch);
+	pcbout.compression = PC_DIM_DELTA;
 	pcbout.readonly = PC_FALSE;
-	memcpy(pcbout.bytes, buf, have);
-	pcfree(buf);
-	deflateEnd(&strm);
 	return pcbout;
 }
 
 /**
-* Returns uncompressed byte array from input with
-* <size_t> size of compressed portion
-* <size_t> size of original data
-* <.....> compresssed bytes
+* The residuals are unpacked straight into the tail of outbytes,
+* each one landing on the point it belongs to, and are then
+* integrated forward in place.
 */
+static void
+pc_bytes_delta_decode_into(const PCBYTES *pcb, uint8_t *outbytes)
+{
+	uint32_t i;
+	size_t size = pc_interpretation_size(pcb->interpretation);
+	uint64_t order = pc_bytes_word_get(pcb->bytes, size);
+	size_t header_size = (1 + order) * size;
+	uint32_t nresiduals;
+	uint64_t val, delta = 0;
+
+	if ( order != 1 && order != 2 )
+		pcerror("%s: invalid differencing order %d", __func__, (int)order);
+
+	nresiduals = pcb->npoints > order ? pcb->npoints - order : 0;
+	if ( nresiduals )
+	{
+		PCBYTES rpcb;
+		rpcb.bytes = pcb->bytes + header_size;
+		rpcb.size = pcb->size - header_size;
+		rpcb.npoints = nresiduals;
+		rpcb.interpretation = pc_bytes_unsigned_interpretation(size);
+		rpcb.compression = PC_DIM_SIGBITS;
+		rpcb.readonly = PC_TRUE;
+		pc_bytes_sigbits_decode_into(&rpcb, outbytes + order*size);
+	}
+
+	if ( pcb->npoints > 0 )
+	{
+		val = pc_bytes_word_get(pcb->bytes + size, size);
+		memcpy(outbytes, pcb->bytes + size, size);
+		if ( order == 2 )
+			delta = pc_bytes_word_get(pcb->bytes + 2*size, size);
+		for ( i = 1; i < pcb->npoints; i++ )
+		{
+			if ( order == 1 )
+				delta = pc_bytes_zigzag_decode(pc_bytes_word_get(outbytes + i*size, size));
+			else if ( i >= 2 )
+				delta += pc_bytes_zigzag_decode(pc_bytes_word_get(outbytes + i*size, size));
+			val += delta;
+			pc_bytes_word_set(outbytes + i*size, size, val);
+		}
+	}
+}
+
 PCBYTES
-pc_bytes_zlib_decode(const PCBYTES pcb)
+pc_bytes_delta_decode(const PCBYTES pcb)
 {
-	z_stream strm;
-	int ret;
-	PCBYTES pcbout = pcb;
+	PCBYTES pcbout = pc_bytes_decoded_make(&pcb);
+	pc_bytes_delta_decode_into(&pcb, pcbout.bytes);
+	return pcbout;
+}
+
+/**
+* The header words need flipping, and so do the sigbits
+* header words of the residuals that follow them.
+*/
+static PCBYTES
+pc_bytes_delta_flip_endian(const PCBYTES pcb)
+{
+	uint64_t order;
+	size_t header_size;
+	size_t size = pc_interpretation_size(pcb.interpretation);
 
-	pcbout.size = pc_interpretation_size(pcb.interpretation) * pcb.npoints;
+	if ( size < 2 )
+		return pcb;
 
-	/* Set up output memory */
-	pcbout.bytes = pcalloc(pcbout.size);
-	pcbout.readonly = PC_FALSE;
+	/* Order word first, so we know how many header words follow */
+	pc_bytes_word_flip(pcb.bytes, size);
+	order = pc_bytes_word_get(pcb.bytes, size);
+	if ( order != 1 && order != 2 )
+		pcerror("%s: invalid differencing order %d", __func__, (int)order);
+	header_size = (1 + order) * size;
+	pc_bytes_word_flip(pcb.bytes + size, size);
+	if ( order == 2 )
+		pc_bytes_word_flip(pcb.bytes + 2*size, size);
 
-	/* Use our own allocators */
-	strm.zalloc = pc_zlib_alloc;
-	strm.zfree = pc_zlib_free;
-	strm.opaque = Z_NULL;
-	ret = inflateInit(&strm);
-	/* Set up input buffer */
-	strm.avail_in = pcb.size;
-	strm.next_in = pcb.bytes;
+	if ( pcb.size > header_size )
+	{
+		PCBYTES rpcb = pcb;
+		rpcb.bytes = pcb.bytes + header_size;
+		rpcb.size = pcb.size - header_size;
+		pc_bytes_sigbits_flip_endian(rpcb);
+	}
+	return pcb;
+}
+
+/**
+* XOR encoding of floating point values, after the Gorilla
+* time series codec. Neighbouring values tend to share sign,
+* exponent and the top of the mantissa, so the XOR of a value
+* with the previous one is mostly zero bits. The stream is a
+* first word holding the first value, then each XOR as one of
+*
+*   0                    value repeats
+*   10 <bits>            meaningful bits fit in the previous window
+*   11 <lead> <len-1> <bits>   a new window of len bits, lead zeros before it
+*
+* A window wider than a new one would cost is dropped, so one
+* outlier does not bloat every value after it. The lead and length
+* fields are 5 bits wide for 32-bit words, 6 bits for 64-bit
+* words. Bits are packed most significant first into bytes.
+*/
+typedef struct
+{
+	uint8_t *ptr;
+	uint64_t acc;
+	int nacc;
+	size_t nbits;
+} PCBITWRITER;
+
+typedef struct
+{
+	const uint8_t *ptr;
+	const uint8_t *end;
+	uint64_t buf;
+	int nbits;
+} PCBITREADER;
+
+/* Append up to 32 bits, only counting them when there is no buffer */
+static inline void
+pc_bitwriter_put(PCBITWRITER *w, uint64_t val, int n)
+{
+	w->nbits += n;
+	if ( ! w->ptr )
+		return;
+	w->acc = (w->acc << n) | val;
+	w->nacc += n;
+	while ( w->nacc >= 8 )
+	{
+		w->nacc -= 8;
+		*(w->ptr++) = (uint8_t)(w->acc >> w->nacc);
+	}
+}
+
+static inline void
+pc_bitwriter_put_long(PCBITWRITER *w, uint64_t val, int n)
+{
+	if ( n > 32 )
+	{
+		pc_bitwriter_put(w, val >> 32, n - 32);
+		n = 32;
+	}
+	pc_bitwriter_put(w, val & 0xFFFFFFFFULL, n);
+}
+
+static inline void
+pc_bitwriter_flush(PCBITWRITER *w)
+{
+	if ( w->ptr && w->nacc )
+		*(w->ptr++) = (uint8_t)(w->acc << (8 - w->nacc));
+	w->nacc = 0;
+}
+
+/* Read up to 32 bits, failing on a stream that runs out */
+static inline uint64_t
+pc_bitreader_get(PCBITREADER *r, int n)
+{
+	uint64_t val;
+	if ( r->nbits < n )
+	{
+		while ( r->nbits <= 56 && r->ptr < r->end )
+		{
+			r->buf |= (uint64_t)(*(r->ptr++)) << (56 - r->nbits);
+			r->nbits += 8;
+		}
+		if ( r->nbits < n )
+			pcerror("%s: truncated xor stream", __func__);
+	}
+	val = r->buf >> (64 - n);
+	r->buf <<= n;
+	r->nbits -= n;
+	return val;
+}
+
+static inline uint64_t
+pc_bitreader_get_long(PCBITREADER *r, int n)
+{
+	uint64_t val = 0;
+	if ( n > 32 )
+	{
+		val = pc_bitreader_get(r, n - 32) << 32;
+		n = 32;
+	}
+	return val | pc_bitreader_get(r, n);
+}
+
+/* Width in bits of the lead and length fields for a word size */
+static inline int
+pc_bytes_xor_field_bits(size_t size)
+{
+	return size == 8 ? 6 : 5;
+}
+
+/**
+* Encoder state between values, the current window
+*/
+typedef struct
+{
+	int wordbits;
+	int fieldbits;
+	int wlead;
+	int wtrail;
+} PCXORSTATE;
+
+static inline void
+pc_bytes_xor_start(PCXORSTATE *st, size_t size)
+{
+	st->wordbits = 8 * size;
+	st->fieldbits = pc_bytes_xor_field_bits(size);
+	/* No window yet, nothing fits in it */
+	st->wlead = st->wordbits + 1;
+	st->wtrail = 0;
+}
+
+/* Write the code for one XOR with the previous value */
+static inline void
+pc_bytes_xor_step(PCXORSTATE *st, PCBITWRITER *w, uint64_t x)
+{
+	int lead, trail;
+	int wordbits = st->wordbits;
+
+	if ( ! x )
+	{
+		pc_bitwriter_put(w, 0, 1);
+		return;
+	}
+
+	lead = __builtin_clzll(x) - (64 - wordbits);
+	trail = __builtin_ctzll(x);
+	/* Reuse the window while it fits and is not much wider than a new one */
+	if ( lead >= st->wlead && trail >= st->wtrail &&
+	     wordbits - st->wlead - st->wtrail <= wordbits - lead - trail + 2*st->fieldbits )
+	{
+		pc_bitwriter_put(w, 2, 2);
+		pc_bitwriter_put_long(w, x >> st->wtrail, wordbits - st->wlead - st->wtrail);
+	}
+	else
+	{
+		int len = wordbits - lead - trail;
+		pc_bitwriter_put(w, 3, 2);
+		pc_bitwriter_put(w, lead, st->fieldbits);
+		pc_bitwriter_put(w, len - 1, st->fieldbits);
+		pc_bitwriter_put_long(w, x >> trail, len);
+		st->wlead = lead;
+		st->wtrail = trail;
+	}
+}
+
+/**
+* Runs the XOR encoder over the values, writing the
+* bit stream when the writer has a buffer
+*/
+static void
+pc_bytes_xor_pack(const PCBYTES *pcb, PCBITWRITER *w)
+{
+	int i;
+	size_t size = pc_interpretation_size(pcb->interpretation);
+	PCXORSTATE st;
+	uint64_t prev = pc_bytes_word_get(pcb->bytes, size);
+
+	pc_bytes_xor_start(&st, size);
+	for ( i = 1; i < pcb->npoints; i++ )
+	{
+		uint64_t val = pc_bytes_word_get(pcb->bytes + i*size, size);
+		pc_bytes_xor_step(&st, w, val ^ prev);
+		prev = val;
+	}
+	pc_bitwriter_flush(w);
+}
+
+static void
+pc_bytes_xor_check(const PCBYTES *pcb)
+{
+	size_t size = pc_interpretation_size(pcb->interpretation);
+	if ( size != 4 && size != 8 )
+		pcerror("%s: xor encoding needs 32 or 64 bit words, got %d bytes", __func__, (int)size);
+}
+
+/**
+* How many bits does the XOR stream of this array take?
+*/
+uint32_t
+pc_bytes_xor_count(const PCBYTES *pcb)
+{
+	PCBITWRITER w = { NULL, 0, 0, 0 };
+	size_t size = pc_interpretation_size(pcb->interpretation);
+
+	if ( pcb->npoints < 2 || (size != 4 && size != 8) )
+		return 0;
+
+	pc_bytes_xor_pack(pcb, &w);
+	return w.nbits;
+}
+
+/**
+* Write the XOR encoding of pcb into bytes_out in a single pass
+* and return its size.
+*/
+static size_t
+pc_bytes_xor_encode_into(const PCBYTES *pcb, uint8_t *bytes_out)
+{
+	size_t size = pc_interpretation_size(pcb->interpretation);
+	PCBITWRITER w = { NULL, 0, 0, 0 };
+
+	pc_bytes_xor_check(pcb);
+	if ( ! pcb->npoints )
+		return 0;
+
+	memcpy(bytes_out, pcb->bytes, size);
+	w.ptr = bytes_out + size;
+	pc_bytes_xor_pack(pcb, &w);
+	return size + (w.nbits + 7) / 8;
+}
+
+/**
+* Returns an XOR encoded byte array of
+* <word> first value
+* <bits> xor stream of the other values
+*/
+PCBYTES
+pc_bytes_xor_encode(const PCBYTES pcb)
+{
+	PCBYTES epcb = pcb;
+	size_t size = pc_interpretation_size(pcb.interpretation);
+
+	pc_bytes_xor_check(&pcb);
+
+	epcb.compression = PC_DIM_XOR;
+	epcb.readonly = PC_FALSE;
+	if ( ! pcb.npoints )
+	{
+		epcb.size = 0;
+		epcb.bytes = NULL;
+		return epcb;
+	}
+
+	/* Size first, then fill */
+	epcb.size = size + (pc_bytes_xor_count(&pcb) + 7) / 8;
+	epcb.bytes = pcalloc(epcb.size);
+	pc_bytes_xor_encode_into(&pcb, epcb.bytes);
+	return epcb;
+}
+
+/**
+* Convert an XOR encoded array back to value bytes in outbytes
+*/
+static void
+pc_bytes_xor_decode_into(const PCBYTES *pcb, uint8_t *outbytes)
+{
+	int i;
+	PCBITREADER r;
+	size_t size = pc_interpretation_size(pcb->interpretation);
+	int wordbits = 8 * size;
+	int fieldbits = pc_bytes_xor_field_bits(size);
+	int wlead = 0, wlen = 0;
+	uint64_t val;
+
+	pc_bytes_xor_check(pcb);
+	if ( ! pcb->npoints )
+		return;
+
+	if ( pcb->size < size )
+		pcerror("%s: truncated xor stream", __func__);
+
+	r.ptr = pcb->bytes + size;
+	r.end = pcb->bytes + pcb->size;
+	r.buf = 0;
+	r.nbits = 0;
+
+	val = pc_bytes_word_get(pcb->bytes, size);
+	pc_bytes_word_set(outbytes, size, val);
+	for ( i = 1; i < pcb->npoints; i++ )
+	{
+		if ( pc_bitreader_get(&r, 1) )
+		{
+			if ( pc_bitreader_get(&r, 1) )
+			{
+				wlead = pc_bitreader_get(&r, fieldbits);
+				wlen = pc_bitreader_get(&r, fieldbits) + 1;
+				if ( wlead + wlen > wordbits )
+					pcerror("%s: invalid xor window", __func__);
+			}
+			else if ( ! wlen )
+			{
+				pcerror("%s: xor stream reuses a missing window", __func__);
+			}
+			val ^= pc_bitreader_get_long(&r, wlen) << (wordbits - wlead - wlen);
+		}
+		pc_bytes_word_set(outbytes + i*size, size, val);
+	}
+}
+
+/**
+* Convert an XOR encoded array back to value bytes
+*/
+PCBYTES
+pc_bytes_xor_decode(const PCBYTES pcb)
+{
+	PCBYTES dpcb;
+	pc_bytes_xor_check(&pcb);
+	dpcb = pc_bytes_decoded_make(&pcb);
+	pc_bytes_xor_decode_into(&pcb, dpcb.bytes);
+	return dpcb;
+}
+
+/**
+* Only the first value is stored as a word,
+* the bit stream is byte ordered already
+*/
+static PCBYTES
+pc_bytes_xor_flip_endian(const PCBYTES pcb)
+{
+	size_t size = pc_interpretation_size(pcb.interpretation);
+	if ( pcb.size >= size )
+		pc_bytes_word_flip(pcb.bytes, size);
+	return pcb;
+}
+
+/* Number of bits up to and including the highest set bit */
+static inline uint32_t
+pc_bytes_bit_length(uint64_t v)
+{
+	return v ? 64 - __builtin_clzll(v) : 0;
+}
+
+/* Number of bytes a VRLE run length takes */
+static inline size_t
+pc_bytes_varint_size(uint32_t count)
+{
+	size_t n = 1;
+	while ( count >= 0x80 )
+	{
+		count >>= 7;
+		n++;
+	}
+	return n;
+}
+
+/**
+* Exact encoded sizes of the array under each of the
+* bit level codecs, found in one pass over the values and
+* without building any of the outputs. The xor size is 0
+* for words that are not 32 or 64 bits.
+*/
+void
+pc_bytes_sizes(const PCBYTES *pcb, PCBYTESSIZES *sizes)
+{
+	uint32_t i;
+	uint32_t npoints = pcb->npoints;
+	size_t size = pc_interpretation_size(pcb->interpretation);
+	int has_xor = (size == 4 || size == 8);
+	uint64_t prev, delta, code, prevdelta = 0;
+	uint64_t sig_and, sig_or;
+	uint64_t d1_and = 0xFFFFFFFFFFFFFFFFULL, d1_or = 0;
+	uint64_t d2_and = 0xFFFFFFFFFFFFFFFFULL, d2_or = 0;
+	uint32_t bits1 = 0, bits2 = 0, bits;
+	uint32_t runlength = 1;
+	uint32_t order, nresiduals;
+	PCBITWRITER w = { NULL, 0, 0, 0 };
+	PCXORSTATE st;
+
+	memset(sizes, 0, sizeof(PCBYTESSIZES));
+	sizes->none = npoints * size;
+	if ( ! npoints )
+		return;
+
+	prev = pc_bytes_word_get(pcb->bytes, size);
+	sig_and = sig_or = prev;
+	if ( has_xor )
+		pc_bytes_xor_start(&st, size);
+
+	for ( i = 1; i < npoints; i++ )
+	{
+		uint64_t val = pc_bytes_word_get(pcb->bytes + i*size, size);
+		uint64_t x = val ^ prev;
+
+		/* Runs */
+		if ( x )
+		{
+			sizes->vrle += pc_bytes_varint_size(runlength) + size;
+			runlength = 1;
+		}
+		else
+		{
+			runlength++;
+		}
+
+		/* Common bits */
+		sig_and &= val;
+		sig_or |= val;
+
+		/* First and second differences */
+		delta = val - prev;
+		code = pc_bytes_zigzag_encode(delta, size);
+		d1_and &= code;
+		d1_or |= code;
+		if ( i >= 2 )
+		{
+			code = pc_bytes_zigzag_encode(delta - prevdelta, size);
+			d2_and &= code;
+			d2_or |= code;
+		}
+
+		if ( has_xor )
+			pc_bytes_xor_step(&st, &w, x);
+
+		prevdelta = delta;
+		prev = val;
+	}
+	sizes->vrle += pc_bytes_varint_size(runlength) + size;
+
+	sizes->sigbits = pc_bytes_sigbits_size(size, pc_bytes_bit_length(sig_and ^ sig_or), npoints);
+
+	/* Same order choice as pc_bytes_delta_count */
+	if ( npoints > 1 )
+		bits1 = pc_bytes_bit_length(d1_and ^ d1_or);
+	if ( npoints > 2 )
+		bits2 = pc_bytes_bit_length(d2_and ^ d2_or);
+	order = bits2 < bits1 ? 2 : 1;
+	bits = bits2 < bits1 ? bits2 : bits1;
+	nresiduals = npoints > order ? npoints - order : 0;
+	sizes->delta = (1 + order) * size;
+	if ( nresiduals )
+		sizes->delta += pc_bytes_sigbits_size(size, bits, nresiduals);
+
+	if ( has_xor )
+		sizes->xor = size + (w.nbits + 7) / 8;
+}
+
+/**
+* Runs and sigbits are not tried on doubles, whose low bits are
+* noise, nor delta on floating point at all, while XOR only makes
+* sense on floating point. Shared with the dimstats recommendation
+* so both pick from the same codecs.
+*/
+int
+pc_bytes_compression_eligible(uint32_t interpretation, uint32_t compression)
+{
+	int isfloat = (interpretation == PC_DOUBLE || interpretation == PC_FLOAT);
+	switch ( compression )
+	{
+	case PC_DIM_RLE:
+	case PC_DIM_VRLE:
+	case PC_DIM_SIGBITS:
+		return interpretation != PC_DOUBLE;
+	case PC_DIM_DELTA:
+		return ! isfloat;
+	case PC_DIM_XOR:
+		return isfloat;
+	default:
+		return PC_TRUE;
+	}
+}
+
+/**
+* Pick the codec for this array from its exact encoded sizes.
+* A bit level codec has to beat the ratio the general purpose
+* codec usually gets on such data, otherwise the fallback is used.
+*/
+uint32_t
+pc_bytes_choose_compression(const PCBYTES *pcb, uint32_t fallback)
+{
+	PCBYTESSIZES sizes;
+	uint32_t compression = fallback;
+	size_t best = 0;
+	int i;
+
+	if ( ! pcb->npoints )
+		return PC_DIM_NONE;
+
+	pc_bytes_sizes(pcb, &sizes);
+
+	{
+		/* Cheapest to decode first, so they win ties */
+		const struct { uint32_t compression; size_t size; double ratio; } candidates[] =
+		{
+			{ PC_DIM_VRLE, sizes.vrle, 4.0 },
+			{ PC_DIM_SIGBITS, sizes.sigbits, 1.6 },
+			{ PC_DIM_DELTA, sizes.delta, 1.6 },
+			{ PC_DIM_XOR, sizes.xor, 2.0 }
+		};
+
+		for ( i = 0; i < 4; i++ )
+		{
+			size_t csize = candidates[i].size;
+			if ( ! pc_bytes_compression_eligible(pcb->interpretation, candidates[i].compression) )
+				continue;
+			if ( ! csize || sizes.none < csize * candidates[i].ratio )
+				continue;
+			if ( ! best || csize < best )
+			{
+				best = csize;
+				compression = candidates[i].compression;
+			}
+		}
+	}
+	return compression;
+}
+
+static voidpf
+pc_zlib_alloc(voidpf opaque, uInt nitems, uInt sz)
+{
+	return pcalloc(sz*nitems);
+}
+
+static void
+pc_zlib_free(voidpf opaque, voidpf ptr)
+{
+	pcfree(ptr);
+}
+
+
+/**
+* Deflate pcb into buf, which must hold compressBound(pcb->size)
+* bytes, and return the compressed size.
+*/
+static size_t
+pc_bytes_zlib_encode_into(const PCBYTES *pcb, int level, uint8_t *buf)
+{
+	z_stream strm;
+	int ret;
+	size_t have;
+
+	/* Use our own allocators */
+	strm.zalloc = pc_zlib_alloc;
+	strm.zfree = pc_zlib_free;
+	strm.opaque = Z_NULL;
+	ret = deflateInit(&strm, level > 0 ? level : PC_ZLIB_DEFAULT_LEVEL);
+	if ( ret != Z_OK )
+		pcerror("%s: deflateInit failed", __func__);
+	/* Set up input buffer */
+	strm.avail_in = pcb->size;
+	strm.next_in = pcb->bytes;
+	/* Set up output buffer */
+	strm.avail_out = compressBound(pcb->size);
+	strm.next_out = buf;
+	/* Compress, the bound guarantees a single call finishes */
+	ret = deflate(&strm, Z_FINISH);
+	have = strm.total_out;
+	deflateEnd(&strm);
+	if ( ret != Z_STREAM_END )
+		pcerror("%s: deflate did not finish", __func__);
+	return have;
+}
+
+/**
+* Returns compressed byte array with
+* <size_t> size of compressed portion
+* <size_t> size of original data
+* <.....> compresssed bytes
+*/
+PCBYTES
+pc_bytes_zlib_encode(const PCBYTES pcb, int level)
+{
+	PCBYTES pcbout = pcb;
+
+	pcbout.bytes = pcalloc(compressBound(pcb.size));
+	pcbout.size = pc_bytes_zlib_encode_into(&pcb, level, pcbout.bytes);
+	pcbout.bytes = pcrealloc(pcbout.bytes, pcbout.size);
+	pcbout.compression = PC_DIM_ZLIB;
+	pcbout.readonly = PC_FALSE;
+	return pcbout;
+}
+
+/**
+* Inflate pcb into the npoints values of outbytes
+*/
+static void
+pc_bytes_zlib_decode_into(const PCBYTES *pcb, uint8_t *outbytes)
+{
+	z_stream strm;
+	int ret;
+	size_t size_out = pc_interpretation_size(pcb->interpretation) * pcb->npoints;
+
+	if ( ! size_out )
+		return;
+
+	/* Use our own allocators */
+	strm.zalloc = pc_zlib_alloc;
+	strm.zfree = pc_zlib_free;
+	strm.opaque = Z_NULL;
+	strm.avail_in = 0;
+	strm.next_in = Z_NULL;
+	ret = inflateInit(&strm);
+	if ( ret != Z_OK )
+		pcerror("%s: inflateInit failed", __func__);
+	/* Set up input buffer */
+	strm.avail_in = pcb->size;
+	strm.next_in = pcb->bytes;
+
+	strm.avail_out = size_out;
+	strm.next_out = outbytes;
+	ret = inflate(&strm, Z_FINISH);
+	inflateEnd(&strm);
+	if ( ret != Z_STREAM_END || strm.total_out != size_out )
+		pcerror("%s: corrupt zlib stream", __func__);
+}
+
+/**
+* Returns uncompressed byte array from input with
+* <size_t> size of compressed portion
+* <size_t> size of original data
+* <.....> compresssed bytes
+*/
+PCBYTES
+pc_bytes_zlib_decode(const PCBYTES pcb)
+{
+	PCBYTES pcbout = pc_bytes_decoded_make(&pcb);
+	pc_bytes_zlib_decode_into(&pcb, pcbout.bytes);
+	return pcbout;
+}
+
+#ifdef HAVE_LIBZSTD
+static size_t
+pc_bytes_zstd_encode_into(const PCBYTES *pcb, int level, uint8_t *buf)
+{
+	size_t have = ZSTD_compress(buf, ZSTD_compressBound(pcb->size), pcb->bytes, pcb->size, level > 0 ? level : PC_ZSTD_DEFAULT_LEVEL);
+	if ( ZSTD_isError(have) )
+		pcerror("%s: %s", __func__, ZSTD_getErrorName(have));
+	return have;
+}
+
+static void
+pc_bytes_zstd_decode_into(const PCBYTES *pcb, uint8_t *outbytes)
+{
+	size_t size_out = pc_interpretation_size(pcb->interpretation) * pcb->npoints;
+	size_t have = ZSTD_decompress(outbytes, size_out, pcb->bytes, pcb->size);
+	if ( ZSTD_isError(have) )
+		pcerror("%s: %s", __func__, ZSTD_getErrorName(have));
+	if ( have != size_out )
+		pcerror("%s: expected %zu bytes, got %zu", __func__, size_out, have);
+}
+#endif
+
+/**
+* Returns a single zstd frame holding the
+* compressed bytes
+*/
+PCBYTES
+pc_bytes_zstd_encode(const PCBYTES pcb, int level)
+{
+#ifdef HAVE_LIBZSTD
+	PCBYTES pcbout = pcb;
+
+	pcbout.bytes = pcalloc(ZSTD_compressBound(pcb.size));
+	pcbout.size = pc_bytes_zstd_encode_into(&pcb, level, pcbout.bytes);
+	pcbout.bytes = pcrealloc(pcbout.bytes, pcbout.size);
+	pcbout.compression = PC_DIM_ZSTD;
+	pcbout.readonly = PC_FALSE;
+	return pcbout;
+#else
+	pcerror("%s: library built without zstd support", __func__);
+	return pcb;
+#endif
+}
+
+/**
+* Returns uncompressed byte array from a zstd frame
+*/
+PCBYTES
+pc_bytes_zstd_decode(const PCBYTES pcb)
+{
+#ifdef HAVE_LIBZSTD
+	PCBYTES pcbout = pc_bytes_decoded_make(&pcb);
+	pc_bytes_zstd_decode_into(&pcb, pcbout.bytes);
+	return pcbout;
+#else
+	pcerror("%s: library built without zstd support", __func__);
+	return pcb;
+#endif
+}
+
+#ifdef HAVE_LIBLZ4
+static size_t
+pc_bytes_lz4_encode_into(const PCBYTES *pcb, int level, uint8_t *buf)
+{
+	int bufsize = LZ4_compressBound(pcb->size);
+	int have;
+
+	if ( level <= 0 )
+		level = PC_LZ4_DEFAULT_LEVEL;
+
+	if ( level > 1 )
+		have = LZ4_compress_HC((const char*)pcb->bytes, (char*)buf, pcb->size, bufsize, level);
+	else
+		have = LZ4_compress_default((const char*)pcb->bytes, (char*)buf, pcb->size, bufsize);
+	if ( have <= 0 )
+		pcerror("%s: compression failed", __func__);
+	return have;
+}
+
+static void
+pc_bytes_lz4_decode_into(const PCBYTES *pcb, uint8_t *outbytes)
+{
+	size_t size_out = pc_interpretation_size(pcb->interpretation) * pcb->npoints;
+	int have = LZ4_decompress_safe((const char*)pcb->bytes, (char*)outbytes, pcb->size, size_out);
+	if ( have < 0 || (size_t)have != size_out )
+		pcerror("%s: corrupt lz4 block", __func__);
+}
+#endif
 
-	strm.avail_out = pcbout.size;
-	strm.next_out = pcbout.bytes;
-	ret = inflate(&strm, Z_FINISH);
-	assert(ret != Z_STREAM_ERROR);
-	inflateEnd(&strm);
+/**
+* Returns a raw lz4 block holding the compressed
+* bytes. Levels above one trade speed for ratio
+* using the lz4hc compressor.
+*/
+PCBYTES
+pc_bytes_lz4_encode(const PCBYTES pcb, int level)
+{
+#ifdef HAVE_LIBLZ4
+	PCBYTES pcbout = pcb;
 
-	pcbout.compression = PC_DIM_NONE;
+	pcbout.bytes = pcalloc(LZ4_compressBound(pcb.size));
+	pcbout.size = pc_bytes_lz4_encode_into(&pcb, level, pcbout.bytes);
+	pcbout.bytes = pcrealloc(pcbout.bytes, pcbout.size);
+	pcbout.compression = PC_DIM_LZ4;
+	pcbout.readonly = PC_FALSE;
+	return pcbout;
+#else
+	pcerror("%s: library built without lz4 support", __func__);
+	return pcb;
+#endif
+}
+
+/**
+* Returns uncompressed byte array from a raw lz4 block
+*/
+PCBYTES
+pc_bytes_lz4_decode(const PCBYTES pcb)
+{
+#ifdef HAVE_LIBLZ4
+	PCBYTES pcbout = pc_bytes_decoded_make(&pcb);
+	pc_bytes_lz4_decode_into(&pcb, pcbout.bytes);
 	return pcbout;
+#else
+	pcerror("%s: library built without lz4 support", __func__);
+	return pcb;
+#endif
 }
 
 /**
@@ -1147,9 +2204,16 @@ pc_bytes_flip_endian(PCBYTES pcb)
 	case PC_DIM_SIGBITS:
 		return pc_bytes_sigbits_flip_endian(pcb);
 	case PC_DIM_ZLIB:
+	case PC_DIM_ZSTD:
+	case PC_DIM_LZ4:
 		return pcb;
 	case PC_DIM_RLE:
+	case PC_DIM_VRLE:
 		return pc_bytes_run_length_flip_endian(pcb);
+	case PC_DIM_DELTA:
+		return pc_bytes_delta_flip_endian(pcb);
+	case PC_DIM_XOR:
+		return pc_bytes_xor_flip_endian(pcb);
 	default:
 		pcerror("%s: unknown compression", __func__);
 	}
@@ -1190,6 +2254,8 @@ pc_bytes_deserialize(const uint8_t *buf, const PCDIMENSION *dim, PCBYTES *pcb, i
 	pcb->compression = buf[0];
 	pcb->size = wkb_get_int32(buf+1, flip_endian);
 	pcb->readonly = readonly;
+	/* Flipping needs to know the word size */
+	pcb->interpretation = dim->interpretation;
 	if ( readonly && flip_endian )
 		pcerror("pc_bytes_deserialize: cannot create a read-only buffer on byteswapped input");
 	if ( readonly )
@@ -1211,117 +2277,372 @@ pc_bytes_deserialize(const uint8_t *buf, const PCDIMENSION *dim, PCBYTES *pcb, i
 	return PC_SUCCESS;
 }
 
-
-static int
-pc_bytes_uncompressed_minmax(const PCBYTES *pcb, double *min, double *max, double *avg)
+/**
+* Largest number of bytes pc_bytes_encode_into can write
+* when encoding the uncompressed pcb with the given compression.
+*/
+size_t
+pc_bytes_encoded_size_bound(const PCBYTES *pcb, int compression)
 {
-	int i;
-	int element_size = pc_interpretation_size(pcb->interpretation);
-	double d;
-	double mn = FLT_MAX;
-	double mx = -1*FLT_MAX;
-	double sm = 0.0;
-	for ( i = 0; i < pcb->npoints; i++ )
+	size_t size = pc_interpretation_size(pcb->interpretation);
+	size_t npoints = pcb->npoints;
+
+	switch ( compression )
+	{
+	case PC_DIM_NONE:
+		return size * npoints;
+	case PC_DIM_RLE:
+	case PC_DIM_VRLE:
+		/* Every point its own run, VRLE counts of one fit a byte */
+		return npoints * (size + 1);
+	case PC_DIM_SIGBITS:
+		return pc_bytes_sigbits_size(size, 8*size, npoints);
+	case PC_DIM_DELTA:
+		return 3 * size + pc_bytes_sigbits_size(size, 8*size, npoints);
+	case PC_DIM_XOR:
 	{
-		d = pc_double_from_ptr(pcb->bytes + i*element_size, pcb->interpretation);
-		if ( d < mn )
-			mn = d;
-		if ( d > mx )
-			mx = d;
-		sm += d;
+		/* Every value after the first opens a new window */
+		int wordbits = 8 * size;
+		size_t bits = (2 + 2 * pc_bytes_xor_field_bits(size) + wordbits);
+		return npoints ? size + ((npoints - 1) * bits + 7) / 8 : 0;
 	}
-	*min = mn;
-	*max = mx;
-	*avg = sm / pcb->npoints;
-	return PC_SUCCESS;
+	case PC_DIM_ZLIB:
+		return compressBound(size * npoints);
+	case PC_DIM_ZSTD:
+#ifdef HAVE_LIBZSTD
+		return ZSTD_compressBound(size * npoints);
+#else
+		pcerror("%s: library built without zstd support", __func__);
+		return 0;
+#endif
+	case PC_DIM_LZ4:
+#ifdef HAVE_LIBLZ4
+		return LZ4_compressBound(size * npoints);
+#else
+		pcerror("%s: library built without lz4 support", __func__);
+		return 0;
+#endif
+	default:
+		pcerror("%s: Uh oh, this compression is not valid", __func__);
+	}
+	return 0;
 }
 
-static int
-pc_bytes_run_length_minmax(const PCBYTES *pcb, double *min, double *max, double *avg)
+/**
+* Encode the uncompressed pcb straight into buf, which must hold
+* pc_bytes_encoded_size_bound bytes, and return the encoded size.
+* The delta codec keeps its residuals in scratch, so a caller
+* encoding many arrays can reuse one; NULL uses a temporary one.
+*/
+size_t
+pc_bytes_encode_into(const PCBYTES *pcb, int compression, int level, uint8_t *buf, PCBYTESSCRATCH *scratch)
 {
-	int element_size = pc_interpretation_size(pcb->interpretation);
-	double mn = FLT_MAX;
-	double mx = -1*FLT_MAX;
-	double sm = 0.0;
-	double d;
-	uint8_t *ptr = pcb->bytes;
-	uint8_t *ptr_end = pcb->bytes + pcb->size;
-	uint8_t count;
+	PCBYTESSCRATCH tmp = {NULL, 0};
+	size_t size_out = 0;
 
+	switch ( compression )
+	{
+	case PC_DIM_NONE:
+		size_out = pcb->size;
+		if ( size_out )
+			memcpy(buf, pcb->bytes, size_out);
+		break;
+	case PC_DIM_RLE:
+	case PC_DIM_VRLE:
+		size_out = pc_bytes_run_length_encode_into(pcb, compression, buf);
+		break;
+	case PC_DIM_SIGBITS:
+	{
+		uint32_t commonbits;
+		uint64_t commonvalue = pc_bytes_sigbits_common(pcb, &commonbits);
+		size_out = pc_bytes_sigbits_encode_into(pcb, commonvalue, commonbits, buf);
+		break;
+	}
+	case PC_DIM_DELTA:
+		size_out = pc_bytes_delta_encode_into(pcb, buf, scratch ? scratch : &tmp);
+		pc_bytes_scratch_free(&tmp);
+		break;
+	case PC_DIM_XOR:
+		size_out = pc_bytes_xor_encode_into(pcb, buf);
+		break;
+	case PC_DIM_ZLIB:
+		size_out = pc_bytes_zlib_encode_into(pcb, level, buf);
+		break;
+	case PC_DIM_ZSTD:
+#ifdef HAVE_LIBZSTD
+		size_out = pc_bytes_zstd_encode_into(pcb, level, buf);
+#else
+		pcerror("%s: library built without zstd support", __func__);
+#endif
+		break;
+	case PC_DIM_LZ4:
+#ifdef HAVE_LIBLZ4
+		size_out = pc_bytes_lz4_encode_into(pcb, level, buf);
+#else
+		pcerror("%s: library built without lz4 support", __func__);
+#endif
+		break;
+	default:
+		pcerror("%s: Uh oh, this compression is not valid", __func__);
+	}
+	return size_out;
+}
 
-	while( ptr < ptr_end )
+/**
+* Decode epcb into buf, which must hold the npoints
+* uncompressed values.
+*/
+void
+pc_bytes_decode_into(const PCBYTES *epcb, uint8_t *buf)
+{
+	switch ( epcb->compression )
 	{
-		/* Read count and advance */
-		count = *ptr;
-		ptr += 1;
+	case PC_DIM_NONE:
+		if ( epcb->size )
+			memcpy(buf, epcb->bytes, epcb->size);
+		break;
+	case PC_DIM_RLE:
+	case PC_DIM_VRLE:
+		pc_bytes_run_length_decode_into(epcb, buf);
+		break;
+	case PC_DIM_SIGBITS:
+		pc_bytes_sigbits_decode_into(epcb, buf);
+		break;
+	case PC_DIM_DELTA:
+		pc_bytes_delta_decode_into(epcb, buf);
+		break;
+	case PC_DIM_XOR:
+		pc_bytes_xor_decode_into(epcb, buf);
+		break;
+	case PC_DIM_ZLIB:
+		pc_bytes_zlib_decode_into(epcb, buf);
+		break;
+	case PC_DIM_ZSTD:
+#ifdef HAVE_LIBZSTD
+		pc_bytes_zstd_decode_into(epcb, buf);
+#else
+		pcerror("%s: library built without zstd support", __func__);
+#endif
+		break;
+	case PC_DIM_LZ4:
+#ifdef HAVE_LIBLZ4
+		pc_bytes_lz4_decode_into(epcb, buf);
+#else
+		pcerror("%s: library built without lz4 support", __func__);
+#endif
+		break;
+	default:
+		pcerror("%s: Uh oh, this compression is not valid", __func__);
+	}
+}
 
-		/* Read value and advance */
-		d = pc_double_from_ptr(ptr, pcb->interpretation);
-		ptr += element_size;
+size_t
+pc_bytes_serialized_size_bound(const PCBYTES *pcb, int compression)
+{
+	/* compression type (1) + size of data (4) + data */
+	return 1 + 4 + pc_bytes_encoded_size_bound(pcb, compression);
+}
+
+/**
+* Serialize the uncompressed pcb as if it had been encoded first,
+* encoding straight into buf behind the header. Returns the
+* serialized size, at most pc_bytes_serialized_size_bound.
+*/
+size_t
+pc_bytes_serialize_encoded(const PCBYTES *pcb, int compression, int level, uint8_t *buf, PCBYTESSCRATCH *scratch)
+{
+	int32_t pcbsize = pc_bytes_encode_into(pcb, compression, level, buf + 5, scratch);
 
-		/* Calc min */
-		if ( d < mn )
-			mn = d;
-		/* Calc max */
-		if ( d > mx )
-			mx = d;
-		/* Calc sum */
-		sm += count * d;
+	/* Compression type number */
+	*buf = compression;
+	/* Buffer size */
+	memcpy(buf + 1, &pcbsize, 4);
+	return 5 + pcbsize;
+}
 
-	}
 
-	*min = mn;
-	*max = mx;
-	*avg = sm / pcb->npoints;
-	return PC_SUCCESS;
+void
+pc_bytes_stat_init(PCBYTESSTAT *stat)
+{
+	stat->count = 0;
+	stat->min = DBL_MAX;
+	stat->max = -1 * DBL_MAX;
+	stat->sum = 0.0;
 }
 
+void
+pc_bytes_stat_merge(PCBYTESSTAT *stat, const PCBYTESSTAT *other)
+{
+	if ( ! other->count )
+		return;
+	if ( other->min < stat->min )
+		stat->min = other->min;
+	if ( other->max > stat->max )
+		stat->max = other->max;
+	stat->sum += other->sum;
+	stat->count += other->count;
+}
 
-static int
-pc_bytes_zlib_minmax(const PCBYTES *pcb, double *min, double *max, double *avg)
+/* Add count copies of d */
+static inline void
+pc_bytes_stat_add(PCBYTESSTAT *stat, double d, uint32_t count)
+{
+	if ( d < stat->min )
+		stat->min = d;
+	if ( d > stat->max )
+		stat->max = d;
+	stat->sum += d * count;
+	stat->count += count;
+}
+
+/* Fold the values of a packed array into a PCDOUBLESTAT */
+static void
+pc_bytes_uncompressed_double_stat(const uint8_t *bytes, uint32_t interpretation, uint32_t npoints, PCDOUBLESTAT *dstat)
+{
+	double vals[PC_DOUBLE_ARRAY_CHUNK];
+	size_t element_size = pc_interpretation_size(interpretation);
+	uint32_t i, n;
+
+	for ( i = 0; i < npoints; i += n )
+	{
+		n = npoints - i;
+		if ( n > PC_DOUBLE_ARRAY_CHUNK )
+			n = PC_DOUBLE_ARRAY_CHUNK;
+		pc_double_array_from_ptr(vals, bytes + i * element_size, interpretation, element_size, n);
+		pc_double_array_stat(vals, n, dstat);
+	}
+}
+
+static void
+pc_bytes_uncompressed_stat(const PCBYTES *pcb, PCBYTESSTAT *stat)
+{
+	PCDOUBLESTAT dstat;
+	dstat.min = stat->min;
+	dstat.max = stat->max;
+	dstat.sum = stat->sum;
+	pc_bytes_uncompressed_double_stat(pcb->bytes, pcb->interpretation, pcb->npoints, &dstat);
+	stat->min = dstat.min;
+	stat->max = dstat.max;
+	stat->sum = dstat.sum;
+	stat->count += pcb->npoints;
+}
+
+/* Each run counts once per element, at the cost of one value read */
+static void
+pc_bytes_run_length_stat(const PCBYTES *pcb, PCBYTESSTAT *stat)
 {
-	PCBYTES zcb = pc_bytes_zlib_decode(*pcb);
-	int rv = pc_bytes_uncompressed_minmax(&zcb, min, max, avg);
-	pc_bytes_free(zcb);
-	return rv;
+	int element_size = pc_interpretation_size(pcb->interpretation);
+	const uint8_t *ptr = pcb->bytes;
+	const uint8_t *ptr_end = pcb->bytes + pcb->size;
+	uint32_t count;
+
+	while( ptr < ptr_end )
+	{
+		/* Read count and advance */
+		count = pc_bytes_run_length_get(&ptr, ptr_end, pcb->compression);
+		if ( ptr + element_size > ptr_end )
+			pcerror("%s: truncated run", __func__);
+		/* Read value and advance */
+		pc_bytes_stat_add(stat, pc_double_from_ptr(ptr, pcb->interpretation), count);
+		ptr += element_size;
+	}
 }
 
+/**
+* For integers, with the sign bit among the common bits, every value
+* is the common value plus its unique bits, so the stats of the
+* array are the stats of the packed bits shifted by the common value.
+* Floating point values and full width signed ones get decoded.
+*/
 static int
-pc_bytes_sigbits_minmax(const PCBYTES *pcb, double *min, double *max, double *avg)
+pc_bytes_sigbits_stat(const PCBYTES *pcb, PCBYTESSTAT *stat)
 {
-	PCBYTES zcb = pc_bytes_sigbits_decode(*pcb);
-	int rv = pc_bytes_uncompressed_minmax(&zcb, min, max, avg);
-	pc_bytes_free(zcb);
-	return rv;
+	size_t size = pc_interpretation_size(pcb->interpretation);
+	uint32_t wordbits = 8 * size;
+	uint64_t nbits, mask, umin, umax;
+	uint8_t base[8];
+	double basevalue, usum;
+	PCBYTESSTAT pstat;
+
+	if ( pcb->interpretation == PC_DOUBLE || pcb->interpretation == PC_FLOAT )
+		return PC_FAILURE;
+	if ( pcb->size < 2*size )
+		pcerror("%s: truncated sigbits header", __func__);
+	nbits = pc_bytes_word_get(pcb->bytes, size);
+	if ( nbits > wordbits )
+		pcerror("%s: invalid unique bit count %d", __func__, (int)nbits);
+	if ( nbits == wordbits && pc_bytes_unsigned_interpretation(size) != pcb->interpretation )
+		return PC_FAILURE;
+
+	mask = nbits >= 64 ? 0xFFFFFFFFFFFFFFFFULL : (1ULL << nbits) - 1;
+	pc_bytes_word_set(base, size, pc_bytes_word_get(pcb->bytes + size, size) & ~mask);
+	basevalue = pc_double_from_ptr(base, pcb->interpretation);
+
+	pc_sigbits_stat(pcb->bytes + 2*size, size, (pcb->size - 2*size) / size, nbits, pcb->npoints, &umin, &umax, &usum);
+	pstat.count = pcb->npoints;
+	pstat.min = basevalue + umin;
+	pstat.max = basevalue + umax;
+	pstat.sum = basevalue * pcb->npoints + usum;
+	pc_bytes_stat_merge(stat, &pstat);
+	return PC_SUCCESS;
 }
 
+/**
+* Add the values of the array to the running stat. Runs and sigbits
+* arrays are read as they are packed, the others are decoded first.
+*/
 int
-pc_bytes_minmax(const PCBYTES *pcb, double *min, double *max, double *avg)
+pc_bytes_stat(const PCBYTES *pcb, PCBYTESSTAT *stat)
 {
 	switch(pcb->compression)
 	{
 	case PC_DIM_NONE:
-		return pc_bytes_uncompressed_minmax(pcb, min, max, avg);
+		pc_bytes_uncompressed_stat(pcb, stat);
+		return PC_SUCCESS;
+	case PC_DIM_RLE:
+	case PC_DIM_VRLE:
+		pc_bytes_run_length_stat(pcb, stat);
+		return PC_SUCCESS;
 	case PC_DIM_SIGBITS:
-		return pc_bytes_sigbits_minmax(pcb, min, max, avg);
+		if ( pc_bytes_sigbits_stat(pcb, stat) == PC_SUCCESS )
+			return PC_SUCCESS;
+		/* Fall through to decoding */
 	case PC_DIM_ZLIB:
-		return pc_bytes_zlib_minmax(pcb, min, max, avg);
-	case PC_DIM_RLE:
-		return pc_bytes_run_length_minmax(pcb, min, max, avg);
+	case PC_DIM_ZSTD:
+	case PC_DIM_LZ4:
+	case PC_DIM_DELTA:
+	case PC_DIM_XOR:
+	{
+		PCBYTES dpcb = pc_bytes_decode(*pcb);
+		pc_bytes_uncompressed_stat(&dpcb, stat);
+		pc_bytes_free(dpcb);
+		return PC_SUCCESS;
+	}
 	default:
 		pcerror("%s: unknown compression", __func__);
 	}
 	return PC_FAILURE;
 }
 
+int
+pc_bytes_minmax(const PCBYTES *pcb, double *min, double *max, double *avg)
+{
+	PCBYTESSTAT stat;
+	pc_bytes_stat_init(&stat);
+	if ( pc_bytes_stat(pcb, &stat) != PC_SUCCESS )
+		return PC_FAILURE;
+	*min = stat.min;
+	*max = stat.max;
+	*avg = stat.sum / pcb->npoints;
+	return PC_SUCCESS;
+}
+
 static PCBYTES
 pc_bytes_uncompressed_filter(const PCBYTES *pcb, const PCBITMAP *map, PCDOUBLESTAT *stats)
 {
 	int i = 0, j = 0;
-	double d;
 	PCBYTES fpcb = pc_bytes_clone(*pcb);
-    int interp = pcb->interpretation;
-	int sz = pc_interpretation_size(interp);
+	int sz = pc_interpretation_size(pcb->interpretation);
 	uint8_t *buf = pcb->bytes;
 	uint8_t *fbuf = fpcb.bytes;
 
@@ -1330,14 +2651,6 @@ pc_bytes_uncompressed_filter(const PCBYTES *pcb, const PCBITMAP *map, PCDOUBLEST
 	    /* This entry is flagged to copy, so... */
 		if ( pc_bitmap_get(map, i) )
 		{
-		    /* Update stats on filtered bytes */
-            if ( stats )
-            {
-                d = pc_double_from_ptr(buf, interp);
-                if ( d < stats->min ) stats->min = d;
-                if ( d > stats->max ) stats->max = d;
-                stats->sum += d;
-            }
             /* Copy into filtered byte array */
 			memcpy(fbuf, buf, sz);
 			fbuf += sz;
@@ -1348,6 +2661,11 @@ pc_bytes_uncompressed_filter(const PCBYTES *pcb, const PCBITMAP *map, PCDOUBLEST
 	}
 	fpcb.size = fbuf - fpcb.bytes;
 	fpcb.npoints = j;
+
+	/* Stats on the filtered bytes, now they are packed together */
+	if ( stats )
+		pc_bytes_uncompressed_double_stat(fpcb.bytes, fpcb.interpretation, fpcb.npoints, stats);
+
 	return fpcb;
 }
 
@@ -1360,15 +2678,15 @@ pc_bytes_run_length_filter(const PCBYTES *pcb, const PCBITMAP *map, PCDOUBLESTAT
 	PCBYTES fpcb = pc_bytes_clone(*pcb);
 	int sz = pc_interpretation_size(pcb->interpretation);
 	uint8_t *fptr = fpcb.bytes;
-	uint8_t *ptr = pcb->bytes;
-	uint8_t *ptr_end = pcb->bytes + pcb->size;
-	uint8_t count;
-    uint8_t fcount;
+	const uint8_t *ptr = pcb->bytes;
+	const uint8_t *ptr_end = pcb->bytes + pcb->size;
+	uint32_t count;
+	uint32_t fcount;
 
 	while( ptr < ptr_end )
 	{
 		/* Read unfiltered count */
-		count = *ptr;
+		count = pc_bytes_run_length_get(&ptr, ptr_end, pcb->compression);
 		/* Initialize filtered count */
         fcount = 0;
         
@@ -1384,12 +2702,10 @@ pc_bytes_run_length_filter(const PCBYTES *pcb, const PCBITMAP *map, PCDOUBLESTAT
         /* If there are some, we need to copy */
         if ( fcount )
         {
-            /* Copy in the filtered count */
-            memcpy(fptr, &fcount, 1);
-            /* Advance to the value */
-            fptr++;
+            /* Copy in the filtered count, no longer than the unfiltered one */
+            fptr = pc_bytes_run_length_put(fptr, fcount, pcb->compression);
             /* Copy in the value */
-            memcpy(fptr, ptr+1, sz);
+            memcpy(fptr, ptr, sz);
             /* Advance to next entry */
             fptr += sz;
             /* Increment point counter */
@@ -1397,15 +2713,15 @@ pc_bytes_run_length_filter(const PCBYTES *pcb, const PCBITMAP *map, PCDOUBLESTAT
             /* Update the stats */
             if ( stats )
             {
-                d = pc_double_from_ptr(ptr+1, pcb->interpretation);
+                d = pc_double_from_ptr(ptr, pcb->interpretation);
                 if ( d < stats->min ) stats->min = d;
                 if ( d > stats->max ) stats->max = d;
-                stats->sum += d;
+                stats->sum += d * fcount;
             }
         }
 
         /* Move to next value in unfiltered bytes */
-        ptr += sz+1;
+        ptr += sz;
         i += count;
         
 	}
@@ -1423,10 +2739,15 @@ pc_bytes_filter(const PCBYTES *pcb, const PCBITMAP *map, PCDOUBLESTAT *stats)
 		return pc_bytes_uncompressed_filter(pcb, map, stats);
 
 	case PC_DIM_RLE:
+	case PC_DIM_VRLE:
         return pc_bytes_run_length_filter(pcb, map, stats);
 
 	case PC_DIM_SIGBITS:
 	case PC_DIM_ZLIB:
+	case PC_DIM_ZSTD:
+	case PC_DIM_LZ4:
+	case PC_DIM_DELTA:
+	case PC_DIM_XOR:
 	{
 		PCBYTES dpcb = pc_bytes_decode(*pcb);
 		PCBYTES fpcb = pc_bytes_uncompressed_filter(&dpcb, map, stats);
@@ -1451,15 +2772,14 @@ pc_bytes_run_length_bitmap(const PCBYTES *pcb, PC_FILTERTYPE filter, double val1
 	double d;
 	PCBITMAP *map = pc_bitmap_new(pcb->npoints);
 	int element_size = pc_interpretation_size(pcb->interpretation);
-	uint8_t *ptr = pcb->bytes;
-	uint8_t *ptr_end = pcb->bytes + pcb->size;
-	uint8_t count;
+	const uint8_t *ptr = pcb->bytes;
+	const uint8_t *ptr_end = pcb->bytes + pcb->size;
+	uint32_t count;
 
 	while( ptr < ptr_end )
 	{
 		/* Read count */
-		count = *ptr;
-		ptr++;
+		count = pc_bytes_run_length_get(&ptr, ptr_end, pcb->compression);
 		run = i + count;
 
 		/* Read value */
@@ -1481,19 +2801,240 @@ pc_bytes_run_length_bitmap(const PCBYTES *pcb, PC_FILTERTYPE filter, double val1
 static PCBITMAP *
 pc_bytes_uncompressed_bitmap(const PCBYTES *pcb, PC_FILTERTYPE filter, double val1, double val2)
 {
-	int i = 0;
-	double d;
+	double vals[PC_DOUBLE_ARRAY_CHUNK];
+	uint32_t i, n;
 	PCBITMAP *map = pc_bitmap_new(pcb->npoints);
-	int element_size = pc_interpretation_size(pcb->interpretation);
-	uint8_t *buf = pcb->bytes;
+	size_t element_size = pc_interpretation_size(pcb->interpretation);
 
-	while ( i < pcb->npoints )
+	for ( i = 0; i < pcb->npoints; i += n )
 	{
-		d = pc_double_from_ptr(buf, pcb->interpretation);
-		pc_bitmap_filter(map, filter, i, d, val1, val2);
-		/* Advance the pointer */
-		buf += element_size;
-		i++;
+		n = pcb->npoints - i;
+		if ( n > PC_DOUBLE_ARRAY_CHUNK )
+			n = PC_DOUBLE_ARRAY_CHUNK;
+		pc_double_array_from_ptr(vals, pcb->bytes + i * element_size, pcb->interpretation, element_size, n);
+		pc_bitmap_filter_array(map, filter, i, vals, n, val1, val2);
+	}
+	return map;
+}
+
+/**
+* A filter on an integer dimension, turned into an inclusive range
+* of keys. The key of a stored word is the word itself, with the
+* sign bit flipped for signed interpretations so that keys order
+* the same way as values.
+*/
+typedef struct
+{
+	uint64_t lo;
+	uint64_t hi;
+	uint64_t bias;
+	int empty;
+} PCKEYRANGE;
+
+static uint64_t
+pc_bytes_key_from_double(double d, int is_signed, size_t size, uint64_t bias)
+{
+	uint64_t wordmask = size == 8 ? 0xFFFFFFFFFFFFFFFFULL : (1ULL << (8*size)) - 1;
+	uint64_t word;
+	/* d is integral and clamped to the type range, but 2^63 and 2^64 are not castable */
+	if ( is_signed )
+		word = d >= ldexp(1.0, 63) ? (uint64_t)INT64_MAX : (uint64_t)(int64_t)d;
+	else
+		word = d >= ldexp(1.0, 64) ? UINT64_MAX : (uint64_t)d;
+	return (word & wordmask) ^ bias;
+}
+
+/**
+* Convert the filter constants, already unscaled and unoffset, into
+* the stored integer domain once, so values can be compared without
+* going through doubles. Gives PC_FAILURE for floating point types.
+* Matches pc_bitmap_filter exactly for values doubles hold exactly.
+*/
+static int
+pc_bytes_key_range(uint32_t interpretation, PC_FILTERTYPE filter, double val1, double val2, PCKEYRANGE *range)
+{
+	size_t size = pc_interpretation_size(interpretation);
+	int is_signed;
+	double tmin, tmax, lo, hi;
+
+	switch ( interpretation )
+	{
+	case PC_INT8:
+	case PC_INT16:
+	case PC_INT32:
+	case PC_INT64:
+		is_signed = PC_TRUE;
+		break;
+	case PC_UINT8:
+	case PC_UINT16:
+	case PC_UINT32:
+	case PC_UINT64:
+		is_signed = PC_FALSE;
+		break;
+	default:
+		return PC_FAILURE;
+	}
+
+	tmin = is_signed ? -ldexp(1.0, 8*size - 1) : 0;
+	tmax = ldexp(1.0, 8*size - is_signed) - 1;
+
+	/* An integer v > x exactly when v > floor(x), v < x when v < ceil(x) */
+	switch ( filter )
+	{
+	case PC_GT:
+		lo = floor(val1) + 1;
+		hi = tmax;
+		break;
+	case PC_LT:
+		lo = tmin;
+		hi = ceil(val1) - 1;
+		break;
+	case PC_EQUAL:
+		lo = hi = ( floor(val1) == val1 ) ? val1 : NAN;
+		break;
+	case PC_BETWEEN:
+		lo = floor(val1) + 1;
+		hi = ceil(val2) - 1;
+		break;
+	default:
+		return PC_FAILURE;
+	}
+
+	range->bias = is_signed ? 1ULL << (8*size - 1) : 0;
+	/* Also catches NaN constants, which nothing compares true with */
+	range->empty = ! ( lo <= hi && lo <= tmax && hi >= tmin );
+	if ( range->empty )
+	{
+		range->lo = 1;
+		range->hi = 0;
+		return PC_SUCCESS;
+	}
+	range->lo = pc_bytes_key_from_double(lo < tmin ? tmin : lo, is_signed, size, range->bias);
+	range->hi = pc_bytes_key_from_double(hi > tmax ? tmax : hi, is_signed, size, range->bias);
+	return PC_SUCCESS;
+}
+
+/* Flag points [start, start+count) in a new, all clear, bitmap */
+static inline void
+pc_bytes_bitmap_fill(PCBITMAP *map, uint32_t start, uint32_t count)
+{
+	if ( start + count > map->npoints || start + count < start )
+		pcerror("%s: run overflows the %d points of the array", __func__, map->npoints);
+	memset(map->map + start, 1, count);
+	map->nset += count;
+}
+
+static PCBITMAP *
+pc_bytes_uncompressed_key_bitmap(const PCBYTES *pcb, const PCKEYRANGE *range)
+{
+	uint32_t i;
+	size_t size = pc_interpretation_size(pcb->interpretation);
+	PCBITMAP *map = pc_bitmap_new(pcb->npoints);
+
+	for ( i = 0; i < pcb->npoints; i++ )
+	{
+		uint64_t key = pc_bytes_word_get(pcb->bytes + i*size, size) ^ range->bias;
+		map->map[i] = ( key >= range->lo && key <= range->hi );
+		map->nset += map->map[i];
+	}
+	return map;
+}
+
+/* One comparison per run */
+static PCBITMAP *
+pc_bytes_run_length_key_bitmap(const PCBYTES *pcb, const PCKEYRANGE *range)
+{
+	uint32_t i = 0;
+	size_t size = pc_interpretation_size(pcb->interpretation);
+	PCBITMAP *map = pc_bitmap_new(pcb->npoints);
+	const uint8_t *ptr = pcb->bytes;
+	const uint8_t *ptr_end = pcb->bytes + pcb->size;
+
+	while ( ptr < ptr_end )
+	{
+		uint32_t count = pc_bytes_run_length_get(&ptr, ptr_end, pcb->compression);
+		uint64_t key;
+		if ( ptr + size > ptr_end )
+			pcerror("%s: truncated run", __func__);
+		key = pc_bytes_word_get(ptr, size) ^ range->bias;
+		if ( key >= range->lo && key <= range->hi )
+			pc_bytes_bitmap_fill(map, i, count);
+		ptr += size;
+		i += count;
+	}
+	return map;
+}
+
+/**
+* The values of a sigbits array all lie between the common value
+* and the common value with every unique bit set. Ranges that cover
+* or miss that span settle the whole array from the header alone,
+* the others are compared on the packed unique bits. Returns NULL
+* when there are no common bits to anchor on for a signed type.
+*/
+static PCBITMAP *
+pc_bytes_sigbits_key_bitmap(const PCBYTES *pcb, const PCKEYRANGE *range)
+{
+	size_t size = pc_interpretation_size(pcb->interpretation);
+	uint32_t wordbits = 8 * size;
+	uint64_t nbits, mask, base, lo, hi;
+	size_t nwords;
+	PCBITMAP *map;
+
+	if ( pcb->size < 2*size )
+		pcerror("%s: truncated sigbits header", __func__);
+	nbits = pc_bytes_word_get(pcb->bytes, size);
+	if ( nbits > wordbits )
+		pcerror("%s: invalid unique bit count %d", __func__, (int)nbits);
+	/* With the sign bit among the unique bits keys are not base + bits */
+	if ( nbits == wordbits && range->bias )
+		return NULL;
+
+	mask = nbits >= 64 ? 0xFFFFFFFFFFFFFFFFULL : (1ULL << nbits) - 1;
+	base = (pc_bytes_word_get(pcb->bytes + size, size) & ~mask) ^ range->bias;
+	map = pc_bitmap_new(pcb->npoints);
+
+	/* Nothing or everything in the patch matches */
+	if ( range->hi < base || range->lo > base + mask )
+		return map;
+	if ( range->lo <= base && range->hi >= base + mask )
+	{
+		pc_bytes_bitmap_fill(map, 0, pcb->npoints);
+		return map;
+	}
+
+	lo = range->lo > base ? range->lo - base : 0;
+	hi = range->hi - base < mask ? range->hi - base : mask;
+	nwords = (pcb->size - 2*size) / size;
+	map->nset = pc_sigbits_match(pcb->bytes + 2*size, size, nwords, nbits, lo, hi, map->map, pcb->npoints);
+	return map;
+}
+
+static PCBITMAP *
+pc_bytes_key_bitmap(const PCBYTES *pcb, const PCKEYRANGE *range)
+{
+	PCBITMAP *map = NULL;
+
+	if ( range->empty )
+		return pc_bitmap_new(pcb->npoints);
+
+	switch ( pcb->compression )
+	{
+	case PC_DIM_NONE:
+		return pc_bytes_uncompressed_key_bitmap(pcb, range);
+	case PC_DIM_RLE:
+	case PC_DIM_VRLE:
+		return pc_bytes_run_length_key_bitmap(pcb, range);
+	case PC_DIM_SIGBITS:
+		map = pc_bytes_sigbits_key_bitmap(pcb, range);
+		break;
+	}
+
+	if ( ! map )
+	{
+		PCBYTES dpcb = pc_bytes_decode(*pcb);
+		map = pc_bytes_uncompressed_key_bitmap(&dpcb, range);
+		pc_bytes_free(dpcb);
 	}
 	return map;
 }
@@ -1501,12 +3042,22 @@ pc_bytes_uncompressed_bitmap(const PCBYTES *pcb, PC_FILTERTYPE filter, double va
 PCBITMAP *
 pc_bytes_bitmap(const PCBYTES *pcb, PC_FILTERTYPE filter, double val1, double val2)
 {
+	PCKEYRANGE range;
+
+	/* Integer dimensions compare stored words, not doubles */
+	if ( pc_bytes_key_range(pcb->interpretation, filter, val1, val2, &range) == PC_SUCCESS )
+		return pc_bytes_key_bitmap(pcb, &range);
+
 	switch(pcb->compression)
 	{
 	case PC_DIM_NONE:
 		return pc_bytes_uncompressed_bitmap(pcb, filter, val1, val2);
 	case PC_DIM_SIGBITS:
 	case PC_DIM_ZLIB:
+	case PC_DIM_ZSTD:
+	case PC_DIM_LZ4:
+	case PC_DIM_DELTA:
+	case PC_DIM_XOR:
 	{
 		PCBYTES dpcb = pc_bytes_decode(*pcb);
 		PCBITMAP *map = pc_bytes_uncompressed_bitmap(&dpcb, filter, val1, val2);
@@ -1514,6 +3065,7 @@ pc_bytes_bitmap(const PCBYTES *pcb, PC_FILTERTYPE filter, double val1, double va
 		return map;
 	}
 	case PC_DIM_RLE:
+	case PC_DIM_VRLE:
 		return pc_bytes_run_length_bitmap(pcb, filter, val1, val2);
 	default:
 		pcerror("%s: unknown compression", __func__);
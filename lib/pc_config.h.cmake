@@ -4,4 +4,8 @@
 
 #cmakedefine HAVE_LIBGHT ${HAVE_LIBGHT}
 
+#cmakedefine HAVE_LIBZSTD ${HAVE_LIBZSTD}
+
+#cmakedefine HAVE_LIBLZ4 ${HAVE_LIBLZ4}
+
 #cmakedefine PROJECT_SOURCE_DIR "${PROJECT_SOURCE_DIR}"
@@ -8,9 +8,11 @@
 *  Depending on the character of the data, one of these schemes
 *  will be used:
 *
-*  - run-length encoding
+*  - run-length encoding, with byte or varint run lengths
 *  - significant-bit removal
-*  - deflate
+*  - delta encoding
+*  - xor encoding, for floating point values
+*  - deflate, or zstandard/lz4 when the schema asks for them
 *
 *  PgSQL Pointcloud is free and open source software provided
 *  by the Government of Canada
@@ -46,6 +48,8 @@ typedef struct
 {
     uint32_t total_runs;
     uint32_t total_commonbits;
+    uint32_t total_deltabits;
+    uint32_t total_xorbits;
     uint32_t recommended_compression;
 } PCDIMSTAT;
 
@@ -74,9 +78,11 @@ pc_dimstats_to_string(const PCDIMSTATS *pds)
 	for ( i = 0; i < pds->ndims; i++ )
 	{
 		if ( i ) stringbuffer_append(sb, ",");
-		stringbuffer_aprintf(sb, "{\"total_runs\":%d,\"total_commonbits\":%d,\"recommended_compression\":%d}",
+		stringbuffer_aprintf(sb, "{\"total_runs\":%d,\"total_commonbits\":%d,\"total_deltabits\":%d,\"total_xorbits\":%d,\"recommended_compression\":%d}",
 		                     pds->stats[i].total_runs,
 		                     pds->stats[i].total_commonbits,
+		                     pds->stats[i].total_deltabits,
+		                     pds->stats[i].total_xorbits,
 		                     pds->stats[i].recommended_compression
 		                    );
 	}
@@ -104,6 +110,9 @@ pc_dimstats_update(PCDIMSTATS *pds, const PCPATCH_DIMENSIONAL *pdl)
 		PCBYTES pcb = pdl->bytes[i];
 		pds->stats[i].total_runs += pc_bytes_run_count(&pcb);
 		pds->stats[i].total_commonbits += pc_bytes_sigbits_count(&pcb);
+		pds->stats[i].total_deltabits += pc_bytes_delta_count(&pcb, NULL);
+		if ( pcb.interpretation == PC_DOUBLE || pcb.interpretation == PC_FLOAT )
+			pds->stats[i].total_xorbits += pc_bytes_xor_count(&pcb);
 	}
 
 	/* Update recommended compression schema */
@@ -112,28 +121,46 @@ pc_dimstats_update(PCDIMSTATS *pds, const PCPATCH_DIMENSIONAL *pdl)
 		PCDIMENSION *dim = pc_schema_get_dimension(schema, i);
 		/* Uncompressed size, foreach point, one value entry */
 		double raw_size = pds->total_points * dim->size;
-		/* RLE size, for each run, one count byte and one value entry */
+		/* RLE size, for each run, one count byte (mostly) and one value entry */
 		double rle_size = pds->stats[i].total_runs * (dim->size + 1);
 		/* Sigbits size, for each patch, one header and n bits for each entry */
 		double avg_commonbits_per_patch = pds->stats[i].total_commonbits / pds->total_patches;
 		double avg_uniquebits_per_patch = 8*dim->size - avg_commonbits_per_patch;
 		double sigbits_size = pds->total_patches * 2 * dim->size + pds->total_points * avg_uniquebits_per_patch / 8;
-		/* Default to ZLib */
-		pds->stats[i].recommended_compression = PC_DIM_ZLIB;
-		/* Only use rle and sigbits compression on integer values */
-		/* If we can do better than 4:1 we might beat zlib */
-		if ( dim->interpretation != PC_DOUBLE )
+		/* Delta size, for each patch, up to five header words and n bits for each difference */
+		double avg_deltabits_per_patch = (double)pds->stats[i].total_deltabits / pds->total_patches;
+		double delta_size = pds->total_patches * 5 * dim->size + pds->total_points * avg_deltabits_per_patch / 8;
+		/* XOR size, for each patch, one first value and the bit stream */
+		double xor_size = pds->total_patches * dim->size + pds->stats[i].total_xorbits / 8.0;
+		/* Default to the general purpose codec of the schema, ZLib unless configured */
+		pds->stats[i].recommended_compression = schema->dimcompression;
+		/* Floating point values XOR well against their neighbours, */
+		/* zlib gets about 2:1 on the noisy ones so XOR has to beat that */
+		if ( pc_bytes_compression_eligible(dim->interpretation, PC_DIM_XOR) &&
+		     raw_size/xor_size > 2.0 )
 		{
-			/* If sigbits is better than 4:1, use that */
-			if ( raw_size/sigbits_size > 1.6 )
-			{
-				pds->stats[i].recommended_compression = PC_DIM_SIGBITS;
-			}
-			/* If RLE size is even better, use that. */
-			if ( raw_size/rle_size > 4.0 )
-			{
-				pds->stats[i].recommended_compression = PC_DIM_RLE;
-			}
+			pds->stats[i].recommended_compression = PC_DIM_XOR;
+		}
+		/* If sigbits is better than 1.6:1, use that */
+		if ( pc_bytes_compression_eligible(dim->interpretation, PC_DIM_SIGBITS) &&
+		     raw_size/sigbits_size > 1.6 &&
+		     ( pds->stats[i].recommended_compression != PC_DIM_XOR || sigbits_size < xor_size ) )
+		{
+			pds->stats[i].recommended_compression = PC_DIM_SIGBITS;
+		}
+		/* Delta is sigbits on the differences, use it when they pack tighter */
+		if ( pc_bytes_compression_eligible(dim->interpretation, PC_DIM_DELTA) &&
+		     raw_size/delta_size > 1.6 && delta_size < sigbits_size )
+		{
+			pds->stats[i].recommended_compression = PC_DIM_DELTA;
+		}
+		/* If RLE is better than 4:1, we might beat zlib */
+		if ( pc_bytes_compression_eligible(dim->interpretation, PC_DIM_VRLE) &&
+		     raw_size/rle_size > 4.0 &&
+		     ( pds->stats[i].recommended_compression != PC_DIM_DELTA || rle_size < delta_size ) &&
+		     ( pds->stats[i].recommended_compression != PC_DIM_XOR || rle_size < xor_size ) )
+		{
+			pds->stats[i].recommended_compression = PC_DIM_VRLE;
 		}
 	}
 	return PC_SUCCESS;
@@ -151,6 +178,8 @@ pc_dimstat_clone( PCDIMSTAT * input_dimstat)
 	
 	pds->total_runs = input_dimstat->total_runs ;
 	pds->total_commonbits = input_dimstat->total_commonbits;
+	pds->total_deltabits = input_dimstat->total_deltabits;
+	pds->total_xorbits = input_dimstat->total_xorbits;
 	pds->recommended_compression = input_dimstat->recommended_compression;
 	
 	return pds;
@@ -10,6 +10,7 @@
 #include "pc_api_internal.h"
 #include <assert.h>
 #include <float.h>
+#include <math.h>
 
 
 PCBITMAP *
@@ -67,28 +68,62 @@ pc_bitmap_filter(PCBITMAP *map, PC_FILTERTYPE filter, int i, double d, double va
 	}
 }
 
+/* Set entries start..start+n from a test on each value, keeping nset */
+#define PC_BITMAP_FILTER_ARRAY(TEST) \
+	for ( i = 0; i < n; i++ ) \
+	{ \
+		double d = vals[i]; \
+		uint8_t bit = (TEST); \
+		nset += bit - bits[i]; \
+		bits[i] = bit; \
+	} \
+	break;
+
+/**
+* Same as pc_bitmap_filter over a run of values, with the filter
+* type looked at once rather than for every value
+*/
+void
+pc_bitmap_filter_array(PCBITMAP *map, PC_FILTERTYPE filter, uint32_t start, const double *vals, uint32_t n, double val1, double val2)
+{
+	uint32_t i;
+	uint8_t *bits = map->map + start;
+	int64_t nset = map->nset;
+
+	switch ( filter )
+	{
+	case PC_GT:
+		PC_BITMAP_FILTER_ARRAY(d > val1)
+	case PC_LT:
+		PC_BITMAP_FILTER_ARRAY(d < val1)
+	case PC_EQUAL:
+		PC_BITMAP_FILTER_ARRAY(d == val1)
+	case PC_BETWEEN:
+		PC_BITMAP_FILTER_ARRAY(d > val1 && d < val2)
+	}
+	map->nset = nset;
+}
+
+#undef PC_BITMAP_FILTER_ARRAY
+
 static PCBITMAP *
 pc_patch_uncompressed_bitmap(const PCPATCH_UNCOMPRESSED *pa, uint32_t dimnum, PC_FILTERTYPE filter, double val1, double val2)
 {
-	PCPOINT pt;
-	uint32_t i = 0;
-	uint8_t *buf = pa->data;
-	double d;
+	double vals[PC_DOUBLE_ARRAY_CHUNK];
+	uint32_t i, n;
+	const PCDIMENSION *dim = pa->schema->dims[dimnum];
 	size_t sz = pa->schema->size;
 	PCBITMAP *map = pc_bitmap_new(pa->npoints);
 
-	pt.readonly = PC_TRUE;
-	pt.schema = pa->schema;
-
-	while ( i < pa->npoints )
+	/* Read the dimension out of the points a chunk at a time */
+	for ( i = 0; i < pa->npoints; i += n )
 	{
-		pt.data = buf;
-		pc_point_get_double(&pt, pa->schema->dims[dimnum], &d);
-		/* Apply the filter to the bitmap */
-		pc_bitmap_filter(map, filter, i, d, val1, val2);
-		/* Advance data pointer and counter */
-		buf += sz;
-		i++;
+		n = pa->npoints - i;
+		if ( n > PC_DOUBLE_ARRAY_CHUNK )
+			n = PC_DOUBLE_ARRAY_CHUNK;
+		pc_double_array_from_ptr(vals, pa->data + i * sz + dim->byteoffset, dim->interpretation, sz, n);
+		pc_double_array_scale_offset(vals, n, dim);
+		pc_bitmap_filter_array(map, filter, i, vals, n, val1, val2);
 	}
 
 	return map;
@@ -152,32 +187,26 @@ pc_patch_dimensional_filter(const PCPATCH_DIMENSIONAL *pdl, const PCBITMAP *map)
 	int i = 0;
 	PCPATCH_DIMENSIONAL *fpdl = pc_patch_dimensional_clone(pdl);
 
-    fpdl->stats = pc_stats_clone(pdl->stats);
 	fpdl->npoints = map->nset;
 
-	for ( i = 0; i < pdl->schema->ndims; i++ )
+	/* Everything passed, keep the bytes as they are */
+	if ( map->nset == pdl->npoints )
 	{
-        PCDOUBLESTAT stats;
-        stats.min = FLT_MAX;
-        stats.max = FLT_MIN;
-        stats.sum = 0;
-		fpdl->bytes[i] = pc_bytes_filter(&(pdl->bytes[i]), map, &stats);
-
-		/* Save the X/Y stats for use in bounds later */
-		if ( i == pdl->schema->x_position )
-		{
-            fpdl->bounds.xmin = stats.min;
-            fpdl->bounds.xmax = stats.max;
-        }
-		else if ( i == pdl->schema->y_position )
-		{
-            fpdl->bounds.ymin = stats.min;
-            fpdl->bounds.ymax = stats.max;
-        }
+		fpdl->stats = pc_stats_clone(pdl->stats);
+		for ( i = 0; i < pdl->schema->ndims; i++ )
+			fpdl->bytes[i] = pc_bytes_clone(pdl->bytes[i]);
+		return fpdl;
+	}
+
+	for ( i = 0; i < pdl->schema->ndims; i++ )
+		fpdl->bytes[i] = pc_bytes_filter(&(pdl->bytes[i]), map, NULL);
 
-        pc_point_set_double_by_index(&(fpdl->stats->min), i, stats.min);
-        pc_point_set_double_by_index(&(fpdl->stats->max), i, stats.max);
-        pc_point_set_double_by_index(&(fpdl->stats->avg), i, stats.sum/fpdl->npoints);
+	/* Stats and bounds come straight off the filtered arrays */
+	if ( PC_FAILURE == pc_patch_dimensional_compute_stats(fpdl) ||
+	     PC_FAILURE == pc_patch_dimensional_compute_extent(fpdl) )
+	{
+		pcerror("%s: failed to compute patch stats", __func__);
+		return NULL;
 	}
 
 	return fpdl;
@@ -328,3 +357,252 @@ pc_patch_filter_between_by_name(const PCPATCH *pa, const char *name, double val1
 }
 
 
+
+/* Scaled values of one dimension for every point of the patch */
+static double *
+pc_patch_dimension_values(const PCPATCH *pa, uint32_t dimnum)
+{
+	const PCDIMENSION *dim = pa->schema->dims[dimnum];
+	double *vals = pcalloc(pa->npoints * sizeof(double));
+
+	if ( pa->type == PC_DIMENSIONAL )
+	{
+		const PCBYTES *pcb = &(((PCPATCH_DIMENSIONAL*)pa)->bytes[dimnum]);
+		size_t size = pc_interpretation_size(dim->interpretation);
+		if ( ! pcb->bytes )
+			pcerror("%s: dimension '%s' was not decoded", __func__, dim->name);
+		if ( pcb->compression == PC_DIM_NONE )
+		{
+			pc_double_array_from_ptr(vals, pcb->bytes, dim->interpretation, size, pa->npoints);
+		}
+		else
+		{
+			PCBYTES dpcb = pc_bytes_decode(*pcb);
+			pc_double_array_from_ptr(vals, dpcb.bytes, dim->interpretation, size, pa->npoints);
+			pc_bytes_free(dpcb);
+		}
+	}
+	else
+	{
+		const PCPATCH_UNCOMPRESSED *pu = (const PCPATCH_UNCOMPRESSED*)pa;
+		pc_double_array_from_ptr(vals, pu->data + dim->byteoffset, dim->interpretation, pa->schema->size, pa->npoints);
+	}
+
+	pc_double_array_scale_offset(vals, pa->npoints, dim);
+	return vals;
+}
+
+double *
+pc_patch_filter_values(const PCPATCH *pa, const uint32_t *fdims, const double *fmins, const double *fmaxs, uint32_t nfilters,
+                       const uint32_t *odims, uint32_t nodims, uint32_t *nkept)
+{
+	PCPATCH_UNCOMPRESSED *pu = NULL;
+	PCBITMAP *map = NULL;
+	double *out = NULL;
+	uint32_t i, j, k;
+
+	*nkept = 0;
+	if ( ! pa || pa->npoints == 0 ) return NULL;
+
+	/* Patches the stats rule out are never decoded */
+	if ( pa->stats )
+	{
+		for ( i = 0; i < nfilters; i++ )
+			if ( ! pc_patch_filter_has_results(pa->stats, fdims[i], PC_BETWEEN, fmins[i], fmaxs[i]) )
+				return NULL;
+	}
+
+	/* GHT patches are read through their uncompressed form */
+	if ( pa->type == PC_GHT )
+	{
+		pu = pc_patch_uncompressed_from_ght((PCPATCH_GHT*)pa);
+		pa = (PCPATCH*)pu;
+	}
+
+	/* And the bitmaps together, stopping as soon as nothing is left */
+	for ( i = 0; i < nfilters; i++ )
+	{
+		PCBITMAP *fmap;
+		if ( pa->type == PC_DIMENSIONAL )
+			fmap = pc_patch_dimensional_bitmap((PCPATCH_DIMENSIONAL*)pa, fdims[i], PC_BETWEEN, fmins[i], fmaxs[i]);
+		else
+			fmap = pc_patch_uncompressed_bitmap((PCPATCH_UNCOMPRESSED*)pa, fdims[i], PC_BETWEEN, fmins[i], fmaxs[i]);
+
+		if ( ! map )
+		{
+			map = fmap;
+		}
+		else
+		{
+			map->nset = 0;
+			for ( j = 0; j < map->npoints; j++ )
+			{
+				map->map[j] &= fmap->map[j];
+				map->nset += map->map[j];
+			}
+			pc_bitmap_free(fmap);
+		}
+		if ( map->nset == 0 )
+			break;
+	}
+
+	*nkept = map ? map->nset : pa->npoints;
+	if ( *nkept && nodims )
+	{
+		out = pcalloc(*nkept * nodims * sizeof(double));
+		for ( k = 0; k < nodims; k++ )
+		{
+			double *vals = pc_patch_dimension_values(pa, odims[k]);
+			double *ptr = out + k;
+			for ( j = 0; j < pa->npoints; j++ )
+			{
+				if ( map && ! map->map[j] )
+					continue;
+				*ptr = vals[j];
+				ptr += nodims;
+			}
+			pcfree(vals);
+		}
+	}
+
+	if ( map ) pc_bitmap_free(map);
+	if ( pu ) pc_patch_free((PCPATCH*)pu);
+	return out;
+}
+
+PCPATCH *
+pc_patch_filter_predicate(const PCPATCH *pa, const PCPREDICATE *pred)
+{
+	PCPATCH_UNCOMPRESSED *pu = NULL;
+	PC_MATCHTYPE match = PC_MATCH_SOME;
+	PCPATCH *paout;
+	PCBITMAP *map;
+	int i;
+
+	if ( ! pa ) return NULL;
+
+	/* The stats may settle it without reading a point */
+	if ( pa->stats )
+		match = pc_predicate_match_stats(pred, pa->stats);
+	if ( match == PC_MATCH_NONE || pa->npoints == 0 )
+		return (PCPATCH*)pc_patch_uncompressed_make(pa->schema, 0);
+
+	/* GHT patches are filtered through their uncompressed form */
+	if ( pa->type == PC_GHT )
+	{
+		pu = pc_patch_uncompressed_from_ght((PCPATCH_GHT*)pa);
+		pa = (PCPATCH*)pu;
+	}
+
+	map = pc_bitmap_new(pa->npoints);
+	if ( match == PC_MATCH_ALL )
+	{
+		memset(map->map, 1, pa->npoints);
+		map->nset = pa->npoints;
+	}
+	else
+	{
+		/* Each dimension the predicate reads is decoded once */
+		uint8_t *used = pcalloc(pa->schema->ndims);
+		double **dimvals = pcalloc(pa->schema->ndims * sizeof(double*));
+		pc_predicate_dimensions(pred, used);
+		for ( i = 0; i < pa->schema->ndims; i++ )
+		{
+			if ( used[i] )
+				dimvals[i] = pc_patch_dimension_values(pa, i);
+		}
+
+		map->nset = pc_predicate_eval(pred, dimvals, pa->npoints, map->map);
+
+		for ( i = 0; i < pa->schema->ndims; i++ )
+		{
+			if ( dimvals[i] )
+				pcfree(dimvals[i]);
+		}
+		pcfree(dimvals);
+		pcfree(used);
+	}
+
+	/* Then every dimension is copied once, through the one bitmap */
+	if ( map->nset == 0 )
+		paout = (PCPATCH*)pc_patch_uncompressed_make(pa->schema, 0);
+	else if ( pa->type == PC_DIMENSIONAL )
+		paout = (PCPATCH*)pc_patch_dimensional_filter((PCPATCH_DIMENSIONAL*)pa, map);
+	else
+		paout = (PCPATCH*)pc_patch_uncompressed_filter((PCPATCH_UNCOMPRESSED*)pa, map);
+
+	pc_bitmap_free(map);
+	if ( pu ) pc_patch_free((PCPATCH*)pu);
+	return paout;
+}
+
+PCPATCH *
+pc_patch_filter_geometry(const PCPATCH *pa, const PCGEOMETRY *geom, double distance)
+{
+	PCPATCH_UNCOMPRESSED *pu = NULL;
+	PC_MATCHTYPE match;
+	PCPATCH *paout;
+	PCBITMAP *map;
+	uint32_t i;
+
+	if ( ! pa ) return NULL;
+
+	if ( ! isfinite(distance) || distance < 0 )
+	{
+		pcerror("%s: distance must be finite and not negative", __func__);
+		return NULL;
+	}
+
+	/* The patch bounds may settle it without reading a point */
+	match = pc_geometry_match_bounds(geom, &(pa->bounds), distance);
+	if ( match == PC_MATCH_NONE || pa->npoints == 0 )
+		return (PCPATCH*)pc_patch_uncompressed_make(pa->schema, 0);
+
+	if ( match == PC_MATCH_SOME &&
+	     (pa->schema->x_position < 0 || pa->schema->y_position < 0) )
+	{
+		pcerror("%s: schema has no X and Y dimensions", __func__);
+		return NULL;
+	}
+
+	/* GHT patches are filtered through their uncompressed form */
+	if ( pa->type == PC_GHT )
+	{
+		pu = pc_patch_uncompressed_from_ght((PCPATCH_GHT*)pa);
+		pa = (PCPATCH*)pu;
+	}
+
+	map = pc_bitmap_new(pa->npoints);
+	if ( match == PC_MATCH_ALL )
+	{
+		memset(map->map, 1, pa->npoints);
+		map->nset = pa->npoints;
+	}
+	else
+	{
+		/* Only X and Y are decoded */
+		double *x = pc_patch_dimension_values(pa, pa->schema->x_position);
+		double *y = pc_patch_dimension_values(pa, pa->schema->y_position);
+		for ( i = 0; i < pa->npoints; i++ )
+		{
+			if ( pc_geometry_covers(geom, x[i], y[i], distance) )
+			{
+				map->map[i] = 1;
+				map->nset++;
+			}
+		}
+		pcfree(x);
+		pcfree(y);
+	}
+
+	if ( map->nset == 0 )
+		paout = (PCPATCH*)pc_patch_uncompressed_make(pa->schema, 0);
+	else if ( pa->type == PC_DIMENSIONAL )
+		paout = (PCPATCH*)pc_patch_dimensional_filter((PCPATCH_DIMENSIONAL*)pa, map);
+	else
+		paout = (PCPATCH*)pc_patch_uncompressed_filter((PCPATCH_UNCOMPRESSED*)pa, map);
+
+	pc_bitmap_free(map);
+	if ( pu ) pc_patch_free((PCPATCH*)pu);
+	return paout;
+}
@@ -0,0 +1,391 @@
+/***********************************************************************
+* pc_geometry.c
+*
+*  Polygons and linework read from WKB, prepared for testing
+*  many points against them.
+*
+*  PgSQL Pointcloud is free and open source software provided
+*  by the Government of Canada
+*  Copyright (c) 2013 Natural Resources Canada
+*
+***********************************************************************/
+
+#include "pc_api_internal.h"
+#include <float.h>
+#include <math.h>
+
+/* WKB geometry types, once the EWKB flags and ISO offsets are off */
+#define WKB_POINT 1
+#define WKB_LINESTRING 2
+#define WKB_POLYGON 3
+#define WKB_MULTIPOINT 4
+#define WKB_MULTILINESTRING 5
+#define WKB_MULTIPOLYGON 6
+#define WKB_GEOMETRYCOLLECTION 7
+
+/* EWKB flags on the geometry type */
+#define WKBZOFFSET 0x80000000
+#define WKBMOFFSET 0x40000000
+#define WKBSRIDFLAG 0x20000000
+
+/* Collections nested deeper than this are refused */
+#define WKB_MAX_DEPTH 32
+
+/* Most bands the segments are spread over */
+#define PC_GEOMETRY_MAX_BANDS 1024
+
+typedef struct
+{
+	const uint8_t *ptr;
+	const uint8_t *end;
+	int flip;
+	int ndims;
+	uint32_t maxedges;
+	PCGEOMETRY *geom;
+} PCWKBREADER;
+
+static int
+pc_wkb_read_uint32(PCWKBREADER *r, uint32_t *v)
+{
+	if ( r->end - r->ptr < 4 )
+		return PC_FAILURE;
+	*v = (uint32_t)wkb_get_int32(r->ptr, r->flip);
+	r->ptr += 4;
+	return PC_SUCCESS;
+}
+
+static double
+pc_wkb_get_double(const uint8_t *wkb, int flip)
+{
+	double d;
+	uint8_t buf[8];
+	int i;
+
+	if ( flip )
+	{
+		for ( i = 0; i < 8; i++ )
+			buf[i] = wkb[7-i];
+		memcpy(&d, buf, 8);
+	}
+	else
+	{
+		memcpy(&d, wkb, 8);
+	}
+	return d;
+}
+
+/* X and Y of the next point, skipping any Z and M */
+static int
+pc_wkb_read_point(PCWKBREADER *r, double *x, double *y)
+{
+	if ( r->end - r->ptr < 8 * r->ndims )
+		return PC_FAILURE;
+	*x = pc_wkb_get_double(r->ptr, r->flip);
+	*y = pc_wkb_get_double(r->ptr + 8, r->flip);
+	r->ptr += 8 * r->ndims;
+	return PC_SUCCESS;
+}
+
+static void
+pc_geometry_add_edge(PCWKBREADER *r, double x1, double y1, double x2, double y2, uint8_t ring)
+{
+	PCGEOMETRY *g = r->geom;
+	double *e;
+
+	if ( g->nedges == r->maxedges )
+	{
+		r->maxedges = r->maxedges ? r->maxedges * 2 : 64;
+		g->edges = g->edges ? pcrealloc(g->edges, r->maxedges * 4 * sizeof(double)) : pcalloc(r->maxedges * 4 * sizeof(double));
+		g->ring = g->ring ? pcrealloc(g->ring, r->maxedges) : pcalloc(r->maxedges);
+	}
+
+	e = g->edges + 4 * g->nedges;
+	e[0] = x1; e[1] = y1; e[2] = x2; e[3] = y2;
+	g->ring[g->nedges++] = ring;
+
+	g->bounds.xmin = fmin(g->bounds.xmin, fmin(x1, x2));
+	g->bounds.xmax = fmax(g->bounds.xmax, fmax(x1, x2));
+	g->bounds.ymin = fmin(g->bounds.ymin, fmin(y1, y2));
+	g->bounds.ymax = fmax(g->bounds.ymax, fmax(y1, y2));
+}
+
+/* Segments between the next npoints points, read after their count */
+static int
+pc_wkb_read_line(PCWKBREADER *r, uint8_t ring)
+{
+	uint32_t i, npoints;
+	double x, y, px = 0, py = 0;
+
+	if ( PC_FAILURE == pc_wkb_read_uint32(r, &npoints) )
+		return PC_FAILURE;
+	for ( i = 0; i < npoints; i++ )
+	{
+		if ( PC_FAILURE == pc_wkb_read_point(r, &x, &y) )
+			return PC_FAILURE;
+		if ( ! (isfinite(x) && isfinite(y)) )
+			return PC_FAILURE;
+		if ( i > 0 )
+			pc_geometry_add_edge(r, px, py, x, y, ring);
+		px = x;
+		py = y;
+	}
+	/* A lone point still counts for distances */
+	if ( npoints == 1 && ! ring )
+		pc_geometry_add_edge(r, px, py, px, py, ring);
+	return PC_SUCCESS;
+}
+
+static int
+pc_wkb_read_geometry(PCWKBREADER *r, int depth)
+{
+	uint32_t type, n, i;
+	double x, y;
+
+	if ( depth > WKB_MAX_DEPTH || r->end - r->ptr < 1 )
+		return PC_FAILURE;
+	r->flip = (*(r->ptr++) != machine_endian());
+	if ( PC_FAILURE == pc_wkb_read_uint32(r, &type) )
+		return PC_FAILURE;
+
+	r->ndims = 2;
+	if ( type & WKBZOFFSET ) r->ndims++;
+	if ( type & WKBMOFFSET ) r->ndims++;
+	if ( type & WKBSRIDFLAG )
+	{
+		if ( r->end - r->ptr < 4 )
+			return PC_FAILURE;
+		/* Only the outermost geometry sets the SRID */
+		if ( depth == 0 )
+			r->geom->srid = wkb_get_int32(r->ptr, r->flip);
+		r->ptr += 4;
+	}
+	type &= 0x0FFFFFFF;
+	/* ISO WKB: 1000 for Z, 2000 for M, 3000 for both */
+	r->ndims += (type / 1000 == 3 ? 2 : (type / 1000 ? 1 : 0));
+	type %= 1000;
+
+	switch ( type )
+	{
+	case WKB_POINT:
+	{
+		if ( PC_FAILURE == pc_wkb_read_point(r, &x, &y) )
+			return PC_FAILURE;
+		/* Empty points are NaN, no other non-finite point is valid */
+		if ( isnan(x) && isnan(y) )
+			return PC_SUCCESS;
+		if ( ! (isfinite(x) && isfinite(y)) )
+			return PC_FAILURE;
+		pc_geometry_add_edge(r, x, y, x, y, PC_FALSE);
+		return PC_SUCCESS;
+	}
+	case WKB_LINESTRING:
+		return pc_wkb_read_line(r, PC_FALSE);
+	case WKB_POLYGON:
+	{
+		if ( PC_FAILURE == pc_wkb_read_uint32(r, &n) )
+			return PC_FAILURE;
+		for ( i = 0; i < n; i++ )
+		{
+			if ( PC_FAILURE == pc_wkb_read_line(r, PC_TRUE) )
+				return PC_FAILURE;
+		}
+		return PC_SUCCESS;
+	}
+	case WKB_MULTIPOINT:
+	case WKB_MULTILINESTRING:
+	case WKB_MULTIPOLYGON:
+	case WKB_GEOMETRYCOLLECTION:
+	{
+		if ( PC_FAILURE == pc_wkb_read_uint32(r, &n) )
+			return PC_FAILURE;
+		for ( i = 0; i < n; i++ )
+		{
+			if ( PC_FAILURE == pc_wkb_read_geometry(r, depth + 1) )
+				return PC_FAILURE;
+		}
+		return PC_SUCCESS;
+	}
+	default:
+		pcerror("%s: unsupported WKB geometry type %d", __func__, type);
+		return PC_FAILURE;
+	}
+}
+
+static uint32_t
+pc_geometry_band(const PCGEOMETRY *g, double y)
+{
+	double b = floor((y - g->bounds.ymin) / g->bandheight);
+	/* Casting NaN or an infinity is undefined, clamp them first */
+	if ( ! isfinite(b) ) return b > 0 ? g->nbands - 1 : 0;
+	if ( b < 0 ) return 0;
+	if ( b >= g->nbands ) return g->nbands - 1;
+	return (uint32_t)b;
+}
+
+/* Spread the segments over horizontal bands, each listing those crossing it */
+static void
+pc_geometry_index(PCGEOMETRY *g)
+{
+	uint32_t i, b, *cursor;
+	double height = g->bounds.ymax - g->bounds.ymin;
+
+	g->nbands = g->nedges / 4 + 1;
+	if ( g->nbands > PC_GEOMETRY_MAX_BANDS )
+		g->nbands = PC_GEOMETRY_MAX_BANDS;
+	if ( ! (height > 0) )
+		g->nbands = 1;
+	g->bandheight = g->nbands > 1 ? height / g->nbands : 1.0;
+	g->bandstart = pcalloc((g->nbands + 1) * sizeof(uint32_t));
+
+	for ( i = 0; i < g->nedges; i++ )
+	{
+		const double *e = g->edges + 4 * i;
+		uint32_t b0 = pc_geometry_band(g, fmin(e[1], e[3]));
+		uint32_t b1 = pc_geometry_band(g, fmax(e[1], e[3]));
+		for ( b = b0; b <= b1; b++ )
+			g->bandstart[b+1]++;
+	}
+	for ( b = 0; b < g->nbands; b++ )
+		g->bandstart[b+1] += g->bandstart[b];
+
+	if ( ! g->bandstart[g->nbands] )
+		return;
+	g->bandedges = pcalloc(g->bandstart[g->nbands] * sizeof(uint32_t));
+	cursor = pcalloc(g->nbands * sizeof(uint32_t));
+	memcpy(cursor, g->bandstart, g->nbands * sizeof(uint32_t));
+	for ( i = 0; i < g->nedges; i++ )
+	{
+		const double *e = g->edges + 4 * i;
+		uint32_t b0 = pc_geometry_band(g, fmin(e[1], e[3]));
+		uint32_t b1 = pc_geometry_band(g, fmax(e[1], e[3]));
+		for ( b = b0; b <= b1; b++ )
+			g->bandedges[cursor[b]++] = i;
+	}
+	pcfree(cursor);
+}
+
+PCGEOMETRY *
+pc_geometry_from_wkb(const uint8_t *wkb, size_t wkbsize)
+{
+	PCWKBREADER r;
+	PCGEOMETRY *g = pcalloc(sizeof(PCGEOMETRY));
+
+	g->bounds.xmin = g->bounds.ymin = DBL_MAX;
+	g->bounds.xmax = g->bounds.ymax = -1 * DBL_MAX;
+
+	r.ptr = wkb;
+	r.end = wkb + wkbsize;
+	r.flip = PC_FALSE;
+	r.ndims = 2;
+	r.maxedges = 0;
+	r.geom = g;
+
+	if ( PC_FAILURE == pc_wkb_read_geometry(&r, 0) )
+	{
+		pc_geometry_free(g);
+		pcerror("%s: invalid or truncated WKB", __func__);
+		return NULL;
+	}
+
+	pc_geometry_index(g);
+	return g;
+}
+
+void
+pc_geometry_free(PCGEOMETRY *g)
+{
+	if ( ! g ) return;
+	if ( g->edges ) pcfree(g->edges);
+	if ( g->ring ) pcfree(g->ring);
+	if ( g->bandstart ) pcfree(g->bandstart);
+	if ( g->bandedges ) pcfree(g->bandedges);
+	pcfree(g);
+}
+
+/* Squared distance from a point to a segment */
+static double
+pc_segment_distance2(double x, double y, const double *e)
+{
+	double dx = e[2] - e[0];
+	double dy = e[3] - e[1];
+	double len2 = dx * dx + dy * dy;
+	double t = 0;
+
+	if ( len2 > 0 )
+	{
+		t = ((x - e[0]) * dx + (y - e[1]) * dy) / len2;
+		if ( t < 0 ) t = 0;
+		if ( t > 1 ) t = 1;
+	}
+	dx = e[0] + t * dx - x;
+	dy = e[1] + t * dy - y;
+	return dx * dx + dy * dy;
+}
+
+int
+pc_geometry_covers(const PCGEOMETRY *g, double x, double y, double distance)
+{
+	uint32_t i, b, b0, b1;
+	int inside = PC_FALSE;
+
+	if ( ! (isfinite(x) && isfinite(y) && isfinite(distance)) )
+		return PC_FALSE;
+	if ( x < g->bounds.xmin - distance || x > g->bounds.xmax + distance ||
+	     y < g->bounds.ymin - distance || y > g->bounds.ymax + distance )
+		return PC_FALSE;
+
+	/* Crossings of a ray to the right, over the ring segments of its band */
+	if ( y >= g->bounds.ymin && y <= g->bounds.ymax )
+	{
+		b = pc_geometry_band(g, y);
+		for ( i = g->bandstart[b]; i < g->bandstart[b+1]; i++ )
+		{
+			uint32_t ei = g->bandedges[i];
+			const double *e = g->edges + 4 * ei;
+			if ( g->ring[ei] && (e[1] > y) != (e[3] > y) &&
+			     x < (e[2] - e[0]) * (y - e[1]) / (e[3] - e[1]) + e[0] )
+				inside = ! inside;
+		}
+		if ( inside )
+			return PC_TRUE;
+	}
+
+	/* Then the segments of the bands within reach, boundaries included */
+	b0 = pc_geometry_band(g, y - distance);
+	b1 = pc_geometry_band(g, y + distance);
+	for ( b = b0; b <= b1; b++ )
+	{
+		for ( i = g->bandstart[b]; i < g->bandstart[b+1]; i++ )
+		{
+			if ( pc_segment_distance2(x, y, g->edges + 4 * g->bandedges[i]) <= distance * distance )
+				return PC_TRUE;
+		}
+	}
+	return PC_FALSE;
+}
+
+PC_MATCHTYPE
+pc_geometry_match_bounds(const PCGEOMETRY *g, const PCBOUNDS *bounds, double distance)
+{
+	uint32_t i;
+
+	if ( ! isfinite(distance) )
+		return PC_MATCH_NONE;
+	if ( bounds->xmax < g->bounds.xmin - distance || bounds->xmin > g->bounds.xmax + distance ||
+	     bounds->ymax < g->bounds.ymin - distance || bounds->ymin > g->bounds.ymax + distance )
+		return PC_MATCH_NONE;
+
+	/* Bounds no segment comes within reach of lie on one side of them all */
+	for ( i = 0; i < g->nedges; i++ )
+	{
+		const double *e = g->edges + 4 * i;
+		if ( fmax(e[0], e[2]) + distance >= bounds->xmin && fmin(e[0], e[2]) - distance <= bounds->xmax &&
+		     fmax(e[1], e[3]) + distance >= bounds->ymin && fmin(e[1], e[3]) - distance <= bounds->ymax )
+			return PC_MATCH_SOME;
+	}
+
+	/* and their centre tells which */
+	if ( pc_geometry_covers(g, (bounds->xmin + bounds->xmax) / 2, (bounds->ymin + bounds->ymax) / 2, distance) )
+		return PC_MATCH_ALL;
+	return PC_MATCH_NONE;
+}
@@ -45,13 +45,7 @@ pc_patch_compute_stats(PCPATCH *pa)
 		return pc_patch_uncompressed_compute_stats((PCPATCH_UNCOMPRESSED*)pa);
 
 	case PC_DIMENSIONAL:
-	{
-		PCPATCH_UNCOMPRESSED *pu = pc_patch_uncompressed_from_dimensional((PCPATCH_DIMENSIONAL*)pa);
-		pc_patch_uncompressed_compute_stats(pu);
-		pa->stats = pc_stats_clone(pu->stats);
-		pc_patch_uncompressed_free(pu);
-		return PC_SUCCESS;
-	}
+		return pc_patch_dimensional_compute_stats((PCPATCH_DIMENSIONAL*)pa);
 	case PC_GHT:
 	{
 		PCPATCH_UNCOMPRESSED *pu = pc_patch_uncompressed_from_ght((PCPATCH_GHT*)pa);
@@ -181,7 +175,7 @@ pc_patch_compress(const PCPATCH *patch, void *userdata)
 		else if ( patch_compression == PC_DIMENSIONAL )
 		{
 			PCPATCH_UNCOMPRESSED *pcu = pc_patch_uncompressed_from_dimensional((PCPATCH_DIMENSIONAL*)patch);
-			PCPATCH_GHT *pgc = pc_patch_ght_from_uncompressed((PCPATCH_UNCOMPRESSED*)patch);
+			PCPATCH_GHT *pgc = pc_patch_ght_from_uncompressed(pcu);
 			pc_patch_uncompressed_free(pcu);
 			return (PCPATCH*)pgc;
 		}
@@ -355,6 +349,7 @@ pc_patch_from_patchlist(PCPATCH **palist, int numpatches)
 	PCPATCH_UNCOMPRESSED *paout;
 	const PCSCHEMA *schema = NULL;
 	uint8_t *buf;
+	int all_dimensional = PC_TRUE;
 
 	assert(palist);
 	assert(numpatches);
@@ -370,9 +365,15 @@ pc_patch_from_patchlist(PCPATCH **palist, int numpatches)
 			pcerror("%s: inconsistent schemas in input", __func__);
 			return NULL;
 		}
+		if ( palist[i]->type != PC_DIMENSIONAL )
+			all_dimensional = PC_FALSE;
 		totalpoints += palist[i]->npoints;
 	}
 
+	/* Dimensional inputs are joined array by array, staying compressed */
+	if ( all_dimensional && totalpoints )
+		return (PCPATCH*)pc_patch_dimensional_from_patchlist(palist, numpatches);
+
 	/* Blank output */
 	paout = pc_patch_uncompressed_make(schema, totalpoints);
 	buf = paout->data;
@@ -0,0 +1,330 @@
+/***********************************************************************
+* pc_patch_builder.c
+*
+*  Build a patch up from points and patches, one uncompressed
+*  array of values per dimension, growing as they come in.
+*  As long as only dimensional patches come in they are held
+*  compressed and joined array by array at the end.
+*
+*  PgSQL Pointcloud is free and open source software provided
+*  by the Government of Canada
+*  Copyright (c) 2013 Natural Resources Canada
+*
+***********************************************************************/
+
+#include "pc_api_internal.h"
+#include <assert.h>
+
+PCPATCHBUILDER *
+pc_patch_builder_make(const PCSCHEMA *schema)
+{
+	PCPATCHBUILDER *b = pcalloc(sizeof(PCPATCHBUILDER));
+	b->schema = schema;
+	b->npoints = 0;
+	b->maxpoints = 0;
+	b->limitpoints = 0;
+	b->dims = pcalloc(schema->ndims * sizeof(uint8_t*));
+	b->patches = NULL;
+	b->npatches = b->maxpatches = 0;
+	return b;
+}
+
+void
+pc_patch_builder_free(PCPATCHBUILDER *b)
+{
+	int i;
+	for ( i = 0; i < b->schema->ndims; i++ )
+	{
+		if ( b->dims[i] )
+			pcfree(b->dims[i]);
+	}
+	for ( i = 0; i < b->npatches; i++ )
+		pc_patch_free(b->patches[i]);
+	if ( b->patches )
+		pcfree(b->patches);
+	pcfree(b->dims);
+	pcfree(b);
+}
+
+/*
+* Make room for npoints more points, doubling the arrays as they
+* fill but not past limitpoints, beyond which only what is needed
+* is allocated.
+*/
+static void
+pc_patch_builder_reserve(PCPATCHBUILDER *b, uint32_t npoints)
+{
+	int i;
+	uint32_t needed = b->npoints + npoints;
+	uint32_t maxpoints = b->maxpoints ? b->maxpoints : 64;
+
+	if ( needed < b->npoints )
+		pcerror("%s: too many points", __func__);
+	if ( needed <= b->maxpoints )
+		return;
+
+	while ( maxpoints < needed )
+		maxpoints = maxpoints > UINT32_MAX / 2 ? UINT32_MAX : maxpoints * 2;
+	if ( b->limitpoints && maxpoints > b->limitpoints )
+		maxpoints = needed > b->limitpoints ? needed : b->limitpoints;
+
+	for ( i = 0; i < b->schema->ndims; i++ )
+	{
+		size_t size = (size_t)maxpoints * b->schema->dims[i]->size;
+		if ( b->dims[i] )
+			b->dims[i] = pcrealloc(b->dims[i], size);
+		else
+			b->dims[i] = pcalloc(size);
+	}
+	b->maxpoints = maxpoints;
+}
+
+/* Keep a copy of a dimensional patch, arrays still compressed */
+static void
+pc_patch_builder_hold(PCPATCHBUILDER *b, const PCPATCH_DIMENSIONAL *pdl)
+{
+	int i;
+	PCPATCH_DIMENSIONAL *copy = pc_patch_dimensional_clone(pdl);
+
+	copy->readonly = PC_FALSE;
+	copy->npoints = pdl->npoints;
+	for ( i = 0; i < b->schema->ndims; i++ )
+		copy->bytes[i] = pc_bytes_clone(pdl->bytes[i]);
+	if ( pdl->stats )
+		copy->stats = pc_stats_clone(pdl->stats);
+
+	if ( b->npatches == b->maxpatches )
+	{
+		b->maxpatches = b->maxpatches ? 2 * b->maxpatches : 16;
+		if ( b->patches )
+			b->patches = pcrealloc(b->patches, b->maxpatches * sizeof(PCPATCH*));
+		else
+			b->patches = pcalloc(b->maxpatches * sizeof(PCPATCH*));
+	}
+	b->patches[b->npatches++] = (PCPATCH*)copy;
+	b->npoints += pdl->npoints;
+}
+
+/* Decode the held patches into the columns, before anything else is added */
+static void
+pc_patch_builder_flush(PCPATCHBUILDER *b)
+{
+	int i, j;
+	uint32_t npoints = b->npoints;
+
+	if ( ! b->npatches )
+		return;
+
+	b->npoints = 0;
+	pc_patch_builder_reserve(b, npoints);
+	for ( j = 0; j < b->npatches; j++ )
+	{
+		const PCPATCH_DIMENSIONAL *pdl = (const PCPATCH_DIMENSIONAL*)b->patches[j];
+		for ( i = 0; i < b->schema->ndims; i++ )
+			pc_bytes_decode_into(&(pdl->bytes[i]), b->dims[i] + (size_t)b->npoints * b->schema->dims[i]->size);
+		b->npoints += pdl->npoints;
+		pc_patch_free(b->patches[j]);
+	}
+	b->npatches = 0;
+}
+
+int
+pc_patch_builder_add_point(PCPATCHBUILDER *b, const PCPOINT *pt)
+{
+	int i;
+
+	if ( pt->schema->pcid != b->schema->pcid )
+	{
+		pcerror("%s: inconsistent schemas in input", __func__);
+		return PC_FAILURE;
+	}
+
+	pc_patch_builder_flush(b);
+	pc_patch_builder_reserve(b, 1);
+	for ( i = 0; i < b->schema->ndims; i++ )
+	{
+		const PCDIMENSION *dim = b->schema->dims[i];
+		memcpy(b->dims[i] + (size_t)b->npoints * dim->size, pt->data + dim->byteoffset, dim->size);
+	}
+	b->npoints++;
+	return PC_SUCCESS;
+}
+
+int
+pc_patch_builder_add_patch(PCPATCHBUILDER *b, const PCPATCH *pa)
+{
+	int i;
+	uint32_t j;
+	const PCSCHEMA *schema = b->schema;
+
+	if ( pa->schema->pcid != schema->pcid )
+	{
+		pcerror("%s: inconsistent schemas in input", __func__);
+		return PC_FAILURE;
+	}
+	if ( ! pa->npoints )
+		return PC_SUCCESS;
+
+	/* Only dimensional patches so far, keep them compressed */
+	if ( pa->type == PC_DIMENSIONAL && (b->npatches || ! b->npoints) )
+	{
+		pc_patch_builder_hold(b, (const PCPATCH_DIMENSIONAL*)pa);
+		return PC_SUCCESS;
+	}
+	pc_patch_builder_flush(b);
+
+	switch ( pa->type )
+	{
+	case PC_DIMENSIONAL:
+	{
+		/* Each array decodes straight onto the end of its column */
+		const PCPATCH_DIMENSIONAL *pdl = (const PCPATCH_DIMENSIONAL*)pa;
+		pc_patch_builder_reserve(b, pa->npoints);
+		for ( i = 0; i < schema->ndims; i++ )
+			pc_bytes_decode_into(&(pdl->bytes[i]), b->dims[i] + (size_t)b->npoints * schema->dims[i]->size);
+		break;
+	}
+	case PC_NONE:
+	{
+		const PCPATCH_UNCOMPRESSED *pu = (const PCPATCH_UNCOMPRESSED*)pa;
+		pc_patch_builder_reserve(b, pa->npoints);
+		for ( i = 0; i < schema->ndims; i++ )
+		{
+			const PCDIMENSION *dim = schema->dims[i];
+			const uint8_t *in = pu->data + dim->byteoffset;
+			uint8_t *out = b->dims[i] + (size_t)b->npoints * dim->size;
+			for ( j = 0; j < pa->npoints; j++ )
+			{
+				memcpy(out, in, dim->size);
+				in += schema->size;
+				out += dim->size;
+			}
+		}
+		break;
+	}
+	case PC_GHT:
+	{
+		PCPATCH_UNCOMPRESSED *pu = pc_patch_uncompressed_from_ght((const PCPATCH_GHT*)pa);
+		int rv = pc_patch_builder_add_patch(b, (PCPATCH*)pu);
+		pc_patch_uncompressed_free(pu);
+		return rv;
+	}
+	default:
+	{
+		pcerror("%s: unknown compression type (%d)", __func__, pa->type);
+		return PC_FAILURE;
+	}
+	}
+
+	b->npoints += pa->npoints;
+	return PC_SUCCESS;
+}
+
+int
+pc_patch_builder_merge(PCPATCHBUILDER *b, const PCPATCHBUILDER *other)
+{
+	int i;
+	const PCSCHEMA *schema = b->schema;
+
+	if ( other->schema->pcid != schema->pcid )
+	{
+		pcerror("%s: inconsistent schemas in input", __func__);
+		return PC_FAILURE;
+	}
+	if ( ! other->npoints )
+		return PC_SUCCESS;
+
+	/* Held patches carry on being held where they can */
+	if ( other->npatches )
+	{
+		for ( i = 0; i < other->npatches; i++ )
+			pc_patch_builder_add_patch(b, other->patches[i]);
+		return PC_SUCCESS;
+	}
+
+	pc_patch_builder_flush(b);
+	pc_patch_builder_reserve(b, other->npoints);
+	for ( i = 0; i < schema->ndims; i++ )
+	{
+		size_t size = schema->dims[i]->size;
+		memcpy(b->dims[i] + (size_t)b->npoints * size, other->dims[i], (size_t)other->npoints * size);
+	}
+	b->npoints += other->npoints;
+	return PC_SUCCESS;
+}
+
+void
+pc_patch_builder_copy_dimension(const PCPATCHBUILDER *b, int dim, uint8_t *out)
+{
+	int i;
+	size_t size = b->schema->dims[dim]->size;
+
+	if ( ! b->npatches )
+	{
+		if ( b->npoints )
+			memcpy(out, b->dims[dim], (size_t)b->npoints * size);
+		return;
+	}
+	for ( i = 0; i < b->npatches; i++ )
+	{
+		const PCPATCH_DIMENSIONAL *pdl = (const PCPATCH_DIMENSIONAL*)b->patches[i];
+		pc_bytes_decode_into(&(pdl->bytes[dim]), out);
+		out += (size_t)pdl->npoints * size;
+	}
+}
+
+PCPATCH *
+pc_patch_builder_to_patch(const PCPATCHBUILDER *b)
+{
+	int i;
+	const PCSCHEMA *schema = b->schema;
+	PCPATCH_DIMENSIONAL *pdl, *pdc;
+
+	if ( ! b->npoints )
+		return NULL;
+
+	/* Held patches are joined array by array, stats merged from theirs */
+	if ( b->npatches )
+		return (PCPATCH*)pc_patch_dimensional_from_patchlist(b->patches, b->npatches);
+
+	/* A read-only view over the columns, the builder keeps them */
+	pdl = pcalloc(sizeof(PCPATCH_DIMENSIONAL));
+	pdl->type = PC_DIMENSIONAL;
+	pdl->readonly = PC_FALSE;
+	pdl->schema = schema;
+	pdl->npoints = b->npoints;
+	pdl->bytes = pcalloc(schema->ndims * sizeof(PCBYTES));
+	for ( i = 0; i < schema->ndims; i++ )
+	{
+		PCBYTES *pcb = &(pdl->bytes[i]);
+		pcb->size = (size_t)b->npoints * schema->dims[i]->size;
+		pcb->npoints = b->npoints;
+		pcb->interpretation = schema->dims[i]->interpretation;
+		pcb->compression = PC_DIM_NONE;
+		pcb->readonly = PC_TRUE;
+		pcb->bytes = b->dims[i];
+	}
+
+	if ( PC_FAILURE == pc_patch_dimensional_compute_stats(pdl) ||
+	     PC_FAILURE == pc_patch_dimensional_compute_extent(pdl) )
+	{
+		pc_patch_free((PCPATCH*)pdl);
+		pcerror("%s: failed to compute patch stats", __func__);
+		return NULL;
+	}
+
+	/* Other schemas are converted by the serializer */
+	if ( schema->compression != PC_DIMENSIONAL )
+		return (PCPATCH*)pdl;
+
+	/* The compressed patch takes over the stats */
+	pdc = pc_patch_dimensional_compress(pdl, NULL);
+	if ( ! pdc )
+	{
+		pc_patch_free((PCPATCH*)pdl);
+		pcerror("%s: failed to compress patch", __func__);
+		return NULL;
+	}
+	pc_patch_dimensional_free(pdl);
+	return (PCPATCH*)pdc;
+}
@@ -82,6 +82,37 @@ pc_patch_dimensional_serialized_size(const PCPATCH_DIMENSIONAL *patch)
 	return size;
 }
 
+size_t
+pc_patch_dimensional_serialized_size_bound(const PCPATCH_DIMENSIONAL *pdl, const uint32_t *compressions)
+{
+	int i;
+	size_t size = 0;
+	for ( i = 0; i < pdl->schema->ndims; i++ )
+		size += pc_bytes_serialized_size_bound(&(pdl->bytes[i]), compressions[i]);
+	return size;
+}
+
+/**
+* Serialize the dimensions of an uncompressed patch into buf,
+* encoding each one straight into place, with no intermediate
+* compressed copy. Returns the size written.
+*/
+size_t
+pc_patch_dimensional_serialize_encoded(const PCPATCH_DIMENSIONAL *pdl, const uint32_t *compressions, uint8_t *buf)
+{
+	int i;
+	size_t size = 0;
+	PCBYTESSCRATCH scratch = {NULL, 0};
+
+	for ( i = 0; i < pdl->schema->ndims; i++ )
+	{
+		assert(pdl->bytes[i].compression == PC_DIM_NONE);
+		size += pc_bytes_serialize_encoded(&(pdl->bytes[i]), compressions[i], pdl->schema->dimcompression_level, buf + size, &scratch);
+	}
+	pc_bytes_scratch_free(&scratch);
+	return size;
+}
+
 
 char *
 pc_patch_dimensional_to_string(const PCPATCH_DIMENSIONAL *pa)
@@ -131,33 +162,52 @@ pc_patch_dimensional_from_uncompressed(const PCPATCH_UNCOMPRESSED *pa)
 	return pdl;
 }
 
+/**
+* Pick the compression of each dimension of an uncompressed patch,
+* as dictated by stats (updating them while still sampling), or
+* without stats by sizing this patch's own values under every codec.
+*/
+void
+pc_patch_dimensional_compressions(const PCPATCH_DIMENSIONAL *pdl, PCDIMSTATS *pds, uint32_t *compressions)
+{
+	int i;
+
+	/* Still sampling, update stats */
+	if ( pds && pds->total_points < PCDIMSTATS_MIN_SAMPLE )
+		pc_dimstats_update(pds, pdl);
+
+	for ( i = 0; i < pdl->schema->ndims; i++ )
+	{
+		if ( pds )
+			compressions[i] = pds->stats[i].recommended_compression;
+		else
+			compressions[i] = pc_bytes_choose_compression(&(pdl->bytes[i]), pdl->schema->dimcompression);
+	}
+}
+
 PCPATCH_DIMENSIONAL *
 pc_patch_dimensional_compress(const PCPATCH_DIMENSIONAL *pdl, PCDIMSTATS *pds)
 {
 	int i;
 	int ndims = pdl->schema->ndims;
 	PCPATCH_DIMENSIONAL *pdl_compressed;
+	uint32_t *compressions;
 
 	assert(pdl);
 	assert(pdl->schema);
 
-	if ( ! pds )
-		pds = pc_dimstats_make(pdl->schema);
-
-	/* Still sampling, update stats */
-	if ( pds->total_points < PCDIMSTATS_MIN_SAMPLE )
-		pc_dimstats_update(pds, pdl);
+	compressions = pcalloc(ndims * sizeof(uint32_t));
+	pc_patch_dimensional_compressions(pdl, pds, compressions);
 
 	pdl_compressed = pcalloc(sizeof(PCPATCH_DIMENSIONAL));
 	memcpy(pdl_compressed, pdl, sizeof(PCPATCH_DIMENSIONAL));
 	pdl_compressed->bytes = pcalloc(ndims*sizeof(PCBYTES));
 
-	/* Compress each dimension as dictated by stats */
+	/* Compress each dimension */
 	for ( i = 0; i < ndims; i++ )
-	{
-		pdl_compressed->bytes[i] = pc_bytes_encode(pdl->bytes[i], pds->stats[i].recommended_compression);
-	}
+		pdl_compressed->bytes[i] = pc_bytes_encode_level(pdl->bytes[i], compressions[i], pdl->schema->dimcompression_level);
 
+	pcfree(compressions);
 	return pdl_compressed;
 }
 
@@ -202,32 +252,30 @@ pc_patch_dimensional_free(PCPATCH_DIMENSIONAL *pdl)
 	pcfree(pdl);
 }
 
+/* Scaled extremes of one dimension, whatever the sign of its scale */
+static void
+pc_patch_dimensional_dim_extent(const PCPATCH_DIMENSIONAL *pdl, uint32_t dimnum, double *min, double *max)
+{
+	PCBYTESSTAT stat;
+	const PCDIMENSION *dim = pdl->schema->dims[dimnum];
+	double a, b;
+
+	pc_bytes_stat_init(&stat);
+	pc_bytes_stat(&(pdl->bytes[dimnum]), &stat);
+	a = pc_value_scale_offset(stat.min, dim);
+	b = pc_value_scale_offset(stat.max, dim);
+	*min = a < b ? a : b;
+	*max = a < b ? b : a;
+}
+
 int
 pc_patch_dimensional_compute_extent(PCPATCH_DIMENSIONAL *pdl)
 {
-	int i;
-	double xmin, xmax, ymin, ymax, xavg, yavg;
-	int rv;
-	PCBYTES *pcb;
-
 	assert(pdl);
 	assert(pdl->schema);
 
-	/* Get x extremes */
-	pcb = &(pdl->bytes[pdl->schema->x_position]);
-	rv = pc_bytes_minmax(pcb, &xmin, &xmax, &xavg);
-	xmin = pc_value_scale_offset(xmin, pdl->schema->dims[pdl->schema->x_position]);
-	xmax = pc_value_scale_offset(xmax, pdl->schema->dims[pdl->schema->x_position]);
-	pdl->bounds.xmin = xmin;
-	pdl->bounds.xmax = xmax;
-
-	/* Get y extremes */
-	pcb = &(pdl->bytes[pdl->schema->y_position]);
-	rv = pc_bytes_minmax(pcb, &ymin, &ymax, &yavg);
-	ymin = pc_value_scale_offset(xmin, pdl->schema->dims[pdl->schema->y_position]);
-	ymax = pc_value_scale_offset(xmax, pdl->schema->dims[pdl->schema->y_position]);
-	pdl->bounds.ymin = ymin;
-	pdl->bounds.ymax = ymax;
+	pc_patch_dimensional_dim_extent(pdl, pdl->schema->x_position, &(pdl->bounds.xmin), &(pdl->bounds.xmax));
+	pc_patch_dimensional_dim_extent(pdl, pdl->schema->y_position, &(pdl->bounds.ymin), &(pdl->bounds.ymax));
 	return PC_SUCCESS;
 }
 
@@ -327,6 +375,48 @@ pc_patch_dimensional_from_pointlist(const PCPOINTLIST *pdl)
 	return dimpatch;
 }
 
+/**
+* Union of dimensional patches that never builds the points. Each
+* dimension is the inputs' arrays joined end to end, the stats are
+* merged from the inputs' stats and the bounds from their bounds.
+*/
+PCPATCH_DIMENSIONAL *
+pc_patch_dimensional_from_patchlist(PCPATCH **palist, int numpatches)
+{
+	int i, j, n;
+	const PCSCHEMA *schema = palist[0]->schema;
+	PCPATCH_DIMENSIONAL *pdl = pc_patch_dimensional_clone((PCPATCH_DIMENSIONAL*)palist[0]);
+	PCBYTES *pcbs = pcalloc(numpatches * sizeof(PCBYTES));
+
+	pdl->readonly = PC_FALSE;
+	pc_bounds_init(&(pdl->bounds));
+	for ( i = 0; i < numpatches; i++ )
+	{
+		if ( palist[i]->type != PC_DIMENSIONAL )
+			pcerror("%s: patch %d is not dimensional", __func__, i);
+		pdl->npoints += palist[i]->npoints;
+		pc_bounds_merge(&(pdl->bounds), &(palist[i]->bounds));
+	}
+
+	for ( j = 0; j < schema->ndims; j++ )
+	{
+		/* Empty inputs have nothing to add */
+		for ( i = 0, n = 0; i < numpatches; i++ )
+			if ( palist[i]->npoints )
+				pcbs[n++] = ((PCPATCH_DIMENSIONAL*)palist[i])->bytes[j];
+		pdl->bytes[j] = pc_bytes_concat(pcbs, n, schema->dimcompression, schema->dimcompression_level);
+	}
+	pcfree(pcbs);
+
+	pdl->stats = pc_stats_merge(palist, numpatches);
+	if ( ! pdl->stats && PC_FAILURE == pc_patch_dimensional_compute_stats(pdl) )
+	{
+		pcerror("%s: stats computation failed", __func__);
+		return NULL;
+	}
+	return pdl;
+}
+
 char * pc_patch_dimensional_bytes_array_to_string(PCPATCH_DIMENSIONAL* pd)
 {
 	int i;
@@ -180,25 +180,43 @@ pc_patch_uncompressed_make(const PCSCHEMA *s, uint32_t maxpoints)
 int
 pc_patch_uncompressed_compute_extent(PCPATCH_UNCOMPRESSED *patch)
 {
-	int i;
-	PCPOINT *pt = pc_point_from_data(patch->schema, patch->data);
+	uint32_t i, n;
+	const PCSCHEMA *schema = patch->schema;
+	const PCDIMENSION *xdim = pc_schema_get_dimension(schema, schema->x_position);
+	const PCDIMENSION *ydim = pc_schema_get_dimension(schema, schema->y_position);
+	double vals[PC_DOUBLE_ARRAY_CHUNK];
+	PCDOUBLESTAT xstat, ystat;
 	PCBOUNDS b;
-	double x, y;
 
-	/* Calculate bounds */
+	/* Calculate bounds, a chunk of X and Y values at a time */
 	pc_bounds_init(&b);
-	for ( i = 0; i < patch->npoints; i++ )
+	if ( ! ( xdim && ydim ) )
+	{
+		patch->bounds = b;
+		return PC_SUCCESS;
+	}
+	xstat.min = ystat.min = b.xmin;
+	xstat.max = ystat.max = b.xmax;
+	xstat.sum = ystat.sum = 0.0;
+	for ( i = 0; i < patch->npoints; i += n )
 	{
-		/* Just push the data buffer forward by one point at a time */
-		pt->data = patch->data + i * patch->schema->size;
-		x = pc_point_get_x(pt);
-		y = pc_point_get_y(pt);
-		if ( b.xmin > x ) b.xmin = x;
-		if ( b.ymin > y ) b.ymin = y;
-		if ( b.xmax < x ) b.xmax = x;
-		if ( b.ymax < y ) b.ymax = y;
+		n = patch->npoints - i;
+		if ( n > PC_DOUBLE_ARRAY_CHUNK )
+			n = PC_DOUBLE_ARRAY_CHUNK;
+		pc_double_array_from_ptr(vals, patch->data + i * schema->size + xdim->byteoffset,
+		                         xdim->interpretation, schema->size, n);
+		pc_double_array_scale_offset(vals, n, xdim);
+		pc_double_array_stat(vals, n, &xstat);
+		pc_double_array_from_ptr(vals, patch->data + i * schema->size + ydim->byteoffset,
+		                         ydim->interpretation, schema->size, n);
+		pc_double_array_scale_offset(vals, n, ydim);
+		pc_double_array_stat(vals, n, &ystat);
 	}
 
+	b.xmin = xstat.min;
+	b.xmax = xstat.max;
+	b.ymin = ystat.min;
+	b.ymax = ystat.max;
 	patch->bounds = b;
 	return PC_SUCCESS;
 }
@@ -0,0 +1,516 @@
+/***********************************************************************
+* pc_predicate.c
+*
+*  Conditions on the dimensions of a patch, parsed from text
+*  and checked against patch stats.
+*
+*  PgSQL Pointcloud is free and open source software provided
+*  by the Government of Canada
+*  Copyright (c) 2013 Natural Resources Canada
+*
+***********************************************************************/
+
+#include "pc_api_internal.h"
+#include <ctype.h>
+#include <float.h>
+#include <math.h>
+
+/*
+* Grammar, keywords in any case:
+*
+*   or     := and ( OR and )*
+*   and    := term ( AND term )*
+*   term   := '(' or ')'
+*           | dim ( '<' | '<=' | '>' | '>=' | '=' ) number
+*           | dim BETWEEN number AND number
+*           | dim IN '(' number ( ',' number )* ')'
+*   dim    := name | '"' name '"'
+*/
+
+typedef struct
+{
+	const PCSCHEMA *schema;
+	const char *str;
+	const char *ptr;
+	int depth;
+} PCPREDPARSER;
+
+/* Parentheses nested deeper than this are refused */
+#define PC_PREDICATE_MAX_DEPTH 64
+
+static PCPREDICATE* pc_predicate_parse_or(PCPREDPARSER *p);
+
+static PCPREDICATE *
+pc_predicate_new(PC_PREDICATETYPE type)
+{
+	PCPREDICATE *pred = pcalloc(sizeof(PCPREDICATE));
+	pred->type = type;
+	pred->min = -1 * DBL_MAX;
+	pred->max = DBL_MAX;
+	pred->mininc = pred->maxinc = PC_TRUE;
+	return pred;
+}
+
+void
+pc_predicate_free(PCPREDICATE *pred)
+{
+	uint32_t i;
+	if ( ! pred ) return;
+	for ( i = 0; i < pred->nargs; i++ )
+		pc_predicate_free(pred->args[i]);
+	if ( pred->args ) pcfree(pred->args);
+	if ( pred->vals ) pcfree(pred->vals);
+	pcfree(pred);
+}
+
+static void
+pc_predicate_add_arg(PCPREDICATE *pred, PCPREDICATE *arg)
+{
+	if ( pred->args )
+		pred->args = pcrealloc(pred->args, (pred->nargs + 1) * sizeof(PCPREDICATE*));
+	else
+		pred->args = pcalloc(sizeof(PCPREDICATE*));
+	pred->args[pred->nargs++] = arg;
+}
+
+static void
+pc_predicate_skip_space(PCPREDPARSER *p)
+{
+	while ( isspace((unsigned char)*p->ptr) )
+		p->ptr++;
+}
+
+static int
+pc_predicate_is_name_char(char c)
+{
+	return isalnum((unsigned char)c) || c == '_';
+}
+
+/* Consume a keyword if it comes next as a whole word */
+static int
+pc_predicate_keyword(PCPREDPARSER *p, const char *kw)
+{
+	size_t len = strlen(kw);
+	pc_predicate_skip_space(p);
+	if ( strncasecmp(p->ptr, kw, len) == 0 && ! pc_predicate_is_name_char(p->ptr[len]) )
+	{
+		p->ptr += len;
+		return PC_TRUE;
+	}
+	return PC_FALSE;
+}
+
+/* Consume a punctuation token if it comes next */
+static int
+pc_predicate_token(PCPREDPARSER *p, const char *tok)
+{
+	size_t len = strlen(tok);
+	pc_predicate_skip_space(p);
+	if ( strncmp(p->ptr, tok, len) == 0 )
+	{
+		p->ptr += len;
+		return PC_TRUE;
+	}
+	return PC_FALSE;
+}
+
+static void
+pc_predicate_syntax_error(PCPREDPARSER *p, const char *expected)
+{
+	pc_predicate_skip_space(p);
+	if ( *p->ptr )
+		pcerror("predicate \"%s\": expected %s at \"%s\"", p->str, expected, p->ptr);
+	else
+		pcerror("predicate \"%s\": expected %s at end of input", p->str, expected);
+}
+
+static int
+pc_predicate_number(PCPREDPARSER *p, double *d)
+{
+	char *end;
+	pc_predicate_skip_space(p);
+	*d = strtod(p->ptr, &end);
+	if ( end == p->ptr || ! isfinite(*d) )
+	{
+		pc_predicate_syntax_error(p, "a number");
+		return PC_FAILURE;
+	}
+	p->ptr = end;
+	return PC_SUCCESS;
+}
+
+static int
+pc_predicate_dimension(PCPREDPARSER *p, uint32_t *dimnum)
+{
+	char name[256];
+	size_t len = 0;
+	PCDIMENSION *dim;
+
+	pc_predicate_skip_space(p);
+	if ( *p->ptr == '"' )
+	{
+		const char *end = strchr(p->ptr + 1, '"');
+		if ( ! end )
+		{
+			pc_predicate_syntax_error(p, "a closing quote");
+			return PC_FAILURE;
+		}
+		len = end - p->ptr - 1;
+		if ( len >= sizeof(name) ) len = sizeof(name) - 1;
+		memcpy(name, p->ptr + 1, len);
+		p->ptr = end + 1;
+	}
+	else
+	{
+		while ( pc_predicate_is_name_char(p->ptr[len]) )
+			len++;
+		if ( ! len )
+		{
+			pc_predicate_syntax_error(p, "a dimension name");
+			return PC_FAILURE;
+		}
+		if ( len >= sizeof(name) ) len = sizeof(name) - 1;
+		memcpy(name, p->ptr, len);
+		while ( pc_predicate_is_name_char(*p->ptr) )
+			p->ptr++;
+	}
+	name[len] = '\0';
+
+	dim = pc_schema_get_dimension_by_name(p->schema, name);
+	if ( ! dim )
+	{
+		pcerror("predicate \"%s\": dimension \"%s\" does not exist in schema", p->str, name);
+		return PC_FAILURE;
+	}
+	*dimnum = dim->position;
+	return PC_SUCCESS;
+}
+
+static PCPREDICATE *
+pc_predicate_parse_term(PCPREDPARSER *p)
+{
+	PCPREDICATE *pred;
+	uint32_t dimnum;
+	double d;
+	int rv;
+
+	if ( pc_predicate_token(p, "(") )
+	{
+		if ( p->depth >= PC_PREDICATE_MAX_DEPTH )
+		{
+			pcerror("predicate \"%s\": parentheses nested deeper than %d", p->str, PC_PREDICATE_MAX_DEPTH);
+			return NULL;
+		}
+		p->depth++;
+		pred = pc_predicate_parse_or(p);
+		p->depth--;
+		if ( pred && ! pc_predicate_token(p, ")") )
+		{
+			pc_predicate_syntax_error(p, "\")\"");
+			pc_predicate_free(pred);
+			return NULL;
+		}
+		return pred;
+	}
+
+	if ( PC_FAILURE == pc_predicate_dimension(p, &dimnum) )
+		return NULL;
+
+	if ( pc_predicate_keyword(p, "IN") )
+	{
+		pred = pc_predicate_new(PC_PRED_IN);
+		pred->dimnum = dimnum;
+		if ( ! pc_predicate_token(p, "(") )
+		{
+			pc_predicate_syntax_error(p, "\"(\"");
+			pc_predicate_free(pred);
+			return NULL;
+		}
+		do
+		{
+			if ( PC_FAILURE == pc_predicate_number(p, &d) )
+			{
+				pc_predicate_free(pred);
+				return NULL;
+			}
+			if ( pred->vals )
+				pred->vals = pcrealloc(pred->vals, (pred->nvals + 1) * sizeof(double));
+			else
+				pred->vals = pcalloc(sizeof(double));
+			pred->vals[pred->nvals++] = d;
+		}
+		while ( pc_predicate_token(p, ",") );
+		if ( ! pc_predicate_token(p, ")") )
+		{
+			pc_predicate_syntax_error(p, "\")\"");
+			pc_predicate_free(pred);
+			return NULL;
+		}
+		return pred;
+	}
+
+	pred = pc_predicate_new(PC_PRED_RANGE);
+	pred->dimnum = dimnum;
+
+	if ( pc_predicate_keyword(p, "BETWEEN") )
+	{
+		double d2;
+		if ( PC_FAILURE == pc_predicate_number(p, &d) )
+		{
+			pc_predicate_free(pred);
+			return NULL;
+		}
+		if ( ! pc_predicate_keyword(p, "AND") )
+		{
+			pc_predicate_syntax_error(p, "AND");
+			pc_predicate_free(pred);
+			return NULL;
+		}
+		if ( PC_FAILURE == pc_predicate_number(p, &d2) )
+		{
+			pc_predicate_free(pred);
+			return NULL;
+		}
+		pred->min = d;
+		pred->max = d2;
+		return pred;
+	}
+
+	/* Two character operators first */
+	if ( pc_predicate_token(p, "<=") )
+	{
+		rv = pc_predicate_number(p, &(pred->max));
+	}
+	else if ( pc_predicate_token(p, ">=") )
+	{
+		rv = pc_predicate_number(p, &(pred->min));
+	}
+	else if ( pc_predicate_token(p, "<") )
+	{
+		rv = pc_predicate_number(p, &(pred->max));
+		pred->maxinc = PC_FALSE;
+	}
+	else if ( pc_predicate_token(p, ">") )
+	{
+		rv = pc_predicate_number(p, &(pred->min));
+		pred->mininc = PC_FALSE;
+	}
+	else if ( pc_predicate_token(p, "=") )
+	{
+		rv = pc_predicate_number(p, &d);
+		pred->min = pred->max = d;
+	}
+	else
+	{
+		pc_predicate_syntax_error(p, "a comparison");
+		rv = PC_FAILURE;
+	}
+
+	if ( rv == PC_FAILURE )
+	{
+		pc_predicate_free(pred);
+		return NULL;
+	}
+	return pred;
+}
+
+/* A run of terms joined by one keyword, as a single node unless there is only one */
+static PCPREDICATE *
+pc_predicate_parse_list(PCPREDPARSER *p, PC_PREDICATETYPE type)
+{
+	PCPREDICATE *pred, *arg;
+	const char *kw = (type == PC_PRED_AND ? "AND" : "OR");
+
+	arg = (type == PC_PRED_AND ? pc_predicate_parse_term(p) : pc_predicate_parse_list(p, PC_PRED_AND));
+	if ( ! arg ) return NULL;
+	if ( ! pc_predicate_keyword(p, kw) )
+		return arg;
+
+	pred = pc_predicate_new(type);
+	pc_predicate_add_arg(pred, arg);
+	do
+	{
+		arg = (type == PC_PRED_AND ? pc_predicate_parse_term(p) : pc_predicate_parse_list(p, PC_PRED_AND));
+		if ( ! arg )
+		{
+			pc_predicate_free(pred);
+			return NULL;
+		}
+		pc_predicate_add_arg(pred, arg);
+	}
+	while ( pc_predicate_keyword(p, kw) );
+
+	return pred;
+}
+
+static PCPREDICATE *
+pc_predicate_parse_or(PCPREDPARSER *p)
+{
+	return pc_predicate_parse_list(p, PC_PRED_OR);
+}
+
+PCPREDICATE *
+pc_predicate_parse(const PCSCHEMA *schema, const char *str)
+{
+	PCPREDPARSER p;
+	PCPREDICATE *pred;
+
+	p.schema = schema;
+	p.str = str;
+	p.ptr = str;
+	p.depth = 0;
+
+	pred = pc_predicate_parse_or(&p);
+	if ( ! pred )
+		return NULL;
+
+	pc_predicate_skip_space(&p);
+	if ( *p.ptr )
+	{
+		pc_predicate_syntax_error(&p, "AND or OR");
+		pc_predicate_free(pred);
+		return NULL;
+	}
+	return pred;
+}
+
+static int
+pc_predicate_range_has(const PCPREDICATE *pred, double d)
+{
+	return (pred->mininc ? d >= pred->min : d > pred->min) &&
+	       (pred->maxinc ? d <= pred->max : d < pred->max);
+}
+
+PC_MATCHTYPE
+pc_predicate_match_stats(const PCPREDICATE *pred, const PCSTATS *stats)
+{
+	uint32_t i;
+	double min, max;
+
+	switch ( pred->type )
+	{
+	case PC_PRED_AND:
+	case PC_PRED_OR:
+	{
+		/* AND is NONE on any NONE, OR is ALL on any ALL */
+		PC_MATCHTYPE stop = (pred->type == PC_PRED_AND ? PC_MATCH_NONE : PC_MATCH_ALL);
+		PC_MATCHTYPE result = (pred->type == PC_PRED_AND ? PC_MATCH_ALL : PC_MATCH_NONE);
+		for ( i = 0; i < pred->nargs; i++ )
+		{
+			PC_MATCHTYPE m = pc_predicate_match_stats(pred->args[i], stats);
+			if ( m == stop )
+				return stop;
+			if ( m != result )
+				result = PC_MATCH_SOME;
+		}
+		return result;
+	}
+	case PC_PRED_RANGE:
+	{
+		pc_point_get_double_by_index(&(stats->min), pred->dimnum, &min);
+		pc_point_get_double_by_index(&(stats->max), pred->dimnum, &max);
+		if ( pc_predicate_range_has(pred, min) && pc_predicate_range_has(pred, max) )
+			return PC_MATCH_ALL;
+		if ( (pred->maxinc ? min > pred->max : min >= pred->max) ||
+		     (pred->mininc ? max < pred->min : max <= pred->min) )
+			return PC_MATCH_NONE;
+		return PC_MATCH_SOME;
+	}
+	case PC_PRED_IN:
+	{
+		PC_MATCHTYPE result = PC_MATCH_NONE;
+		pc_point_get_double_by_index(&(stats->min), pred->dimnum, &min);
+		pc_point_get_double_by_index(&(stats->max), pred->dimnum, &max);
+		for ( i = 0; i < pred->nvals; i++ )
+		{
+			if ( pred->vals[i] >= min && pred->vals[i] <= max )
+			{
+				if ( min == max )
+					return PC_MATCH_ALL;
+				result = PC_MATCH_SOME;
+			}
+		}
+		return result;
+	}
+	}
+	return PC_MATCH_SOME;
+}
+
+void
+pc_predicate_dimensions(const PCPREDICATE *pred, uint8_t *used)
+{
+	uint32_t i;
+	if ( pred->type == PC_PRED_AND || pred->type == PC_PRED_OR )
+	{
+		for ( i = 0; i < pred->nargs; i++ )
+			pc_predicate_dimensions(pred->args[i], used);
+	}
+	else
+	{
+		used[pred->dimnum] = PC_TRUE;
+	}
+}
+
+uint32_t
+pc_predicate_eval(const PCPREDICATE *pred, double **dimvals, uint32_t npoints, uint8_t *map)
+{
+	uint32_t i, j, nset = 0;
+
+	switch ( pred->type )
+	{
+	case PC_PRED_AND:
+	case PC_PRED_OR:
+	{
+		uint8_t *argmap = pcalloc(npoints);
+		nset = pc_predicate_eval(pred->args[0], dimvals, npoints, map);
+		for ( i = 1; i < pred->nargs; i++ )
+		{
+			/* Nothing left to take away, or to add */
+			if ( (pred->type == PC_PRED_AND && nset == 0) ||
+			     (pred->type == PC_PRED_OR && nset == npoints) )
+				break;
+			pc_predicate_eval(pred->args[i], dimvals, npoints, argmap);
+			nset = 0;
+			for ( j = 0; j < npoints; j++ )
+			{
+				if ( pred->type == PC_PRED_AND )
+					map[j] &= argmap[j];
+				else
+					map[j] |= argmap[j];
+				nset += map[j];
+			}
+		}
+		pcfree(argmap);
+		break;
+	}
+	case PC_PRED_RANGE:
+	{
+		const double *vals = dimvals[pred->dimnum];
+		for ( j = 0; j < npoints; j++ )
+		{
+			map[j] = pc_predicate_range_has(pred, vals[j]);
+			nset += map[j];
+		}
+		break;
+	}
+	case PC_PRED_IN:
+	{
+		const double *vals = dimvals[pred->dimnum];
+		for ( j = 0; j < npoints; j++ )
+		{
+			map[j] = PC_FALSE;
+			for ( i = 0; i < pred->nvals; i++ )
+			{
+				if ( vals[j] == pred->vals[i] )
+				{
+					map[j] = PC_TRUE;
+					break;
+				}
+			}
+			nset += map[j];
+		}
+		break;
+	}
+	}
+	return nset;
+}
@@ -96,6 +96,38 @@ pc_compression_number(const char *str)
 	return PC_NONE;
 }
 
+static int
+pc_dimcompression_number(const char *str)
+{
+	if ( ! str )
+		return PC_DIM_ZLIB;
+
+	if ( strcasecmp(str, "zstd") == 0 )
+	{
+#ifdef HAVE_LIBZSTD
+		return PC_DIM_ZSTD;
+#else
+		pcwarn("library built without zstd support, using zlib instead");
+		return PC_DIM_ZLIB;
+#endif
+	}
+
+	if ( strcasecmp(str, "lz4") == 0 )
+	{
+#ifdef HAVE_LIBLZ4
+		return PC_DIM_LZ4;
+#else
+		pcwarn("library built without lz4 support, using zlib instead");
+		return PC_DIM_ZLIB;
+#endif
+	}
+
+	if ( strcasecmp(str, "zlib") != 0 )
+		pcwarn("unknown dimcompression '%s', using zlib instead", str);
+
+	return PC_DIM_ZLIB;
+}
+
 /** Convert type interpretation number size in bytes */
 size_t
 pc_interpretation_size(uint32_t interp)
@@ -154,6 +186,7 @@ pc_schema_new(uint32_t ndims)
 	pcs->ndims = ndims;
 	pcs->x_position = -1;
 	pcs->y_position = -1;
+	pcs->dimcompression = PC_DIM_ZLIB;
 	return pcs;
 }
 
@@ -194,6 +227,8 @@ pc_schema_clone(const PCSCHEMA *s)
 	pcs->x_position = s->x_position;
 	pcs->y_position = s->y_position;
 	pcs->compression = s->compression;
+	pcs->dimcompression = s->dimcompression;
+	pcs->dimcompression_level = s->dimcompression_level;
 	for ( i = 0; i < pcs->ndims; i++ )
 	{
 		if ( s->dims[i] )
@@ -221,6 +256,8 @@ pc_schema_clone_subset(  PCSCHEMA *s, uint32_t * dimensions_position_array, uint
 	pcs->srid = s->srid;
 	
 	pcs->compression = s->compression;
+	pcs->dimcompression = s->dimcompression;
+	pcs->dimcompression_level = s->dimcompression_level;
 	
 	//printf("\n for loop \n");
 	for ( i = 0; i < dimensions_number; i++ )
@@ -269,6 +306,176 @@ pc_schema_free(PCSCHEMA *pcs)
 	pcfree(pcs);
 }
 
+/* Width of the binary schema header, ten 32-bit words */
+#define PC_SCHEMA_BINARY_HEADER 40
+
+static uint8_t *
+pc_schema_binary_put_string(uint8_t *ptr, const char *str)
+{
+	/* Lengths count the terminator, so zero stands for NULL */
+	uint32_t len = str ? strlen(str) + 1 : 0;
+	memcpy(ptr, &len, 4);
+	ptr += 4;
+	if ( len )
+		memcpy(ptr, str, len);
+	return ptr + len;
+}
+
+static const uint8_t *
+pc_schema_binary_get_string(const uint8_t *ptr, const uint8_t *end, char **str)
+{
+	uint32_t len;
+	*str = NULL;
+	if ( end - ptr < 4 )
+		return NULL;
+	memcpy(&len, ptr, 4);
+	ptr += 4;
+	if ( ! len )
+		return ptr;
+	if ( (size_t)(end - ptr) < len || ptr[len-1] != '\0' )
+		return NULL;
+	*str = pcstrdup((const char*)ptr);
+	return ptr + len;
+}
+
+/**
+* Write the schema in its binary form: a header, then every
+* PCDIMENSION as it sits in memory, then the dimension strings.
+* The layout is native to this build, the header lets
+* pc_schema_from_binary refuse anything else.
+*/
+uint8_t *
+pc_schema_to_binary(const PCSCHEMA *s, size_t *binsize)
+{
+	uint32_t header[10];
+	PCDIMENSION dim;
+	uint8_t *buf, *ptr;
+	size_t size = PC_SCHEMA_BINARY_HEADER + s->ndims * sizeof(PCDIMENSION);
+	int i;
+
+	for ( i = 0; i < s->ndims; i++ )
+	{
+		const PCDIMENSION *d = s->dims[i];
+		if ( ! d )
+			return NULL;
+		size += 8;
+		size += d->name ? strlen(d->name) + 1 : 0;
+		size += d->description ? strlen(d->description) + 1 : 0;
+	}
+
+	header[0] = PC_SCHEMA_BINARY_MAGIC;
+	header[1] = PC_SCHEMA_BINARY_VERSION;
+	header[2] = sizeof(PCDIMENSION);
+	header[3] = s->ndims;
+	header[4] = s->srid;
+	memcpy(header + 5, &(s->x_position), 4);
+	memcpy(header + 6, &(s->y_position), 4);
+	header[7] = s->compression;
+	header[8] = s->dimcompression;
+	memcpy(header + 9, &(s->dimcompression_level), 4);
+
+	buf = pcalloc(size);
+	memcpy(buf, header, PC_SCHEMA_BINARY_HEADER);
+	ptr = buf + PC_SCHEMA_BINARY_HEADER;
+
+	for ( i = 0; i < s->ndims; i++ )
+	{
+		/* Pointers mean nothing once loaded, blank them out */
+		memset(&dim, 0, sizeof(PCDIMENSION));
+		memcpy(&dim, s->dims[i], sizeof(PCDIMENSION));
+		dim.name = NULL;
+		dim.description = NULL;
+		memcpy(ptr, &dim, sizeof(PCDIMENSION));
+		ptr += sizeof(PCDIMENSION);
+	}
+
+	for ( i = 0; i < s->ndims; i++ )
+	{
+		ptr = pc_schema_binary_put_string(ptr, s->dims[i]->name);
+		ptr = pc_schema_binary_put_string(ptr, s->dims[i]->description);
+	}
+
+	*binsize = size;
+	return buf;
+}
+
+/**
+* Rebuild a schema from pc_schema_to_binary output. Returns NULL
+* for a blob from another version or build, or a damaged one,
+* so callers can fall back on the XML.
+*/
+PCSCHEMA *
+pc_schema_from_binary(const uint8_t *buf, size_t size)
+{
+	uint32_t header[10];
+	const uint8_t *ptr, *end = buf + size;
+	PCSCHEMA *s;
+	int i;
+
+	if ( size < PC_SCHEMA_BINARY_HEADER )
+		return NULL;
+
+	memcpy(header, buf, PC_SCHEMA_BINARY_HEADER);
+	if ( header[0] != PC_SCHEMA_BINARY_MAGIC ||
+	     header[1] != PC_SCHEMA_BINARY_VERSION ||
+	     header[2] != sizeof(PCDIMENSION) ||
+	     ! header[3] ||
+	     (size - PC_SCHEMA_BINARY_HEADER) / sizeof(PCDIMENSION) < header[3] )
+	{
+		return NULL;
+	}
+
+	s = pc_schema_new(header[3]);
+	s->srid = header[4];
+	memcpy(&(s->x_position), header + 5, 4);
+	memcpy(&(s->y_position), header + 6, 4);
+	s->compression = header[7];
+	s->dimcompression = header[8];
+	memcpy(&(s->dimcompression_level), header + 9, 4);
+
+	ptr = buf + PC_SCHEMA_BINARY_HEADER;
+	for ( i = 0; i < s->ndims; i++ )
+	{
+		PCDIMENSION *d = pc_dimension_new();
+		memcpy(d, ptr, sizeof(PCDIMENSION));
+		d->name = d->description = NULL;
+		ptr += sizeof(PCDIMENSION);
+		if ( d->position != i )
+		{
+			pc_dimension_free(d);
+			pc_schema_free(s);
+			return NULL;
+		}
+		s->dims[i] = d;
+	}
+
+	/* Fix up the strings, then index the names */
+	for ( i = 0; i < s->ndims; i++ )
+	{
+		PCDIMENSION *d = s->dims[i];
+		if ( ptr )
+			ptr = pc_schema_binary_get_string(ptr, end, &(d->name));
+		if ( ptr )
+			ptr = pc_schema_binary_get_string(ptr, end, &(d->description));
+		if ( ! ( ptr && d->name ) )
+		{
+			pc_schema_free(s);
+			return NULL;
+		}
+		hashtable_insert(s->namehash, d->name, d);
+	}
+
+	if ( s->x_position < 0 || s->x_position >= s->ndims ||
+	     s->y_position < 0 || s->y_position >= s->ndims )
+	{
+		pc_schema_free(s);
+		return NULL;
+	}
+
+	pc_schema_calculate_byteoffsets(s);
+	return s;
+}
+
 /** Convert a PCSCHEMA to a human-readable JSON string */
 char *
 pc_schema_to_json(const PCSCHEMA *pcs)
@@ -286,6 +493,10 @@ pc_schema_to_json(const PCSCHEMA *pcs)
 		stringbuffer_aprintf(sb, "\"srid\" : %d,\n", pcs->srid);
 	if ( pcs->compression )
 		stringbuffer_aprintf(sb, "\"compression\" : %d,\n", pcs->compression);
+	if ( pcs->dimcompression != PC_DIM_ZLIB )
+		stringbuffer_aprintf(sb, "\"dimcompression\" : %d,\n", pcs->dimcompression);
+	if ( pcs->dimcompression_level )
+		stringbuffer_aprintf(sb, "\"dimcompression_level\" : %d,\n", pcs->dimcompression_level);
 	if ( pcs->size )
 		stringbuffer_aprintf(sb, "\"size\" : %zu,\n", pcs->size);
 	if ( pcs->x_position>=0 )
@@ -313,6 +524,31 @@ pc_schema_to_json(const PCSCHEMA *pcs)
 	return str;
 }
 
+/**
+* Flag the dimensions named in a comma separated list
+* as carried by the N-D index key, unknown names are
+* ignored with a warning.
+*/
+static void
+pc_schema_set_indexdims(PCSCHEMA *s, const char *names)
+{
+	char *str, *name, *saveptr = NULL;
+
+	if ( ! names || ! s->namehash )
+		return;
+
+	str = pcstrdup(names);
+	for ( name = strtok_r(str, ", \t\n", &saveptr); name; name = strtok_r(NULL, ", \t\n", &saveptr) )
+	{
+		PCDIMENSION *d = pc_schema_get_dimension_by_name(s, name);
+		if ( d )
+			d->indexed = 1;
+		else if ( strcasecmp(name, "Z") )
+			pcwarn("indexdims names unknown dimension \"%s\"", name);
+	}
+	pcfree(str);
+}
+
 void pc_schema_check_xy(PCSCHEMA *s)
 {
 	int i;
@@ -619,12 +855,33 @@ pc_schema_from_xml(const char *xml_str, PCSCHEMA **schema)
 					s->compression = compression;
 				}
 			}
+			/* And the codec dimensional patches fall back on */
+			else if ( strcmp(metadata_name, "dimcompression") == 0 )
+			{
+				s->dimcompression = pc_dimcompression_number(metadata_value);
+			}
+			else if ( strcmp(metadata_name, "dimcompression_level") == 0 )
+			{
+				s->dimcompression_level = metadata_value ? atoi(metadata_value) : 0;
+			}
+			/* Extra dimensions to carry in the N-D index key */
+			else if ( strcmp(metadata_name, "indexdims") == 0 )
+			{
+				pc_schema_set_indexdims(s, metadata_value);
+			}
 			xmlFree(metadata_name);
 		}
 	}
 
 	xmlXPathFreeObject(xpath_obj);
 
+	/* X, Y and Z are always in the index key */
+	pc_schema_set_indexdims(s, "Z");
+	if ( s->x_position >= 0 && s->x_position < s->ndims && s->dims[s->x_position] )
+		s->dims[s->x_position]->indexed = 1;
+	if ( s->y_position >= 0 && s->y_position < s->ndims && s->dims[s->y_position] )
+		s->dims[s->y_position]->indexed = 1;
+
 	xmlXPathFreeContext(xpath_ctx);
 	xmlFreeDoc(xml_doc);
 	xmlCleanupParser();
@@ -0,0 +1,720 @@
+/***********************************************************************
+* pc_sigbits.c
+*
+*  Bit packing kernels behind the PC_DIM_SIGBITS codec.
+*
+*  The packed layout is fixed: unique bits are written most
+*  significant bit first into a stream of native words of the
+*  same width as the dimension. The kernels here only change how
+*  fast we get there. Unpacking has a word-at-a-time scalar
+*  implementation and, on x86 CPUs with AVX2, a vector one that
+*  decodes eight values per instruction. The kernel set is picked
+*  the first time it is needed.
+*
+*  PgSQL Pointcloud is free and open source software provided
+*  by the Government of Canada
+*  Copyright (c) 2013 Natural Resources Canada
+*
+***********************************************************************/
+
+#include "pc_api_internal.h"
+
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+#define PC_SIGBITS_AVX2 1
+#include <immintrin.h>
+#endif
+
+typedef struct
+{
+	const char *name;
+	void (*unpack_8)(const uint8_t *, size_t, uint32_t, uint8_t, uint8_t *, uint32_t);
+	void (*unpack_16)(const uint16_t *, size_t, uint32_t, uint16_t, uint16_t *, uint32_t);
+	void (*unpack_32)(const uint32_t *, size_t, uint32_t, uint32_t, uint32_t *, uint32_t);
+	void (*unpack_64)(const uint64_t *, size_t, uint32_t, uint64_t, uint64_t *, uint32_t);
+} PCSIGBITSKERNEL;
+
+
+/***********************************************************************
+* SCALAR PACKING
+*
+* Values are shifted into a 64-bit accumulator and whole words are
+* flushed out of the top of it, so there is no branching on whether
+* a value straddles a word boundary. Words are stored with memcpy,
+* as the output can start at any byte of a serialized patch.
+*/
+
+static inline void
+pc_sigbits_store_16(uint16_t *word, uint16_t v)
+{
+	memcpy(word, &v, sizeof(v));
+}
+
+static inline void
+pc_sigbits_store_32(uint32_t *word, uint32_t v)
+{
+	memcpy(word, &v, sizeof(v));
+}
+
+static inline void
+pc_sigbits_store_64(uint64_t *word, uint64_t v)
+{
+	memcpy(word, &v, sizeof(v));
+}
+
+void
+pc_sigbits_pack_8(const uint8_t *in, uint32_t npoints, uint32_t nbits, uint8_t *words)
+{
+	uint32_t i;
+	uint64_t buf = 0;
+	uint32_t nbuf = 0;
+	uint8_t mask = (uint8_t)(0xFF >> (8 - nbits));
+
+	if ( nbits == 0 ) return;
+
+	for ( i = 0; i < npoints; i++ )
+	{
+		buf = (buf << nbits) | (in[i] & mask);
+		nbuf += nbits;
+		if ( nbuf >= 8 )
+		{
+			nbuf -= 8;
+			*words++ = (uint8_t)(buf >> nbuf);
+		}
+	}
+	/* Left-justify whatever is left in the last word */
+	if ( nbuf )
+		*words = (uint8_t)(buf << (8 - nbuf));
+}
+
+void
+pc_sigbits_pack_16(const uint16_t *in, uint32_t npoints, uint32_t nbits, uint16_t *words)
+{
+	uint32_t i;
+	uint64_t buf = 0;
+	uint32_t nbuf = 0;
+	uint16_t mask = (uint16_t)(0xFFFF >> (16 - nbits));
+
+	if ( nbits == 0 ) return;
+
+	for ( i = 0; i < npoints; i++ )
+	{
+		buf = (buf << nbits) | (in[i] & mask);
+		nbuf += nbits;
+		if ( nbuf >= 16 )
+		{
+			nbuf -= 16;
+			pc_sigbits_store_16(words++, (uint16_t)(buf >> nbuf));
+		}
+	}
+	if ( nbuf )
+		pc_sigbits_store_16(words, (uint16_t)(buf << (16 - nbuf)));
+}
+
+void
+pc_sigbits_pack_32(const uint32_t *in, uint32_t npoints, uint32_t nbits, uint32_t *words)
+{
+	uint32_t i;
+	uint64_t buf = 0;
+	uint32_t nbuf = 0;
+	uint32_t mask = (uint32_t)(0xFFFFFFFFULL >> (32 - nbits));
+
+	if ( nbits == 0 ) return;
+
+	for ( i = 0; i < npoints; i++ )
+	{
+		buf = (buf << nbits) | (in[i] & mask);
+		nbuf += nbits;
+		if ( nbuf >= 32 )
+		{
+			nbuf -= 32;
+			pc_sigbits_store_32(words++, (uint32_t)(buf >> nbuf));
+		}
+	}
+	if ( nbuf )
+		pc_sigbits_store_32(words, (uint32_t)(buf << (32 - nbuf)));
+}
+
+/*
+* A 64-bit value does not fit in an accumulator next to the bits
+* already waiting in it, so for 64-bit words we fill the output word
+* directly and carry whatever spills over into the next one.
+*/
+void
+pc_sigbits_pack_64(const uint64_t *in, uint32_t npoints, uint32_t nbits, uint64_t *words)
+{
+	uint32_t i;
+	uint64_t cur = 0;
+	uint32_t used = 0;
+	uint64_t mask;
+
+	if ( nbits == 0 ) return;
+	mask = 0xFFFFFFFFFFFFFFFFULL >> (64 - nbits);
+
+	for ( i = 0; i < npoints; i++ )
+	{
+		uint64_t val = in[i] & mask;
+		uint32_t room = 64 - used;
+		if ( nbits < room )
+		{
+			cur |= val << (room - nbits);
+			used += nbits;
+		}
+		else
+		{
+			uint32_t spill = nbits - room;
+			pc_sigbits_store_64(words++, cur | (val >> spill));
+			cur = spill ? val << (64 - spill) : 0;
+			used = spill;
+		}
+	}
+	if ( used )
+		pc_sigbits_store_64(words, cur);
+}
+
+
+/***********************************************************************
+* SCALAR UNPACKING
+*
+* Decode values [start, npoints) from the packed stream. Words are
+* pulled into a 64-bit buffer only when it runs dry, and reads past
+* nwords are treated as zeroes, so short buffers cannot overrun.
+*/
+
+static void
+pc_sigbits_unpack_8_scalar_from(const uint8_t *words, size_t nwords, uint32_t nbits, uint8_t commonvalue, uint8_t *out, uint32_t start, uint32_t npoints)
+{
+	uint32_t i;
+	uint64_t pos = (uint64_t)start * nbits;
+	size_t w = pos / 8;
+	uint64_t buf = (w < nwords) ? words[w] : 0;
+	uint32_t avail = 8 - (pos % 8);
+	uint8_t mask = (uint8_t)(0xFF >> (8 - nbits));
+
+	if ( nbits == 0 ) mask = 0;
+	w++;
+
+	for ( i = start; i < npoints; i++ )
+	{
+		if ( avail < nbits )
+		{
+			buf = (buf << 8) | ((w < nwords) ? words[w] : 0);
+			avail += 8;
+			w++;
+		}
+		avail -= nbits;
+		out[i] = ((uint8_t)(buf >> avail) & mask) | commonvalue;
+	}
+}
+
+static void
+pc_sigbits_unpack_16_scalar_from(const uint16_t *words, size_t nwords, uint32_t nbits, uint16_t commonvalue, uint16_t *out, uint32_t start, uint32_t npoints)
+{
+	uint32_t i;
+	uint64_t pos = (uint64_t)start * nbits;
+	size_t w = pos / 16;
+	uint64_t buf = (w < nwords) ? words[w] : 0;
+	uint32_t avail = 16 - (pos % 16);
+	uint16_t mask = (uint16_t)(0xFFFF >> (16 - nbits));
+
+	if ( nbits == 0 ) mask = 0;
+	w++;
+
+	for ( i = start; i < npoints; i++ )
+	{
+		if ( avail < nbits )
+		{
+			buf = (buf << 16) | ((w < nwords) ? words[w] : 0);
+			avail += 16;
+			w++;
+		}
+		avail -= nbits;
+		out[i] = ((uint16_t)(buf >> avail) & mask) | commonvalue;
+	}
+}
+
+static void
+pc_sigbits_unpack_32_scalar_from(const uint32_t *words, size_t nwords, uint32_t nbits, uint32_t commonvalue, uint32_t *out, uint32_t start, uint32_t npoints)
+{
+	uint32_t i;
+	uint64_t pos = (uint64_t)start * nbits;
+	size_t w = pos / 32;
+	uint64_t buf = (w < nwords) ? words[w] : 0;
+	uint32_t avail = 32 - (pos % 32);
+	uint32_t mask = (uint32_t)(0xFFFFFFFFULL >> (32 - nbits));
+
+	if ( nbits == 0 ) mask = 0;
+	w++;
+
+	for ( i = start; i < npoints; i++ )
+	{
+		if ( avail < nbits )
+		{
+			buf = (buf << 32) | ((w < nwords) ? words[w] : 0);
+			avail += 32;
+			w++;
+		}
+		avail -= nbits;
+		out[i] = ((uint32_t)(buf >> avail) & mask) | commonvalue;
+	}
+}
+
+static void
+pc_sigbits_unpack_64_scalar_from(const uint64_t *words, size_t nwords, uint32_t nbits, uint64_t commonvalue, uint64_t *out, uint32_t start, uint32_t npoints)
+{
+	uint32_t i;
+	uint64_t pos = (uint64_t)start * nbits;
+	size_t w = pos / 64;
+	uint32_t off = pos % 64;
+
+	for ( i = start; i < npoints; i++ )
+	{
+		uint64_t val = 0;
+		if ( nbits )
+		{
+			val = ((w < nwords) ? words[w] : 0) << off;
+			/* Pull in the rest from the next word */
+			if ( off + nbits > 64 )
+				val |= ((w + 1 < nwords) ? words[w + 1] : 0) >> (64 - off);
+			val >>= 64 - nbits;
+		}
+		out[i] = val | commonvalue;
+		off += nbits;
+		w += off / 64;
+		off %= 64;
+	}
+}
+
+static void
+pc_sigbits_unpack_8_scalar(const uint8_t *words, size_t nwords, uint32_t nbits, uint8_t commonvalue, uint8_t *out, uint32_t npoints)
+{
+	pc_sigbits_unpack_8_scalar_from(words, nwords, nbits, commonvalue, out, 0, npoints);
+}
+
+static void
+pc_sigbits_unpack_16_scalar(const uint16_t *words, size_t nwords, uint32_t nbits, uint16_t commonvalue, uint16_t *out, uint32_t npoints)
+{
+	pc_sigbits_unpack_16_scalar_from(words, nwords, nbits, commonvalue, out, 0, npoints);
+}
+
+static void
+pc_sigbits_unpack_32_scalar(const uint32_t *words, size_t nwords, uint32_t nbits, uint32_t commonvalue, uint32_t *out, uint32_t npoints)
+{
+	pc_sigbits_unpack_32_scalar_from(words, nwords, nbits, commonvalue, out, 0, npoints);
+}
+
+static void
+pc_sigbits_unpack_64_scalar(const uint64_t *words, size_t nwords, uint32_t nbits, uint64_t commonvalue, uint64_t *out, uint32_t npoints)
+{
+	pc_sigbits_unpack_64_scalar_from(words, nwords, nbits, commonvalue, out, 0, npoints);
+}
+
+static const PCSIGBITSKERNEL pc_sigbits_kernel_scalar =
+{
+	"scalar",
+	pc_sigbits_unpack_8_scalar,
+	pc_sigbits_unpack_16_scalar,
+	pc_sigbits_unpack_32_scalar,
+	pc_sigbits_unpack_64_scalar
+};
+
+
+/***********************************************************************
+* SCANNING
+*
+* Test the packed unique bits against a range, or sum them up,
+* without adding the common value back in, so filters and stats
+* never build the decoded array.
+* The word size is a constant in each caller and the reads get
+* specialized to it.
+*/
+
+static inline uint64_t
+pc_sigbits_word(const uint8_t *words, size_t size, size_t nwords, size_t w)
+{
+	if ( w >= nwords )
+		return 0;
+	switch ( size )
+	{
+	case 1:
+		return words[w];
+	case 2:
+		return ((const uint16_t*)words)[w];
+	case 4:
+		return ((const uint32_t*)words)[w];
+	default:
+		return ((const uint64_t*)words)[w];
+	}
+}
+
+/* Read the nbits-wide value that starts pos bits into the stream */
+static inline uint64_t
+pc_sigbits_read(const uint8_t *words, size_t size, size_t nwords, uint32_t nbits, uint64_t mask, uint64_t pos)
+{
+	uint32_t wordbits = 8 * size;
+	size_t w = pos / wordbits;
+	uint32_t avail = wordbits - (pos % wordbits);
+	uint64_t cur = pc_sigbits_word(words, size, nwords, w);
+	uint32_t need;
+	uint64_t top;
+
+	if ( nbits <= avail )
+		return (cur >> (avail - nbits)) & mask;
+
+	/* Straddles into the next word */
+	need = nbits - avail;
+	top = avail >= 64 ? cur : cur & ((1ULL << avail) - 1);
+	return (top << need) | (pc_sigbits_word(words, size, nwords, w + 1) >> (wordbits - need));
+}
+
+static inline uint32_t
+pc_sigbits_match_size(const uint8_t *words, size_t size, size_t nwords, uint32_t nbits, uint64_t lo, uint64_t hi, uint8_t *map, uint32_t npoints)
+{
+	uint32_t i, nset = 0;
+	uint64_t mask = nbits >= 64 ? 0xFFFFFFFFFFFFFFFFULL : (1ULL << nbits) - 1;
+
+	for ( i = 0; i < npoints; i++ )
+	{
+		uint64_t val = pc_sigbits_read(words, size, nwords, nbits, mask, (uint64_t)i * nbits);
+		map[i] = ( val >= lo && val <= hi );
+		nset += map[i];
+	}
+	return nset;
+}
+
+static inline void
+pc_sigbits_stat_size(const uint8_t *words, size_t size, size_t nwords, uint32_t nbits, uint32_t npoints, uint64_t *min, uint64_t *max, double *sum)
+{
+	uint32_t i;
+	uint64_t mask = nbits >= 64 ? 0xFFFFFFFFFFFFFFFFULL : (1ULL << nbits) - 1;
+	uint64_t mn = mask, mx = 0;
+	/* Up to 2^32 values of up to 32 bits add up in 64 bits */
+	uint64_t isum = 0;
+	double dsum = 0;
+
+	for ( i = 0; i < npoints; i++ )
+	{
+		uint64_t val = pc_sigbits_read(words, size, nwords, nbits, mask, (uint64_t)i * nbits);
+		if ( val < mn ) mn = val;
+		if ( val > mx ) mx = val;
+		if ( nbits <= 32 )
+			isum += val;
+		else
+			dsum += (double)val;
+	}
+	*min = mn;
+	*max = mx;
+	*sum = nbits <= 32 ? (double)isum : dsum;
+}
+
+uint32_t
+pc_sigbits_match(const uint8_t *words, size_t size, size_t nwords, uint32_t nbits, uint64_t lo, uint64_t hi, uint8_t *map, uint32_t npoints)
+{
+	/* Every value is just the common value */
+	if ( nbits == 0 )
+	{
+		int match = ( lo == 0 );
+		memset(map, match, npoints);
+		return match ? npoints : 0;
+	}
+	switch ( size )
+	{
+	case 1:
+		return pc_sigbits_match_size(words, 1, nwords, nbits, lo, hi, map, npoints);
+	case 2:
+		return pc_sigbits_match_size(words, 2, nwords, nbits, lo, hi, map, npoints);
+	case 4:
+		return pc_sigbits_match_size(words, 4, nwords, nbits, lo, hi, map, npoints);
+	case 8:
+		return pc_sigbits_match_size(words, 8, nwords, nbits, lo, hi, map, npoints);
+	default:
+		pcerror("%s: cannot handle %d byte words", __func__, (int)size);
+	}
+	return 0;
+}
+
+void
+pc_sigbits_stat(const uint8_t *words, size_t size, size_t nwords, uint32_t nbits, uint32_t npoints, uint64_t *min, uint64_t *max, double *sum)
+{
+	*min = *max = 0;
+	*sum = 0;
+	if ( nbits == 0 || npoints == 0 )
+		return;
+	switch ( size )
+	{
+	case 1:
+		pc_sigbits_stat_size(words, 1, nwords, nbits, npoints, min, max, sum);
+		break;
+	case 2:
+		pc_sigbits_stat_size(words, 2, nwords, nbits, npoints, min, max, sum);
+		break;
+	case 4:
+		pc_sigbits_stat_size(words, 4, nwords, nbits, npoints, min, max, sum);
+		break;
+	case 8:
+		pc_sigbits_stat_size(words, 8, nwords, nbits, npoints, min, max, sum);
+		break;
+	default:
+		pcerror("%s: cannot handle %d byte words", __func__, (int)size);
+	}
+}
+
+
+#ifdef PC_SIGBITS_AVX2
+
+/***********************************************************************
+* AVX2 UNPACKING
+*
+* Each lane works out the bit offset of its own value inside a small
+* window of words loaded in one go, shuffles the word holding the
+* first bit and the word after it into place, and shifts the value
+* out of the pair. AVX2 variable shifts return zero for counts of 32
+* or more, which takes care of values starting on a word boundary
+* without any special casing. Wide 32-bit values can spill out of
+* the window, so those fall back to gathering straight from memory.
+*
+* Blocks are only decoded while the window stays inside the buffer;
+* the scalar kernel finishes off the tail.
+*/
+
+/* Decode the 8 values starting at index i into 32-bit lanes */
+__attribute__((target("avx2")))
+static inline __m256i
+pc_sigbits_avx2_lanes_8(const uint8_t *words, uint32_t i, uint32_t nbits, __m256i vnbits, __m128i vrshift)
+{
+	const __m256i vlane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	uint64_t pos = (uint64_t)i * nbits;
+	__m256i rel = _mm256_add_epi32(_mm256_mullo_epi32(vlane, vnbits), _mm256_set1_epi32(pos % 8));
+	__m256i k = _mm256_srli_epi32(rel, 3);
+	__m256i o = _mm256_and_si256(rel, _mm256_set1_epi32(7));
+	/* Bytes k and k+1 of the window go to the top of each lane */
+	__m256i ctrl = _mm256_or_si256(_mm256_slli_epi32(k, 24), _mm256_slli_epi32(_mm256_add_epi32(k, _mm256_set1_epi32(1)), 16));
+	__m256i win = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(words + pos / 8)));
+	__m256i w = _mm256_shuffle_epi8(win, _mm256_or_si256(ctrl, _mm256_set1_epi32(0x8080)));
+	return _mm256_srl_epi32(_mm256_sllv_epi32(w, o), vrshift);
+}
+
+/* Decode the 8 values starting at index i into 32-bit lanes */
+__attribute__((target("avx2")))
+static inline __m256i
+pc_sigbits_avx2_lanes_16(const uint16_t *words, uint32_t i, uint32_t nbits, __m256i vnbits, __m128i vrshift)
+{
+	const __m256i vlane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	const __m256i v32 = _mm256_set1_epi32(32);
+	uint64_t pos = (uint64_t)i * nbits;
+	__m256i rel = _mm256_add_epi32(_mm256_mullo_epi32(vlane, vnbits), _mm256_set1_epi32(pos % 16));
+	__m256i k = _mm256_srli_epi32(rel, 4);
+	__m256i o = _mm256_and_si256(rel, _mm256_set1_epi32(15));
+	/* Word k sits in dword k/2, at the top half when k is odd */
+	__m256i d = _mm256_srli_epi32(k, 1);
+	__m256i h = _mm256_slli_epi32(_mm256_and_si256(k, _mm256_set1_epi32(1)), 4);
+	__m256i win = _mm256_loadu_si256((const __m256i *)(words + pos / 16));
+	__m256i da = _mm256_permutevar8x32_epi32(win, d);
+	__m256i db = _mm256_permutevar8x32_epi32(win, _mm256_add_epi32(d, _mm256_set1_epi32(1)));
+	/* Word k in the low half, word k+1 in the high half; swap them */
+	__m256i w = _mm256_or_si256(_mm256_srlv_epi32(da, h), _mm256_sllv_epi32(db, _mm256_sub_epi32(v32, h)));
+	w = _mm256_or_si256(_mm256_slli_epi32(w, 16), _mm256_srli_epi32(w, 16));
+	return _mm256_srl_epi32(_mm256_sllv_epi32(w, o), vrshift);
+}
+
+/* Decode the 8 values starting at index i into 32-bit lanes */
+__attribute__((target("avx2")))
+static inline __m256i
+pc_sigbits_avx2_lanes_32(const uint32_t *words, uint32_t i, uint32_t nbits, __m256i vnbits, __m128i vrshift, int gather)
+{
+	const __m256i vlane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	const __m256i v32 = _mm256_set1_epi32(32);
+	uint64_t pos = (uint64_t)i * nbits;
+	const uint32_t *base = words + pos / 32;
+	__m256i rel = _mm256_add_epi32(_mm256_mullo_epi32(vlane, vnbits), _mm256_set1_epi32(pos % 32));
+	__m256i k = _mm256_srli_epi32(rel, 5);
+	__m256i o = _mm256_and_si256(rel, _mm256_set1_epi32(31));
+	__m256i w0, w1, v;
+	if ( gather )
+	{
+		w0 = _mm256_i32gather_epi32((const int *)base, k, 4);
+		w1 = _mm256_i32gather_epi32((const int *)(base + 1), k, 4);
+	}
+	else
+	{
+		__m256i win = _mm256_loadu_si256((const __m256i *)base);
+		w0 = _mm256_permutevar8x32_epi32(win, k);
+		w1 = _mm256_permutevar8x32_epi32(win, _mm256_add_epi32(k, _mm256_set1_epi32(1)));
+	}
+	v = _mm256_or_si256(_mm256_sllv_epi32(w0, o), _mm256_srlv_epi32(w1, _mm256_sub_epi32(v32, o)));
+	return _mm256_srl_epi32(v, vrshift);
+}
+
+/*
+* Is there a full window of nwin words, starting at the word
+* holding the first bit of value i, inside the buffer?
+*/
+static inline int
+pc_sigbits_window_fits(uint32_t i, uint32_t nbits, uint32_t wordbits, uint32_t nwin, size_t nwords)
+{
+	return ((uint64_t)i * nbits) / wordbits + nwin <= nwords;
+}
+
+__attribute__((target("avx2")))
+static void
+pc_sigbits_unpack_8_avx2(const uint8_t *words, size_t nwords, uint32_t nbits, uint8_t commonvalue, uint8_t *out, uint32_t npoints)
+{
+	uint32_t i = 0;
+	const __m256i vnbits = _mm256_set1_epi32(nbits);
+	const __m128i vrshift = _mm_cvtsi32_si128(32 - nbits);
+	const __m256i vcommon = _mm256_set1_epi8(commonvalue);
+	const __m256i vorder = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+	if ( nbits > 0 )
+	{
+		/* 32 values per pass, so the narrowing packs come out whole */
+		while ( i + 32 <= npoints && pc_sigbits_window_fits(i + 24, nbits, 8, 16, nwords) )
+		{
+			__m256i a = pc_sigbits_avx2_lanes_8(words, i,      nbits, vnbits, vrshift);
+			__m256i b = pc_sigbits_avx2_lanes_8(words, i +  8, nbits, vnbits, vrshift);
+			__m256i c = pc_sigbits_avx2_lanes_8(words, i + 16, nbits, vnbits, vrshift);
+			__m256i d = pc_sigbits_avx2_lanes_8(words, i + 24, nbits, vnbits, vrshift);
+			__m256i v = _mm256_packus_epi16(_mm256_packus_epi32(a, b), _mm256_packus_epi32(c, d));
+			v = _mm256_permutevar8x32_epi32(v, vorder);
+			_mm256_storeu_si256((__m256i *)(out + i), _mm256_or_si256(v, vcommon));
+			i += 32;
+		}
+	}
+	pc_sigbits_unpack_8_scalar_from(words, nwords, nbits, commonvalue, out, i, npoints);
+}
+
+__attribute__((target("avx2")))
+static void
+pc_sigbits_unpack_16_avx2(const uint16_t *words, size_t nwords, uint32_t nbits, uint16_t commonvalue, uint16_t *out, uint32_t npoints)
+{
+	uint32_t i = 0;
+	const __m256i vnbits = _mm256_set1_epi32(nbits);
+	const __m128i vrshift = _mm_cvtsi32_si128(32 - nbits);
+	const __m256i vcommon = _mm256_set1_epi16(commonvalue);
+
+	if ( nbits > 0 )
+	{
+		while ( i + 16 <= npoints && pc_sigbits_window_fits(i + 8, nbits, 16, 16, nwords) )
+		{
+			__m256i a = pc_sigbits_avx2_lanes_16(words, i,     nbits, vnbits, vrshift);
+			__m256i b = pc_sigbits_avx2_lanes_16(words, i + 8, nbits, vnbits, vrshift);
+			__m256i v = _mm256_permute4x64_epi64(_mm256_packus_epi32(a, b), 0xD8);
+			_mm256_storeu_si256((__m256i *)(out + i), _mm256_or_si256(v, vcommon));
+			i += 16;
+		}
+	}
+	pc_sigbits_unpack_16_scalar_from(words, nwords, nbits, commonvalue, out, i, npoints);
+}
+
+__attribute__((target("avx2")))
+static void
+pc_sigbits_unpack_32_avx2(const uint32_t *words, size_t nwords, uint32_t nbits, uint32_t commonvalue, uint32_t *out, uint32_t npoints)
+{
+	uint32_t i = 0;
+	const __m256i vnbits = _mm256_set1_epi32(nbits);
+	const __m128i vrshift = _mm_cvtsi32_si128(32 - nbits);
+	const __m256i vcommon = _mm256_set1_epi32(commonvalue);
+	/* Up to 27 bits, eight values never reach past an eight word window */
+	int gather = (nbits > 27);
+
+	if ( nbits > 0 )
+	{
+		while ( i + 8 <= npoints && pc_sigbits_window_fits(i, nbits, 32, gather ? 10 : 8, nwords) )
+		{
+			__m256i v = pc_sigbits_avx2_lanes_32(words, i, nbits, vnbits, vrshift, gather);
+			_mm256_storeu_si256((__m256i *)(out + i), _mm256_or_si256(v, vcommon));
+			i += 8;
+		}
+	}
+	pc_sigbits_unpack_32_scalar_from(words, nwords, nbits, commonvalue, out, i, npoints);
+}
+
+static const PCSIGBITSKERNEL pc_sigbits_kernel_avx2 =
+{
+	"avx2",
+	pc_sigbits_unpack_8_avx2,
+	pc_sigbits_unpack_16_avx2,
+	pc_sigbits_unpack_32_avx2,
+	/* 64-bit lanes would only decode four values a step; stay scalar */
+	pc_sigbits_unpack_64_scalar
+};
+
+#endif /* PC_SIGBITS_AVX2 */
+
+
+/***********************************************************************
+* DISPATCH
+*/
+
+static const PCSIGBITSKERNEL *pc_sigbits_kernel = NULL;
+
+static const PCSIGBITSKERNEL *
+pc_sigbits_kernel_get(void)
+{
+	if ( ! pc_sigbits_kernel )
+	{
+		pc_sigbits_kernel = &pc_sigbits_kernel_scalar;
+#ifdef PC_SIGBITS_AVX2
+		__builtin_cpu_init();
+		if ( __builtin_cpu_supports("avx2") )
+			pc_sigbits_kernel = &pc_sigbits_kernel_avx2;
+#endif
+	}
+	return pc_sigbits_kernel;
+}
+
+const char *
+pc_sigbits_kernel_name(void)
+{
+	return pc_sigbits_kernel_get()->name;
+}
+
+int
+pc_sigbits_kernel_set(const char *name)
+{
+	if ( ! name || strcmp(name, "auto") == 0 )
+	{
+		pc_sigbits_kernel = NULL;
+		pc_sigbits_kernel_get();
+		return PC_SUCCESS;
+	}
+	if ( strcmp(name, pc_sigbits_kernel_scalar.name) == 0 )
+	{
+		pc_sigbits_kernel = &pc_sigbits_kernel_scalar;
+		return PC_SUCCESS;
+	}
+#ifdef PC_SIGBITS_AVX2
+	if ( strcmp(name, pc_sigbits_kernel_avx2.name) == 0 )
+	{
+		__builtin_cpu_init();
+		if ( ! __builtin_cpu_supports("avx2") )
+			return PC_FAILURE;
+		pc_sigbits_kernel = &pc_sigbits_kernel_avx2;
+		return PC_SUCCESS;
+	}
+#endif
+	return PC_FAILURE;
+}
+
+void
+pc_sigbits_unpack_8(const uint8_t *words, size_t nwords, uint32_t nbits, uint8_t commonvalue, uint8_t *out, uint32_t npoints)
+{
+	pc_sigbits_kernel_get()->unpack_8(words, nwords, nbits, commonvalue, out, npoints);
+}
+
+void
+pc_sigbits_unpack_16(const uint16_t *words, size_t nwords, uint32_t nbits, uint16_t commonvalue, uint16_t *out, uint32_t npoints)
+{
+	pc_sigbits_kernel_get()->unpack_16(words, nwords, nbits, commonvalue, out, npoints);
+}
+
+void
+pc_sigbits_unpack_32(const uint32_t *words, size_t nwords, uint32_t nbits, uint32_t commonvalue, uint32_t *out, uint32_t npoints)
+{
+	pc_sigbits_kernel_get()->unpack_32(words, nwords, nbits, commonvalue, out, npoints);
+}
+
+void
+pc_sigbits_unpack_64(const uint64_t *words, size_t nwords, uint32_t nbits, uint64_t commonvalue, uint64_t *out, uint32_t npoints)
+{
+	pc_sigbits_kernel_get()->unpack_64(words, nwords, nbits, commonvalue, out, npoints);
+}
@@ -165,39 +165,31 @@ pc_stats_update_schema(PCSTATS *stats,const PCSCHEMA * pds)
 int
 pc_patch_uncompressed_compute_stats(PCPATCH_UNCOMPRESSED *pa)
 {
-	int i, j;
+	uint32_t i, j, n;
 	const PCSCHEMA *schema = pa->schema;
-	double val;
+	double vals[PC_DOUBLE_ARRAY_CHUNK];
 	PCDOUBLESTATS *dstats = pc_dstats_new(pa->schema->ndims);
 
 	if ( pa->stats )
 		pc_stats_free(pa->stats);
 
-	/* Point on stack for fast access to values in patch */
-	PCPOINT pt;
-	pt.readonly = PC_TRUE;
-	pt.schema = schema;
-	pt.data = pa->data;
-
 	/* We know npoints right away */
 	dstats->npoints = pa->npoints;
 
-	for ( i = 0; i < pa->npoints; i++ )
+	/* A chunk of points at a time, one dimension after the other */
+	for ( i = 0; i < pa->npoints; i += n )
 	{
+		n = pa->npoints - i;
+		if ( n > PC_DOUBLE_ARRAY_CHUNK )
+			n = PC_DOUBLE_ARRAY_CHUNK;
 		for ( j = 0; j < schema->ndims; j++ )
 		{
-			pc_point_get_double(&pt, schema->dims[j], &val);
-			/* Check minimum */
-			if ( val < dstats->dims[j].min )
-				dstats->dims[j].min = val;
-			/* Check maximum */
-			if ( val > dstats->dims[j].max )
-				dstats->dims[j].max = val;
-			/* Add to sum */
-			dstats->dims[j].sum += val;
+			const PCDIMENSION *dim = schema->dims[j];
+			pc_double_array_from_ptr(vals, pa->data + i * schema->size + dim->byteoffset,
+			                         dim->interpretation, schema->size, n);
+			pc_double_array_scale_offset(vals, n, dim);
+			pc_double_array_stat(vals, n, &(dstats->dims[j]));
 		}
-		/* Advance to next point */
-		pt.data += schema->size;
 	}
 
 	pa->stats = pc_stats_new_from_dstats(pa->schema, dstats);
@@ -205,6 +197,89 @@ pc_patch_uncompressed_compute_stats(PCPATCH_UNCOMPRESSED *pa)
 	return PC_SUCCESS;
 }
 
+/**
+* Dimensional patches get their stats from the arrays as they are
+* stored, see pc_bytes_stat
+*/
+int
+pc_patch_dimensional_compute_stats(PCPATCH_DIMENSIONAL *pdl)
+{
+	int i;
+	const PCSCHEMA *schema = pdl->schema;
+	PCDOUBLESTATS *dstats = pc_dstats_new(schema->ndims);
+
+	if ( pdl->stats )
+		pc_stats_free(pdl->stats);
+
+	dstats->npoints = pdl->npoints;
+
+	for ( i = 0; i < schema->ndims; i++ )
+	{
+		PCDIMENSION *dim = schema->dims[i];
+		PCBYTESSTAT stat;
+		double min, max;
+
+		pc_bytes_stat_init(&stat);
+		if ( PC_FAILURE == pc_bytes_stat(&(pdl->bytes[i]), &stat) )
+		{
+			pc_dstats_free(dstats);
+			pdl->stats = NULL;
+			return PC_FAILURE;
+		}
+		/* Stats are kept on the scaled values */
+		min = pc_value_scale_offset(stat.min, dim);
+		max = pc_value_scale_offset(stat.max, dim);
+		dstats->dims[i].min = min < max ? min : max;
+		dstats->dims[i].max = min < max ? max : min;
+		dstats->dims[i].sum = pc_value_scale_offset(stat.sum / pdl->npoints, dim) * pdl->npoints;
+	}
+
+	pdl->stats = pc_stats_new_from_dstats(schema, dstats);
+	pc_dstats_free(dstats);
+	return PC_SUCCESS;
+}
+
+/**
+* Stats of a union of patches, read off their own stats: the extreme
+* mins and maxes, and averages weighted by point counts. Returns NULL
+* when one of the patches has no stats to merge.
+*/
+PCSTATS *
+pc_stats_merge(PCPATCH **palist, int numpatches)
+{
+	int i, j;
+	const PCSCHEMA *schema = palist[0]->schema;
+	PCDOUBLESTATS *dstats = pc_dstats_new(schema->ndims);
+	PCSTATS *stats;
+
+	for ( i = 0; i < numpatches; i++ )
+	{
+		const PCPATCH *pa = palist[i];
+		if ( ! pa->npoints )
+			continue;
+		if ( ! pa->stats )
+		{
+			pc_dstats_free(dstats);
+			return NULL;
+		}
+		for ( j = 0; j < schema->ndims; j++ )
+		{
+			double min, max, avg;
+			pc_point_get_double_by_index(&(pa->stats->min), j, &min);
+			pc_point_get_double_by_index(&(pa->stats->max), j, &max);
+			pc_point_get_double_by_index(&(pa->stats->avg), j, &avg);
+			if ( min < dstats->dims[j].min ) dstats->dims[j].min = min;
+			if ( max > dstats->dims[j].max ) dstats->dims[j].max = max;
+			dstats->dims[j].sum += avg * pa->npoints;
+		}
+		dstats->npoints += pa->npoints;
+	}
+
+	stats = pc_stats_new_from_dstats(schema, dstats);
+	pc_dstats_free(dstats);
+	return stats;
+}
+
 size_t
 pc_stats_size(const PCSCHEMA *schema)
 {
@@ -317,6 +317,51 @@ void pc_bounds_merge(PCBOUNDS *b1, const PCBOUNDS *b2)
 	if ( b2->ymax > b1->ymax ) b1->ymax = b2->ymax;
 }
 
+/* Map a coordinate onto 32 bits, keeping the order of values */
+static uint32_t
+pc_hilbert_ordinate(double d)
+{
+	float f = (float)d;
+	uint32_t u;
+	memcpy(&u, &f, 4);
+	/* Negatives count down from the middle, positives up */
+	return (u & 0x80000000) ? ~u : (u | 0x80000000);
+}
+
+/**
+* Position of a point along a Hilbert curve covering the whole
+* float plane. Sorting on it keeps nearby points together, with no
+* need to know the extent of the data beforehand.
+*/
+uint64_t
+pc_hilbert_key(double x, double y)
+{
+	uint32_t hx = pc_hilbert_ordinate(x);
+	uint32_t hy = pc_hilbert_ordinate(y);
+	uint32_t s, rx, ry, t;
+	uint64_t d = 0;
+
+	for ( s = 0x80000000; s; s >>= 1 )
+	{
+		rx = (hx & s) ? 1 : 0;
+		ry = (hy & s) ? 1 : 0;
+		d += (uint64_t)s * s * ((3 * rx) ^ ry);
+		/* Rotate the quadrant so the curve stays continuous */
+		if ( ! ry )
+		{
+			if ( rx )
+			{
+				hx = ~hx;
+				hy = ~hy;
+			}
+			t = hx;
+			hx = hy;
+			hy = t;
+		}
+	}
+	return d;
+}
+
 /**
  * @brief this function retura a PCBOUNDS as a string json type
  * @param the bounds to print
@@ -195,3 +195,105 @@ pc_double_to_ptr(uint8_t *ptr, uint32_t interpretation, double val)
 	}
 	return PC_SUCCESS;
 }
+
+/* Read one interpretation into doubles, the body of each case below */
+#define PC_DOUBLE_ARRAY_FROM_PTR(TYPE) \
+	if ( stride == sizeof(TYPE) ) \
+	{ \
+		for ( i = 0; i < n; i++ ) \
+		{ \
+			TYPE v; \
+			memcpy(&v, ptr + i * sizeof(TYPE), sizeof(TYPE)); \
+			vals[i] = (double)v; \
+		} \
+	} \
+	else \
+	{ \
+		for ( i = 0; i < n; i++ ) \
+		{ \
+			TYPE v; \
+			memcpy(&v, ptr + i * stride, sizeof(TYPE)); \
+			vals[i] = (double)v; \
+		} \
+	} \
+	break;
+
+/**
+* Read n values of one interpretation, stride bytes apart, as
+* doubles. Unlike pc_double_from_ptr the type is looked at once,
+* each case is a plain loop the compiler can unroll or vectorize,
+* with packed arrays (stride equal to the value size) kept apart
+* from values spread through points.
+*/
+void
+pc_double_array_from_ptr(double *vals, const uint8_t *ptr, uint32_t interpretation, size_t stride, uint32_t n)
+{
+	uint32_t i;
+
+	switch( interpretation )
+	{
+	case PC_UINT8:
+		PC_DOUBLE_ARRAY_FROM_PTR(uint8_t)
+	case PC_UINT16:
+		PC_DOUBLE_ARRAY_FROM_PTR(uint16_t)
+	case PC_UINT32:
+		PC_DOUBLE_ARRAY_FROM_PTR(uint32_t)
+	case PC_UINT64:
+		PC_DOUBLE_ARRAY_FROM_PTR(uint64_t)
+	case PC_INT8:
+		PC_DOUBLE_ARRAY_FROM_PTR(int8_t)
+	case PC_INT16:
+		PC_DOUBLE_ARRAY_FROM_PTR(int16_t)
+	case PC_INT32:
+		PC_DOUBLE_ARRAY_FROM_PTR(int32_t)
+	case PC_INT64:
+		PC_DOUBLE_ARRAY_FROM_PTR(int64_t)
+	case PC_FLOAT:
+		PC_DOUBLE_ARRAY_FROM_PTR(float)
+	case PC_DOUBLE:
+		PC_DOUBLE_ARRAY_FROM_PTR(double)
+	default:
+		pcerror("unknown interpretation type %d encountered in %s", interpretation, __func__);
+	}
+}
+
+#undef PC_DOUBLE_ARRAY_FROM_PTR
+
+/** Apply the scale/offset of a dimension to n values, as pc_value_scale_offset */
+void
+pc_double_array_scale_offset(double *vals, uint32_t n, const PCDIMENSION *dim)
+{
+	uint32_t i;
+	double scale = dim->scale;
+	double offset = dim->offset;
+
+	if ( scale != 1 )
+		for ( i = 0; i < n; i++ )
+			vals[i] *= scale;
+
+	if ( offset )
+		for ( i = 0; i < n; i++ )
+			vals[i] += offset;
+}
+
+/** Fold n values into the running min, max and sum */
+void
+pc_double_array_stat(const double *vals, uint32_t n, PCDOUBLESTAT *stat)
+{
+	uint32_t i;
+	double min = stat->min;
+	double max = stat->max;
+	double sum = stat->sum;
+
+	for ( i = 0; i < n; i++ )
+	{
+		double d = vals[i];
+		min = d < min ? d : min;
+		max = d > max ? d : max;
+		sum += d;
+	}
+
+	stat->min = min;
+	stat->max = max;
+	stat->sum = sum;
+}
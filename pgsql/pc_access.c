@@ -9,9 +9,17 @@
 *
 ***********************************************************************/
 
+#include <math.h>
 #include "pc_pgsql.h"      /* Common PgSQL support for our type */
 #include "utils/numeric.h"
 #include "funcapi.h"
+#include "access/htup_details.h"
+#include "utils/memutils.h"
+#include "utils/lsyscache.h"
+
+#ifndef TupleDescAttr
+#define TupleDescAttr(tupdesc, i) ((tupdesc)->attrs[(i)])
+#endif
 
 /* General SQL functions */
 Datum pcpoint_get_value(PG_FUNCTION_ARGS);
@@ -24,26 +32,38 @@ Datum pcpatch_compression(PG_FUNCTION_ARGS);
 Datum pcpatch_intersects(PG_FUNCTION_ARGS);
 Datum pcpatch_get_stat(PG_FUNCTION_ARGS);
 Datum pcpatch_filter(PG_FUNCTION_ARGS);
+Datum pcpatch_filter_predicate(PG_FUNCTION_ARGS);
+Datum pcpatch_filter_geometry(PG_FUNCTION_ARGS);
 Datum pcpatch_size(PG_FUNCTION_ARGS);
 Datum pcpoint_size(PG_FUNCTION_ARGS);
 Datum pc_version(PG_FUNCTION_ARGS);
 
 /* Generic aggregation functions */
 Datum pointcloud_agg_transfn(PG_FUNCTION_ARGS);
-Datum pointcloud_abs_in(PG_FUNCTION_ARGS);
-Datum pointcloud_abs_out(PG_FUNCTION_ARGS);
 
 /* Point finalizers */
-Datum pcpoint_agg_final_pcpatch(PG_FUNCTION_ARGS);
 Datum pcpoint_agg_final_array(PG_FUNCTION_ARGS);
 
 /* Patch finalizers */
 Datum pcpatch_agg_final_array(PG_FUNCTION_ARGS);
-Datum pcpatch_agg_final_pcpatch(PG_FUNCTION_ARGS);
+
+/* Parallel PC_Point_Agg and PC_Patch_Agg */
+Datum pointcloud_agg_combinefn(PG_FUNCTION_ARGS);
+Datum pointcloud_agg_serialfn(PG_FUNCTION_ARGS);
+Datum pointcloud_agg_deserialfn(PG_FUNCTION_ARGS);
+
+/* PC_Patch and PC_Union, building the patch as the points come in */
+Datum pcpoint_union_transfn(PG_FUNCTION_ARGS);
+Datum pcpatch_union_transfn(PG_FUNCTION_ARGS);
+Datum pointcloud_union_final(PG_FUNCTION_ARGS);
+Datum pointcloud_union_combinefn(PG_FUNCTION_ARGS);
+Datum pointcloud_union_serialfn(PG_FUNCTION_ARGS);
+Datum pointcloud_union_deserialfn(PG_FUNCTION_ARGS);
 
 /* Deaggregation functions */
 Datum pcpatch_unnest(PG_FUNCTION_ARGS);
 Datum pcpatch_unnest_reduce_dimension(PG_FUNCTION_ARGS);
+Datum pcpatch_values(PG_FUNCTION_ARGS);
 
 /**
 * Read a named dimension from a PCPOINT
@@ -88,7 +108,7 @@ array_get_isnull(const bits8 *nullbitmap, int offset)
 }
 
 static PCPATCH *
-pcpatch_from_point_array(ArrayType *array, FunctionCallInfoData *fcinfo)
+pcpatch_from_point_array(ArrayType *array, FunctionCallInfo fcinfo)
 {
 	int nelems;
 	bits8 *bitmap;
@@ -159,7 +179,7 @@ pcpatch_from_point_array(ArrayType *array, FunctionCallInfoData *fcinfo)
 
 
 static PCPATCH *
-pcpatch_from_patch_array(ArrayType *array, FunctionCallInfoData *fcinfo)
+pcpatch_from_patch_array(ArrayType *array, FunctionCallInfo fcinfo)
 {
 	int nelems;
 	bits8 *bitmap;
@@ -284,23 +304,6 @@ typedef struct
 	ArrayBuildState *s;
 } abs_trans;
 
-PG_FUNCTION_INFO_V1(pointcloud_abs_in);
-Datum pointcloud_abs_in(PG_FUNCTION_ARGS)
-{
-	ereport(ERROR,(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-	               errmsg("function pointcloud_abs_in not implemented")));
-	PG_RETURN_POINTER(NULL);
-}
-
-PG_FUNCTION_INFO_V1(pointcloud_abs_out);
-Datum pointcloud_abs_out(PG_FUNCTION_ARGS)
-{
-	ereport(ERROR,(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-	               errmsg("function pointcloud_abs_out not implemented")));
-	PG_RETURN_POINTER(NULL);
-}
-
-
 PG_FUNCTION_INFO_V1(pointcloud_agg_transfn);
 Datum pointcloud_agg_transfn(PG_FUNCTION_ARGS)
 {
@@ -315,24 +318,15 @@ Datum pointcloud_agg_transfn(PG_FUNCTION_ARGS)
 		        (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
 		         errmsg("could not determine input data type")));
 
-	if (fcinfo->context && IsA(fcinfo->context, AggState))
-	{
-		aggcontext = ((AggState *) fcinfo->context)->aggcontext;
-	}
-	else if (fcinfo->context && IsA(fcinfo->context, WindowAggState))
+	if ( ! AggCheckCallContext(fcinfo, &aggcontext) )
 	{
-		aggcontext = ((WindowAggState *) fcinfo->context)->aggcontext;
-	}
-	else
-	{
-		/* cannot be called directly because of dummy-type argument */
+		/* cannot be called directly because of internal-type argument */
 		elog(ERROR, "pointcloud_agg_transfn called in non-aggregate context");
-		aggcontext = NULL;  /* keep compiler quiet */
 	}
 
 	if ( PG_ARGISNULL(0) )
 	{
-		a = (abs_trans*) palloc(sizeof(abs_trans));
+		a = (abs_trans*) MemoryContextAlloc(aggcontext, sizeof(abs_trans));
 		a->s = NULL;
 	}
 	else
@@ -397,46 +391,215 @@ Datum pcpatch_agg_final_array(PG_FUNCTION_ARGS)
 	PG_RETURN_DATUM(result);
 }
 
+/**
+* Append the elements gathered by a partial PC_Point_Agg or
+* PC_Patch_Agg to the state of the group.
+*/
+PG_FUNCTION_INFO_V1(pointcloud_agg_combinefn);
+Datum pointcloud_agg_combinefn(PG_FUNCTION_ARGS)
+{
+	MemoryContext aggcontext;
+	abs_trans *a, *a2;
+	int i;
+
+	if ( ! AggCheckCallContext(fcinfo, &aggcontext) )
+		elog(ERROR, "%s called in non-aggregate context", __func__);
+
+	if ( PG_ARGISNULL(1) )
+	{
+		if ( PG_ARGISNULL(0) )
+			PG_RETURN_NULL();
+		PG_RETURN_POINTER(PG_GETARG_POINTER(0));
+	}
+	a2 = (abs_trans*) PG_GETARG_POINTER(1);
 
-PG_FUNCTION_INFO_V1(pcpoint_agg_final_pcpatch);
-Datum pcpoint_agg_final_pcpatch(PG_FUNCTION_ARGS)
+	if ( PG_ARGISNULL(0) )
+	{
+		a = (abs_trans*) MemoryContextAlloc(aggcontext, sizeof(abs_trans));
+		a->s = NULL;
+	}
+	else
+	{
+		a = (abs_trans*) PG_GETARG_POINTER(0);
+	}
+
+	/* Elements are copied into the state's own context */
+	for ( i = 0; i < a2->s->nelems; i++ )
+	{
+		a->s = accumArrayResult(a->s,
+		                        a2->s->dvalues[i],
+		                        a2->s->dnulls[i],
+		                        a2->s->element_type,
+		                        aggcontext);
+	}
+
+	PG_RETURN_POINTER(a);
+}
+
+/**
+* Partial PC_Point_Agg or PC_Patch_Agg state as a bytea, which
+* holds the array the state would finish into.
+*/
+PG_FUNCTION_INFO_V1(pointcloud_agg_serialfn);
+Datum pointcloud_agg_serialfn(PG_FUNCTION_ARGS)
 {
-	ArrayType *array;
 	abs_trans *a;
-	PCPATCH *pa;
-	SERIALIZED_PATCH *serpa;
 
-	if (PG_ARGISNULL(0))
-		PG_RETURN_NULL();   /* returns null iff no input values */
+	if ( ! AggCheckCallContext(fcinfo, NULL) )
+		elog(ERROR, "%s called in non-aggregate context", __func__);
 
 	a = (abs_trans*) PG_GETARG_POINTER(0);
+	PG_RETURN_DATUM(pointcloud_agg_final(a, CurrentMemoryContext, fcinfo));
+}
 
-	array = DatumGetArrayTypeP(pointcloud_agg_final(a, CurrentMemoryContext, fcinfo));
-	pa = pcpatch_from_point_array(array, fcinfo);
+PG_FUNCTION_INFO_V1(pointcloud_agg_deserialfn);
+Datum pointcloud_agg_deserialfn(PG_FUNCTION_ARGS)
+{
+	ArrayType *arr;
+	abs_trans *a;
+	Datum *elems;
+	bool *nulls;
+	int16 typlen;
+	bool typbyval;
+	char typalign;
+	int nelems, i;
+
+	if ( ! AggCheckCallContext(fcinfo, NULL) )
+		elog(ERROR, "%s called in non-aggregate context", __func__);
+
+	arr = PG_GETARG_ARRAYTYPE_P(0);
+	get_typlenbyvalalign(ARR_ELEMTYPE(arr), &typlen, &typbyval, &typalign);
+	deconstruct_array(arr, ARR_ELEMTYPE(arr), typlen, typbyval, typalign,
+	                  &elems, &nulls, &nelems);
+
+	a = (abs_trans*) palloc(sizeof(abs_trans));
+	a->s = NULL;
+	for ( i = 0; i < nelems; i++ )
+	{
+		a->s = accumArrayResult(a->s, elems[i], nulls[i],
+		                        ARR_ELEMTYPE(arr), CurrentMemoryContext);
+	}
+
+	PG_RETURN_POINTER(a);
+}
+
+
+/**
+* State of PC_Patch and PC_Union for a group, the points it
+* holds so far one column per dimension, passed around as internal.
+* Checks the points of the next input fit within
+* pointcloud.agg_memory_limit, and within what a single patch
+* can hold, before any of them is decoded.
+*/
+static PCPATCHBUILDER *
+pointcloud_union_state(FunctionCallInfo fcinfo, uint32 pcid, uint32 npoints, MemoryContext *aggcontext)
+{
+	PCPATCHBUILDER *b;
+	Size limit = MaxAllocSize;
+
+	if ( ! AggCheckCallContext(fcinfo, aggcontext) )
+		elog(ERROR, "%s called in non-aggregate context", __func__);
+
+	if ( PG_ARGISNULL(0) )
+	{
+		PCSCHEMA *schema = pc_schema_from_pcid(pcid, fcinfo);
+		MemoryContext oldcontext = MemoryContextSwitchTo(*aggcontext);
+		b = pc_patch_builder_make(schema);
+		MemoryContextSwitchTo(oldcontext);
+	}
+	else
+	{
+		b = (PCPATCHBUILDER*) PG_GETARG_POINTER(0);
+	}
+
+	if ( b->schema->pcid != pcid )
+		elog(ERROR, "%s: pcid mismatch (%d != %d)", __func__, pcid, b->schema->pcid);
+
+	if ( pc_agg_memory_limit >= 0 && (Size)pc_agg_memory_limit * 1024 < limit )
+		limit = (Size)pc_agg_memory_limit * 1024;
+	/* The columns stop doubling at the limit, so they never outgrow it */
+	b->limitpoints = Max(1, Min(limit / b->schema->size, PG_UINT32_MAX));
+	if ( ((Size)b->npoints + npoints) * b->schema->size > limit )
+		ereport(ERROR,
+		        (errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+		         errmsg("points of the aggregate group exceed %lu bytes", (unsigned long)limit),
+		         errhint("Raise pointcloud.agg_memory_limit, or aggregate into smaller patches.")));
+
+	return b;
+}
+
+PG_FUNCTION_INFO_V1(pcpoint_union_transfn);
+Datum pcpoint_union_transfn(PG_FUNCTION_ARGS)
+{
+	MemoryContext aggcontext, oldcontext;
+	SERIALIZED_POINT *serpt;
+	PCPATCHBUILDER *b;
+	PCPOINT *pt;
+
+	if ( PG_ARGISNULL(1) )
+	{
+		if ( PG_ARGISNULL(0) )
+			PG_RETURN_NULL();
+		PG_RETURN_POINTER(PG_GETARG_POINTER(0));
+	}
+
+	serpt = PG_GETARG_SERPOINT_P(1);
+	b = pointcloud_union_state(fcinfo, serpt->pcid, 1, &aggcontext);
+	pt = pc_point_deserialize(serpt, b->schema);
+
+	oldcontext = MemoryContextSwitchTo(aggcontext);
+	pc_patch_builder_add_point(b, pt);
+	MemoryContextSwitchTo(oldcontext);
+
+	pc_point_free(pt);
+	PG_RETURN_POINTER(b);
+}
+
+PG_FUNCTION_INFO_V1(pcpatch_union_transfn);
+Datum pcpatch_union_transfn(PG_FUNCTION_ARGS)
+{
+	MemoryContext aggcontext, oldcontext;
+	SERIALIZED_PATCH *serpatch;
+	PCPATCHBUILDER *b;
+	PCPATCH *pa;
+
+	if ( PG_ARGISNULL(1) )
+	{
+		if ( PG_ARGISNULL(0) )
+			PG_RETURN_NULL();
+		PG_RETURN_POINTER(PG_GETARG_POINTER(0));
+	}
+
+	/* Only the header is needed to know whether the points fit */
+	serpatch = PG_GETHEADER_SERPATCH_P(1);
+	b = pointcloud_union_state(fcinfo, serpatch->pcid, serpatch->npoints, &aggcontext);
+
+	serpatch = PG_GETARG_SERPATCH_P(1);
+	pa = pc_patch_deserialize(serpatch, b->schema);
 	if ( ! pa )
-		PG_RETURN_NULL();
+		elog(ERROR, "%s: patch deserialization failed", __func__);
+
+	oldcontext = MemoryContextSwitchTo(aggcontext);
+	pc_patch_builder_add_patch(b, pa);
+	MemoryContextSwitchTo(oldcontext);
 
-	serpa = pc_patch_serialize(pa, NULL);
 	pc_patch_free(pa);
-	PG_RETURN_POINTER(serpa);
+	PG_RETURN_POINTER(b);
 }
 
-
-PG_FUNCTION_INFO_V1(pcpatch_agg_final_pcpatch);
-Datum pcpatch_agg_final_pcpatch(PG_FUNCTION_ARGS)
+PG_FUNCTION_INFO_V1(pointcloud_union_final);
+Datum pointcloud_union_final(PG_FUNCTION_ARGS)
 {
-	ArrayType *array;
-	abs_trans *a;
+	PCPATCHBUILDER *b;
 	PCPATCH *pa;
 	SERIALIZED_PATCH *serpa;
 
-	if (PG_ARGISNULL(0))
+	if ( PG_ARGISNULL(0) )
 		PG_RETURN_NULL();   /* returns null iff no input values */
 
-	a = (abs_trans*) PG_GETARG_POINTER(0);
-
-	array = DatumGetArrayTypeP(pointcloud_agg_final(a, CurrentMemoryContext, fcinfo));
-	pa = pcpatch_from_patch_array(array, fcinfo);
+	/* The state is left as it is, window aggregates carry on from it */
+	b = (PCPATCHBUILDER*) PG_GETARG_POINTER(0);
+	pa = pc_patch_builder_to_patch(b);
 	if ( ! pa )
 		PG_RETURN_NULL();
 
@@ -445,6 +608,118 @@ Datum pcpatch_agg_final_pcpatch(PG_FUNCTION_ARGS)
 	PG_RETURN_POINTER(serpa);
 }
 
+/**
+* Append the points of a partial PC_Patch or PC_Union to the
+* state of the group, within the same memory limit as its inputs.
+*/
+PG_FUNCTION_INFO_V1(pointcloud_union_combinefn);
+Datum pointcloud_union_combinefn(PG_FUNCTION_ARGS)
+{
+	MemoryContext aggcontext, oldcontext;
+	PCPATCHBUILDER *b, *b2;
+
+	if ( PG_ARGISNULL(1) )
+	{
+		if ( PG_ARGISNULL(0) )
+			PG_RETURN_NULL();
+		PG_RETURN_POINTER(PG_GETARG_POINTER(0));
+	}
+
+	b2 = (PCPATCHBUILDER*) PG_GETARG_POINTER(1);
+	b = pointcloud_union_state(fcinfo, b2->schema->pcid, b2->npoints, &aggcontext);
+
+	oldcontext = MemoryContextSwitchTo(aggcontext);
+	pc_patch_builder_merge(b, b2);
+	MemoryContextSwitchTo(oldcontext);
+
+	PG_RETURN_POINTER(b);
+}
+
+/**
+* Partial PC_Patch or PC_Union state as a bytea: pcid, number
+* of points, then the values of each dimension in schema order,
+* held dimensional patches decoded on the way.
+*/
+PG_FUNCTION_INFO_V1(pointcloud_union_serialfn);
+Datum pointcloud_union_serialfn(PG_FUNCTION_ARGS)
+{
+	PCPATCHBUILDER *b;
+	bytea *result;
+	uint8 *ptr;
+	uint32 pcid;
+	Size size;
+	int i;
+
+	if ( ! AggCheckCallContext(fcinfo, NULL) )
+		elog(ERROR, "%s called in non-aggregate context", __func__);
+
+	b = (PCPATCHBUILDER*) PG_GETARG_POINTER(0);
+	pcid = b->schema->pcid;
+
+	size = VARHDRSZ + 2 * sizeof(uint32) + (Size)b->npoints * b->schema->size;
+	result = palloc(size);
+	SET_VARSIZE(result, size);
+	ptr = (uint8*) VARDATA(result);
+	memcpy(ptr, &pcid, sizeof(uint32));
+	ptr += sizeof(uint32);
+	memcpy(ptr, &(b->npoints), sizeof(uint32));
+	ptr += sizeof(uint32);
+	for ( i = 0; i < b->schema->ndims; i++ )
+	{
+		pc_patch_builder_copy_dimension(b, i, ptr);
+		ptr += (Size)b->npoints * b->schema->dims[i]->size;
+	}
+
+	PG_RETURN_BYTEA_P(result);
+}
+
+PG_FUNCTION_INFO_V1(pointcloud_union_deserialfn);
+Datum pointcloud_union_deserialfn(PG_FUNCTION_ARGS)
+{
+	bytea *serial;
+	uint8 *ptr;
+	uint32 pcid, npoints;
+	PCSCHEMA *schema;
+	PCPATCHBUILDER *b, partial;
+	int i;
+
+	if ( ! AggCheckCallContext(fcinfo, NULL) )
+		elog(ERROR, "%s called in non-aggregate context", __func__);
+
+	serial = PG_GETARG_BYTEA_P(0);
+	if ( VARSIZE(serial) - VARHDRSZ < 2 * sizeof(uint32) )
+		elog(ERROR, "%s: truncated aggregate state", __func__);
+	ptr = (uint8*) VARDATA(serial);
+	memcpy(&pcid, ptr, sizeof(uint32));
+	ptr += sizeof(uint32);
+	memcpy(&npoints, ptr, sizeof(uint32));
+	ptr += sizeof(uint32);
+
+	schema = pc_schema_from_pcid(pcid, fcinfo);
+	if ( VARSIZE(serial) - VARHDRSZ != 2 * sizeof(uint32) + (Size)npoints * schema->size )
+		elog(ERROR, "%s: truncated aggregate state", __func__);
+
+	/* The columns are read in place, then copied into the state */
+	partial.schema = schema;
+	partial.npoints = partial.maxpoints = npoints;
+	partial.limitpoints = 0;
+	partial.patches = NULL;
+	partial.npatches = partial.maxpatches = 0;
+	partial.dims = palloc(schema->ndims * sizeof(uint8*));
+	for ( i = 0; i < schema->ndims; i++ )
+	{
+		partial.dims[i] = ptr;
+		ptr += (Size)npoints * schema->dims[i]->size;
+	}
+
+	b = pc_patch_builder_make(schema);
+	b->limitpoints = Max(1, npoints);
+	pc_patch_builder_merge(b, &partial);
+	pfree(partial.dims);
+
+	PG_RETURN_POINTER(b);
+}
+
 
 PG_FUNCTION_INFO_V1(pcpatch_unnest);
 Datum pcpatch_unnest(PG_FUNCTION_ARGS)
@@ -482,7 +757,7 @@ Datum pcpatch_unnest(PG_FUNCTION_ARGS)
 		* passed array will stick around till then.)
 		*/
 		serpatch = PG_GETARG_SERPATCH_P(0);
-		patch = pc_patch_deserialize(serpatch, pc_schema_from_pcid_uncached(serpatch->pcid));
+		patch = pc_patch_deserialize(serpatch, pc_schema_from_pcid(serpatch->pcid, fcinfo));
 
 		/* allocate memory for user context */
 		fctx = (pcpatch_unnest_fctx *) palloc(sizeof(pcpatch_unnest_fctx));
@@ -544,6 +819,7 @@ Datum pcpatch_unnest_reduce_dimension(PG_FUNCTION_ARGS)
 		int j ;
 		int ndim;
 		char ** final_dimension_array;
+		uint32_t *dims;
 		Datum temp_text_array_datum;
 		ndim=0;
 
@@ -567,29 +843,32 @@ Datum pcpatch_unnest_reduce_dimension(PG_FUNCTION_ARGS)
 		*/
 		//getting the serialized patch
 				//pcinfo("getting serpatch\n");
-		serpatch = PG_GETARG_SERPATCH_P(0);
+		//only the header for now, the dimensions we keep are read later
+		serpatch = PG_GETHEADER_SERPATCH_P(0);
 		funcctx->max_calls = serpatch->npoints; //setting the max number of call : one per point to output
 		pc_serpatch_to_string(serpatch,NULL);
 		//getting the schema
 				//pcinfo("getting schema\n");
-		//schema = pc_schema_from_pcid(serpatch->pcid, fcinfo); //doesn't work because we need to writte the schema in the cache
-		schema = pc_schema_from_pcid_uncached(serpatch->pcid);
+		schema = pc_schema_from_pcid(serpatch->pcid, fcinfo);
 		//getting the text[] that represent the dimensions we want to keep
 				//pcinfo("getting text[] content\n");
 		temp_text_array_datum = PG_GETARG_DATUM(1);
 		final_dimension_array = pccstringarray_from_Datum(temp_text_array_datum,&ndim);
+		dims = pcalloc(ndim * sizeof(uint32_t));
 			for(i=0;i<ndim;i++)
 					{
 						if((j=pc_schema_get_dimension_position_by_name(schema, final_dimension_array[i])) == -1 )
 							{pcerror("error, you asked to keep the dimension  ░▒▓%s▓▒░, yet this dimension doesn't exist in the schema %s\n"
 								,final_dimension_array[i],pc_schema_to_json(schema));
 							}
+						dims[i] = j;
 						//pcinfo(" the dimension %s has position %d and exists \n",final_dimension_array[i],j);
 					}
 		
-		//deserializing
+		//deserializing, only detoasting the dimensions we keep
 				//pcinfo("deserializing\n");
-		patch = pc_patch_deserialize(serpatch, schema);
+		patch = pc_patch_deserialize_dimensions(PG_GETARG_DATUM(0), schema, dims, ndim);
+		pcfree(dims);
 		
 		//reducing the number of dimension
 				//pcinfo("reducing number of dims\n");
@@ -671,6 +950,144 @@ Datum pcpatch_unnest_reduce_dimension(PG_FUNCTION_ARGS)
 }
 
 
+/* Read a float8[] argument that must hold n elements */
+static float8 *
+pc_float8_array_from_arg(ArrayType *arrptr, int n, const char *argname)
+{
+	if ( ARR_ELEMTYPE(arrptr) != FLOAT8OID )
+		elog(ERROR, "%s must be of float8[]", argname);
+	if ( ARR_HASNULL(arrptr) )
+		elog(ERROR, "%s must not have null elements", argname);
+	if ( ArrayGetNItems(ARR_NDIM(arrptr), ARR_DIMS(arrptr)) != n )
+		elog(ERROR, "%s must have one element per filter dimension", argname);
+	return (float8*) ARR_DATA_PTR(arrptr);
+}
+
+/* Position of a named dimension, or an error naming the schema */
+static uint32_t
+pc_schema_dimension_position(const PCSCHEMA *schema, const char *name)
+{
+	PCDIMENSION *dim = pc_schema_get_dimension_by_name(schema, name);
+	if ( ! dim )
+		elog(ERROR, "dimension \"%s\" does not exist in schema of pcid = %d", name, schema->pcid);
+	return dim->position;
+}
+
+/**
+* PC_Values(p pcpatch, dims text[], filterdims text[], mins float8[], maxs float8[])
+* returns setof record
+* Points of the patch strictly between mins[i] and maxs[i] on every
+* filterdims[i], as one float8 column per dims entry. Patches the stats
+* rule out are not detoasted past their header, the others only have the
+* filter and output dimensions decoded, and the points are never built.
+*/
+PG_FUNCTION_INFO_V1(pcpatch_values);
+Datum pcpatch_values(PG_FUNCTION_ARGS)
+{
+	typedef struct
+	{
+		uint32_t nextelem;
+		uint32_t numelems;
+		uint32_t ncols;
+		double *vals;
+	} pcpatch_values_fctx;
+
+	FuncCallContext *funcctx;
+	pcpatch_values_fctx *fctx;
+	MemoryContext oldcontext;
+
+	if (SRF_IS_FIRSTCALL())
+	{
+		SERIALIZED_PATCH *serpatch;
+		PCSCHEMA *schema;
+		PCPATCH *patch;
+		TupleDesc tupdesc;
+		char **odimnames, **fdimnames;
+		int nodims, nfdims, i;
+		uint32_t *dims;
+		float8 *mins, *maxs;
+		double *fmins, *fmaxs;
+
+		funcctx = SRF_FIRSTCALL_INIT();
+		oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+
+		if ( get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE )
+			elog(ERROR, "PC_Values needs a column definition list, one float8 per dimension");
+		funcctx->tuple_desc = BlessTupleDesc(tupdesc);
+
+		fctx = palloc0(sizeof(pcpatch_values_fctx));
+		funcctx->user_fctx = fctx;
+
+		serpatch = pc_patch_header_stats(PG_GETARG_DATUM(0), &schema, fcinfo);
+
+		odimnames = pccstringarray_from_Datum(PG_GETARG_DATUM(1), &nodims);
+		fdimnames = pccstringarray_from_Datum(PG_GETARG_DATUM(2), &nfdims);
+		mins = pc_float8_array_from_arg(PG_GETARG_ARRAYTYPE_P(3), nfdims, "mins");
+		maxs = pc_float8_array_from_arg(PG_GETARG_ARRAYTYPE_P(4), nfdims, "maxs");
+
+		if ( nodims != tupdesc->natts )
+			elog(ERROR, "PC_Values returns %d columns, but %d are defined", nodims, tupdesc->natts);
+		for ( i = 0; i < tupdesc->natts; i++ )
+		{
+			if ( TupleDescAttr(tupdesc, i)->atttypid != FLOAT8OID )
+				elog(ERROR, "PC_Values columns must be float8");
+		}
+
+		/* Output dimensions first, then the filter dimensions */
+		dims = palloc((nodims + nfdims) * sizeof(uint32_t));
+		fmins = palloc((nfdims + 1) * sizeof(double));
+		fmaxs = palloc((nfdims + 1) * sizeof(double));
+		for ( i = 0; i < nodims; i++ )
+			dims[i] = pc_schema_dimension_position(schema, odimnames[i]);
+		for ( i = 0; i < nfdims; i++ )
+		{
+			double min, max;
+			dims[nodims + i] = pc_schema_dimension_position(schema, fdimnames[i]);
+			fmins[i] = Min(mins[i], maxs[i]);
+			fmaxs[i] = Max(mins[i], maxs[i]);
+
+			/* Nothing in this patch, leave the rest of it in the toast */
+			pc_patch_stats_range(serpatch, schema, schema->dims[dims[nodims + i]], &min, &max);
+			if ( max <= fmins[i] || min >= fmaxs[i] )
+			{
+				MemoryContextSwitchTo(oldcontext);
+				SRF_RETURN_DONE(funcctx);
+			}
+		}
+
+		patch = pc_patch_deserialize_dimensions(PG_GETARG_DATUM(0), schema, dims, nodims + nfdims);
+		fctx->ncols = nodims;
+		fctx->vals = pc_patch_filter_values(patch, dims + nodims, fmins, fmaxs, nfdims, dims, nodims, &(fctx->numelems));
+		pc_patch_free(patch);
+
+		MemoryContextSwitchTo(oldcontext);
+	}
+
+	funcctx = SRF_PERCALL_SETUP();
+	fctx = funcctx->user_fctx;
+
+	if ( fctx->nextelem < fctx->numelems )
+	{
+		Datum *values = palloc(fctx->ncols * sizeof(Datum));
+		bool *nulls = palloc0(fctx->ncols * sizeof(bool));
+		double *row = fctx->vals + (size_t)fctx->nextelem * fctx->ncols;
+		HeapTuple tuple;
+		int i;
+
+		for ( i = 0; i < fctx->ncols; i++ )
+			values[i] = Float8GetDatum(row[i]);
+
+		tuple = heap_form_tuple(funcctx->tuple_desc, values, nulls);
+		fctx->nextelem++;
+		SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(tuple));
+	}
+	else
+	{
+		SRF_RETURN_DONE(funcctx);
+	}
+}
+
+
 PG_FUNCTION_INFO_V1(pcpatch_uncompress);
 Datum pcpatch_uncompress(PG_FUNCTION_ARGS)
 {
@@ -773,7 +1190,7 @@ PG_FUNCTION_INFO_V1(pcpatch_compression);
 Datum pcpatch_compression(PG_FUNCTION_ARGS)
 {
 	SERIALIZED_PATCH *serpa = PG_GETHEADER_SERPATCH_P(0);
-	PG_RETURN_INT32(serpa->compression);
+	PG_RETURN_INT32(SERPATCH_COMPRESSION(serpa));
 }
 
 PG_FUNCTION_INFO_V1(pcpatch_intersects);
@@ -934,5 +1351,126 @@ Datum pcpatch_filter(PG_FUNCTION_ARGS)
 	PG_RETURN_POINTER(serpatch_filtered);
 }
 
+/**
+* PC_Filter(patch pcpatch, predicate text) returns pcpatch
+* Points matching a predicate over any number of dimensions, with
+* the patch stats checked before the patch is read
+*/
+PG_FUNCTION_INFO_V1(pcpatch_filter_predicate);
+Datum pcpatch_filter_predicate(PG_FUNCTION_ARGS)
+{
+	PCSCHEMA *schema;
+	SERIALIZED_PATCH *serpatch;
+	PCSTATS *stats;
+	PCPREDICATE *pred;
+	PCPATCH *patch, *patch_filtered;
+	SERIALIZED_PATCH *serpatch_filtered;
+	char *str = text_to_cstring(PG_GETARG_TEXT_P(1));
+	PC_MATCHTYPE match;
+
+	serpatch = pc_patch_header_stats(PG_GETARG_DATUM(0), &schema, fcinfo);
+	pred = pc_predicate_parse(schema, str);
+	if ( ! pred )
+		elog(ERROR, "invalid predicate \"%s\"", str);
+	pfree(str);
+
+	/* Nothing or everything in this patch, leave it in the toast */
+	stats = pc_stats_new_from_data(schema, serpatch->data, serpatch->data + schema->size, serpatch->data + 2 * schema->size);
+	match = pc_predicate_match_stats(pred, stats);
+	pc_stats_free(stats);
+	if ( match == PC_MATCH_NONE || serpatch->npoints == 0 )
+	{
+		pc_predicate_free(pred);
+		PG_RETURN_NULL();
+	}
+	if ( match == PC_MATCH_ALL )
+	{
+		pc_predicate_free(pred);
+		PG_RETURN_DATUM(PG_GETARG_DATUM(0));
+	}
+
+	patch = pc_patch_deserialize(PG_GETARG_SERPATCH_P(0), schema);
+	if ( ! patch )
+		elog(ERROR, "failed to deserialize patch");
+
+	patch_filtered = pc_patch_filter_predicate(patch, pred);
+	pc_patch_free(patch);
+	pc_predicate_free(pred);
+
+	/* Always treat zero-point patches as SQL NULL */
+	if ( patch_filtered->npoints <= 0 )
+	{
+		pc_patch_free(patch_filtered);
+		PG_RETURN_NULL();
+	}
+
+	serpatch_filtered = pc_patch_serialize(patch_filtered, NULL);
+	pc_patch_free(patch_filtered);
+
+	PG_RETURN_POINTER(serpatch_filtered);
+}
+
+/**
+* Points covered by a geometry given as WKB, or within a distance
+* of it, with the patch bounds checked before the patch is read
+*/
+PG_FUNCTION_INFO_V1(pcpatch_filter_geometry);
+Datum pcpatch_filter_geometry(PG_FUNCTION_ARGS)
+{
+	SERIALIZED_PATCH *serpatch = PG_GETHEADER_SERPATCH_P(0);
+	bytea *wkb = PG_GETARG_BYTEA_P(1);
+	float8 distance = PG_GETARG_FLOAT8(2);
+	PCSCHEMA *schema;
+	PCGEOMETRY *geom;
+	PCPATCH *patch, *patch_filtered;
+	SERIALIZED_PATCH *serpatch_filtered;
+	PC_MATCHTYPE match;
+
+	if ( ! isfinite(distance) || distance < 0 )
+		elog(ERROR, "distance must be finite and not negative");
+
+	geom = pc_geometry_from_wkb((uint8_t*)VARDATA(wkb), VARSIZE(wkb) - VARHDRSZ);
+	if ( ! geom )
+		elog(ERROR, "invalid WKB geometry");
+
+	/* An EWKB SRID must be the patch SRID, plain WKB is taken to be in it */
+	schema = pc_schema_from_pcid(serpatch->pcid, fcinfo);
+	if ( geom->srid && geom->srid != (int32)schema->srid )
+		elog(ERROR, "geometry SRID (%d) does not match patch SRID (%d)", geom->srid, (int)schema->srid);
+
+	/* Nothing or everything in this patch, leave it in the toast */
+	match = pc_geometry_match_bounds(geom, &(serpatch->bounds), distance);
+	if ( match == PC_MATCH_NONE || serpatch->npoints == 0 )
+	{
+		pc_geometry_free(geom);
+		PG_RETURN_NULL();
+	}
+	if ( match == PC_MATCH_ALL )
+	{
+		pc_geometry_free(geom);
+		PG_RETURN_DATUM(PG_GETARG_DATUM(0));
+	}
+
+	patch = pc_patch_deserialize(PG_GETARG_SERPATCH_P(0), schema);
+	if ( ! patch )
+		elog(ERROR, "failed to deserialize patch");
+
+	patch_filtered = pc_patch_filter_geometry(patch, geom, distance);
+	pc_patch_free(patch);
+	pc_geometry_free(geom);
+
+	/* Always treat zero-point patches as SQL NULL */
+	if ( patch_filtered->npoints <= 0 )
+	{
+		pc_patch_free(patch_filtered);
+		PG_RETURN_NULL();
+	}
+
+	serpatch_filtered = pc_patch_serialize(patch_filtered, NULL);
+	pc_patch_free(patch_filtered);
+
+	PG_RETURN_POINTER(serpatch_filtered);
+}
+
 
 
@@ -0,0 +1,617 @@
+/***********************************************************************
+* pc_analyze.c
+*
+*  Planner statistics for patch columns: ANALYZE samples the patch
+*  headers and stats, and the selectivity functions of the patch
+*  operators estimate row counts from what it gathered.
+*
+*  PgSQL Pointcloud is free and open source software provided
+*  by the Government of Canada
+*  Copyright (c) 2013 Natural Resources Canada
+*
+***********************************************************************/
+
+#include <float.h>
+#include <math.h>
+#include "pc_pgsql.h"      /* Common PgSQL support for our type */
+#include "access/htup_details.h"
+#include "catalog/pg_statistic.h"
+#include "commands/vacuum.h"
+#include "utils/geo_decls.h"
+#include "utils/lsyscache.h"
+#include "utils/selfuncs.h"
+
+/**
+* Statistic kinds of patch columns, from the range kept for private
+* use. The 2D kind is a grid of the patch centers over their extent,
+* the N-D kind holds quantiles of the dimension ranges, for the
+* schema of the first patch sampled.
+*/
+#define PC_STATISTIC_KIND_BOUNDS_2D 10100
+#define PC_STATISTIC_KIND_BOUNDS_ND 10101
+
+/* Grid cells on each side at most */
+#define PC_STATS_GRID_MAX 32
+
+/* Layout of the 2D statistic, a float8 array */
+#define PC_GRID_XMIN 0
+#define PC_GRID_YMIN 1
+#define PC_GRID_XMAX 2
+#define PC_GRID_YMAX 3
+#define PC_GRID_NX 4
+#define PC_GRID_NY 5
+#define PC_GRID_AVGW 6
+#define PC_GRID_AVGH 7
+#define PC_GRID_CELLS 8
+
+/* Layout of the N-D statistic, followed by the min then max quantiles of each dimension */
+#define PC_RANGES_PCID 0
+#define PC_RANGES_FRACTION 1
+#define PC_RANGES_NDIMS 2
+#define PC_RANGES_NBINS 3
+#define PC_RANGES_QUANTILES 4
+
+/* Estimates when there are no statistics, as areasel and contsel give */
+#define PC_DEFAULT_OVERLAP_SEL 0.005
+#define PC_DEFAULT_CONTAIN_SEL 0.001
+
+/* What the box selectivity is asked for */
+enum
+{
+	PC_SEL_OVERLAPS,
+	PC_SEL_CONTAINED,
+	PC_SEL_CONTAINS
+};
+
+Datum pcpatch_analyze(PG_FUNCTION_ARGS);
+Datum pcpatch_overlaps_sel(PG_FUNCTION_ARGS);
+Datum pcpatch_contained_sel(PG_FUNCTION_ARGS);
+Datum pcpatch_contains_sel(PG_FUNCTION_ARGS);
+Datum pcpatch_pcbox_sel(PG_FUNCTION_ARGS);
+Datum pcpatch_overlaps_joinsel(PG_FUNCTION_ARGS);
+
+
+static int
+pc_double_cmp(const void *a, const void *b)
+{
+	double da = *((const double*)a);
+	double db = *((const double*)b);
+	if ( da < db ) return -1;
+	if ( da > db ) return 1;
+	return 0;
+}
+
+/* Hand a float8 array over to a statistics slot */
+static void
+pc_stats_set_slot(VacAttrStats *stats, int slot, int kind, const double *vals, int nvals)
+{
+	Datum *values = palloc(nvals * sizeof(Datum));
+	int i;
+
+	for ( i = 0; i < nvals; i++ )
+		values[i] = Float8GetDatum(vals[i]);
+
+	stats->stakind[slot] = kind;
+	stats->staop[slot] = InvalidOid;
+	stats->stavalues[slot] = values;
+	stats->numvalues[slot] = nvals;
+	stats->statypid[slot] = FLOAT8OID;
+	stats->statyplen[slot] = sizeof(float8);
+	stats->statypbyval[slot] = FLOAT8PASSBYVAL;
+	stats->statypalign[slot] = 'd';
+}
+
+/**
+* Grid of where the centers of the sampled patches fall, as the
+* fraction of the ntotal non-null patches in each cell, with their
+* average size. Empty patches have no bounds and fall in no cell.
+*/
+static double *
+pc_stats_grid(const PCBOUNDS *bounds, int n, int ntotal, int *nvals)
+{
+	int nx, ny, i, cells;
+	double *grid;
+	double xmin = DBL_MAX, ymin = DBL_MAX, xmax = -DBL_MAX, ymax = -DBL_MAX;
+	double sumw = 0.0, sumh = 0.0;
+
+	for ( i = 0; i < n; i++ )
+	{
+		double cx = (bounds[i].xmin + bounds[i].xmax) / 2.0;
+		double cy = (bounds[i].ymin + bounds[i].ymax) / 2.0;
+		xmin = Min(xmin, cx); xmax = Max(xmax, cx);
+		ymin = Min(ymin, cy); ymax = Max(ymax, cy);
+		sumw += bounds[i].xmax - bounds[i].xmin;
+		sumh += bounds[i].ymax - bounds[i].ymin;
+	}
+	if ( n == 0 )
+		xmin = ymin = xmax = ymax = 0.0;
+
+	/* Some ten patches a cell on average */
+	nx = ny = Max(1, Min(PC_STATS_GRID_MAX, (int)sqrt(n / 10.0)));
+	if ( xmax <= xmin ) nx = 1;
+	if ( ymax <= ymin ) ny = 1;
+	cells = nx * ny;
+
+	*nvals = PC_GRID_CELLS + cells;
+	grid = palloc0(*nvals * sizeof(double));
+	grid[PC_GRID_XMIN] = xmin;
+	grid[PC_GRID_YMIN] = ymin;
+	grid[PC_GRID_XMAX] = xmax;
+	grid[PC_GRID_YMAX] = ymax;
+	grid[PC_GRID_NX] = nx;
+	grid[PC_GRID_NY] = ny;
+	grid[PC_GRID_AVGW] = n ? sumw / n : 0.0;
+	grid[PC_GRID_AVGH] = n ? sumh / n : 0.0;
+
+	for ( i = 0; i < n; i++ )
+	{
+		double cx = (bounds[i].xmin + bounds[i].xmax) / 2.0;
+		double cy = (bounds[i].ymin + bounds[i].ymax) / 2.0;
+		int ix = nx > 1 ? (int)((cx - xmin) / (xmax - xmin) * nx) : 0;
+		int iy = ny > 1 ? (int)((cy - ymin) / (ymax - ymin) * ny) : 0;
+		ix = Min(Max(ix, 0), nx - 1);
+		iy = Min(Max(iy, 0), ny - 1);
+		grid[PC_GRID_CELLS + iy * nx + ix] += 1.0 / ntotal;
+	}
+	return grid;
+}
+
+/**
+* Quantiles of the minimums and of the maximums of every dimension,
+* over the sampled patches of one schema.
+*/
+static double *
+pc_stats_ranges(uint32 pcid, double fraction, const PCSCHEMA *schema, double **mins, double **maxs, int n, int stattarget, int *nvals)
+{
+	int nbins = Max(1, Min(stattarget, n - 1));
+	int d, k;
+	double *ranges, *ptr;
+
+	*nvals = PC_RANGES_QUANTILES + schema->ndims * 2 * (nbins + 1);
+	ranges = palloc(*nvals * sizeof(double));
+	ranges[PC_RANGES_PCID] = pcid;
+	ranges[PC_RANGES_FRACTION] = fraction;
+	ranges[PC_RANGES_NDIMS] = schema->ndims;
+	ranges[PC_RANGES_NBINS] = nbins;
+
+	ptr = ranges + PC_RANGES_QUANTILES;
+	for ( d = 0; d < schema->ndims; d++ )
+	{
+		qsort(mins[d], n, sizeof(double), pc_double_cmp);
+		qsort(maxs[d], n, sizeof(double), pc_double_cmp);
+		for ( k = 0; k <= nbins; k++ )
+			*ptr++ = mins[d][(int)((double)k * (n - 1) / nbins)];
+		for ( k = 0; k <= nbins; k++ )
+			*ptr++ = maxs[d][(int)((double)k * (n - 1) / nbins)];
+	}
+	return ranges;
+}
+
+static void
+pcpatch_compute_stats(VacAttrStats *stats, AnalyzeAttrFetchFunc fetchfunc, int samplerows, double totalrows)
+{
+#if PG_VERSION_NUM >= 170000
+	int stattarget = stats->attstattarget;
+#else
+	int stattarget = stats->attr->attstattarget;
+#endif
+	PCBOUNDS *bounds = palloc(samplerows * sizeof(PCBOUNDS));
+	PCSCHEMA *schema = NULL;
+	uint32 pcid = 0;
+	double **mins = NULL, **maxs = NULL;
+	double total_width = 0.0;
+	int notnull = 0, nbounds = 0, nranges = 0;
+	int i, d;
+
+	for ( i = 0; i < samplerows; i++ )
+	{
+		bool isnull;
+		Datum value = fetchfunc(stats, i, &isnull);
+		SERIALIZED_PATCH *serpatch;
+		PCSCHEMA *patch_schema;
+
+#if PG_VERSION_NUM >= 180000
+		vacuum_delay_point(true);
+#else
+		vacuum_delay_point();
+#endif
+		if ( isnull )
+			continue;
+
+		total_width += VARSIZE_ANY(DatumGetPointer(value));
+		notnull++;
+		serpatch = pc_patch_header_stats(value, &patch_schema, NULL);
+
+		/* Empty patches have inverted bounds and no ranges, they overlap nothing */
+		if ( serpatch->npoints == 0 ||
+		     serpatch->bounds.xmin > serpatch->bounds.xmax ||
+		     serpatch->bounds.ymin > serpatch->bounds.ymax )
+		{
+			if ( (Pointer)serpatch != DatumGetPointer(value) )
+				pfree(serpatch);
+			continue;
+		}
+		bounds[nbounds++] = serpatch->bounds;
+
+		/* Dimension ranges come from the schema of the first patch */
+		if ( ! schema )
+		{
+			schema = patch_schema;
+			pcid = serpatch->pcid;
+			mins = palloc(schema->ndims * sizeof(double*));
+			maxs = palloc(schema->ndims * sizeof(double*));
+			for ( d = 0; d < schema->ndims; d++ )
+			{
+				mins[d] = palloc(samplerows * sizeof(double));
+				maxs[d] = palloc(samplerows * sizeof(double));
+			}
+		}
+		if ( serpatch->pcid == pcid )
+		{
+			for ( d = 0; d < schema->ndims; d++ )
+				pc_patch_stats_range(serpatch, schema, schema->dims[d], &(mins[d][nranges]), &(maxs[d][nranges]));
+			nranges++;
+		}
+
+		if ( (Pointer)serpatch != DatumGetPointer(value) )
+			pfree(serpatch);
+	}
+
+	if ( notnull > 0 )
+	{
+		double *vals;
+		int nvals;
+
+		stats->stats_valid = true;
+		stats->stanullfrac = (double)(samplerows - notnull) / samplerows;
+		stats->stawidth = total_width / notnull;
+		stats->stadistinct = -1.0;
+
+		vals = pc_stats_grid(bounds, nbounds, notnull, &nvals);
+		pc_stats_set_slot(stats, 0, PC_STATISTIC_KIND_BOUNDS_2D, vals, nvals);
+		if ( nranges > 0 )
+		{
+			vals = pc_stats_ranges(pcid, (double)nranges / notnull, schema, mins, maxs, nranges, stattarget, &nvals);
+			pc_stats_set_slot(stats, 1, PC_STATISTIC_KIND_BOUNDS_ND, vals, nvals);
+		}
+	}
+	else if ( samplerows > 0 )
+	{
+		/* Nothing but nulls */
+		stats->stats_valid = true;
+		stats->stanullfrac = 1.0;
+		stats->stawidth = 0;
+		stats->stadistinct = 0.0;
+	}
+}
+
+/**
+* Statistics are gathered from the patch headers and stats only,
+* the points are never read.
+*/
+PG_FUNCTION_INFO_V1(pcpatch_analyze);
+Datum pcpatch_analyze(PG_FUNCTION_ARGS)
+{
+	VacAttrStats *stats = (VacAttrStats*)PG_GETARG_POINTER(0);
+#if PG_VERSION_NUM >= 170000
+	int stattarget = stats->attstattarget;
+#else
+	int stattarget = stats->attr->attstattarget;
+
+	if ( stattarget < 0 )
+		stattarget = stats->attr->attstattarget = default_statistics_target;
+#endif
+
+	stats->compute_stats = pcpatch_compute_stats;
+	stats->minrows = 300 * stattarget;
+	PG_RETURN_BOOL(true);
+}
+
+/**
+* Copy out the float8 array of a statistic of the column, with the
+* fraction of nulls. False when ANALYZE left none.
+*/
+static bool
+pc_stats_get(VariableStatData *vardata, int kind, double **vals, int *nvals, double *nullfrac)
+{
+	int i;
+#if PG_VERSION_NUM >= 100000
+	AttStatsSlot sslot;
+#else
+	Datum *values;
+	int nvalues;
+#endif
+
+	if ( ! HeapTupleIsValid(vardata->statsTuple) )
+		return false;
+
+#if PG_VERSION_NUM >= 100000
+	if ( ! get_attstatsslot(&sslot, vardata->statsTuple, kind, InvalidOid, ATTSTATSSLOT_VALUES) )
+		return false;
+	*nvals = sslot.nvalues;
+	*vals = palloc(sslot.nvalues * sizeof(double));
+	for ( i = 0; i < sslot.nvalues; i++ )
+		(*vals)[i] = DatumGetFloat8(sslot.values[i]);
+	free_attstatsslot(&sslot);
+#else
+	if ( ! get_attstatsslot(vardata->statsTuple, FLOAT8OID, -1, kind, InvalidOid, NULL, &values, &nvalues, NULL, NULL) )
+		return false;
+	*nvals = nvalues;
+	*vals = palloc(nvalues * sizeof(double));
+	for ( i = 0; i < nvalues; i++ )
+		(*vals)[i] = DatumGetFloat8(values[i]);
+	free_attstatsslot(FLOAT8OID, values, nvalues, NULL, 0);
+#endif
+
+	*nullfrac = ((Form_pg_statistic) GETSTRUCT(vardata->statsTuple))->stanullfrac;
+	return true;
+}
+
+/* Share of a cell extent that falls in a range, cells of no extent count whole */
+static double
+pc_overlap_fraction(double lo, double hi, double qlo, double qhi)
+{
+	if ( hi <= lo )
+		return (lo >= qlo && lo <= qhi) ? 1.0 : 0.0;
+	return Max(0.0, Min(hi, qhi) - Max(lo, qlo)) / (hi - lo);
+}
+
+/**
+* Fraction of the patches whose center falls in the box, each cell
+* contributing as much as the box covers of it.
+*/
+static double
+pc_grid_mass(const double *grid, double xmin, double ymin, double xmax, double ymax)
+{
+	int nx = (int)grid[PC_GRID_NX];
+	int ny = (int)grid[PC_GRID_NY];
+	double cw = (grid[PC_GRID_XMAX] - grid[PC_GRID_XMIN]) / nx;
+	double ch = (grid[PC_GRID_YMAX] - grid[PC_GRID_YMIN]) / ny;
+	double mass = 0.0;
+	int ix, iy;
+
+	if ( xmax < xmin || ymax < ymin )
+		return 0.0;
+
+	for ( iy = 0; iy < ny; iy++ )
+	{
+		double cy = grid[PC_GRID_YMIN] + iy * ch;
+		double fy = pc_overlap_fraction(cy, cy + ch, ymin, ymax);
+		if ( fy <= 0.0 )
+			continue;
+		for ( ix = 0; ix < nx; ix++ )
+		{
+			double cell = grid[PC_GRID_CELLS + iy * nx + ix];
+			double cx = grid[PC_GRID_XMIN] + ix * cw;
+			if ( cell > 0.0 )
+				mass += cell * fy * pc_overlap_fraction(cx, cx + cw, xmin, xmax);
+		}
+	}
+	return mass;
+}
+
+/**
+* Patches of the average size overlap a box when their center is in
+* the box grown by half that size, they are inside it when their
+* center is in the box shrunk by as much, and they contain it when
+* their center is near enough the center of the box.
+*/
+static double
+pc_grid_box_selectivity(const double *grid, const BOX *box, int mode)
+{
+	double hw = grid[PC_GRID_AVGW] / 2.0;
+	double hh = grid[PC_GRID_AVGH] / 2.0;
+	double cx, cy, dx, dy;
+
+	switch ( mode )
+	{
+	case PC_SEL_OVERLAPS:
+		return pc_grid_mass(grid, box->low.x - hw, box->low.y - hh, box->high.x + hw, box->high.y + hh);
+	case PC_SEL_CONTAINED:
+		return pc_grid_mass(grid, box->low.x + hw, box->low.y + hh, box->high.x - hw, box->high.y - hh);
+	case PC_SEL_CONTAINS:
+		cx = (box->low.x + box->high.x) / 2.0;
+		cy = (box->low.y + box->high.y) / 2.0;
+		dx = hw - (box->high.x - box->low.x) / 2.0;
+		dy = hh - (box->high.y - box->low.y) / 2.0;
+		return pc_grid_mass(grid, cx - dx, cy - dy, cx + dx, cy + dy);
+	}
+	return 0.0;
+}
+
+/**
+* Restriction selectivity of the box operators, the constant is a
+* box or the bounds of a patch.
+*/
+static double
+pcpatch_box_restrict(FunctionCallInfo fcinfo, int mode)
+{
+	PlannerInfo *root = (PlannerInfo*)PG_GETARG_POINTER(0);
+	List *args = (List*)PG_GETARG_POINTER(2);
+	int varRelid = PG_GETARG_INT32(3);
+	double selec = (mode == PC_SEL_OVERLAPS) ? PC_DEFAULT_OVERLAP_SEL : PC_DEFAULT_CONTAIN_SEL;
+	VariableStatData vardata;
+	Node *other;
+	bool varonleft;
+	double *grid, nullfrac;
+	int nvals;
+	BOX box;
+
+	if ( ! get_restriction_variable(root, args, varRelid, &vardata, &other, &varonleft) )
+		return selec;
+
+	if ( IsA(other, Const) && ! ((Const*)other)->constisnull &&
+	     pc_stats_get(&vardata, PC_STATISTIC_KIND_BOUNDS_2D, &grid, &nvals, &nullfrac) )
+	{
+		Const *c = (Const*)other;
+
+		if ( c->consttype == BOXOID )
+		{
+			box = *DatumGetBoxP(c->constvalue);
+		}
+		else
+		{
+			SERIALIZED_PATCH *serpatch = (SERIALIZED_PATCH*)PG_DETOAST_DATUM_SLICE(c->constvalue, 0, sizeof(SERIALIZED_PATCH));
+			box.low.x = serpatch->bounds.xmin;
+			box.low.y = serpatch->bounds.ymin;
+			box.high.x = serpatch->bounds.xmax;
+			box.high.y = serpatch->bounds.ymax;
+		}
+		selec = pc_grid_box_selectivity(grid, &box, mode) * (1.0 - nullfrac);
+		pfree(grid);
+	}
+
+	ReleaseVariableStats(vardata);
+	CLAMP_PROBABILITY(selec);
+	return selec;
+}
+
+PG_FUNCTION_INFO_V1(pcpatch_overlaps_sel);
+Datum pcpatch_overlaps_sel(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_FLOAT8(pcpatch_box_restrict(fcinfo, PC_SEL_OVERLAPS));
+}
+
+PG_FUNCTION_INFO_V1(pcpatch_contained_sel);
+Datum pcpatch_contained_sel(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_FLOAT8(pcpatch_box_restrict(fcinfo, PC_SEL_CONTAINED));
+}
+
+PG_FUNCTION_INFO_V1(pcpatch_contains_sel);
+Datum pcpatch_contains_sel(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_FLOAT8(pcpatch_box_restrict(fcinfo, PC_SEL_CONTAINS));
+}
+
+/* Fraction of the sampled values below x, from their quantiles */
+static double
+pc_quantile_fraction(const double *q, int nbins, double x)
+{
+	int k;
+
+	if ( x <= q[0] )
+		return 0.0;
+	if ( x >= q[nbins] )
+		return 1.0;
+	for ( k = 0; k < nbins; k++ )
+	{
+		if ( x < q[k+1] )
+			return (k + (q[k+1] > q[k] ? (x - q[k]) / (q[k+1] - q[k]) : 0.0)) / nbins;
+	}
+	return 1.0;
+}
+
+/**
+* Patches overlap a pcbox when, on every dimension, their minimum is
+* below its maximum and their maximum above its minimum. Dimensions
+* are taken as independent.
+*/
+PG_FUNCTION_INFO_V1(pcpatch_pcbox_sel);
+Datum pcpatch_pcbox_sel(PG_FUNCTION_ARGS)
+{
+	PlannerInfo *root = (PlannerInfo*)PG_GETARG_POINTER(0);
+	List *args = (List*)PG_GETARG_POINTER(2);
+	int varRelid = PG_GETARG_INT32(3);
+	double selec = PC_DEFAULT_OVERLAP_SEL;
+	VariableStatData vardata;
+	Node *other;
+	bool varonleft;
+	double *ranges, nullfrac;
+	int nvals;
+
+	if ( ! get_restriction_variable(root, args, varRelid, &vardata, &other, &varonleft) )
+		PG_RETURN_FLOAT8(selec);
+
+	if ( IsA(other, Const) && ! ((Const*)other)->constisnull &&
+	     pc_stats_get(&vardata, PC_STATISTIC_KIND_BOUNDS_ND, &ranges, &nvals, &nullfrac) )
+	{
+		SERIALIZED_BOX *query = (SERIALIZED_BOX*)PG_DETOAST_DATUM(((Const*)other)->constvalue);
+		double fraction = ranges[PC_RANGES_FRACTION];
+		uint32 ndims = (uint32)ranges[PC_RANGES_NDIMS];
+		int nbins = (int)ranges[PC_RANGES_NBINS];
+		uint32 i;
+
+		/* Patches of the other schemas are not known dimension by dimension */
+		if ( query->pcid != (uint32)ranges[PC_RANGES_PCID] )
+		{
+			selec = (1.0 - fraction) * PC_DEFAULT_OVERLAP_SEL;
+		}
+		else
+		{
+			selec = fraction;
+			for ( i = 0; i < query->ndims; i++ )
+			{
+				const PCBOXDIM *qd = &(query->dims[i]);
+				const double *qmins, *qmaxs;
+
+				if ( qd->position >= ndims )
+					continue;
+				qmins = ranges + PC_RANGES_QUANTILES + qd->position * 2 * (nbins + 1);
+				qmaxs = qmins + nbins + 1;
+				selec *= Max(0.0, pc_quantile_fraction(qmins, nbins, qd->max) - pc_quantile_fraction(qmaxs, nbins, qd->min));
+			}
+		}
+		selec *= 1.0 - nullfrac;
+		pfree(ranges);
+	}
+
+	ReleaseVariableStats(vardata);
+	CLAMP_PROBABILITY(selec);
+	PG_RETURN_FLOAT8(selec);
+}
+
+/**
+* Join selectivity of overlapping patches: for the patches of each
+* cell of one grid, the fraction of the other patches whose center
+* is close enough for their average sizes to overlap.
+*/
+PG_FUNCTION_INFO_V1(pcpatch_overlaps_joinsel);
+Datum pcpatch_overlaps_joinsel(PG_FUNCTION_ARGS)
+{
+	PlannerInfo *root = (PlannerInfo*)PG_GETARG_POINTER(0);
+	List *args = (List*)PG_GETARG_POINTER(2);
+	double selec = PC_DEFAULT_OVERLAP_SEL;
+	VariableStatData vardata1, vardata2;
+	double *grid1, *grid2, nullfrac1, nullfrac2;
+	int nvals1, nvals2;
+
+	if ( list_length(args) != 2 )
+		PG_RETURN_FLOAT8(selec);
+
+	examine_variable(root, (Node*)linitial(args), 0, &vardata1);
+	examine_variable(root, (Node*)lsecond(args), 0, &vardata2);
+
+	if ( pc_stats_get(&vardata1, PC_STATISTIC_KIND_BOUNDS_2D, &grid1, &nvals1, &nullfrac1) &&
+	     pc_stats_get(&vardata2, PC_STATISTIC_KIND_BOUNDS_2D, &grid2, &nvals2, &nullfrac2) )
+	{
+		int nx = (int)grid1[PC_GRID_NX];
+		int ny = (int)grid1[PC_GRID_NY];
+		double cw = (grid1[PC_GRID_XMAX] - grid1[PC_GRID_XMIN]) / nx;
+		double ch = (grid1[PC_GRID_YMAX] - grid1[PC_GRID_YMIN]) / ny;
+		double hw = (grid1[PC_GRID_AVGW] + grid2[PC_GRID_AVGW]) / 2.0;
+		double hh = (grid1[PC_GRID_AVGH] + grid2[PC_GRID_AVGH]) / 2.0;
+		int ix, iy;
+
+		selec = 0.0;
+		for ( iy = 0; iy < ny; iy++ )
+		{
+			for ( ix = 0; ix < nx; ix++ )
+			{
+				double cell = grid1[PC_GRID_CELLS + iy * nx + ix];
+				double cx = grid1[PC_GRID_XMIN] + (ix + 0.5) * cw;
+				double cy = grid1[PC_GRID_YMIN] + (iy + 0.5) * ch;
+				if ( cell > 0.0 )
+					selec += cell * pc_grid_mass(grid2, cx - hw, cy - hh, cx + hw, cy + hh);
+			}
+		}
+		selec *= (1.0 - nullfrac1) * (1.0 - nullfrac2);
+		pfree(grid1);
+		pfree(grid2);
+	}
+
+	ReleaseVariableStats(vardata1);
+	ReleaseVariableStats(vardata2);
+	CLAMP_PROBABILITY(selec);
+	PG_RETURN_FLOAT8(selec);
+}
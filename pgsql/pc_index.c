@@ -0,0 +1,880 @@
+/***********************************************************************
+* pc_index.c
+*
+*  Index support for patches in PgSQL: GiST, SP-GiST and BRIN
+*  operator classes on the patch bounds, compared against boxes,
+*  and a GiST operator class on the N-D bounds of the indexed
+*  dimensions, compared against pcboxes.
+*
+*  PgSQL Pointcloud is free and open source software provided
+*  by the Government of Canada
+*  Copyright (c) 2013 Natural Resources Canada
+*
+***********************************************************************/
+
+#include "pc_pgsql.h"      /* Common PgSQL support for our type */
+#include "access/gist.h"
+#include "access/skey.h"
+#include "utils/geo_decls.h"
+
+#include <float.h>
+
+#if PG_VERSION_NUM >= 90500
+#include "access/brin_internal.h"
+#include "access/brin_tuple.h"
+#include "utils/datum.h"
+#include "utils/typcache.h"
+#endif
+
+#if PG_VERSION_NUM >= 110000
+#include "access/spgist.h"
+#endif
+
+#if PG_VERSION_NUM >= 120000
+#include "nodes/makefuncs.h"
+#include "nodes/nodeFuncs.h"
+#include "nodes/supportnodes.h"
+#include "optimizer/optimizer.h"
+#include "utils/lsyscache.h"
+#endif
+
+#if PG_VERSION_NUM >= 140000
+#include "utils/sortsupport.h"
+#endif
+
+/* Operators against boxes */
+Datum pcpatch_box(PG_FUNCTION_ARGS);
+Datum pcpatch_overlaps_box(PG_FUNCTION_ARGS);
+Datum pcpatch_contained_by_box(PG_FUNCTION_ARGS);
+Datum pcpatch_contains_box(PG_FUNCTION_ARGS);
+Datum pcpatch_overlaps_pcpatch(PG_FUNCTION_ARGS);
+
+/* Planner support for PC_Intersects */
+#if PG_VERSION_NUM >= 120000
+Datum pcpatch_intersects_support(PG_FUNCTION_ARGS);
+#endif
+
+/* Estimates of the overlap operator, in pc_analyze.c */
+Datum pcpatch_overlaps_sel(PG_FUNCTION_ARGS);
+Datum pcpatch_overlaps_joinsel(PG_FUNCTION_ARGS);
+
+/* GiST support */
+Datum pcpatch_gist_compress(PG_FUNCTION_ARGS);
+Datum pcpatch_gist_decompress(PG_FUNCTION_ARGS);
+Datum pcpatch_gist_consistent(PG_FUNCTION_ARGS);
+#if PG_VERSION_NUM >= 140000
+Datum pcpatch_gist_sortsupport(PG_FUNCTION_ARGS);
+#endif
+
+/* SP-GiST support */
+#if PG_VERSION_NUM >= 110000
+Datum pcpatch_spgist_config(PG_FUNCTION_ARGS);
+#endif
+
+/* BRIN support */
+#if PG_VERSION_NUM >= 90500
+Datum pcpatch_brin_opcinfo(PG_FUNCTION_ARGS);
+Datum pcpatch_brin_add_value(PG_FUNCTION_ARGS);
+Datum pcpatch_brin_consistent(PG_FUNCTION_ARGS);
+Datum pcpatch_brin_union(PG_FUNCTION_ARGS);
+#endif
+
+/* N-D bounds against pcboxes, and their GiST support */
+Datum pcpatch_pcbox(PG_FUNCTION_ARGS);
+Datum pcpatch_overlaps_pcbox(PG_FUNCTION_ARGS);
+Datum pcbox_gist_compress(PG_FUNCTION_ARGS);
+Datum pcbox_gist_decompress(PG_FUNCTION_ARGS);
+Datum pcbox_gist_consistent(PG_FUNCTION_ARGS);
+Datum pcbox_gist_union(PG_FUNCTION_ARGS);
+Datum pcbox_gist_penalty(PG_FUNCTION_ARGS);
+Datum pcbox_gist_picksplit(PG_FUNCTION_ARGS);
+Datum pcbox_gist_same(PG_FUNCTION_ARGS);
+
+
+/**
+* Read the bounds of a patch into a box. Only the header of the
+* patch is detoasted, the points are never read.
+*/
+static BOX *
+pcpatch_bounds_box(Datum d, BOX *box)
+{
+	SERIALIZED_PATCH *serpatch = (SERIALIZED_PATCH*)PG_DETOAST_DATUM_SLICE(d, 0, sizeof(SERIALIZED_PATCH));
+
+	box->low.x = serpatch->bounds.xmin;
+	box->low.y = serpatch->bounds.ymin;
+	box->high.x = serpatch->bounds.xmax;
+	box->high.y = serpatch->bounds.ymax;
+
+	if ( (Pointer)serpatch != DatumGetPointer(d) )
+		pfree(serpatch);
+
+	return box;
+}
+
+PG_FUNCTION_INFO_V1(pcpatch_box);
+Datum pcpatch_box(PG_FUNCTION_ARGS)
+{
+	BOX *box = palloc(sizeof(BOX));
+	PG_RETURN_BOX_P(pcpatch_bounds_box(PG_GETARG_DATUM(0), box));
+}
+
+/*
+* The operators are the box operators applied to the patch bounds,
+* so they agree with the index, fuzzy comparisons and all.
+*/
+PG_FUNCTION_INFO_V1(pcpatch_overlaps_box);
+Datum pcpatch_overlaps_box(PG_FUNCTION_ARGS)
+{
+	BOX box;
+	pcpatch_bounds_box(PG_GETARG_DATUM(0), &box);
+	PG_RETURN_DATUM(DirectFunctionCall2(box_overlap, BoxPGetDatum(&box), PG_GETARG_DATUM(1)));
+}
+
+PG_FUNCTION_INFO_V1(pcpatch_contained_by_box);
+Datum pcpatch_contained_by_box(PG_FUNCTION_ARGS)
+{
+	BOX box;
+	pcpatch_bounds_box(PG_GETARG_DATUM(0), &box);
+	PG_RETURN_DATUM(DirectFunctionCall2(box_contained, BoxPGetDatum(&box), PG_GETARG_DATUM(1)));
+}
+
+PG_FUNCTION_INFO_V1(pcpatch_contains_box);
+Datum pcpatch_contains_box(PG_FUNCTION_ARGS)
+{
+	BOX box;
+	pcpatch_bounds_box(PG_GETARG_DATUM(0), &box);
+	PG_RETURN_DATUM(DirectFunctionCall2(box_contain, BoxPGetDatum(&box), PG_GETARG_DATUM(1)));
+}
+
+/* Bounds of the patches overlap, the join operator */
+PG_FUNCTION_INFO_V1(pcpatch_overlaps_pcpatch);
+Datum pcpatch_overlaps_pcpatch(PG_FUNCTION_ARGS)
+{
+	BOX box1, box2;
+	pcpatch_bounds_box(PG_GETARG_DATUM(0), &box1);
+	pcpatch_bounds_box(PG_GETARG_DATUM(1), &box2);
+	PG_RETURN_DATUM(DirectFunctionCall2(box_overlap, BoxPGetDatum(&box1), BoxPGetDatum(&box2)));
+}
+
+#if PG_VERSION_NUM >= 120000
+/**
+* PC_Intersects(pcpatch, pcpatch) holds only for patches whose bounds
+* overlap, so the planner is handed the overlap operator as a lossy
+* index condition, with its estimates. The call itself rechecks.
+*/
+PG_FUNCTION_INFO_V1(pcpatch_intersects_support);
+Datum pcpatch_intersects_support(PG_FUNCTION_ARGS)
+{
+	Node *rawreq = (Node*)PG_GETARG_POINTER(0);
+
+	if ( IsA(rawreq, SupportRequestSelectivity) )
+	{
+		SupportRequestSelectivity *req = (SupportRequestSelectivity*)rawreq;
+
+		if ( req->is_join )
+		{
+			req->selectivity = DatumGetFloat8(DirectFunctionCall5(pcpatch_overlaps_joinsel,
+			                                  PointerGetDatum(req->root), ObjectIdGetDatum(InvalidOid),
+			                                  PointerGetDatum(req->args), Int16GetDatum(req->jointype),
+			                                  PointerGetDatum(req->sjinfo)));
+		}
+		else
+		{
+			req->selectivity = DatumGetFloat8(DirectFunctionCall4(pcpatch_overlaps_sel,
+			                                  PointerGetDatum(req->root), ObjectIdGetDatum(InvalidOid),
+			                                  PointerGetDatum(req->args), Int32GetDatum(req->varRelid)));
+		}
+		PG_RETURN_POINTER(req);
+	}
+
+	if ( IsA(rawreq, SupportRequestIndexCondition) )
+	{
+		SupportRequestIndexCondition *req = (SupportRequestIndexCondition*)rawreq;
+		FuncExpr *clause = (FuncExpr*)req->node;
+		Node *indexarg, *otherarg;
+		Oid opno;
+
+		if ( ! is_funcclause(clause) || list_length(clause->args) != 2 || req->indexarg > 1 )
+			PG_RETURN_POINTER(NULL);
+
+		indexarg = (Node*)list_nth(clause->args, req->indexarg);
+		otherarg = (Node*)list_nth(clause->args, 1 - req->indexarg);
+
+		/* Only indexes that have the overlap operator on patches */
+		opno = get_opfamily_member(req->opfamily, exprType(indexarg), exprType(otherarg), RTOverlapStrategyNumber);
+		if ( ! OidIsValid(opno) )
+			PG_RETURN_POINTER(NULL);
+#if PG_VERSION_NUM >= 140000
+		if ( ! is_pseudo_constant_for_index(req->root, otherarg, req->index) )
+#else
+		if ( ! is_pseudo_constant_for_index(otherarg, req->index) )
+#endif
+			PG_RETURN_POINTER(NULL);
+
+		req->lossy = true;
+		PG_RETURN_POINTER(list_make1(make_opclause(opno, BOOLOID, false,
+		                                           (Expr*)indexarg, (Expr*)otherarg,
+		                                           InvalidOid, InvalidOid)));
+	}
+
+	PG_RETURN_POINTER(NULL);
+}
+#endif /* PG_VERSION_NUM >= 120000 */
+
+/**
+* GiST keys are the boxes of the patch bounds, everything past
+* the compression of leaf entries is the stock box opclass.
+*/
+PG_FUNCTION_INFO_V1(pcpatch_gist_compress);
+Datum pcpatch_gist_compress(PG_FUNCTION_ARGS)
+{
+	GISTENTRY *entry = (GISTENTRY*)PG_GETARG_POINTER(0);
+	GISTENTRY *retval;
+
+	if ( ! entry->leafkey )
+		PG_RETURN_POINTER(entry);
+
+	retval = palloc(sizeof(GISTENTRY));
+	if ( DatumGetPointer(entry->key) )
+	{
+		BOX *box = palloc(sizeof(BOX));
+		pcpatch_bounds_box(entry->key, box);
+		gistentryinit(*retval, BoxPGetDatum(box), entry->rel, entry->page, entry->offset, false);
+	}
+	else
+	{
+		gistentryinit(*retval, (Datum) 0, entry->rel, entry->page, entry->offset, false);
+	}
+	PG_RETURN_POINTER(retval);
+}
+
+PG_FUNCTION_INFO_V1(pcpatch_gist_decompress);
+Datum pcpatch_gist_decompress(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_POINTER(PG_GETARG_POINTER(0));
+}
+
+PG_FUNCTION_INFO_V1(pcpatch_gist_consistent);
+Datum pcpatch_gist_consistent(PG_FUNCTION_ARGS)
+{
+	Datum query = PG_GETARG_DATUM(1);
+	Oid subtype = PG_GETARG_OID(3);
+	BOX box;
+
+	/* Declared on pcpatch for the opclass, the query is a box or a patch */
+	if ( subtype != BOXOID )
+		query = BoxPGetDatum(pcpatch_bounds_box(query, &box));
+
+	PG_RETURN_DATUM(DirectFunctionCall5(gist_box_consistent,
+	                                    PG_GETARG_DATUM(0), query,
+	                                    PG_GETARG_DATUM(2), ObjectIdGetDatum(BOXOID),
+	                                    PG_GETARG_DATUM(4)));
+}
+
+#if PG_VERSION_NUM >= 140000
+
+/* Sort keys on the Hilbert curve through the box centres */
+static uint64
+pcpatch_gist_key(Datum d)
+{
+	BOX *box = DatumGetBoxP(d);
+	return pc_hilbert_key((box->low.x + box->high.x) / 2, (box->low.y + box->high.y) / 2);
+}
+
+static int
+pcpatch_gist_cmp(Datum a, Datum b, SortSupport ssup)
+{
+	uint64 ka = pcpatch_gist_key(a);
+	uint64 kb = pcpatch_gist_key(b);
+	if ( ka < kb )
+		return -1;
+	return ka > kb ? 1 : 0;
+}
+
+#if SIZEOF_DATUM >= 8
+/* The whole key fits in a Datum, so the abbreviation is exact */
+static Datum
+pcpatch_gist_abbrev_convert(Datum original, SortSupport ssup)
+{
+	return (Datum) pcpatch_gist_key(original);
+}
+
+static int
+pcpatch_gist_abbrev_cmp(Datum a, Datum b, SortSupport ssup)
+{
+	if ( a < b )
+		return -1;
+	return a > b ? 1 : 0;
+}
+
+static bool
+pcpatch_gist_abbrev_abort(int memtupcount, SortSupport ssup)
+{
+	return false;
+}
+#endif
+
+/**
+* Sorted GiST builds lay the leaves out along a Hilbert curve,
+* which is much faster than inserting patches one at a time.
+*/
+PG_FUNCTION_INFO_V1(pcpatch_gist_sortsupport);
+Datum pcpatch_gist_sortsupport(PG_FUNCTION_ARGS)
+{
+	SortSupport ssup = (SortSupport) PG_GETARG_POINTER(0);
+
+#if SIZEOF_DATUM >= 8
+	if ( ssup->abbreviate )
+	{
+		ssup->comparator = pcpatch_gist_abbrev_cmp;
+		ssup->abbrev_converter = pcpatch_gist_abbrev_convert;
+		ssup->abbrev_abort = pcpatch_gist_abbrev_abort;
+		ssup->abbrev_full_comparator = pcpatch_gist_cmp;
+		PG_RETURN_VOID();
+	}
+#endif
+	ssup->comparator = pcpatch_gist_cmp;
+	PG_RETURN_VOID();
+}
+
+#endif /* PG_VERSION_NUM >= 140000 */
+
+#if PG_VERSION_NUM >= 110000
+
+/**
+* SP-GiST uses the quad tree of boxes as it is, storing the
+* bounds of each patch (pcpatch_box is the compress method)
+* as the leaf value.
+*/
+PG_FUNCTION_INFO_V1(pcpatch_spgist_config);
+Datum pcpatch_spgist_config(PG_FUNCTION_ARGS)
+{
+	spgConfigOut *cfg = (spgConfigOut *) PG_GETARG_POINTER(1);
+
+	DirectFunctionCall2(spg_box_quad_config, PG_GETARG_DATUM(0), PG_GETARG_DATUM(1));
+	cfg->leafType = BOXOID;
+	/* Leaves hold boxes, not patches */
+	cfg->canReturnData = false;
+	PG_RETURN_VOID();
+}
+
+#endif /* PG_VERSION_NUM >= 110000 */
+
+#if PG_VERSION_NUM >= 90500
+
+/* Grow a box to cover another */
+static void
+pcpatch_box_merge(BOX *box, const BOX *other)
+{
+	box->low.x = Min(box->low.x, other->low.x);
+	box->low.y = Min(box->low.y, other->low.y);
+	box->high.x = Max(box->high.x, other->high.x);
+	box->high.y = Max(box->high.y, other->high.y);
+}
+
+/**
+* BRIN summaries are one box per block range, covering the bounds
+* of every patch in the range. Patches loaded in acquisition order
+* give tight boxes, and summarizing reads only patch headers.
+*/
+PG_FUNCTION_INFO_V1(pcpatch_brin_opcinfo);
+Datum pcpatch_brin_opcinfo(PG_FUNCTION_ARGS)
+{
+	BrinOpcInfo *result = palloc0(MAXALIGN(SizeofBrinOpcInfo(1)));
+
+	result->oi_nstored = 1;
+	result->oi_typcache[0] = lookup_type_cache(BOXOID, 0);
+	PG_RETURN_POINTER(result);
+}
+
+PG_FUNCTION_INFO_V1(pcpatch_brin_add_value);
+Datum pcpatch_brin_add_value(PG_FUNCTION_ARGS)
+{
+	BrinValues *column = (BrinValues *) PG_GETARG_POINTER(1);
+	Datum newval = PG_GETARG_DATUM(2);
+	bool isnull = PG_GETARG_BOOL(3);
+	BOX box, *rangebox;
+
+	/* Nulls only need noting once */
+	if ( isnull )
+	{
+		if ( column->bv_hasnulls )
+			PG_RETURN_BOOL(false);
+		column->bv_hasnulls = true;
+		PG_RETURN_BOOL(true);
+	}
+
+	pcpatch_bounds_box(newval, &box);
+
+	if ( column->bv_allnulls )
+	{
+		column->bv_values[0] = datumCopy(BoxPGetDatum(&box), false, sizeof(BOX));
+		column->bv_allnulls = false;
+		PG_RETURN_BOOL(true);
+	}
+
+	/* The range box is ours, grow it in place if need be */
+	rangebox = DatumGetBoxP(column->bv_values[0]);
+	if ( box.low.x >= rangebox->low.x && box.low.y >= rangebox->low.y &&
+	     box.high.x <= rangebox->high.x && box.high.y <= rangebox->high.y )
+	{
+		PG_RETURN_BOOL(false);
+	}
+
+	pcpatch_box_merge(rangebox, &box);
+	PG_RETURN_BOOL(true);
+}
+
+PG_FUNCTION_INFO_V1(pcpatch_brin_consistent);
+Datum pcpatch_brin_consistent(PG_FUNCTION_ARGS)
+{
+	BrinValues *column = (BrinValues *) PG_GETARG_POINTER(1);
+	ScanKey key = (ScanKey) PG_GETARG_POINTER(2);
+	Datum rangebox, query;
+
+	/* IS NULL and IS NOT NULL tests */
+	if ( key->sk_flags & SK_ISNULL )
+	{
+		if ( key->sk_flags & SK_SEARCHNULL )
+			PG_RETURN_BOOL(column->bv_allnulls || column->bv_hasnulls);
+		if ( key->sk_flags & SK_SEARCHNOTNULL )
+			PG_RETURN_BOOL(! column->bv_allnulls);
+		PG_RETURN_BOOL(false);
+	}
+
+	/* Nothing but nulls, no patch can match */
+	if ( column->bv_allnulls )
+		PG_RETURN_BOOL(false);
+
+	rangebox = column->bv_values[0];
+	query = key->sk_argument;
+
+	switch ( key->sk_strategy )
+	{
+	/* Some patch may overlap, or be inside, a box that overlaps the range */
+	case RTOverlapStrategyNumber:
+	case RTContainedByStrategyNumber:
+		PG_RETURN_DATUM(DirectFunctionCall2(box_overlap, rangebox, query));
+	/* Only a range that covers the box can hold a patch covering it */
+	case RTContainsStrategyNumber:
+		PG_RETURN_DATUM(DirectFunctionCall2(box_contain, rangebox, query));
+	default:
+		elog(ERROR, "%s: unknown strategy number %d", __func__, key->sk_strategy);
+	}
+	PG_RETURN_BOOL(false);
+}
+
+PG_FUNCTION_INFO_V1(pcpatch_brin_union);
+Datum pcpatch_brin_union(PG_FUNCTION_ARGS)
+{
+	BrinValues *col_a = (BrinValues *) PG_GETARG_POINTER(1);
+	BrinValues *col_b = (BrinValues *) PG_GETARG_POINTER(2);
+
+	if ( col_b->bv_hasnulls && ! col_a->bv_hasnulls )
+		col_a->bv_hasnulls = true;
+
+	if ( col_b->bv_allnulls )
+		PG_RETURN_VOID();
+
+	if ( col_a->bv_allnulls )
+	{
+		col_a->bv_allnulls = false;
+		col_a->bv_values[0] = datumCopy(col_b->bv_values[0], false, sizeof(BOX));
+		PG_RETURN_VOID();
+	}
+
+	pcpatch_box_merge(DatumGetBoxP(col_a->bv_values[0]), DatumGetBoxP(col_b->bv_values[0]));
+	PG_RETURN_VOID();
+}
+
+#endif /* PG_VERSION_NUM >= 90500 */
+
+
+/**
+* N-D bounds of a patch over the dimensions its schema flags as
+* indexed: X, Y, Z and those named in the indexdims metadata.
+*/
+static SERIALIZED_BOX *
+pcpatch_bounds_pcbox(Datum d, FunctionCallInfo fcinfo)
+{
+	PCSCHEMA *schema;
+	SERIALIZED_PATCH *serpatch = pc_patch_header_stats(d, &schema, fcinfo);
+	SERIALIZED_BOX *serbox = palloc0(SERBOX_SIZE(schema->ndims));
+	uint32 i, n = 0;
+
+	for ( i = 0; i < schema->ndims; i++ )
+	{
+		PCDIMENSION *dim = schema->dims[i];
+		if ( ! dim->indexed )
+			continue;
+		serbox->dims[n].position = dim->position;
+		pc_patch_stats_range(serpatch, schema, dim, &(serbox->dims[n].min), &(serbox->dims[n].max));
+		n++;
+	}
+	serbox->pcid = serpatch->pcid;
+	serbox->ndims = n;
+	SET_VARSIZE(serbox, SERBOX_SIZE(n));
+
+	if ( (Pointer)serpatch != DatumGetPointer(d) )
+		pfree(serpatch);
+
+	return serbox;
+}
+
+PG_FUNCTION_INFO_V1(pcpatch_pcbox);
+Datum pcpatch_pcbox(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_POINTER(pcpatch_bounds_pcbox(PG_GETARG_DATUM(0), fcinfo));
+}
+
+/**
+* Patches overlap a pcbox when the range of every dimension of the
+* pcbox overlaps that of the patch. Unlike the index, any dimension
+* can be asked for.
+*/
+PG_FUNCTION_INFO_V1(pcpatch_overlaps_pcbox);
+Datum pcpatch_overlaps_pcbox(PG_FUNCTION_ARGS)
+{
+	SERIALIZED_BOX *query = PG_GETARG_SERBOX_P(1);
+	PCSCHEMA *schema;
+	SERIALIZED_PATCH *serpatch = pc_patch_header_stats(PG_GETARG_DATUM(0), &schema, fcinfo);
+	bool result = (serpatch->pcid == query->pcid);
+	uint32 i;
+
+	for ( i = 0; result && i < query->ndims; i++ )
+	{
+		const PCBOXDIM *qd = &(query->dims[i]);
+		PCDIMENSION *dim = pc_schema_get_dimension(schema, qd->position);
+		double min, max;
+
+		if ( ! dim )
+			elog(ERROR, "%s: pcbox dimension %u is not in schema %u", __func__, qd->position, query->pcid);
+
+		pc_patch_stats_range(serpatch, schema, dim, &min, &max);
+		if ( max < qd->min || min > qd->max )
+			result = false;
+	}
+	PG_RETURN_BOOL(result);
+}
+
+/* Range of a dimension in a pcbox, NULL when it has none */
+static const PCBOXDIM *
+pcbox_find(const SERIALIZED_BOX *serbox, uint32 position)
+{
+	uint32 i;
+	for ( i = 0; i < serbox->ndims; i++ )
+	{
+		if ( serbox->dims[i].position == position )
+			return &(serbox->dims[i]);
+	}
+	return NULL;
+}
+
+static SERIALIZED_BOX *
+pcbox_copy(const SERIALIZED_BOX *serbox)
+{
+	SERIALIZED_BOX *copy = palloc(VARSIZE(serbox));
+	memcpy(copy, serbox, VARSIZE(serbox));
+	return copy;
+}
+
+/**
+* Grow a pcbox to cover another, in place. Only the dimensions
+* both have ranges for are kept, and boxes of different schemas
+* merge into the box of everything.
+*/
+static void
+pcbox_merge(SERIALIZED_BOX *serbox, const SERIALIZED_BOX *other)
+{
+	uint32 i, n = 0;
+
+	if ( serbox->pcid != other->pcid )
+	{
+		serbox->pcid = 0;
+		serbox->ndims = 0;
+		SET_VARSIZE(serbox, SERBOX_SIZE(0));
+		return;
+	}
+
+	for ( i = 0; i < serbox->ndims; i++ )
+	{
+		const PCBOXDIM *od = pcbox_find(other, serbox->dims[i].position);
+		if ( ! od )
+			continue;
+		serbox->dims[n].position = serbox->dims[i].position;
+		serbox->dims[n].min = Min(serbox->dims[i].min, od->min);
+		serbox->dims[n].max = Max(serbox->dims[i].max, od->max);
+		n++;
+	}
+	serbox->ndims = n;
+	SET_VARSIZE(serbox, SERBOX_SIZE(n));
+}
+
+/**
+* GiST keys are the N-D bounds of the patches, read from their
+* stats on the way into the index.
+*/
+PG_FUNCTION_INFO_V1(pcbox_gist_compress);
+Datum pcbox_gist_compress(PG_FUNCTION_ARGS)
+{
+	GISTENTRY *entry = (GISTENTRY*)PG_GETARG_POINTER(0);
+	GISTENTRY *retval;
+
+	if ( ! entry->leafkey )
+		PG_RETURN_POINTER(entry);
+
+	retval = palloc(sizeof(GISTENTRY));
+	if ( DatumGetPointer(entry->key) )
+	{
+		SERIALIZED_BOX *serbox = pcpatch_bounds_pcbox(entry->key, fcinfo);
+		gistentryinit(*retval, PointerGetDatum(serbox), entry->rel, entry->page, entry->offset, false);
+	}
+	else
+	{
+		gistentryinit(*retval, (Datum) 0, entry->rel, entry->page, entry->offset, false);
+	}
+	PG_RETURN_POINTER(retval);
+}
+
+/* Keys may come back from the index with a short header */
+PG_FUNCTION_INFO_V1(pcbox_gist_decompress);
+Datum pcbox_gist_decompress(PG_FUNCTION_ARGS)
+{
+	GISTENTRY *entry = (GISTENTRY*)PG_GETARG_POINTER(0);
+	GISTENTRY *retval;
+	SERIALIZED_BOX *serbox;
+
+	if ( ! DatumGetPointer(entry->key) )
+		PG_RETURN_POINTER(entry);
+
+	serbox = (SERIALIZED_BOX*)PG_DETOAST_DATUM(entry->key);
+	if ( (Pointer)serbox == DatumGetPointer(entry->key) )
+		PG_RETURN_POINTER(entry);
+
+	retval = palloc(sizeof(GISTENTRY));
+	gistentryinit(*retval, PointerGetDatum(serbox), entry->rel, entry->page, entry->offset, false);
+	PG_RETURN_POINTER(retval);
+}
+
+/**
+* Dimensions of the query the key has no range for cannot rule
+* the entry out, leaves matched that way are rechecked against
+* the stats of the patch.
+*/
+PG_FUNCTION_INFO_V1(pcbox_gist_consistent);
+Datum pcbox_gist_consistent(PG_FUNCTION_ARGS)
+{
+	GISTENTRY *entry = (GISTENTRY*)PG_GETARG_POINTER(0);
+	SERIALIZED_BOX *query = PG_GETARG_SERBOX_P(1);
+	StrategyNumber strategy = (StrategyNumber) PG_GETARG_UINT16(2);
+	bool *recheck = (bool*)PG_GETARG_POINTER(4);
+	SERIALIZED_BOX *key = (SERIALIZED_BOX*)DatumGetPointer(entry->key);
+	uint32 i;
+
+	if ( strategy != RTOverlapStrategyNumber )
+		elog(ERROR, "%s: unknown strategy number %d", __func__, strategy);
+
+	*recheck = false;
+
+	/* Union of several schemas, anything can be below */
+	if ( ! key->pcid )
+	{
+		*recheck = true;
+		PG_RETURN_BOOL(true);
+	}
+
+	if ( key->pcid != query->pcid )
+		PG_RETURN_BOOL(false);
+
+	for ( i = 0; i < query->ndims; i++ )
+	{
+		const PCBOXDIM *qd = &(query->dims[i]);
+		const PCBOXDIM *kd = pcbox_find(key, qd->position);
+
+		if ( ! kd )
+			*recheck = true;
+		else if ( kd->max < qd->min || kd->min > qd->max )
+			PG_RETURN_BOOL(false);
+	}
+	PG_RETURN_BOOL(true);
+}
+
+PG_FUNCTION_INFO_V1(pcbox_gist_union);
+Datum pcbox_gist_union(PG_FUNCTION_ARGS)
+{
+	GistEntryVector *entryvec = (GistEntryVector*)PG_GETARG_POINTER(0);
+	int *sizep = (int*)PG_GETARG_POINTER(1);
+	SERIALIZED_BOX *result = pcbox_copy((SERIALIZED_BOX*)DatumGetPointer(entryvec->vector[0].key));
+	int i;
+
+	for ( i = 1; i < entryvec->n; i++ )
+		pcbox_merge(result, (SERIALIZED_BOX*)DatumGetPointer(entryvec->vector[i].key));
+
+	*sizep = VARSIZE(result);
+	PG_RETURN_POINTER(result);
+}
+
+/**
+* Dimensions are in units that do not compare, so the penalty is
+* the growth of each range relative to its grown size, summed. A
+* range lost to the union costs as much as the largest growth.
+*/
+PG_FUNCTION_INFO_V1(pcbox_gist_penalty);
+Datum pcbox_gist_penalty(PG_FUNCTION_ARGS)
+{
+	GISTENTRY *origentry = (GISTENTRY*)PG_GETARG_POINTER(0);
+	GISTENTRY *newentry = (GISTENTRY*)PG_GETARG_POINTER(1);
+	float *penalty = (float*)PG_GETARG_POINTER(2);
+	SERIALIZED_BOX *orig = (SERIALIZED_BOX*)DatumGetPointer(origentry->key);
+	SERIALIZED_BOX *add = (SERIALIZED_BOX*)DatumGetPointer(newentry->key);
+	uint32 i;
+
+	*penalty = 0.0;
+	if ( ! orig->pcid )
+		PG_RETURN_POINTER(penalty);
+
+	if ( orig->pcid != add->pcid )
+	{
+		*penalty = orig->ndims + 1;
+		PG_RETURN_POINTER(penalty);
+	}
+
+	for ( i = 0; i < orig->ndims; i++ )
+	{
+		const PCBOXDIM *od = &(orig->dims[i]);
+		const PCBOXDIM *ad = pcbox_find(add, od->position);
+		double extent, grown;
+
+		if ( ! ad )
+		{
+			*penalty += 1.0;
+			continue;
+		}
+		extent = od->max - od->min;
+		grown = Max(od->max, ad->max) - Min(od->min, ad->min);
+		if ( grown > extent )
+			*penalty += (grown - extent) / grown;
+	}
+	PG_RETURN_POINTER(penalty);
+}
+
+/* Entries of a split, ordered by schema then along one dimension */
+typedef struct
+{
+	OffsetNumber offset;
+	uint32 pcid;
+	double center;
+} PCBOX_SPLIT_ITEM;
+
+static int
+pcbox_split_item_cmp(const void *a, const void *b)
+{
+	const PCBOX_SPLIT_ITEM *ia = (const PCBOX_SPLIT_ITEM*)a;
+	const PCBOX_SPLIT_ITEM *ib = (const PCBOX_SPLIT_ITEM*)b;
+
+	if ( ia->pcid != ib->pcid )
+		return ia->pcid < ib->pcid ? -1 : 1;
+	if ( ia->center != ib->center )
+		return ia->center < ib->center ? -1 : 1;
+	return 0;
+}
+
+/**
+* Split in halves along the dimension whose entries are the most
+* spread out relative to their own extent, the one where the
+* halves overlap least.
+*/
+PG_FUNCTION_INFO_V1(pcbox_gist_picksplit);
+Datum pcbox_gist_picksplit(PG_FUNCTION_ARGS)
+{
+	GistEntryVector *entryvec = (GistEntryVector*)PG_GETARG_POINTER(0);
+	GIST_SPLITVEC *v = (GIST_SPLITVEC*)PG_GETARG_POINTER(1);
+	OffsetNumber i, maxoff = entryvec->n - 1;
+	int nentries = maxoff - FirstOffsetNumber + 1;
+	SERIALIZED_BOX *first = (SERIALIZED_BOX*)DatumGetPointer(entryvec->vector[FirstOffsetNumber].key);
+	PCBOX_SPLIT_ITEM *items = palloc(nentries * sizeof(PCBOX_SPLIT_ITEM));
+	SERIALIZED_BOX *left = NULL, *right = NULL;
+	uint32 position = 0;
+	double best = -1.0;
+	uint32 d;
+	int j;
+
+	/* Pick the dimension to split along */
+	for ( d = 0; d < first->ndims; d++ )
+	{
+		double cmin = DBL_MAX, cmax = -DBL_MAX, extent = 0.0, spread;
+		int n = 0;
+
+		for ( i = FirstOffsetNumber; i <= maxoff; i = OffsetNumberNext(i) )
+		{
+			SERIALIZED_BOX *key = (SERIALIZED_BOX*)DatumGetPointer(entryvec->vector[i].key);
+			const PCBOXDIM *kd = (key->pcid == first->pcid) ? pcbox_find(key, first->dims[d].position) : NULL;
+			double center;
+
+			if ( ! kd )
+				continue;
+			center = (kd->min + kd->max) / 2.0;
+			cmin = Min(cmin, center);
+			cmax = Max(cmax, center);
+			extent += kd->max - kd->min;
+			n++;
+		}
+		if ( n < 2 || cmax <= cmin )
+			continue;
+		spread = (cmax - cmin) / ((cmax - cmin) + extent / n);
+		if ( spread > best )
+		{
+			best = spread;
+			position = first->dims[d].position;
+		}
+	}
+
+	for ( i = FirstOffsetNumber, j = 0; i <= maxoff; i = OffsetNumberNext(i), j++ )
+	{
+		SERIALIZED_BOX *key = (SERIALIZED_BOX*)DatumGetPointer(entryvec->vector[i].key);
+		const PCBOXDIM *kd = (best >= 0.0) ? pcbox_find(key, position) : NULL;
+
+		items[j].offset = i;
+		items[j].pcid = key->pcid;
+		items[j].center = kd ? (kd->min + kd->max) / 2.0 : 0.0;
+	}
+	qsort(items, nentries, sizeof(PCBOX_SPLIT_ITEM), pcbox_split_item_cmp);
+
+	v->spl_left = palloc(nentries * sizeof(OffsetNumber));
+	v->spl_right = palloc(nentries * sizeof(OffsetNumber));
+	v->spl_nleft = v->spl_nright = 0;
+
+	for ( j = 0; j < nentries; j++ )
+	{
+		SERIALIZED_BOX *key = (SERIALIZED_BOX*)DatumGetPointer(entryvec->vector[items[j].offset].key);
+
+		if ( j < nentries / 2 )
+		{
+			v->spl_left[v->spl_nleft++] = items[j].offset;
+			if ( left ) pcbox_merge(left, key);
+			else left = pcbox_copy(key);
+		}
+		else
+		{
+			v->spl_right[v->spl_nright++] = items[j].offset;
+			if ( right ) pcbox_merge(right, key);
+			else right = pcbox_copy(key);
+		}
+	}
+
+	v->spl_ldatum = PointerGetDatum(left);
+	v->spl_rdatum = PointerGetDatum(right);
+	pfree(items);
+	PG_RETURN_POINTER(v);
+}
+
+PG_FUNCTION_INFO_V1(pcbox_gist_same);
+Datum pcbox_gist_same(PG_FUNCTION_ARGS)
+{
+	SERIALIZED_BOX *a = (SERIALIZED_BOX*)PG_GETARG_POINTER(0);
+	SERIALIZED_BOX *b = (SERIALIZED_BOX*)PG_GETARG_POINTER(1);
+	bool *result = (bool*)PG_GETARG_POINTER(2);
+
+	*result = VARSIZE(a) == VARSIZE(b) && memcmp(a, b, VARSIZE(a)) == 0;
+	PG_RETURN_POINTER(result);
+}
@@ -16,6 +16,8 @@ Datum pcpoint_in(PG_FUNCTION_ARGS);
 Datum pcpoint_out(PG_FUNCTION_ARGS);
 Datum pcpatch_in(PG_FUNCTION_ARGS);
 Datum pcpatch_out(PG_FUNCTION_ARGS);
+Datum pcbox_in(PG_FUNCTION_ARGS);
+Datum pcbox_out(PG_FUNCTION_ARGS);
 
 /* Typmod support */
 Datum pc_typmod_in(PG_FUNCTION_ARGS);
@@ -32,6 +34,7 @@ Datum pcpoint_as_text(PG_FUNCTION_ARGS);
 Datum pcpatch_as_text(PG_FUNCTION_ARGS);
 Datum pcpoint_as_bytea(PG_FUNCTION_ARGS);
 Datum pcpatch_bytea_envelope(PG_FUNCTION_ARGS);
+Datum pcbox_from_range(PG_FUNCTION_ARGS);
 
 
 
@@ -164,6 +167,81 @@ Datum pcpatch_out(PG_FUNCTION_ARGS)
 	PG_RETURN_CSTRING(hexwkb);
 }
 
+/**
+* Boxes are built with PC_MakeBox or read from patches, they have
+* no text form to parse.
+*/
+PG_FUNCTION_INFO_V1(pcbox_in);
+Datum pcbox_in(PG_FUNCTION_ARGS)
+{
+	ereport(ERROR,(errmsg("pcbox parse error - use PC_MakeBox to build a pcbox")));
+	PG_RETURN_NULL();
+}
+
+PG_FUNCTION_INFO_V1(pcbox_out);
+Datum pcbox_out(PG_FUNCTION_ARGS)
+{
+	SERIALIZED_BOX *serbox = PG_GETARG_SERBOX_P(0);
+	PCSCHEMA *schema = NULL;
+	StringInfoData str;
+	int i;
+
+	if ( serbox->pcid )
+		schema = pc_schema_from_pcid(serbox->pcid, fcinfo);
+
+	initStringInfo(&str);
+	appendStringInfo(&str, "{\"pcid\":%u,\"bounds\":{", serbox->pcid);
+	for ( i = 0; i < serbox->ndims; i++ )
+	{
+		const PCBOXDIM *bd = &(serbox->dims[i]);
+		PCDIMENSION *dim = schema ? pc_schema_get_dimension(schema, bd->position) : NULL;
+
+		if ( i ) appendStringInfoChar(&str, ',');
+		if ( dim )
+			appendStringInfo(&str, "\"%s\":[%g,%g]", dim->name, bd->min, bd->max);
+		else
+			appendStringInfo(&str, "\"%u\":[%g,%g]", bd->position, bd->min, bd->max);
+	}
+	appendStringInfoString(&str, "}}");
+	PG_RETURN_CSTRING(str.data);
+}
+
+/**
+* PC_MakeBox(pcid integer, dimname text, min float8, max float8)
+* returns a pcbox ranging over one dimension
+*/
+PG_FUNCTION_INFO_V1(pcbox_from_range);
+Datum pcbox_from_range(PG_FUNCTION_ARGS)
+{
+	uint32 pcid = PG_GETARG_INT32(0);
+	char *dim_str = text_to_cstring(PG_GETARG_TEXT_P(1));
+	float8 min = PG_GETARG_FLOAT8(2);
+	float8 max = PG_GETARG_FLOAT8(3);
+	PCSCHEMA *schema = pc_schema_from_pcid(pcid, fcinfo);
+	PCDIMENSION *dim;
+	SERIALIZED_BOX *serbox;
+
+	if ( ! schema )
+		elog(ERROR, "unable to load schema for pcid = %d", pcid);
+
+	dim = pc_schema_get_dimension_by_name(schema, dim_str);
+	if ( ! dim )
+		elog(ERROR, "dimension \"%s\" does not exist in schema", dim_str);
+	pfree(dim_str);
+
+	if ( min > max )
+		elog(ERROR, "pcbox minimum %g is greater than its maximum %g", min, max);
+
+	serbox = palloc0(SERBOX_SIZE(1));
+	SET_VARSIZE(serbox, SERBOX_SIZE(1));
+	serbox->pcid = pcid;
+	serbox->ndims = 1;
+	serbox->dims[0].position = dim->position;
+	serbox->dims[0].min = min;
+	serbox->dims[0].max = max;
+	PG_RETURN_POINTER(serbox);
+}
+
 PG_FUNCTION_INFO_V1(pcschema_is_valid);
 Datum pcschema_is_valid(PG_FUNCTION_ARGS)
 {
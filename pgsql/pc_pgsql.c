@@ -15,6 +15,12 @@
 #include "executor/spi.h"
 #include "access/hash.h"
 #include "utils/hsearch.h"
+#include "access/xact.h"
+#include "catalog/namespace.h"
+#include "commands/trigger.h"
+#include "utils/inval.h"
+#include "utils/memutils.h"
+#include "utils/guc.h"
 
 
 PG_MODULE_MAGIC;
@@ -96,6 +102,10 @@ pgsql_info(const char *fmt, va_list ap)
 * functions of libpc to the PostgreSQL ones.
 * TODO: also hook the libxml2 hooks into PostgreSQL.
 */
+static void pc_schema_cache_init(void);
+
+int pc_agg_memory_limit = -1;
+
 void _PG_init(void);
 void
 _PG_init(void)
@@ -104,6 +114,15 @@ _PG_init(void)
 	pc_set_handlers(pgsql_alloc, pgsql_realloc,
 	                pgsql_free, pgsql_error,
 	                pgsql_info, pgsql_warn);
+	pc_schema_cache_init();
+
+	DefineCustomIntVariable("pointcloud.agg_memory_limit",
+	                        "Memory the points of one PC_Patch or PC_Union group may take.",
+	                        "Groups going over it fail as soon as they do, -1 leaves only the patch size limit.",
+	                        &pc_agg_memory_limit,
+	                        -1, -1, MAX_KILOBYTES,
+	                        PGC_USERSET, GUC_UNIT_KB,
+	                        NULL, NULL, NULL);
 
 }
 
@@ -129,7 +148,7 @@ uint32 pcid_from_typmod(const int32 typmod)
 */
 
 PCPOINT *
-pc_point_from_hexwkb(const char *hexwkb, size_t hexlen, FunctionCallInfoData *fcinfo)
+pc_point_from_hexwkb(const char *hexwkb, size_t hexlen, FunctionCallInfo fcinfo)
 {
 	PCPOINT *pt;
 	PCSCHEMA *schema;
@@ -162,7 +181,7 @@ pc_point_to_hexwkb(const PCPOINT *pt)
 */
 
 PCPATCH *
-pc_patch_from_hexwkb(const char *hexwkb, size_t hexlen, FunctionCallInfoData *fcinfo)
+pc_patch_from_hexwkb(const char *hexwkb, size_t hexlen, FunctionCallInfo fcinfo)
 {
 	PCPATCH *patch;
 	PCSCHEMA *schema;
@@ -216,8 +235,11 @@ pc_schema_from_pcid_uncached(uint32 pcid)
 {
 	char sql[256];
 	char *xml, *xml_spi, *srid_spi;
+	uint8_t *bin = NULL;
+	Datum bin_datum;
+	bool bin_null;
 	int err, srid;
-	size_t size;
+	size_t size, binsize = 0;
 	PCSCHEMA *schema;
 
 	if (SPI_OK_CONNECT != SPI_connect ())
@@ -227,8 +249,9 @@ pc_schema_from_pcid_uncached(uint32 pcid)
 		return NULL;
 	}
 
-	sprintf(sql, "select %s, %s from %s where pcid = %d",
-	        POINTCLOUD_FORMATS_XML, POINTCLOUD_FORMATS_SRID, POINTCLOUD_FORMATS, pcid);
+	sprintf(sql, "select %s, %s, %s from %s where pcid = %d",
+	        POINTCLOUD_FORMATS_XML, POINTCLOUD_FORMATS_SRID, POINTCLOUD_FORMATS_BIN,
+	        POINTCLOUD_FORMATS, pcid);
 	err = SPI_exec(sql, 1);
 
 	if ( err < 0 )
@@ -263,21 +286,38 @@ pc_schema_from_pcid_uncached(uint32 pcid)
 	xml = SPI_palloc(size);
 	memcpy(xml, xml_spi, size);
 
+	/* And the binary form, if the trigger has filled it in */
+	bin_datum = SPI_getbinval(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 3, &bin_null);
+	if ( ! bin_null )
+	{
+		bytea *bin_spi = DatumGetByteaPP(bin_datum);
+		binsize = VARSIZE_ANY_EXHDR(bin_spi);
+		bin = SPI_palloc(binsize);
+		memcpy(bin, VARDATA_ANY(bin_spi), binsize);
+	}
+
 	/* Parse the SRID string into the function stack */
 	srid = atoi(srid_spi);
 
 	/* Disconnect from SPI, losing all our SPI-allocated memory now... */
 	SPI_finish();
 
-	/* Build the schema object */
-	err = pc_schema_from_xml(xml, &schema);
+	/* Build the schema object, from the XML if the binary is stale */
+	schema = bin ? pc_schema_from_binary(bin, binsize) : NULL;
+	if ( bin )
+		pfree(bin);
 
-	if ( ! err )
+	if ( ! schema )
 	{
-		ereport(ERROR,
-		        (errcode(ERRCODE_NOT_AN_XML_DOCUMENT),
-		         errmsg("unable to parse XML for pcid = %d in \"%s\"", pcid, POINTCLOUD_FORMATS)));
+		err = pc_schema_from_xml(xml, &schema);
+		if ( ! err )
+		{
+			ereport(ERROR,
+			        (errcode(ERRCODE_NOT_AN_XML_DOCUMENT),
+			         errmsg("unable to parse XML for pcid = %d in \"%s\"", pcid, POINTCLOUD_FORMATS)));
+		}
 	}
+	pfree(xml);
 
 	schema->pcid = pcid;
 	schema->srid = srid;
@@ -286,111 +326,102 @@ pc_schema_from_pcid_uncached(uint32 pcid)
 }
 
 
-typedef struct
-{
-	int type;
-	char data[1];
-} GenericCache;
-
 /**
-* Hold the schema references in a list.
-* We'll just search them linearly, because
-* usually we'll have only one per statement
+* Schemas are cached for the life of the backend, keyed on
+* pcid, in a context of their own under TopMemoryContext.
+* Changes to POINTCLOUD_FORMATS fire a trigger that sends a
+* relcache invalidation to every backend, whose callback
+* retires the whole cache. Schemas already handed out stay
+* valid until the end of the transaction.
 */
-#define SchemaCacheSize 16
-
 typedef struct
 {
-	int type;
-	int next_slot;
-	int pcids[SchemaCacheSize];
-	PCSCHEMA* schemas[SchemaCacheSize];
-} SchemaCache;
+	uint32 pcid;
+	PCSCHEMA *schema;
+} SchemaCacheEntry;
 
+static HTAB *schema_cache = NULL;
+static MemoryContext schema_cache_context = NULL;
+static MemoryContext schema_cache_retired = NULL;
+static Oid schema_cache_relid = InvalidOid;
 
-/**
-* PostGIS uses this kind of structure for its
-* cache objects, and we expect to be used in
-* concert with PostGIS, so here we not only ape
-* the container, but avoid the first 10 slots,
-* so as to miss any existing cached PostGIS objects.
-*/
-typedef struct
+static void
+pc_schema_cache_invalidate(Datum arg, Oid relid)
 {
-	GenericCache *entry[16];
-} GenericCacheCollection;
+	if ( ! schema_cache )
+		return;
 
-#define PC_SCHEMA_CACHE 10
-#define PC_STATS_CACHE  11
+	/* Only changes to the formats table matter, when we know it */
+	if ( OidIsValid(relid) && OidIsValid(schema_cache_relid) && relid != schema_cache_relid )
+		return;
 
-/**
-* Get the generic collection off the statement, allocate a
-* new one if we don't have one already.
-*/
-static GenericCacheCollection *
-GetGenericCacheCollection(FunctionCallInfoData *fcinfo)
-{
-	GenericCacheCollection *cache = fcinfo->flinfo->fn_extra;
+	/* Callers may still hold schemas, free them at transaction end */
+	MemoryContextSetParent(schema_cache_context, schema_cache_retired);
+	schema_cache = NULL;
+	schema_cache_context = NULL;
+}
 
-	if ( ! cache )
-	{
-		cache = MemoryContextAlloc(fcinfo->flinfo->fn_mcxt, sizeof(GenericCacheCollection));
-		memset(cache, 0, sizeof(GenericCacheCollection));
-		fcinfo->flinfo->fn_extra = cache;
-	}
-	return cache;
+static void
+pc_schema_cache_xact_callback(XactEvent event, void *arg)
+{
+	if ( event == XACT_EVENT_COMMIT || event == XACT_EVENT_ABORT )
+		MemoryContextReset(schema_cache_retired);
 }
 
 /**
-* Get the Proj4 entry from the generic cache if one exists.
-* If it doesn't exist, make a new empty one and return it.
+* Hook the cache up to invalidations, called once on module load.
 */
-static SchemaCache *
-GetSchemaCache(FunctionCallInfoData* fcinfo)
+static void
+pc_schema_cache_init(void)
 {
-	GenericCacheCollection *generic_cache = GetGenericCacheCollection(fcinfo);
-	SchemaCache* cache = (SchemaCache*)(generic_cache->entry[PC_SCHEMA_CACHE]);
-
-	if ( ! cache )
-	{
-		/* Allocate in the upper context */
-		cache = MemoryContextAlloc(fcinfo->flinfo->fn_mcxt, sizeof(SchemaCache));
-		memset(cache, 0, sizeof(SchemaCache));
-		cache->type = PC_SCHEMA_CACHE;
-	}
-
-	generic_cache->entry[PC_SCHEMA_CACHE] = (GenericCache*)cache;
-	return cache;
+	schema_cache_retired = AllocSetContextCreate(TopMemoryContext,
+	                       "Pointcloud retired schema cache",
+	                       ALLOCSET_SMALL_MINSIZE,
+	                       ALLOCSET_SMALL_INITSIZE,
+	                       ALLOCSET_SMALL_MAXSIZE);
+	CacheRegisterRelcacheCallback(pc_schema_cache_invalidate, (Datum) 0);
+	RegisterXactCallback(pc_schema_cache_xact_callback, NULL);
 }
 
+static HTAB *
+pc_schema_cache_get(void)
+{
+	HASHCTL ctl;
+
+	if ( schema_cache )
+		return schema_cache;
+
+	schema_cache_context = AllocSetContextCreate(TopMemoryContext,
+	                       "Pointcloud schema cache",
+	                       ALLOCSET_DEFAULT_MINSIZE,
+	                       ALLOCSET_DEFAULT_INITSIZE,
+	                       ALLOCSET_DEFAULT_MAXSIZE);
+	memset(&ctl, 0, sizeof(ctl));
+	ctl.keysize = sizeof(uint32);
+	ctl.entrysize = sizeof(SchemaCacheEntry);
+	ctl.hash = tag_hash;
+	ctl.hcxt = schema_cache_context;
+	schema_cache = hash_create("Pointcloud schema cache", 16, &ctl,
+	                           HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT);
+	schema_cache_relid = RelnameGetRelid(POINTCLOUD_FORMATS);
+	return schema_cache;
+}
 
 PCSCHEMA *
-pc_schema_from_pcid(uint32 pcid, FunctionCallInfoData *fcinfo)
+pc_schema_from_pcid(uint32 pcid, FunctionCallInfo fcinfo)
 {
-	SchemaCache *schema_cache = GetSchemaCache(fcinfo);
-	int i;
+	HTAB *cache = pc_schema_cache_get();
+	MemoryContext cache_context = schema_cache_context;
+	SchemaCacheEntry *entry;
 	PCSCHEMA *schema;
 	MemoryContext oldcontext;
 
-	/* Unable to find/make a schema cache? Odd. */
-	if ( ! schema_cache )
-	{
-		ereport(ERROR,
-		        (errcode(ERRCODE_INTERNAL_ERROR),
-		         errmsg("unable to create/load statement level schema cache")));
-	}
-
-	/* Find our PCID if it's in there (usually it will be first) */
-	for ( i = 0; i < SchemaCacheSize; i++ )
-	{
-		if ( schema_cache->pcids[i] == pcid )
-		{
-			return schema_cache->schemas[i];
-		}
-	}
+	entry = (SchemaCacheEntry*)hash_search(cache, &pcid, HASH_FIND, NULL);
+	if ( entry )
+		return entry->schema;
 
 	/* Not in there, load one the old-fashioned way. */
-	oldcontext = MemoryContextSwitchTo(fcinfo->flinfo->fn_mcxt);
+	oldcontext = MemoryContextSwitchTo(cache_context);
 	schema = pc_schema_from_pcid_uncached(pcid);
 	MemoryContextSwitchTo(oldcontext);
 
@@ -402,13 +433,95 @@ pc_schema_from_pcid(uint32 pcid, FunctionCallInfoData *fcinfo)
 		         errmsg("unable to load schema for pcid %u", pcid)));
 	}
 
-	/* Save the XML in the next unused slot */
-	schema_cache->schemas[schema_cache->next_slot] = schema;
-	schema_cache->pcids[schema_cache->next_slot] = pcid;
-	schema_cache->next_slot = (schema_cache->next_slot + 1) % SchemaCacheSize;
+	/* The lookup can process invalidations, only keep it if the cache survived */
+	if ( schema_cache_context == cache_context )
+	{
+		entry = (SchemaCacheEntry*)hash_search(cache, &pcid, HASH_ENTER, NULL);
+		entry->schema = schema;
+	}
 	return schema;
 }
 
+/**
+* Trigger on POINTCLOUD_FORMATS, makes every backend drop
+* its cached schemas once the change commits.
+*/
+Datum pointcloud_formats_changed(PG_FUNCTION_ARGS);
+PG_FUNCTION_INFO_V1(pointcloud_formats_changed);
+Datum pointcloud_formats_changed(PG_FUNCTION_ARGS)
+{
+	TriggerData *trigdata = (TriggerData *) fcinfo->context;
+
+	if ( ! CALLED_AS_TRIGGER(fcinfo) )
+		elog(ERROR, "%s: not called by trigger manager", __func__);
+
+	CacheInvalidateRelcache(trigdata->tg_relation);
+	return PointerGetDatum(NULL);
+}
+
+/**
+* Trigger on POINTCLOUD_FORMATS, stores the binary form of
+* each schema next to its XML so backends can load it without
+* parsing. Fired on every insert and update, so the binary
+* column cannot drift from the XML, and "UPDATE ... SET schema
+* = schema" rebuilds it after an upgrade changes the format.
+*/
+Datum pointcloud_formats_compile(PG_FUNCTION_ARGS);
+PG_FUNCTION_INFO_V1(pointcloud_formats_compile);
+Datum pointcloud_formats_compile(PG_FUNCTION_ARGS)
+{
+	TriggerData *trigdata = (TriggerData *) fcinfo->context;
+	TupleDesc tupdesc;
+	HeapTuple tuple;
+	int xml_attnum, bin_attnum;
+	char *xmlstr;
+	PCSCHEMA *schema = NULL;
+	Datum bin_datum = (Datum) 0;
+	char bin_null = 'n';
+
+	if ( ! CALLED_AS_TRIGGER(fcinfo) )
+		elog(ERROR, "%s: not called by trigger manager", __func__);
+
+	if ( ! ( TRIGGER_FIRED_BEFORE(trigdata->tg_event) &&
+	         TRIGGER_FIRED_FOR_ROW(trigdata->tg_event) ) )
+		elog(ERROR, "%s: must be fired before insert or update, for each row", __func__);
+
+	if ( TRIGGER_FIRED_BY_UPDATE(trigdata->tg_event) )
+		tuple = trigdata->tg_newtuple;
+	else
+		tuple = trigdata->tg_trigtuple;
+
+	tupdesc = trigdata->tg_relation->rd_att;
+	xml_attnum = SPI_fnumber(tupdesc, POINTCLOUD_FORMATS_XML);
+	bin_attnum = SPI_fnumber(tupdesc, POINTCLOUD_FORMATS_BIN);
+	if ( xml_attnum <= 0 || bin_attnum <= 0 )
+		elog(ERROR, "%s: \"%s\" is missing the schema columns", __func__, POINTCLOUD_FORMATS);
+
+	/* Bad XML is left to the CHECK constraint, we just store nothing */
+	xmlstr = SPI_getvalue(tuple, tupdesc, xml_attnum);
+	if ( xmlstr && pc_schema_from_xml(xmlstr, &schema) && schema )
+	{
+		size_t size;
+		uint8_t *bin = pc_schema_to_binary(schema, &size);
+		if ( bin )
+		{
+			bytea *bin_bytea = palloc(size + VARHDRSZ);
+			SET_VARSIZE(bin_bytea, size + VARHDRSZ);
+			memcpy(VARDATA(bin_bytea), bin, size);
+			pcfree(bin);
+			bin_datum = PointerGetDatum(bin_bytea);
+			bin_null = ' ';
+		}
+		pc_schema_free(schema);
+	}
+
+	tuple = SPI_modifytuple(trigdata->tg_relation, tuple, 1, &bin_attnum, &bin_datum, &bin_null);
+	if ( ! tuple )
+		elog(ERROR, "%s: unable to set \"%s\" (%d)", __func__, POINTCLOUD_FORMATS_BIN, SPI_result);
+
+	return PointerGetDatum(tuple);
+}
+
 
 
 /**********************************************************************************
@@ -465,7 +578,7 @@ pc_patch_serialized_size(const PCPATCH *patch)
 	}
 	case PC_DIMENSIONAL:
 	{
-		return common_size + stats_size + pc_patch_dimensional_serialized_size((PCPATCH_DIMENSIONAL*)patch);
+		return common_size + stats_size + SERPATCH_DIRECTORY_SIZE(patch->schema) + pc_patch_dimensional_serialized_size((PCPATCH_DIMENSIONAL*)patch);
 	}
 	default:
 	{
@@ -505,6 +618,65 @@ pc_patch_stats_deserialize(const PCSCHEMA *schema, const uint8_t *buf)
 	return pc_stats_new_from_data(schema, buf_min, buf_max, buf_avg);
 }
 
+/**
+* Detoast the header and stats of a patch, which hold the range of
+* every dimension, and look up its schema. The points are never read.
+*/
+SERIALIZED_PATCH *
+pc_patch_header_stats(Datum d, PCSCHEMA **schema, FunctionCallInfo fcinfo)
+{
+	static size_t stats_size_guess = 400;
+	SERIALIZED_PATCH *serpatch = (SERIALIZED_PATCH*)PG_DETOAST_DATUM_SLICE(d, 0, sizeof(SERIALIZED_PATCH) + stats_size_guess);
+
+	*schema = pc_schema_from_pcid(serpatch->pcid, fcinfo);
+	if ( stats_size_guess < pc_stats_size(*schema) )
+	{
+		if ( (Pointer)serpatch != DatumGetPointer(d) )
+			pfree(serpatch);
+		serpatch = (SERIALIZED_PATCH*)PG_DETOAST_DATUM_SLICE(d, 0, sizeof(SERIALIZED_PATCH) + pc_stats_size(*schema));
+	}
+	return serpatch;
+}
+
+/**
+* Range of a dimension, from the min and max points of the stats
+*/
+void
+pc_patch_stats_range(const SERIALIZED_PATCH *serpatch, const PCSCHEMA *schema, const PCDIMENSION *dim, double *min, double *max)
+{
+	PCPOINT pt;
+
+	pt.readonly = PC_TRUE;
+	pt.schema = schema;
+	pt.data = (uint8_t*)serpatch->data;
+	pc_point_get_double(&pt, dim, min);
+	pt.data += schema->size;
+	pc_point_get_double(&pt, dim, max);
+}
+
+/**
+* Fill in the dimension directory at dir from the serialized
+* dimensions that follow it, the first of them starting at
+* offset in the data area.
+*/
+static void
+pc_patch_directory_serialize(uint8_t *dir, const PCSCHEMA *schema, uint32_t offset)
+{
+	int i;
+	int32_t bsize;
+	const uint8_t *buf = dir + SERPATCH_DIRECTORY_SIZE(schema);
+
+	for ( i = 0; i < schema->ndims; i++ )
+	{
+		memcpy(dir + 4*i, &offset, 4);
+		/* Skip compression type and size of the serialized bytes */
+		memcpy(&bsize, buf + 1, 4);
+		offset += 5 + bsize;
+		buf += 5 + bsize;
+	}
+	memcpy(dir + 4*i, &offset, 4);
+}
+
 static SERIALIZED_PATCH *
 pc_patch_dimensional_serialize(const PCPATCH *patch_in)
 {
@@ -515,10 +687,11 @@ pc_patch_dimensional_serialize(const PCPATCH *patch_in)
 	//  double xmin, xmax, ymin, ymax;
 	//  data:
 	//    pcpoint[3] stats;
+	//    uint32_t directory[ndims+1];
 	//    serialized_pcbytes[ndims] dimensions;
 
 	int i;
-	uint8_t *buf;
+	uint8_t *buf, *dir;
 	size_t serpch_size = pc_patch_serialized_size(patch_in);
 	SERIALIZED_PATCH *serpch = pcalloc(serpch_size);
 	const PCPATCH_DIMENSIONAL *patch = (PCPATCH_DIMENSIONAL*)patch_in;
@@ -528,7 +701,7 @@ pc_patch_dimensional_serialize(const PCPATCH *patch_in)
 	serpch->pcid = patch->schema->pcid;
 	serpch->npoints = patch->npoints;
 	serpch->bounds = patch->bounds;
-	serpch->compression = patch->type;
+	serpch->compression = patch->type | PC_SERPATCH_DIRECTORY;
 	//pcinfo("	dim serialisation : just copied basic : pcid : %d, npoints : %d, compression :%d,  bounds\n", serpch->pcid,serpch->npoints,serpch->compression );
 
 	/* Get a pointer to the data area */
@@ -544,6 +717,10 @@ pc_patch_dimensional_serialize(const PCPATCH *patch_in)
 		pcerror("%s: stats missing!", __func__);
 	}
 
+	/* Leave room for the directory */
+	dir = buf;
+	buf += SERPATCH_DIRECTORY_SIZE(patch->schema);
+
 	/* Write each dimension in after the stats */
 	for ( i = 0; i < patch->schema->ndims; i++ )
 	{
@@ -552,11 +729,55 @@ pc_patch_dimensional_serialize(const PCPATCH *patch_in)
 		pc_bytes_serialize(pcb, buf, &bsize);
 		buf += bsize;
 	}
+	pc_patch_directory_serialize(dir, patch->schema, dir - serpch->data);
 	SET_VARSIZE(serpch, serpch_size);
 	return serpch;
 }
 
 
+/**
+* Dimensionally compress an uncompressed patch straight into the
+* serialization. The buffer is sized for the worst case of each
+* codec and cut back to its used part once written, so no
+* compressed copy of the dimensions is ever made.
+*/
+static SERIALIZED_PATCH *
+pc_patch_dimensional_serialize_encoded(const PCPATCH_UNCOMPRESSED *patch, PCDIMSTATS *pds)
+{
+	uint8_t *buf, *dir;
+	size_t stats_size = pc_stats_size(patch->schema);
+	size_t common_size = sizeof(SERIALIZED_PATCH) - 1;
+	size_t dir_size = SERPATCH_DIRECTORY_SIZE(patch->schema);
+	size_t serpch_size;
+	SERIALIZED_PATCH *serpch;
+	PCPATCH_DIMENSIONAL *pdl = pc_patch_dimensional_from_uncompressed(patch);
+	uint32_t *compressions = pcalloc(patch->schema->ndims * sizeof(uint32_t));
+
+	pc_patch_dimensional_compressions(pdl, pds, compressions);
+	serpch = pcalloc(common_size + stats_size + dir_size + pc_patch_dimensional_serialized_size_bound(pdl, compressions));
+
+	/* Copy basics */
+	serpch->pcid = patch->schema->pcid;
+	serpch->npoints = patch->npoints;
+	serpch->bounds = patch->bounds;
+	serpch->compression = PC_DIMENSIONAL | PC_SERPATCH_DIRECTORY;
+
+	/* Write stats, then the directory of the dimensions after them */
+	buf = serpch->data;
+	buf += pc_patch_stats_serialize(buf, patch->schema, patch->stats);
+	dir = buf;
+	buf += dir_size;
+	buf += pc_patch_dimensional_serialize_encoded(pdl, compressions, buf);
+	pc_patch_directory_serialize(dir, patch->schema, dir - serpch->data);
+
+	serpch_size = buf - (uint8_t*)serpch;
+	serpch = pcrealloc(serpch, serpch_size);
+	SET_VARSIZE(serpch, serpch_size);
+	pcfree(compressions);
+	pc_patch_free((PCPATCH*)pdl);
+	return serpch;
+}
+
 static SERIALIZED_PATCH *
 pc_patch_ght_serialize(const PCPATCH *patch_in)
 {
@@ -667,6 +888,14 @@ pc_patch_serialize(const PCPATCH *patch_in, void *userdata)
 		return NULL;
 	}
 	/*
+	* Uncompressed points headed for a dimensional schema are
+	* encoded directly into the serialization.
+	*/
+	if ( patch->type == PC_NONE && patch->schema->compression == PC_DIMENSIONAL && patch->npoints > 0 )
+	{
+		return pc_patch_dimensional_serialize_encoded((PCPATCH_UNCOMPRESSED*)patch, (PCDIMSTATS*)userdata);
+	}
+	/*
 	* Convert the patch to the final target compression,
 	* which is the one in the schema.
 	*/
@@ -789,6 +1018,7 @@ pc_patch_dimensional_deserialize(const SERIALIZED_PATCH *serpatch, const PCSCHEM
 	//  double xmin, xmax, ymin, ymax;
 	//  data:
 	//    pcpoint[3] pcstats(min, max, avg)
+	//    uint32_t directory[ndims+1], with PC_SERPATCH_DIRECTORY
 	//    pcbytes[ndims];
 	// }
 	// SERIALIZED_PATCH;
@@ -804,7 +1034,7 @@ pc_patch_dimensional_deserialize(const SERIALIZED_PATCH *serpatch, const PCSCHEM
 	patch = pcalloc(sizeof(PCPATCH_DIMENSIONAL));
 
 	/* Set up basic info */
-	patch->type = serpatch->compression;
+	patch->type = SERPATCH_COMPRESSION(serpatch);
 	patch->schema = schema;
 	patch->readonly = true;
 	patch->npoints = npoints;
@@ -813,9 +1043,11 @@ pc_patch_dimensional_deserialize(const SERIALIZED_PATCH *serpatch, const PCSCHEM
 	/* Point into the stats area */
 	patch->stats = pc_patch_stats_deserialize(schema, serpatch->data);
 
-	/* Set up dimensions */
+	/* Set up dimensions, they follow each other behind any directory */
 	patch->bytes = pcalloc(ndims * sizeof(PCBYTES));
 	buf = serpatch->data + stats_size;
+	if ( serpatch->compression & PC_SERPATCH_DIRECTORY )
+		buf += SERPATCH_DIRECTORY_SIZE(schema);
 
 	for ( i = 0; i < ndims; i++ )
 	{
@@ -882,7 +1114,7 @@ pc_patch_ght_deserialize(const SERIALIZED_PATCH *serpatch, const PCSCHEMA *schem
 PCPATCH *
 pc_patch_deserialize(const SERIALIZED_PATCH *serpatch, const PCSCHEMA *schema)
 {
-	switch(serpatch->compression)
+	switch(SERPATCH_COMPRESSION(serpatch))
 	{
 	case PC_NONE:
 		return pc_patch_uncompressed_deserialize(serpatch, schema);
@@ -895,6 +1127,77 @@ pc_patch_deserialize(const SERIALIZED_PATCH *serpatch, const PCSCHEMA *schema)
 	return NULL;
 }
 
+/**
+* Read only some dimensions of a patch. When the patch has a
+* dimension directory and is toasted, only the header, stats,
+* directory and the slices holding the wanted dimensions are
+* detoasted; the other dimensions are left empty and must not
+* be read. Anything else is detoasted and deserialized whole.
+*/
+PCPATCH *
+pc_patch_deserialize_dimensions(Datum d, const PCSCHEMA *schema, const uint32_t *dims, uint32_t ndims)
+{
+	int i;
+	uint32_t start, end;
+	size_t data_offset = offsetof(SERIALIZED_PATCH, data) - VARHDRSZ;
+	size_t stats_size = pc_stats_size(schema);
+	size_t header_size = data_offset + stats_size + SERPATCH_DIRECTORY_SIZE(schema);
+	const uint8_t *dir;
+	SERIALIZED_PATCH *serpatch;
+	PCPATCH_DIMENSIONAL *patch;
+
+	/* Slicing only saves work on toasted values */
+	if ( ! VARATT_IS_EXTENDED(DatumGetPointer(d)) )
+		return pc_patch_deserialize((SERIALIZED_PATCH*)DatumGetPointer(d), schema);
+
+	serpatch = (SERIALIZED_PATCH*)PG_DETOAST_DATUM_SLICE(d, 0, header_size);
+	if ( VARSIZE(serpatch) < VARHDRSZ + header_size || ! (serpatch->compression & PC_SERPATCH_DIRECTORY) )
+		return pc_patch_deserialize((SERIALIZED_PATCH*)PG_DETOAST_DATUM(d), schema);
+
+	patch = pcalloc(sizeof(PCPATCH_DIMENSIONAL));
+	patch->type = SERPATCH_COMPRESSION(serpatch);
+	patch->schema = schema;
+	patch->readonly = true;
+	patch->npoints = serpatch->npoints;
+	patch->bounds = serpatch->bounds;
+	patch->stats = pc_patch_stats_deserialize(schema, serpatch->data);
+
+	/* Dimensions not asked for stay empty */
+	patch->bytes = pcalloc(schema->ndims * sizeof(PCBYTES));
+	for ( i = 0; i < schema->ndims; i++ )
+	{
+		patch->bytes[i].interpretation = schema->dims[i]->interpretation;
+		patch->bytes[i].readonly = PC_TRUE;
+	}
+
+	dir = serpatch->data + stats_size;
+	for ( i = 0; i < ndims; i++ )
+	{
+		struct varlena *slice;
+		uint32_t dimnum = dims[i];
+		PCBYTES *pcb;
+
+		if ( dimnum >= schema->ndims )
+			pcerror("%s: dimension %d out of range", __func__, dimnum);
+		pcb = &(patch->bytes[dimnum]);
+		if ( pcb->bytes )
+			continue;
+
+		memcpy(&start, dir + 4*dimnum, 4);
+		memcpy(&end, dir + 4*(dimnum+1), 4);
+		if ( end < start + 5 )
+			pcerror("%s: corrupt dimension directory", __func__);
+
+		slice = PG_DETOAST_DATUM_SLICE(d, data_offset + start, end - start);
+		if ( VARSIZE(slice) - VARHDRSZ != end - start )
+			pcerror("%s: truncated dimension %d", __func__, dimnum);
+		pc_bytes_deserialize((uint8_t*)VARDATA(slice), schema->dims[dimnum], pcb, true /*readonly*/, false /*flipendian*/);
+		pcb->npoints = patch->npoints;
+	}
+
+	return (PCPATCH*)patch;
+}
+
 
 static uint8_t *
 pc_patch_wkb_set_double(uint8_t *wkb, double d)
@@ -24,6 +24,7 @@
 #define POINTCLOUD_FORMATS "pointcloud_formats"
 #define POINTCLOUD_FORMATS_XML "schema"
 #define POINTCLOUD_FORMATS_SRID "srid"
+#define POINTCLOUD_FORMATS_BIN "schema_bin"
 
 #define PG_GETARG_SERPOINT_P(argnum) (SERIALIZED_POINT*)PG_DETOAST_DATUM(PG_GETARG_DATUM(argnum))
 #define PG_GETARG_SERPATCH_P(argnum) (SERIALIZED_PATCH*)PG_DETOAST_DATUM(PG_GETARG_DATUM(argnum))
@@ -34,6 +35,9 @@
 
 #define PG_GETHEADER_STATS_P(argnum, statsize) (uint8_t*)(((SERIALIZED_PATCH*)PG_DETOAST_DATUM_SLICE(PG_GETARG_DATUM(argnum), 0, sizeof(SERIALIZED_PATCH) + statsize))->data)
 
+/* Memory the points of one PC_Patch or PC_Union group may take, in kB, -1 for no limit */
+extern int pc_agg_memory_limit;
+
 #define AUTOCOMPRESS_NO 0
 #define AUTOCOMPRESS_YES 1
 
@@ -74,12 +78,59 @@ typedef struct
 }
 SERIALIZED_PATCH;
 
+/**
+* Dimensional patches flag this bit in their compression word
+* when a directory of uint32 dimension offsets, ndims+1 of them
+* and relative to the data area, follows the stats. Any one
+* dimension can then be read with a slice of the datum. Patches
+* without it walk the dimension headers in order.
+*/
+#define PC_SERPATCH_DIRECTORY 0x10000
+
+/** Compression of a serialized patch, without the format flags */
+#define SERPATCH_COMPRESSION(serpatch) ((serpatch)->compression & 0xFFFF)
+
+/** Size of the dimension directory of a schema */
+#define SERPATCH_DIRECTORY_SIZE(schema) (4 * ((schema)->ndims + 1))
+
+/** Range of one dimension in a pcbox */
+typedef struct
+{
+	uint32_t position;
+	uint32_t pad;
+	double min;
+	double max;
+}
+PCBOXDIM;
+
+/**
+* PgSQL pcbox type, the N-D bounds of patches on some of the
+* dimensions of their schema, as index keys and as queries.
+* Boxes of different schemas cannot be compared, so a union
+* across schemas has a pcid of zero and no ranges, and stands
+* for everything.
+*/
+typedef struct
+{
+	uint32_t size;
+	uint32_t pcid;
+	uint32_t ndims;
+	uint32_t pad;
+	PCBOXDIM dims[1];
+}
+SERIALIZED_BOX;
+
+/** Size of a pcbox with that many ranges */
+#define SERBOX_SIZE(ndims) (offsetof(SERIALIZED_BOX, dims) + (ndims) * sizeof(PCBOXDIM))
+
+#define PG_GETARG_SERBOX_P(argnum) (SERIALIZED_BOX*)PG_DETOAST_DATUM(PG_GETARG_DATUM(argnum))
+
 
 /* PGSQL / POINTCLOUD UTILITY FUNCTIONS */
 uint32 pcid_from_typmod(const int32 typmod);
 
-/** Look-up the PCID in the POINTCLOUD_FORMATS table, and construct a PC_SCHEMA from the XML therein */
-PCSCHEMA* pc_schema_from_pcid(uint32_t pcid, FunctionCallInfoData *fcinfo);
+/** Look-up the PCID in the backend schema cache, loading it from the POINTCLOUD_FORMATS table on a miss */
+PCSCHEMA* pc_schema_from_pcid(uint32_t pcid, FunctionCallInfo fcinfo);
 
 /** Look-up the PCID in the POINTCLOUD_FORMATS table, and construct a PC_SCHEMA from the XML therein */
 PCSCHEMA* pc_schema_from_pcid_uncached(uint32 pcid);
@@ -91,7 +142,7 @@ SERIALIZED_POINT* pc_point_serialize(const PCPOINT *pcpt);
 PCPOINT* pc_point_deserialize(const SERIALIZED_POINT *serpt, const PCSCHEMA *schema);
 
 /** Create a new readwrite PCPOINT from a hex string */
-PCPOINT* pc_point_from_hexwkb(const char *hexwkb, size_t hexlen, FunctionCallInfoData *fcinfo);
+PCPOINT* pc_point_from_hexwkb(const char *hexwkb, size_t hexlen, FunctionCallInfo fcinfo);
 
 /** Create a hex representation of a PCPOINT */
 char* pc_point_to_hexwkb(const PCPOINT *pt);
@@ -108,8 +159,11 @@ SERIALIZED_PATCH* pc_patch_serialize_to_uncompressed(const PCPATCH *patch);
 /** Turn a byte buffer into a PCPATCH for processing */
 PCPATCH* pc_patch_deserialize(const SERIALIZED_PATCH *serpatch, const PCSCHEMA *schema);
 
+/** Deserialize only the listed dimensions of a patch datum, detoasting just their slices when it has a directory */
+PCPATCH* pc_patch_deserialize_dimensions(Datum d, const PCSCHEMA *schema, const uint32_t *dims, uint32_t ndims);
+
 /** Create a new readwrite PCPATCH from a hex string */
-PCPATCH* pc_patch_from_hexwkb(const char *hexwkb, size_t hexlen, FunctionCallInfoData *fcinfo);
+PCPATCH* pc_patch_from_hexwkb(const char *hexwkb, size_t hexlen, FunctionCallInfo fcinfo);
 
 /** Create a hex representation of a PCPOINT */
 char* pc_patch_to_hexwkb(const PCPATCH *patch);
@@ -122,6 +176,12 @@ uint32 pcid_from_datum(Datum d);
 
 PCSTATS* pc_patch_stats_deserialize(const PCSCHEMA *schema, const uint8_t *buf);
 
+/** Header and stats of a patch datum, and its schema */
+SERIALIZED_PATCH* pc_patch_header_stats(Datum d, PCSCHEMA **schema, FunctionCallInfo fcinfo);
+
+/** Range of a dimension from the stats of a patch */
+void pc_patch_stats_range(const SERIALIZED_PATCH *serpatch, const PCSCHEMA *schema, const PCDIMENSION *dim, double *min, double *max);
+
 /** return a serpatch struct as a string for convenient debug */
 char* pc_serpatch_to_string(const SERIALIZED_PATCH *serpatch, const PCSCHEMA *schema);
 
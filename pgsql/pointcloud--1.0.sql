@@ -20,12 +20,32 @@ CREATE TABLE pointcloud_formats (
         CHECK (pcid > 0 AND pcid < 65536),
     srid INTEGER, -- REFERENCES spatial_ref_sys(srid)
     schema TEXT 
-		CHECK ( PC_SchemaIsValid(schema) )
+		CHECK ( PC_SchemaIsValid(schema) ),
+    -- Binary form of the schema, maintained by a trigger
+    schema_bin BYTEA
 );
 
 -- Register pointcloud_formats table so the contents are included in pg_dump output
 SELECT pg_catalog.pg_extension_config_dump('pointcloud_formats', '');
 
+-- Schemas are cached by every backend, flush them when the formats change
+CREATE OR REPLACE FUNCTION pointcloud_formats_changed()
+	RETURNS trigger AS 'MODULE_PATHNAME','pointcloud_formats_changed'
+    LANGUAGE 'c';
+
+CREATE TRIGGER pointcloud_formats_changed
+	AFTER INSERT OR UPDATE OR DELETE OR TRUNCATE ON pointcloud_formats
+	FOR EACH STATEMENT EXECUTE PROCEDURE pointcloud_formats_changed();
+
+-- Keep the binary form of each schema in step with its XML
+CREATE OR REPLACE FUNCTION pointcloud_formats_compile()
+	RETURNS trigger AS 'MODULE_PATHNAME','pointcloud_formats_compile'
+    LANGUAGE 'c';
+
+CREATE TRIGGER pointcloud_formats_compile
+	BEFORE INSERT OR UPDATE ON pointcloud_formats
+	FOR EACH ROW EXECUTE PROCEDURE pointcloud_formats_compile();
+
 CREATE OR REPLACE FUNCTION PC_SchemaGetNDims(pcid integer)
 	RETURNS integer 
 	AS 'MODULE_PATHNAME','pcschema_get_ndims'
@@ -105,6 +125,11 @@ CREATE OR REPLACE FUNCTION pcpatch_out(pcpatch)
 	RETURNS cstring AS 'MODULE_PATHNAME', 'pcpatch_out'
 	LANGUAGE 'c' IMMUTABLE STRICT;
 	
+-- Planner statistics from the patch headers and stats
+CREATE OR REPLACE FUNCTION pcpatch_analyze(internal)
+	RETURNS bool AS 'MODULE_PATHNAME', 'pcpatch_analyze'
+	LANGUAGE 'c' STRICT;
+
 CREATE TYPE pcpatch (
 	internallength = variable,
 	input = pcpatch_in,
@@ -115,7 +140,7 @@ CREATE TYPE pcpatch (
 	typmod_out = pc_typmod_out,
 	-- delimiter = ':',
 	-- alignment = double,
-	-- analyze = geometry_analyze,
+	analyze = pcpatch_analyze,
 	storage = external
 );
 
@@ -179,6 +204,275 @@ CREATE OR REPLACE FUNCTION PC_FilterBetween(p pcpatch, attr text, v1 float8 defa
 	RETURNS pcpatch AS 'MODULE_PATHNAME', 'pcpatch_filter'
     LANGUAGE 'c' IMMUTABLE STRICT;
 
+-- BETWEEN in the predicate includes its bounds as in SQL, PC_FilterBetween excludes them
+CREATE OR REPLACE FUNCTION PC_Filter(p pcpatch, predicate text)
+	RETURNS pcpatch AS 'MODULE_PATHNAME', 'pcpatch_filter_predicate'
+    LANGUAGE 'c' IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION PC_FilterGeometry(p pcpatch, wkb bytea, distance float8 default 0.0)
+	RETURNS pcpatch AS 'MODULE_PATHNAME', 'pcpatch_filter_geometry'
+    LANGUAGE 'c' IMMUTABLE STRICT;
+
+-------------------------------------------------------------------
+--  PCPATCH INDEXING
+-------------------------------------------------------------------
+
+-- Bounds of a patch, read from its header only
+CREATE OR REPLACE FUNCTION box(p pcpatch)
+	RETURNS box AS 'MODULE_PATHNAME', 'pcpatch_box'
+    LANGUAGE 'c' IMMUTABLE STRICT;
+
+CREATE CAST (pcpatch AS box) WITH FUNCTION box(pcpatch);
+
+-- Selectivity of the patch operators, from the ANALYZE statistics
+CREATE OR REPLACE FUNCTION pcpatch_overlaps_sel(internal, oid, internal, integer)
+	RETURNS float8 AS 'MODULE_PATHNAME', 'pcpatch_overlaps_sel'
+    LANGUAGE 'c' STABLE STRICT;
+
+CREATE OR REPLACE FUNCTION pcpatch_contained_sel(internal, oid, internal, integer)
+	RETURNS float8 AS 'MODULE_PATHNAME', 'pcpatch_contained_sel'
+    LANGUAGE 'c' STABLE STRICT;
+
+CREATE OR REPLACE FUNCTION pcpatch_contains_sel(internal, oid, internal, integer)
+	RETURNS float8 AS 'MODULE_PATHNAME', 'pcpatch_contains_sel'
+    LANGUAGE 'c' STABLE STRICT;
+
+CREATE OR REPLACE FUNCTION pcpatch_overlaps_joinsel(internal, oid, internal, smallint, internal)
+	RETURNS float8 AS 'MODULE_PATHNAME', 'pcpatch_overlaps_joinsel'
+    LANGUAGE 'c' STABLE STRICT;
+
+CREATE OR REPLACE FUNCTION pcpatch_overlaps_box(p pcpatch, b box)
+	RETURNS boolean AS 'MODULE_PATHNAME', 'pcpatch_overlaps_box'
+    LANGUAGE 'c' IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION pcpatch_contained_by_box(p pcpatch, b box)
+	RETURNS boolean AS 'MODULE_PATHNAME', 'pcpatch_contained_by_box'
+    LANGUAGE 'c' IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION pcpatch_contains_box(p pcpatch, b box)
+	RETURNS boolean AS 'MODULE_PATHNAME', 'pcpatch_contains_box'
+    LANGUAGE 'c' IMMUTABLE STRICT;
+
+-- Patch bounds overlap the box
+CREATE OPERATOR && (
+	LEFTARG = pcpatch, RIGHTARG = box,
+	PROCEDURE = pcpatch_overlaps_box,
+	RESTRICT = pcpatch_overlaps_sel, JOIN = areajoinsel
+);
+
+-- Patch bounds are inside the box
+CREATE OPERATOR @ (
+	LEFTARG = pcpatch, RIGHTARG = box,
+	PROCEDURE = pcpatch_contained_by_box,
+	RESTRICT = pcpatch_contained_sel, JOIN = contjoinsel
+);
+
+-- Patch bounds contain the box
+CREATE OPERATOR ~ (
+	LEFTARG = pcpatch, RIGHTARG = box,
+	PROCEDURE = pcpatch_contains_box,
+	RESTRICT = pcpatch_contains_sel, JOIN = contjoinsel
+);
+
+CREATE OR REPLACE FUNCTION pcpatch_overlaps_pcpatch(p1 pcpatch, p2 pcpatch)
+	RETURNS boolean AS 'MODULE_PATHNAME', 'pcpatch_overlaps_pcpatch'
+    LANGUAGE 'c' IMMUTABLE STRICT;
+
+-- Bounds of the patches overlap
+CREATE OPERATOR && (
+	LEFTARG = pcpatch, RIGHTARG = pcpatch,
+	PROCEDURE = pcpatch_overlaps_pcpatch,
+	COMMUTATOR = &&,
+	RESTRICT = pcpatch_overlaps_sel, JOIN = pcpatch_overlaps_joinsel
+);
+
+CREATE OR REPLACE FUNCTION pcpatch_gist_consistent(internal, pcpatch, smallint, oid, internal)
+	RETURNS boolean AS 'MODULE_PATHNAME', 'pcpatch_gist_consistent'
+    LANGUAGE 'c';
+
+CREATE OR REPLACE FUNCTION pcpatch_gist_compress(internal)
+	RETURNS internal AS 'MODULE_PATHNAME', 'pcpatch_gist_compress'
+    LANGUAGE 'c';
+
+CREATE OR REPLACE FUNCTION pcpatch_gist_decompress(internal)
+	RETURNS internal AS 'MODULE_PATHNAME', 'pcpatch_gist_decompress'
+    LANGUAGE 'c';
+
+-- Index keys are the boxes of the patch bounds, handled as box_ops does
+CREATE OPERATOR CLASS gist_pcpatch_ops
+	DEFAULT FOR TYPE pcpatch USING gist AS
+	STORAGE box,
+	OPERATOR 3 && (pcpatch, box),
+	OPERATOR 3 && (pcpatch, pcpatch),
+	OPERATOR 7 ~ (pcpatch, box),
+	OPERATOR 8 @ (pcpatch, box),
+	FUNCTION 1 pcpatch_gist_consistent (internal, pcpatch, smallint, oid, internal),
+	FUNCTION 2 gist_box_union (internal, internal),
+	FUNCTION 3 pcpatch_gist_compress (internal),
+	FUNCTION 4 pcpatch_gist_decompress (internal),
+	FUNCTION 5 gist_box_penalty (internal, internal, internal),
+	FUNCTION 6 gist_box_picksplit (internal, internal),
+	FUNCTION 7 gist_box_same (box, box, internal);
+
+-- N-D bounds of patches, over the indexed dimensions of their schema:
+-- X, Y, Z and those named in the indexdims metadata
+CREATE OR REPLACE FUNCTION pcbox_in(cstring)
+	RETURNS pcbox AS 'MODULE_PATHNAME', 'pcbox_in'
+	LANGUAGE 'c' IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION pcbox_out(pcbox)
+	RETURNS cstring AS 'MODULE_PATHNAME', 'pcbox_out'
+	LANGUAGE 'c' IMMUTABLE STRICT;
+
+CREATE TYPE pcbox (
+	internallength = variable,
+	input = pcbox_in,
+	output = pcbox_out,
+	alignment = double,
+	storage = main
+);
+
+CREATE OR REPLACE FUNCTION PC_MakeBox(pcid integer, dimname text, min float8, max float8)
+	RETURNS pcbox AS 'MODULE_PATHNAME', 'pcbox_from_range'
+	LANGUAGE 'c' IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION pcbox(p pcpatch)
+	RETURNS pcbox AS 'MODULE_PATHNAME', 'pcpatch_pcbox'
+    LANGUAGE 'c' IMMUTABLE STRICT;
+
+CREATE CAST (pcpatch AS pcbox) WITH FUNCTION pcbox(pcpatch);
+
+CREATE OR REPLACE FUNCTION pcpatch_overlaps_pcbox(p pcpatch, b pcbox)
+	RETURNS boolean AS 'MODULE_PATHNAME', 'pcpatch_overlaps_pcbox'
+    LANGUAGE 'c' IMMUTABLE STRICT;
+
+CREATE OR REPLACE FUNCTION pcpatch_pcbox_sel(internal, oid, internal, integer)
+	RETURNS float8 AS 'MODULE_PATHNAME', 'pcpatch_pcbox_sel'
+    LANGUAGE 'c' STABLE STRICT;
+
+-- Patch ranges overlap those of the pcbox, on every dimension of the pcbox
+CREATE OPERATOR && (
+	LEFTARG = pcpatch, RIGHTARG = pcbox,
+	PROCEDURE = pcpatch_overlaps_pcbox,
+	RESTRICT = pcpatch_pcbox_sel, JOIN = areajoinsel
+);
+
+CREATE OR REPLACE FUNCTION pcbox_gist_consistent(internal, pcpatch, smallint, oid, internal)
+	RETURNS boolean AS 'MODULE_PATHNAME', 'pcbox_gist_consistent'
+    LANGUAGE 'c';
+
+CREATE OR REPLACE FUNCTION pcbox_gist_compress(internal)
+	RETURNS internal AS 'MODULE_PATHNAME', 'pcbox_gist_compress'
+    LANGUAGE 'c';
+
+CREATE OR REPLACE FUNCTION pcbox_gist_decompress(internal)
+	RETURNS internal AS 'MODULE_PATHNAME', 'pcbox_gist_decompress'
+    LANGUAGE 'c';
+
+CREATE OR REPLACE FUNCTION pcbox_gist_union(internal, internal)
+	RETURNS pcbox AS 'MODULE_PATHNAME', 'pcbox_gist_union'
+    LANGUAGE 'c';
+
+-- Strict, as gist_box_penalty is, so GiST never hands it a NULL key
+CREATE OR REPLACE FUNCTION pcbox_gist_penalty(internal, internal, internal)
+	RETURNS internal AS 'MODULE_PATHNAME', 'pcbox_gist_penalty'
+    LANGUAGE 'c' STRICT;
+
+CREATE OR REPLACE FUNCTION pcbox_gist_picksplit(internal, internal)
+	RETURNS internal AS 'MODULE_PATHNAME', 'pcbox_gist_picksplit'
+    LANGUAGE 'c';
+
+CREATE OR REPLACE FUNCTION pcbox_gist_same(pcbox, pcbox, internal)
+	RETURNS internal AS 'MODULE_PATHNAME', 'pcbox_gist_same'
+    LANGUAGE 'c';
+
+-- Index keys are the N-D bounds of the patches
+CREATE OPERATOR CLASS gist_pcpatch_nd_ops
+	FOR TYPE pcpatch USING gist AS
+	STORAGE pcbox,
+	OPERATOR 3 && (pcpatch, pcbox),
+	FUNCTION 1 pcbox_gist_consistent (internal, pcpatch, smallint, oid, internal),
+	FUNCTION 2 pcbox_gist_union (internal, internal),
+	FUNCTION 3 pcbox_gist_compress (internal),
+	FUNCTION 4 pcbox_gist_decompress (internal),
+	FUNCTION 5 pcbox_gist_penalty (internal, internal, internal),
+	FUNCTION 6 pcbox_gist_picksplit (internal, internal),
+	FUNCTION 7 pcbox_gist_same (pcbox, pcbox, internal);
+
+-- Sorted GiST builds (PostgreSQL 14), planner support functions
+-- (PostgreSQL 12), SP-GiST with a compress method (PostgreSQL 11)
+-- and BRIN (PostgreSQL 9.5) are only set up where the server has them
+DO $$
+BEGIN
+	IF current_setting('server_version_num')::integer >= 90500 THEN
+		CREATE OR REPLACE FUNCTION pcpatch_brin_opcinfo(internal)
+			RETURNS internal AS 'MODULE_PATHNAME', 'pcpatch_brin_opcinfo'
+			LANGUAGE 'c' STRICT;
+
+		CREATE OR REPLACE FUNCTION pcpatch_brin_add_value(internal, internal, internal, internal)
+			RETURNS boolean AS 'MODULE_PATHNAME', 'pcpatch_brin_add_value'
+			LANGUAGE 'c' STRICT;
+
+		CREATE OR REPLACE FUNCTION pcpatch_brin_consistent(internal, internal, internal)
+			RETURNS boolean AS 'MODULE_PATHNAME', 'pcpatch_brin_consistent'
+			LANGUAGE 'c' STRICT;
+
+		CREATE OR REPLACE FUNCTION pcpatch_brin_union(internal, internal, internal)
+			RETURNS boolean AS 'MODULE_PATHNAME', 'pcpatch_brin_union'
+			LANGUAGE 'c' STRICT;
+
+		-- One box per block range, covering the bounds of its patches
+		CREATE OPERATOR CLASS brin_pcpatch_inclusion_ops
+			DEFAULT FOR TYPE pcpatch USING brin AS
+			STORAGE box,
+			OPERATOR 3 && (pcpatch, box),
+			OPERATOR 7 ~ (pcpatch, box),
+			OPERATOR 8 @ (pcpatch, box),
+			FUNCTION 1 pcpatch_brin_opcinfo (internal),
+			FUNCTION 2 pcpatch_brin_add_value (internal, internal, internal, internal),
+			FUNCTION 3 pcpatch_brin_consistent (internal, internal, internal),
+			FUNCTION 4 pcpatch_brin_union (internal, internal, internal);
+	END IF;
+
+	IF current_setting('server_version_num')::integer >= 140000 THEN
+		CREATE OR REPLACE FUNCTION pcpatch_gist_sortsupport(internal)
+			RETURNS void AS 'MODULE_PATHNAME', 'pcpatch_gist_sortsupport'
+			LANGUAGE 'c' STRICT;
+
+		ALTER OPERATOR FAMILY gist_pcpatch_ops USING gist
+			ADD FUNCTION 11 (pcpatch) pcpatch_gist_sortsupport (internal);
+	END IF;
+
+	IF current_setting('server_version_num')::integer >= 120000 THEN
+		CREATE OR REPLACE FUNCTION pcpatch_intersects_support(internal)
+			RETURNS internal AS 'MODULE_PATHNAME', 'pcpatch_intersects_support'
+			LANGUAGE 'c' STRICT;
+
+		-- Hands the planner the indexable && on the patch bounds
+		ALTER FUNCTION PC_Intersects(pcpatch, pcpatch) SUPPORT pcpatch_intersects_support;
+	END IF;
+
+	IF current_setting('server_version_num')::integer >= 110000 THEN
+		CREATE OR REPLACE FUNCTION pcpatch_spgist_config(internal, internal)
+			RETURNS void AS 'MODULE_PATHNAME', 'pcpatch_spgist_config'
+			LANGUAGE 'c' STRICT;
+
+		CREATE OPERATOR CLASS spgist_pcpatch_ops
+			DEFAULT FOR TYPE pcpatch USING spgist AS
+			STORAGE box,
+			OPERATOR 3 && (pcpatch, box),
+			OPERATOR 7 ~ (pcpatch, box),
+			OPERATOR 8 @ (pcpatch, box),
+			FUNCTION 1 pcpatch_spgist_config (internal, internal),
+			FUNCTION 2 spg_box_quad_choose (internal, internal),
+			FUNCTION 3 spg_box_quad_picksplit (internal, internal),
+			FUNCTION 4 spg_box_quad_inner_consistent (internal, internal),
+			FUNCTION 5 spg_box_quad_leaf_consistent (internal, internal),
+			FUNCTION 6 box (pcpatch);
+	END IF;
+END
+$$;
+
 -------------------------------------------------------------------
 --  POINTCLOUD_COLUMNS
 -------------------------------------------------------------------
@@ -220,25 +514,6 @@ CREATE OR REPLACE FUNCTION pcpoint(p pcpoint, typmod integer, explicit boolean)
 
 CREATE CAST (pcpoint AS pcpoint) WITH FUNCTION pcpoint(pcpoint, integer, boolean) AS IMPLICIT;
 
--------------------------------------------------------------------
---  AGGREGATE GENERIC SUPPORT
--------------------------------------------------------------------
-
-CREATE OR REPLACE FUNCTION pointcloud_abs_in(cstring)
-	RETURNS pointcloud_abs AS 'MODULE_PATHNAME'
-	LANGUAGE 'c';
-
-CREATE OR REPLACE FUNCTION pointcloud_abs_out(pointcloud_abs)
-	RETURNS cstring AS 'MODULE_PATHNAME'
-	LANGUAGE 'c';
-
-CREATE TYPE pointcloud_abs (
-	internallength = 8,
-	input = pointcloud_abs_in,
-	output = pointcloud_abs_out,
-	alignment = double
-);
-
 -------------------------------------------------------------------
 --  AGGREGATE PCPOINT
 -------------------------------------------------------------------
@@ -247,29 +522,33 @@ CREATE OR REPLACE FUNCTION PC_Patch(pcpoint[])
 	RETURNS pcpatch AS 'MODULE_PATHNAME', 'pcpatch_from_pcpoint_array'
 	LANGUAGE 'c' IMMUTABLE STRICT;
 
-CREATE OR REPLACE FUNCTION pcpoint_agg_transfn (pointcloud_abs, pcpoint)
-	RETURNS pointcloud_abs AS 'MODULE_PATHNAME', 'pointcloud_agg_transfn'
+CREATE OR REPLACE FUNCTION pcpoint_agg_transfn (internal, pcpoint)
+	RETURNS internal AS 'MODULE_PATHNAME', 'pointcloud_agg_transfn'
 	LANGUAGE 'c';
 
-CREATE OR REPLACE FUNCTION pcpoint_agg_final_array (pointcloud_abs)
+CREATE OR REPLACE FUNCTION pcpoint_agg_final_array (internal)
 	RETURNS pcpoint[] AS 'MODULE_PATHNAME', 'pcpoint_agg_final_array'
 	LANGUAGE 'c';
 
-CREATE OR REPLACE FUNCTION pcpoint_agg_final_pcpatch (pointcloud_abs)
-	RETURNS pcpatch AS 'MODULE_PATHNAME', 'pcpoint_agg_final_pcpatch'
+CREATE OR REPLACE FUNCTION pcpoint_union_transfn (internal, pcpoint)
+	RETURNS internal AS 'MODULE_PATHNAME', 'pcpoint_union_transfn'
+	LANGUAGE 'c';
+
+CREATE OR REPLACE FUNCTION pointcloud_union_final (internal)
+	RETURNS pcpatch AS 'MODULE_PATHNAME', 'pointcloud_union_final'
 	LANGUAGE 'c';
 
 CREATE AGGREGATE PC_Patch (
         BASETYPE = pcpoint,
-        SFUNC = pcpoint_agg_transfn,
-        STYPE = pointcloud_abs,
-        FINALFUNC = pcpoint_agg_final_pcpatch
+        SFUNC = pcpoint_union_transfn,
+        STYPE = internal,
+        FINALFUNC = pointcloud_union_final
 );
 
 CREATE AGGREGATE PC_Point_Agg (
         BASETYPE = pcpoint,
         SFUNC = pcpoint_agg_transfn,
-        STYPE = pointcloud_abs,
+        STYPE = internal,
         FINALFUNC = pcpoint_agg_final_array
 );
 
@@ -277,36 +556,123 @@ CREATE AGGREGATE PC_Point_Agg (
 --  AGGREGATE / EXPLODE PCPATCH
 -------------------------------------------------------------------
 
-CREATE OR REPLACE FUNCTION pcpatch_agg_final_array (pointcloud_abs)
+CREATE OR REPLACE FUNCTION pcpatch_agg_final_array (internal)
 	RETURNS pcpatch[] AS 'MODULE_PATHNAME', 'pcpatch_agg_final_array'
 	LANGUAGE 'c';
 
-CREATE OR REPLACE FUNCTION pcpatch_agg_final_pcpatch (pointcloud_abs)
-	RETURNS pcpatch AS 'MODULE_PATHNAME', 'pcpatch_agg_final_pcpatch'
+CREATE OR REPLACE FUNCTION pcpatch_agg_transfn (internal, pcpatch)
+	RETURNS internal AS 'MODULE_PATHNAME', 'pointcloud_agg_transfn'
 	LANGUAGE 'c';
 
-CREATE OR REPLACE FUNCTION pcpatch_agg_transfn (pointcloud_abs, pcpatch)
-	RETURNS pointcloud_abs AS 'MODULE_PATHNAME', 'pointcloud_agg_transfn'
+CREATE OR REPLACE FUNCTION pcpatch_union_transfn (internal, pcpatch)
+	RETURNS internal AS 'MODULE_PATHNAME', 'pcpatch_union_transfn'
 	LANGUAGE 'c';
 	
 CREATE AGGREGATE PC_Patch_Agg (
         BASETYPE = pcpatch,
         SFUNC = pcpatch_agg_transfn,
-        STYPE = pointcloud_abs,
+        STYPE = internal,
         FINALFUNC = pcpatch_agg_final_array
 );
 
 CREATE AGGREGATE PC_Union (
         BASETYPE = pcpatch,
-        SFUNC = pcpatch_agg_transfn,
-        STYPE = pointcloud_abs,
-        FINALFUNC = pcpatch_agg_final_pcpatch
+        SFUNC = pcpatch_union_transfn,
+        STYPE = internal,
+        FINALFUNC = pointcloud_union_final
 );
 
+-- Partial aggregates (PostgreSQL 9.6) let parallel workers each
+-- build part of a group, which the leader combines
+DO $$
+BEGIN
+	IF current_setting('server_version_num')::integer >= 90600 THEN
+		CREATE OR REPLACE FUNCTION pointcloud_agg_combinefn (internal, internal)
+			RETURNS internal AS 'MODULE_PATHNAME', 'pointcloud_agg_combinefn'
+			LANGUAGE 'c' PARALLEL SAFE;
+
+		CREATE OR REPLACE FUNCTION pointcloud_agg_serialfn (internal)
+			RETURNS bytea AS 'MODULE_PATHNAME', 'pointcloud_agg_serialfn'
+			LANGUAGE 'c' STRICT PARALLEL SAFE;
+
+		CREATE OR REPLACE FUNCTION pointcloud_agg_deserialfn (bytea, internal)
+			RETURNS internal AS 'MODULE_PATHNAME', 'pointcloud_agg_deserialfn'
+			LANGUAGE 'c' STRICT PARALLEL SAFE;
+
+		CREATE OR REPLACE FUNCTION pointcloud_union_combinefn (internal, internal)
+			RETURNS internal AS 'MODULE_PATHNAME', 'pointcloud_union_combinefn'
+			LANGUAGE 'c' PARALLEL SAFE;
+
+		CREATE OR REPLACE FUNCTION pointcloud_union_serialfn (internal)
+			RETURNS bytea AS 'MODULE_PATHNAME', 'pointcloud_union_serialfn'
+			LANGUAGE 'c' STRICT PARALLEL SAFE;
+
+		CREATE OR REPLACE FUNCTION pointcloud_union_deserialfn (bytea, internal)
+			RETURNS internal AS 'MODULE_PATHNAME', 'pointcloud_union_deserialfn'
+			LANGUAGE 'c' STRICT PARALLEL SAFE;
+
+		ALTER FUNCTION pcpoint_agg_transfn (internal, pcpoint) PARALLEL SAFE;
+		ALTER FUNCTION pcpoint_agg_final_array (internal) PARALLEL SAFE;
+		ALTER FUNCTION pcpoint_union_transfn (internal, pcpoint) PARALLEL SAFE;
+		ALTER FUNCTION pcpatch_agg_transfn (internal, pcpatch) PARALLEL SAFE;
+		ALTER FUNCTION pcpatch_agg_final_array (internal) PARALLEL SAFE;
+		ALTER FUNCTION pcpatch_union_transfn (internal, pcpatch) PARALLEL SAFE;
+		ALTER FUNCTION pointcloud_union_final (internal) PARALLEL SAFE;
+
+		DROP AGGREGATE PC_Patch (pcpoint);
+		CREATE AGGREGATE PC_Patch (pcpoint) (
+			SFUNC = pcpoint_union_transfn,
+			STYPE = internal,
+			FINALFUNC = pointcloud_union_final,
+			COMBINEFUNC = pointcloud_union_combinefn,
+			SERIALFUNC = pointcloud_union_serialfn,
+			DESERIALFUNC = pointcloud_union_deserialfn,
+			PARALLEL = SAFE
+		);
+
+		DROP AGGREGATE PC_Point_Agg (pcpoint);
+		CREATE AGGREGATE PC_Point_Agg (pcpoint) (
+			SFUNC = pcpoint_agg_transfn,
+			STYPE = internal,
+			FINALFUNC = pcpoint_agg_final_array,
+			COMBINEFUNC = pointcloud_agg_combinefn,
+			SERIALFUNC = pointcloud_agg_serialfn,
+			DESERIALFUNC = pointcloud_agg_deserialfn,
+			PARALLEL = SAFE
+		);
+
+		DROP AGGREGATE PC_Patch_Agg (pcpatch);
+		CREATE AGGREGATE PC_Patch_Agg (pcpatch) (
+			SFUNC = pcpatch_agg_transfn,
+			STYPE = internal,
+			FINALFUNC = pcpatch_agg_final_array,
+			COMBINEFUNC = pointcloud_agg_combinefn,
+			SERIALFUNC = pointcloud_agg_serialfn,
+			DESERIALFUNC = pointcloud_agg_deserialfn,
+			PARALLEL = SAFE
+		);
+
+		DROP AGGREGATE PC_Union (pcpatch);
+		CREATE AGGREGATE PC_Union (pcpatch) (
+			SFUNC = pcpatch_union_transfn,
+			STYPE = internal,
+			FINALFUNC = pointcloud_union_final,
+			COMBINEFUNC = pointcloud_union_combinefn,
+			SERIALFUNC = pointcloud_union_serialfn,
+			DESERIALFUNC = pointcloud_union_deserialfn,
+			PARALLEL = SAFE
+		);
+	END IF;
+END $$;
+
 CREATE OR REPLACE FUNCTION PC_Explode(p pcpatch)
 	RETURNS setof pcpoint AS 'MODULE_PATHNAME', 'pcpatch_unnest'
 	LANGUAGE 'c' IMMUTABLE STRICT;
 
+CREATE OR REPLACE FUNCTION PC_Values(p pcpatch, dims text[], filterdims text[] default '{}', mins float8[] default '{}', maxs float8[] default '{}')
+	RETURNS setof record AS 'MODULE_PATHNAME', 'pcpatch_values'
+	LANGUAGE 'c' IMMUTABLE STRICT;
+
 
 -------------------------------------------------------------------
 --  SQL Utility Functions
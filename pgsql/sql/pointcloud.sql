@@ -175,6 +175,9 @@ SELECT PC_Uncompress(pa) FROM pa_test LIMIT 1;
 SELECT PC_AsText(pa) FROM pa_test;
 SELECT PC_Envelope(pa) from pa_test;
 SELECT PC_AsText(PC_Union(pa)) FROM pa_test;
+SET pointcloud.agg_memory_limit = 0;
+SELECT PC_AsText(PC_Union(pa)) FROM pa_test;
+RESET pointcloud.agg_memory_limit;
 SELECT sum(PC_NumPoints(pa)) FROM pa_test;
 
 CREATE TABLE IF NOT EXISTS pa_test_dim (
@@ -211,6 +214,109 @@ SELECT Sum(PC_MemSize(pa)) FROM pa_test_dim;
 SELECT Max(PC_PatchMax(pa,'x')) FROM pa_test_dim;
 SELECT Min(PC_PatchMin(pa,'x')) FROM pa_test_dim;
 SELECT Min(PC_PatchMin(pa,'z')) FROM pa_test_dim;
+SELECT PC_NumPoints(u), PC_PatchMin(u, 'x'), PC_PatchMax(u, 'z') FROM (SELECT PC_Union(pa) AS u FROM pa_test_dim) AS s;
+
+CREATE INDEX pa_test_dim_gist ON pa_test_dim USING GIST (pa);
+SET enable_seqscan = off;
+SELECT count(*) FROM pa_test_dim WHERE pa && '((-120,40),(-110,50))'::box;
+SELECT count(*) FROM pa_test_dim WHERE pa @ '((-130,40),(-100,70))'::box;
+SELECT count(*) FROM pa_test_dim WHERE pa ~ '((-125,46),(-124,47))'::box;
+RESET enable_seqscan;
+DROP INDEX pa_test_dim_gist;
+SELECT count(*) FROM pa_test_dim WHERE pa @ '((-124,48),(-114,58))'::box;
+CREATE INDEX pa_test_dim_brin ON pa_test_dim USING BRIN (pa);
+SET enable_seqscan = off;
+SELECT count(*) FROM pa_test_dim WHERE pa && '((-120,40),(-110,50))'::box;
+SELECT count(*) FROM pa_test_dim WHERE pa ~ '((-125,46),(-124,47))'::box;
+SELECT count(*) FROM pa_test_dim WHERE pa @ '((-124,48),(-114,58))'::box;
+RESET enable_seqscan;
+DROP INDEX pa_test_dim_brin;
+CREATE INDEX pa_test_dim_nd ON pa_test_dim USING GIST (pa gist_pcpatch_nd_ops);
+SELECT PC_MakeBox(3, 'Z', 1000, 1300);
+SET enable_seqscan = off;
+SELECT count(*) FROM pa_test_dim WHERE pa && PC_MakeBox(3, 'Z', 1000, 1300);
+SELECT count(*) FROM pa_test_dim WHERE pa && PC_MakeBox(3, 'Intensity', 0, 10);
+RESET enable_seqscan;
+DROP INDEX pa_test_dim_nd;
+CREATE TABLE pa_test_grid AS SELECT PC_Patch(PC_MakePoint(3, ARRAY[-127+(a/4)%40*0.5+a%4*0.1, 45+(a/4)/40*0.5+a%4*0.1, a, a%100])) AS pa FROM generate_series(0,7999) AS a GROUP BY a/4;
+SELECT count(*) FROM pa_test_grid WHERE pa && '((-120.025,50.025),(-115.025,55.025))'::box;
+SELECT count(*) FROM pa_test_grid WHERE pa @ '((-125.025,46.025),(-110.025,60.025))'::box;
+CREATE INDEX pa_test_grid_gist ON pa_test_grid USING GIST (pa);
+SET enable_seqscan = off;
+SELECT count(*) FROM pa_test_grid WHERE pa && '((-120.025,50.025),(-115.025,55.025))'::box;
+SELECT count(*) FROM pa_test_grid WHERE pa @ '((-125.025,46.025),(-110.025,60.025))'::box;
+RESET enable_seqscan;
+DROP INDEX pa_test_grid_gist;
+CREATE INDEX pa_test_grid_spgist ON pa_test_grid USING SPGIST (pa);
+SET enable_seqscan = off;
+SELECT count(*) FROM pa_test_grid WHERE pa && '((-120.025,50.025),(-115.025,55.025))'::box;
+SELECT count(*) FROM pa_test_grid WHERE pa @ '((-125.025,46.025),(-110.025,60.025))'::box;
+RESET enable_seqscan;
+DROP INDEX pa_test_grid_spgist;
+SELECT count(*) FROM pa_test_grid WHERE pa && PC_MakeBox(3, 'Z', 1000.5, 1300.5);
+CREATE INDEX pa_test_grid_nd ON pa_test_grid USING GIST (pa gist_pcpatch_nd_ops);
+INSERT INTO pa_test_grid (pa) VALUES (NULL);
+SET enable_seqscan = off;
+SELECT count(*) FROM pa_test_grid WHERE pa && PC_MakeBox(3, 'Z', 1000.5, 1300.5);
+RESET enable_seqscan;
+SELECT count(*) FROM pa_test_grid WHERE pa IS NULL;
+DROP INDEX pa_test_grid_nd;
+CREATE TABLE pt_test_grid AS SELECT PC_Explode(pa) AS pt FROM pa_test_grid;
+SET max_parallel_workers_per_gather = 0;
+CREATE TABLE pa_test_serial AS SELECT PC_Union(pa) AS u, PC_Patch_Agg(pa) AS a FROM pa_test_grid;
+CREATE TABLE pt_test_serial AS SELECT PC_Patch(pt) AS p, PC_Point_Agg(pt) AS a FROM pt_test_grid;
+SET parallel_setup_cost = 0;
+SET parallel_tuple_cost = 0;
+SET min_parallel_table_scan_size = 0;
+SET max_parallel_workers_per_gather = 2;
+DO $$ BEGIN IF current_setting('server_version_num')::integer >= 160000 THEN SET debug_parallel_query = on; ELSE SET force_parallel_mode = on; END IF; END $$;
+CREATE FUNCTION pc_test_explain(q text) RETURNS SETOF text LANGUAGE plpgsql AS $$ DECLARE l text; BEGIN FOR l IN EXECUTE 'EXPLAIN (COSTS OFF) ' || q LOOP RETURN NEXT l; END LOOP; END $$;
+SELECT (SELECT bool_or(l LIKE '%Partial Aggregate%') FROM pc_test_explain('CREATE TABLE pa_test_parallel AS SELECT PC_Union(pa) AS u, PC_Patch_Agg(pa) AS a FROM pa_test_grid') AS l) AS patches, (SELECT bool_or(l LIKE '%Partial Aggregate%') FROM pc_test_explain('CREATE TABLE pt_test_parallel AS SELECT PC_Patch(pt) AS p, PC_Point_Agg(pt) AS a FROM pt_test_grid') AS l) AS points;
+DROP FUNCTION pc_test_explain(text);
+CREATE TABLE pa_test_parallel AS SELECT PC_Union(pa) AS u, PC_Patch_Agg(pa) AS a FROM pa_test_grid;
+CREATE TABLE pt_test_parallel AS SELECT PC_Patch(pt) AS p, PC_Point_Agg(pt) AS a FROM pt_test_grid;
+DO $$ BEGIN IF current_setting('server_version_num')::integer >= 160000 THEN RESET debug_parallel_query; ELSE RESET force_parallel_mode; END IF; END $$;
+RESET max_parallel_workers_per_gather;
+RESET min_parallel_table_scan_size;
+RESET parallel_tuple_cost;
+RESET parallel_setup_cost;
+SELECT PC_NumPoints(p.u), (SELECT array_agg(z ORDER BY z) FROM PC_Values(p.u, ARRAY['Z']) AS v(z float8)) = (SELECT array_agg(z ORDER BY z) FROM PC_Values(s.u, ARRAY['Z']) AS v(z float8)) AS same, array_length(p.a, 1), (SELECT array_agg(PC_PatchMin(e, 'z') ORDER BY PC_PatchMin(e, 'z')) FROM unnest(p.a) AS e) = (SELECT array_agg(PC_PatchMin(e, 'z') ORDER BY PC_PatchMin(e, 'z')) FROM unnest(s.a) AS e) AS same_agg FROM pa_test_parallel p, pa_test_serial s;
+SELECT PC_NumPoints(p.p), (SELECT array_agg(z ORDER BY z) FROM PC_Values(p.p, ARRAY['Z']) AS v(z float8)) = (SELECT array_agg(z ORDER BY z) FROM PC_Values(s.p, ARRAY['Z']) AS v(z float8)) AS same, array_length(p.a, 1), (SELECT array_agg(PC_Get(e, 'z') ORDER BY PC_Get(e, 'z')) FROM unnest(p.a) AS e) = (SELECT array_agg(PC_Get(e, 'z') ORDER BY PC_Get(e, 'z')) FROM unnest(s.a) AS e) AS same_agg FROM pt_test_parallel p, pt_test_serial s;
+DROP TABLE pa_test_serial, pt_test_serial, pa_test_parallel, pt_test_parallel, pt_test_grid;
+ANALYZE pa_test_dim;
+SELECT stakind1, stakind2 FROM pg_statistic WHERE starelid = 'pa_test_dim'::regclass;
+SELECT count(*) FROM pa_test_dim a, pa_test_dim b WHERE a.pa && b.pa;
+CREATE TABLE pa_test_empty AS SELECT pa FROM pa_test;
+INSERT INTO pa_test_empty (pa) VALUES ('01010000000000000000000000');
+SELECT PC_NumPoints(pa) FROM pa_test_empty WHERE PC_NumPoints(pa) = 0;
+ANALYZE pa_test_empty;
+SELECT stavalues1::text NOT SIMILAR TO '%(NaN|Infinity)%' AS finite FROM pg_statistic WHERE starelid = 'pa_test_empty'::regclass;
+DROP TABLE pa_test_empty;
+CREATE FUNCTION pc_test_explain(q text) RETURNS SETOF text LANGUAGE plpgsql AS $$ DECLARE l text; BEGIN FOR l IN EXECUTE 'EXPLAIN (COSTS OFF) ' || q LOOP RETURN NEXT l; END LOOP; END $$;
+CREATE INDEX pa_test_dim_gist ON pa_test_dim USING GIST (pa);
+SET enable_seqscan = off;
+SELECT bool_or(l LIKE '%Index Cond: (%&&%)') AS index_cond, bool_or(l LIKE '% on pa_test_dim_gist%' OR l LIKE '% using pa_test_dim_gist %') AS gist FROM pc_test_explain('SELECT count(*) FROM pa_test_dim a, pa_test_dim b WHERE PC_Intersects(a.pa, b.pa)') AS l;
+DROP FUNCTION pc_test_explain(text);
+SELECT count(*) FROM pa_test_dim a, pa_test_dim b WHERE PC_Intersects(a.pa, b.pa);
+RESET enable_seqscan;
+DROP INDEX pa_test_dim_gist;
+SELECT count(*), min(z), max(z) FROM pa_test_dim, PC_Values(pa, ARRAY['Z', 'Intensity'], ARRAY['Z'], ARRAY[1000], ARRAY[1100]) AS v(z float8, i float8);
+SELECT count(*), min(x), max(x), max(i) FROM pa_test_dim, PC_Values(pa, ARRAY['X', 'Intensity'], ARRAY['Z', 'Intensity'], ARRAY[1500, 150], ARRAY[1600, 152]) AS v(x float8, i float8);
+CREATE TABLE pa_test_toast (pa PCPATCH(3));
+ALTER TABLE pa_test_toast ALTER COLUMN pa SET STORAGE EXTERNAL;
+INSERT INTO pa_test_toast (pa) SELECT PC_Patch(PC_MakePoint(3, ARRAY[-127+(a*7919%1600)/100.0, 45+(a*104729%1600)/100.0, a*31%1601, a*17%1000])) FROM generate_series(1,1600) AS a;
+SELECT pg_column_size(pa) > 2000 AS toasted FROM pa_test_toast;
+SELECT count(*) FROM pa_test_toast, PC_Values(pa, ARRAY['Z', 'Intensity'], ARRAY['X'], ARRAY[-120.005], ARRAY[-115.005]) AS v(z float8, i float8);
+SELECT (SELECT array_agg(ROW(z, i)) FROM pa_test_toast, PC_Values(pa, ARRAY['Z', 'Intensity'], ARRAY['X'], ARRAY[-120.005], ARRAY[-115.005]) AS v(z float8, i float8)) = (SELECT array_agg(ROW(z, i)) FROM pa_test_toast, PC_Values(PC_Uncompress(pa), ARRAY['Z', 'Intensity'], ARRAY['X'], ARRAY[-120.005], ARRAY[-115.005]) AS v(z float8, i float8)) AS same;
+SELECT (SELECT array_agg(x) FROM pa_test_toast, PC_Values(pa, ARRAY['X']) AS v(x float8)) = (SELECT array_agg(x) FROM pa_test_toast, PC_Values(PC_Uncompress(pa), ARRAY['X']) AS v(x float8)) AS same;
+DROP TABLE pa_test_toast;
+SELECT Sum(PC_NumPoints(PC_Filter(pa, 'z BETWEEN 100 AND 200 AND (intensity IN (12, 15) OR x < -125.5)'))) FROM pa_test_dim;
+SELECT Sum(PC_NumPoints(PC_Filter(pa, 'intensity >= 0'))), Count(PC_Filter(pa, 'Z IN (1, 1600)')) FROM pa_test_dim;
+SELECT Sum(PC_NumPoints(PC_Filter(pa, 'z BETWEEN 100 AND 200'))), Sum(PC_NumPoints(PC_FilterBetween(pa, 'z', 100, 200))) FROM pa_test_dim;
+SELECT Sum(PC_NumPoints(PC_FilterGeometry(pa, decode('01030000000100000005000000b81e85eb51a05fc08fc2f5285cbf464048e17a14ae7f5fc08fc2f5285cbf464048e17a14ae7f5fc0713d0ad7a3004740b81e85eb51a05fc0713d0ad7a3004740b81e85eb51a05fc08fc2f5285cbf4640', 'hex')))) FROM pa_test_dim;
+SELECT Sum(PC_NumPoints(PC_FilterGeometry(pa, decode('01010000000000000000805fc00000000000004740', 'hex'), 0.015))) FROM pa_test_dim;
+SELECT Sum(PC_NumPoints(PC_FilterGeometry(pa, decode('01010000000000000000805fc00000000000004740', 'hex'), 'Infinity'))) FROM pa_test_dim;
+SELECT Sum(PC_NumPoints(PC_FilterGeometry(pa, decode('0101000020e61000000000000000805fc00000000000004740', 'hex'), 0.015))) FROM pa_test_dim;
 
 
 
@@ -4,12 +4,17 @@
 CREATE OR REPLACE FUNCTION PC_Intersection(pcpatch, geometry)
     RETURNS pcpatch AS
     $$
-        WITH 
-             pts AS (SELECT PC_Explode($1) AS pt), 
-           pgpts AS (SELECT ST_GeomFromEWKB(PC_AsBinary(pt)) AS pgpt, pt FROM pts),
-            ipts AS (SELECT pt FROM pgpts WHERE ST_Intersects(pgpt, $2)),
-            ipch AS (SELECT PC_Patch(pt) AS pch FROM ipts)
-        SELECT pch FROM ipch;
+        SELECT PC_FilterGeometry($1, ST_AsEWKB($2));
+    $$ 
+    LANGUAGE 'sql';
+
+-----------------------------------------------------------------------------
+-- Function to keep the points of a patch within a distance of a geometry
+--
+CREATE OR REPLACE FUNCTION PC_Intersection(pcpatch, geometry, float8)
+    RETURNS pcpatch AS
+    $$
+        SELECT PC_FilterGeometry($1, ST_AsEWKB($2), $3);
     $$ 
     LANGUAGE 'sql';
 
@@ -41,10 +46,12 @@ CREATE CAST (pcpoint AS geometry) WITH FUNCTION geometry(pcpoint);
 -----------------------------------------------------------------------------
 -- Function to overlap polygon on patch
 --
+-- The bounds test inlines into the calling query, where an
+-- index on the patches can answer it
 CREATE OR REPLACE FUNCTION PC_Intersects(pcpatch, geometry)
     RETURNS boolean AS
     $$
-        SELECT ST_Intersects($2, geometry($1))
+        SELECT $1 && Box($2) AND ST_Intersects($2, geometry($1))
     $$ 
     LANGUAGE 'sql';
 